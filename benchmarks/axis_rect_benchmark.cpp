@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+#include "particle.hpp"
+#include "geometry.hpp"
+#include "cube.hpp"
+
+//Cube from performance_tests.txt traced with general polygon walls
+//and with the axis aligned fast path. Argument is R in percent
+static void TraceCube(benchmark::State& state, const bool is_axis_rect){
+    Geometry geo(MakeCubeGeometry(static_cast<double>(state.range(0))/100,
+                                  is_axis_rect));
+    Background gas = {2e-16, 300.0, 5.0};
+    std::mt19937 rnd_gen(42);
+    for(auto _ : state){
+        Particle pt(Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rnd_gen);
+        benchmark::DoNotOptimize(pt.Trace(geo, gas, rnd_gen));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void TraceCubePolygon(benchmark::State& state){
+    TraceCube(state, false);
+}
+
+static void TraceCubeAxisRect(benchmark::State& state){
+    TraceCube(state, true);
+}
+
+//Only the nearest wall search for random rays inside the cube
+static void ClosestHit(benchmark::State& state, const bool is_axis_rect,
+                       const bool is_mixed = false){
+    Geometry geo(MakeCubeGeometry(0.0, is_axis_rect));
+    geo.SetMixedPrecision(is_mixed);
+    std::mt19937 rnd_gen(42);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::vector<ShearedRay> rays;
+    for(size_t i=0; i<1024; i++){
+        Vec3 start(dist(rnd_gen), dist(rnd_gen), dist(rnd_gen));
+        Particle pt(start, Vec3(1.0, 0.0, 0.0), rnd_gen);
+        rays.emplace_back(start, pt.GetDirection());
+    }
+    size_t idx = 0;
+    for(auto _ : state){
+        benchmark::DoNotOptimize(geo.FindClosestHit(rays[idx]));
+        idx = (idx+1)%rays.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void ClosestHitPolygon(benchmark::State& state){
+    ClosestHit(state, false);
+}
+
+static void ClosestHitAxisRect(benchmark::State& state){
+    ClosestHit(state, true);
+}
+
+static void ClosestHitAxisRectMixed(benchmark::State& state){
+    ClosestHit(state, true, true);
+}
+
+BENCHMARK(TraceCubePolygon)->Arg(0)->Arg(50);
+BENCHMARK(TraceCubeAxisRect)->Arg(0)->Arg(50);
+BENCHMARK(ClosestHitPolygon);
+BENCHMARK(ClosestHitAxisRect);
+BENCHMARK(ClosestHitAxisRectMixed);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "simulation.hpp"
+#include "reflector.hpp"
+#include "cube.hpp"
+
+//Cascade throughput: the cube is made of secondary emission walls, the
+//primaries start at the yield maximum. First argument is the maximum
+//yield in tenths, the second is the limit of secondaries of one primary.
+//Items are all traced particles, primaries and secondaries
+static Geometry MakeEmittingCube(const double max_yield){
+    //secondaries are emitted with the mean energy near the yield
+    //maximum, so the cascade goes on while the yield is above one
+    return Geometry(MakeCubeGeometry([max_yield](size_t){
+        return std::make_unique<SecondaryEmissionReflector>(
+                    0.1, SecondaryYield{max_yield, 50.0, 0.0, 1.0, 40.0});
+    }, true));
+}
+
+static void Cascade(benchmark::State& state){
+    double max_yield = 0.1*static_cast<double>(state.range(0));
+    Simulation sim(MakeEmittingCube(max_yield), {2e-16, 300.0, 10.0}, 1, 42u);
+    sim.SetSecondaryLimits(1 << 16, static_cast<size_t>(state.range(1)));
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, ElectronSpeed(50.0)}};
+    int64_t batch = 2000;
+    size_t traced = 0;
+    size_t dropped = 0;
+    for(auto _ : state){
+        RunResult result = sim.Run(sources, static_cast<size_t>(batch));
+        traced += static_cast<size_t>(batch) + result.secondary_num_;
+        dropped += result.dropped_num_;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(traced));
+    state.counters["per_primary"] = static_cast<double>(traced)/
+            static_cast<double>(state.iterations()*batch);
+    state.counters["dropped"] = static_cast<double>(dropped)/
+            static_cast<double>(state.iterations()*batch);
+}
+
+BENCHMARK(Cascade)->Args({5, 1000})->Args({9, 1000})->Args({15, 100})
+                  ->Args({15, 1000})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,49 @@
+#ifndef BENCH_CUBE_HPP
+#define BENCH_CUBE_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "surface.hpp"
+#include "reflector.hpp"
+
+//Cube 1x1x1, reflector of each wall is made by the factory from the wall
+//index, statistics is not saved. Walls are general polygons unless axis
+//aligned rectangles are asked
+inline std::vector<std::unique_ptr<Surface>> MakeCubeGeometry(
+            const std::function<std::unique_ptr<Reflector>(size_t)>& make_reflector,
+            const bool is_axis_rect = false){
+    std::vector<std::vector<Vec3>> contours {
+        {Vec3(0.0, 0.0, 0.0), Vec3(0.0, 1.0, 0.0), Vec3(0.0, 1.0, 1.0), Vec3(0.0, 0.0, 1.0)},
+        {Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 1.0), Vec3(1.0, 0.0, 1.0), Vec3(1.0, 0.0, 0.0)},
+        {Vec3(0.0, 0.0, 0.0), Vec3(1.0, 0.0, 0.0), Vec3(1.0, 1.0, 0.0), Vec3(0.0, 1.0, 0.0)},
+        {Vec3(1.0, 0.0, 0.0), Vec3(1.0, 0.0, 1.0), Vec3(1.0, 1.0, 1.0), Vec3(1.0, 1.0, 0.0)},
+        {Vec3(0.0, 1.0, 0.0), Vec3(1.0, 1.0, 0.0), Vec3(1.0, 1.0, 1.0), Vec3(0.0, 1.0, 1.0)},
+        {Vec3(0.0, 0.0, 1.0), Vec3(0.0, 1.0, 1.0), Vec3(1.0, 1.0, 1.0), Vec3(1.0, 0.0, 1.0)}};
+    std::vector<std::unique_ptr<Surface>> walls;
+    for(size_t i=0; i<contours.size(); i++){
+        if(is_axis_rect){
+            walls.push_back(std::make_unique<AxisAlignedRect>(std::move(contours[i]),
+                                      make_reflector(i), nullptr));
+        } else {
+            walls.push_back(std::make_unique<PolygonSurface>(std::move(contours[i]),
+                                      make_reflector(i), std::ofstream()));
+        }
+    }
+    return walls;
+}
+
+//Cube from performance_tests.txt: YZ walls are mirrors, the others are
+//cosine reflectors
+inline std::vector<std::unique_ptr<Surface>> MakeCubeGeometry(const double R,
+                                                const bool is_axis_rect = false){
+    return MakeCubeGeometry([R](size_t wall) -> std::unique_ptr<Reflector>{
+        if(wall%3 == 0){
+            return std::make_unique<MirrorReflector>(R);
+        }
+        return std::make_unique<LambertianReflector>(R);
+    }, is_axis_rect);
+}
+
+#endif //BENCH_CUBE_HPP
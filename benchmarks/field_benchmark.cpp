@@ -0,0 +1,51 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "simulation.hpp"
+#include "cube.hpp"
+
+//Field transport against the straight flights in the cube from
+//performance_tests.txt, 10 Pa, 10 eV electrons. Argument is the mode:
+//0 - straight flights, 1 - uniform B, 2 - the same B on the 11^3 grid,
+//3 - uniform B and E. Magnetic field 1 mT gives the Larmor radius 1 cm,
+//a flight is about ten substeps
+static std::shared_ptr<const FieldTransport> MakeField(const int mode){
+    Vec3 B(0.0, 0.0, 1e-3);
+    Vec3 E = mode == 3 ? Vec3(0.0, 0.0, -1.0) : Vec3(0.0, 0.0, 0.0);
+    FieldStepping stepping;
+    if(mode != 2){
+        return std::make_shared<const FieldTransport>(std::make_unique<UniformField>(E, B),
+                                                      stepping);
+    }
+    std::array<size_t, 3> nodes {11, 11, 11};
+    size_t node_num = nodes[0]*nodes[1]*nodes[2];
+    stepping.max_step_ = 0.1;
+    return std::make_shared<const FieldTransport>(
+            std::make_unique<GridField>(Vec3(0.0, 0.0, 0.0), Vec3(0.1, 0.1, 0.1), nodes,
+                                        std::vector<Vec3>(node_num, E),
+                                        std::vector<Vec3>(node_num, B)),
+            stepping);
+}
+
+static void FieldFlights(benchmark::State& state){
+    int mode = static_cast<int>(state.range(0));
+    Simulation sim(Geometry(MakeCubeGeometry(0.5, true)), {2e-16, 300.0, 10.0}, 1, 42u);
+    if(mode > 0){
+        sim.GetGeometry().SetField(MakeField(mode));
+    }
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, ElectronSpeed(10.0)}};
+    int64_t batch = 2000;
+    size_t segments = 0;
+    for(auto _ : state){
+        RunResult result = sim.Run(sources, static_cast<size_t>(batch));
+        segments += result.absorbed_.GetFlightNum();
+    }
+    state.SetItemsProcessed(state.iterations()*batch);
+    state.counters["segments"] = static_cast<double>(segments)/
+            static_cast<double>(state.iterations()*batch);
+}
+
+BENCHMARK(FieldFlights)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,64 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+#include "particle.hpp"
+#include "surface.hpp"
+#include "geometry.hpp"
+#include "cube.hpp"
+
+//Header-only math: single kernels which were calls into math.cpp, and
+//the full trace in the polygon cube of performance_tests.txt, where
+//every coordinate access of the cross point test was a call before
+static std::vector<Vec3> MakeDirections(const size_t n){
+    std::mt19937 rnd_gen(42);
+    std::vector<Vec3> dirs;
+    for(size_t i=0; i<n; i++){
+        Particle pt(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rnd_gen);
+        dirs.push_back(pt.GetDirection());
+    }
+    return dirs;
+}
+
+static void BasisTransform(benchmark::State& state){
+    std::vector<Vec3> dirs = MakeDirections(1024);
+    ONBasis_3x3 basis(Vec3(1.0, 2.0, 3.0).Norm());
+    size_t i = 0;
+    for(auto _ : state){
+        Vec3 local = basis.FromOriginalCoorsToThis(dirs[i]);
+        benchmark::DoNotOptimize(basis.FromThisCoorsToOriginal(local));
+        i = (i + 1) & 1023;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void PolygonCrossPoint(benchmark::State& state){
+    std::vector<Vec3> dirs = MakeDirections(1024);
+    auto walls = MakeCubeGeometry(0.5);
+    size_t i = 0;
+    for(auto _ : state){
+        ShearedRay ray(Vec3(0.5, 0.5, 0.5), dirs[i]);
+        for(const auto& wall : walls){
+            benchmark::DoNotOptimize(wall->GetCrossPoint(ray));
+        }
+        i = (i + 1) & 1023;
+    }
+    state.SetItemsProcessed(state.iterations()*static_cast<int64_t>(walls.size()));
+}
+
+static void TracePolygonCube(benchmark::State& state){
+    Geometry geo(MakeCubeGeometry(0.5));
+    Background gas = {2e-16, 300.0, 100.0};
+    std::mt19937 rnd_gen(42);
+    for(auto _ : state){
+        Particle pt(Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rnd_gen);
+        benchmark::DoNotOptimize(pt.Trace(geo, gas, rnd_gen));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BasisTransform);
+BENCHMARK(PolygonCrossPoint);
+BENCHMARK(TracePolygonCube);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "simulation.hpp"
+#include "cube.hpp"
+
+//Throughput of Simulation::Run on the cube against the thread number.
+//Second argument: 0 - threads are free, 1 - pinned round robin over
+//NUMA nodes, 2 - pinned and each node traces in its own geometry replica
+static void ScaleThreads(benchmark::State& state){
+    size_t thread_num = static_cast<size_t>(state.range(0));
+    Simulation sim(Geometry(MakeCubeGeometry(0.9, true)), {2e-16, 300.0, 5.0},
+                   thread_num, 42u);
+    if(state.range(1) > 0){
+        sim.SetThreadPlacement(true, state.range(1) > 1);
+    }
+    std::vector<ParticleSource> sources {{Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, 0.0}};
+    size_t batch = 20000*thread_num;
+    for(auto _ : state){
+        benchmark::DoNotOptimize(sim.Run(sources, batch));
+    }
+    state.SetItemsProcessed(state.iterations()*static_cast<int64_t>(batch));
+    state.counters["replicas"] = static_cast<double>(sim.GetReplicaNum());
+}
+
+static void ThreadArgs(benchmark::internal::Benchmark* bench){
+    long max_threads = std::max(1L, static_cast<long>(std::thread::hardware_concurrency()));
+    for(long mode=0; mode<3; mode++){
+        for(long threads=1; threads<max_threads; threads*=2){
+            bench->Args({threads, mode});
+        }
+        bench->Args({max_threads, mode});
+    }
+}
+
+BENCHMARK(ScaleThreads)->Apply(ThreadArgs)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "particle.hpp"
+#include "surface.hpp"
+#include "geometry.hpp"
+#include "cube.hpp"
+
+//Absorption fraction of every wall is counted with the help of the
+//observer, so double and mixed precision runs can be compared
+class AbsorptionCounter : public TraceObserver{
+public:
+    std::vector<double> counts_ = std::vector<double>(6, 0.0);
+    double total_ = 0.0;
+    void OnWallHit([[maybe_unused]] const Particle& pt, const size_t wall_id,
+                   const bool is_reflected) override {
+        if(!is_reflected){
+            counts_[wall_id] += 1.0;
+            total_ += 1.0;
+        }
+    }
+};
+
+static void TraceCube(benchmark::State& state, const bool is_mixed){
+    auto walls = MakeCubeGeometry(0.5);
+    for(auto& s : walls){
+        s->SetMixedPrecision(is_mixed);
+    }
+    Geometry geo(std::move(walls));
+    Background gas = {2e-16, 300.0, 100.0};
+    std::mt19937 rnd_gen(42);
+    AbsorptionCounter counter;
+    for(auto _ : state){
+        Particle pt(Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rnd_gen);
+        benchmark::DoNotOptimize(pt.Trace(geo, gas, rnd_gen, &counter));
+    }
+    state.SetItemsProcessed(state.iterations());
+    for(size_t i=0; i<counter.counts_.size(); i++){
+        state.counters["frac_" + std::to_string(i)] = counter.counts_[i]/counter.total_;
+    }
+}
+
+static void TraceCubeDouble(benchmark::State& state){
+    TraceCube(state, false);
+}
+
+static void TraceCubeMixed(benchmark::State& state){
+    TraceCube(state, true);
+}
+
+//Traces the same number of histories in both modes and reports
+//the largest deviation of absorption fractions in units of sigma
+static void PrecisionValidation(benchmark::State& state){
+    size_t pt_num = static_cast<size_t>(state.range(0));
+    Background gas = {2e-16, 300.0, 100.0};
+    double max_z = 0.0;
+    for(auto _ : state){
+        std::vector<AbsorptionCounter> counters(2);
+        for(size_t mode=0; mode<2; mode++){
+            auto walls = MakeCubeGeometry(0.5);
+            for(auto& s : walls){
+                s->SetMixedPrecision(mode == 1);
+            }
+            Geometry geo(std::move(walls));
+            std::mt19937 rnd_gen(static_cast<unsigned>(mode+1));
+            for(size_t i=0; i<pt_num; i++){
+                Particle(Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rnd_gen)
+                        .Trace(geo, gas, rnd_gen, &counters[mode]);
+            }
+        }
+        for(size_t i=0; i<6; i++){
+            double f1 = counters[0].counts_[i]/counters[0].total_;
+            double f2 = counters[1].counts_[i]/counters[1].total_;
+            double sigma = std::sqrt(f1*(1-f1)/counters[0].total_ +
+                                     f2*(1-f2)/counters[1].total_);
+            max_z = std::max(max_z, std::fabs(f1-f2)/sigma);
+        }
+    }
+    state.counters["max_z"] = max_z;
+    if(max_z > 4.0){
+        state.SkipWithError("mixed precision results differ from double ones");
+    }
+}
+
+BENCHMARK(TraceCubeDouble);
+BENCHMARK(TraceCubeMixed);
+BENCHMARK(PrecisionValidation)->Arg(200000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
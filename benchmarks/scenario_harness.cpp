@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#include <lyra/lyra.hpp>
+#include <nlohmann/json.hpp>
+
+#include "simulation.hpp"
+#include "reflector.hpp"
+#include "cube.hpp"
+#include "../tests/box.hpp"
+
+//End-to-end scenarios of the tracer: every scenario is traced with each
+//thread number, results go to the table, to the json file and are
+//compared with the baseline json made by the same harness
+
+using json = nlohmann::json;
+
+namespace {
+
+struct Scenario{
+    std::string name_;
+    std::string description_;
+    std::function<Geometry()> make_geometry_;
+    Background gas_;
+    ParticleSource source_;
+    size_t pt_num_;
+};
+
+struct Measurement{
+    std::string scenario_;
+    size_t thread_num_;
+    size_t pt_num_;
+    double seconds_;
+    double pt_rate_;
+    double event_rate_;
+    double efficiency_;
+    size_t peak_rss_kb_;
+};
+
+//Box 1x1x1 with every face split into tiles x tiles squares, each square
+//is two triangles. Triangles are general polygons, so the mesh goes
+//through the generic surface search
+std::vector<std::unique_ptr<Surface>> MakeTriangleBox(const size_t tiles, const double R){
+    std::vector<std::unique_ptr<Surface>> walls;
+    for(const auto& quad : MakeTiledBoxContours(tiles)){
+        walls.push_back(std::make_unique<PolygonSurface>(
+                    std::vector<Vec3>{quad[0], quad[1], quad[2]},
+                    std::make_unique<LambertianReflector>(R), nullptr));
+        walls.push_back(std::make_unique<PolygonSurface>(
+                    std::vector<Vec3>{quad[0], quad[2], quad[3]},
+                    std::make_unique<LambertianReflector>(R), nullptr));
+    }
+    return walls;
+}
+
+std::vector<Scenario> MakeScenarios(){
+    ParticleSource source{Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), true, 0.0};
+    return {
+        //cube from performance_tests.txt
+        {"cube_100pa", "cube 1x1x1, R=0.5, 100 Pa",
+            []{return Geometry(MakeCubeGeometry(0.5));}, {2e-16, 300.0, 100.0},
+            source, 200000},
+        {"cube_500pa", "cube 1x1x1, R=0.5, 500 Pa",
+            []{return Geometry(MakeCubeGeometry(0.5));}, {2e-16, 300.0, 500.0},
+            source, 50000},
+        {"cube_axis_rect", "cube 1x1x1 with axis rect walls, R=0.5, 100 Pa",
+            []{return Geometry(MakeCubeGeometry(0.5, true));}, {2e-16, 300.0, 100.0},
+            source, 200000},
+        {"large_mesh", "box of 1536 triangles, R=0.5, 10 Pa",
+            []{return Geometry(MakeTriangleBox(16, 0.5));}, {2e-16, 300.0, 10.0},
+            source, 5000},
+        {"mirror_heavy", "cube 1x1x1, R=0.99, 1 Pa",
+            []{return Geometry(MakeCubeGeometry(0.99, true));}, {2e-16, 300.0, 1.0},
+            source, 20000},
+        {"absorbing_heavy", "cube 1x1x1, R=0, vacuum",
+            []{return Geometry(MakeCubeGeometry(0.0, true));}, {2e-16, 300.0, 0.0},
+            source, 2000000}};
+}
+
+//Peak resident set since the last reset, kB
+size_t ReadPeakRss(){
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)){
+        if(line.compare(0, 6, "VmHWM:") == 0){
+            return std::stoul(line.substr(6));
+        }
+    }
+    return 0;
+}
+
+void ResetPeakRss(){
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+std::vector<size_t> ParseThreads(const std::string& list){
+    std::vector<size_t> threads;
+    std::stringstream ss(list);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        threads.push_back(std::stoul(item));
+    }
+    return threads;
+}
+
+std::vector<size_t> DefaultThreads(){
+    size_t max_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    std::vector<size_t> threads;
+    for(size_t t=1; t<max_threads; t*=2){
+        threads.push_back(t);
+    }
+    threads.push_back(max_threads);
+    return threads;
+}
+
+Measurement RunScenario(const Scenario& scenario, const size_t thread_num,
+                        const double scale){
+    ResetPeakRss();
+    Simulation sim(scenario.make_geometry_(), scenario.gas_, thread_num, 42u);
+    size_t pt_num = std::max<size_t>(static_cast<size_t>(
+                        static_cast<double>(scenario.pt_num_)*scale), thread_num);
+    auto start = std::chrono::steady_clock::now();
+    RunResult result = sim.Run({scenario.source_}, pt_num);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = elapsed.count();
+    return {scenario.name_, thread_num, pt_num, seconds,
+            static_cast<double>(pt_num)/seconds,
+            static_cast<double>(result.absorbed_.GetFlightNum())/seconds,
+            0.0, ReadPeakRss()};
+}
+
+json ToJson(const std::vector<Measurement>& results){
+    json out = json::array();
+    for(const auto& m : results){
+        out.push_back({{"scenario", m.scenario_}, {"threads", m.thread_num_},
+                       {"particles", m.pt_num_}, {"seconds", m.seconds_},
+                       {"particles_per_sec", m.pt_rate_}, {"events_per_sec", m.event_rate_},
+                       {"parallel_efficiency", m.efficiency_},
+                       {"peak_rss_kb", m.peak_rss_kb_}});
+    }
+    return out;
+}
+
+//Ratio to the baseline particle rate of the same scenario and threads,
+//zero if the baseline has no such entry
+double CompareToBaseline(const Measurement& m, const json& baseline){
+    for(const auto& el : baseline){
+        if(el["scenario"].get<std::string>() == m.scenario_ &&
+                el["threads"].get<size_t>() == m.thread_num_){
+            return m.pt_rate_/el["particles_per_sec"].get<double>();
+        }
+    }
+    return 0.0;
+}
+
+}
+
+int main(int argc, const char ** argv){
+    std::string output_file;
+    std::string baseline_file;
+    std::string thread_list;
+    std::string only_scenario;
+    double scale = 1.0;
+    double tolerance = 0.1;
+    bool show_help = false;
+    auto cli = lyra::cli()
+            | lyra::opt(output_file, "json")["-o"]["--output"]
+                ("Write results as json")
+            | lyra::opt(baseline_file, "json")["-b"]["--baseline"]
+                ("Compare particle rates with the results of the earlier run")
+            | lyra::opt(thread_list, "list")["-t"]["--threads"]
+                ("Comma separated thread numbers [1, 2, 4 ... hardware threads]")
+            | lyra::opt(only_scenario, "name")["-s"]["--scenario"]
+                ("Run only this scenario")
+            | lyra::opt(scale, "factor")["--scale"]
+                ("Multiplies particle numbers of all scenarios [1.0]")
+            | lyra::opt(tolerance, "fraction")["--tolerance"]
+                ("Allowed slowdown against the baseline [0.1]")
+            | lyra::help(show_help);
+    auto cmd_parse = cli.parse({argc, argv});
+    if(show_help){
+        std::cout << cli;
+        return 0;
+    }
+    if(!cmd_parse){
+        std::cerr << cmd_parse.errorMessage() << "\n";
+        return 1;
+    }
+    std::vector<size_t> threads = thread_list.empty() ? DefaultThreads()
+                                                      : ParseThreads(thread_list);
+    json baseline = json::array();
+    if(!baseline_file.empty()){
+        std::ifstream file(baseline_file);
+        if(!file.is_open()){
+            fprintf(stderr, "could not open file %s\n", baseline_file.c_str());
+            return 1;
+        }
+        baseline = json::parse(file);
+    }
+
+    std::vector<Measurement> results;
+    bool is_regression = false;
+    std::cout << fmt::format("{:<16} {:>4} {:>10} {:>12} {:>12} {:>6} {:>10} {:>9}\n",
+                             "scenario", "thr", "particles", "pt/s", "events/s",
+                             "eff", "rss_kB", "baseline");
+    for(const auto& scenario : MakeScenarios()){
+        if(!only_scenario.empty() && scenario.name_ != only_scenario){
+            continue;
+        }
+        //efficiency is per thread rate against the first thread number
+        double first_rate = 0.0;
+        for(size_t thread_num : threads){
+            Measurement m = RunScenario(scenario, thread_num, scale);
+            if(first_rate == 0.0){
+                first_rate = m.pt_rate_/static_cast<double>(thread_num);
+            }
+            m.efficiency_ = m.pt_rate_/(static_cast<double>(thread_num)*first_rate);
+            double ratio = CompareToBaseline(m, baseline);
+            std::string mark = ratio == 0.0 ? "-" : fmt::format("{:.2f}", ratio);
+            if(ratio > 0.0 && ratio < 1.0 - tolerance){
+                mark += " !";
+                is_regression = true;
+            }
+            std::cout << fmt::format("{:<16} {:>4} {:>10} {:>12.4g} {:>12.4g} {:>6.2f} {:>10} {:>9}\n",
+                                     m.scenario_, m.thread_num_, m.pt_num_, m.pt_rate_,
+                                     m.event_rate_, m.efficiency_, m.peak_rss_kb_, mark);
+            results.push_back(m);
+        }
+    }
+    if(!output_file.empty()){
+        std::ofstream out(output_file);
+        if(!out.is_open()){
+            fprintf(stderr, "could not open file %s\n", output_file.c_str());
+            return 1;
+        }
+        out << ToJson(results).dump(2) << "\n";
+    }
+    if(is_regression){
+        std::cout << fmt::format("Slower than the baseline by more than {:.0f}%\n",
+                                 100*tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+﻿#ifndef ASYNC_OUTPUT_HPP
+#define ASYNC_OUTPUT_HPP
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "output.hpp"
+
+/*!Bounded lock-free queue for one producer and one consumer thread*/
+template<typename T>
+class SpscQueue{
+private:
+    std::vector<T> items_;
+    alignas(64) std::atomic<size_t> head_{0};  //next item to pop
+    alignas(64) std::atomic<size_t> tail_{0};  //next free slot
+public:
+    explicit SpscQueue(const size_t capacity): items_(capacity+1) {}
+
+    bool TryPush(const T& val){
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail+1)%items_.size();
+        if(next == head_.load(std::memory_order_acquire)){
+            return false;   //full
+        }
+        items_[tail] = val;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& val){
+        size_t head = head_.load(std::memory_order_relaxed);
+        if(head == tail_.load(std::memory_order_acquire)){
+            return false;   //empty
+        }
+        val = items_[head];
+        head_.store((head+1)%items_.size(), std::memory_order_release);
+        return true;
+    }
+};
+
+/*!Moves all ParticleWriter calls out of the compute threads.
+ * Each compute thread fills its own record buffer and hands it over to
+ * the writer thread through the single producer queue when it is full.
+ * Emptied buffers come back through the second queue, so nothing is
+ * allocated after construction. When all buffers of a thread are in
+ * flight Push waits -- this is the backpressure of the queue depth.*/
+class AsyncWriter{
+public:
+    struct Item{
+        ParticleWriter* writer_;
+        ParticleRecord record_;
+    };
+private:
+    struct Buffer{
+        std::vector<Item> items_;
+    };
+    struct alignas(64) Producer{
+        std::vector<std::unique_ptr<Buffer>> storage_;
+        SpscQueue<Buffer*> full_;
+        SpscQueue<Buffer*> free_;
+        Buffer* current_ = nullptr;
+        explicit Producer(const size_t queue_depth): full_(queue_depth+1),
+                                                    free_(queue_depth+1) {}
+    };
+
+    size_t buffer_size_;
+    std::vector<std::unique_ptr<Producer>> producers_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+
+    void WriterLoop();
+    bool DrainQueues();
+    void HandOver(Producer& prod);
+public:
+    AsyncWriter(const size_t thread_num, const size_t buffer_size,
+                const size_t queue_depth);
+    ~AsyncWriter();
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void Start();
+    //should be called only by compute thread tid
+    void Push(const size_t tid, ParticleWriter* writer, const ParticleRecord& rec);
+    //stops writer thread and writes the rest,
+    //should be called when compute threads are stopped
+    void Finish();
+};
+
+#endif //ASYNC_OUTPUT_HPP
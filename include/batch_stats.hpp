@@ -0,0 +1,29 @@
+﻿#ifndef BATCH_STATS_HPP
+#define BATCH_STATS_HPP
+
+#include <vector>
+
+/*!Batch means estimate of the statistical error. Each batch gives one
+ * value of every tallied quantity; the batches are independent, so the
+ * error of the mean is the spread of the batch values over sqrt(B)*/
+class BatchStats{
+private:
+    std::vector<double> sum_;
+    std::vector<double> sum2_;
+    size_t batch_num_ = 0;
+public:
+    explicit BatchStats(const size_t size);
+    void AddBatch(const std::vector<double>& values);
+    size_t GetBatchNum() const;
+    size_t GetSize() const;
+    double GetMean(const size_t i) const;
+    /*!Standard error of the mean, zero for less than two batches*/
+    double GetError(const size_t i) const;
+    /*!Largest relative error over the quantities whose sum over the
+     * batches is above min_sum, so rare bins with a few counts do not hold
+     * the run. Infinity for less than two batches*/
+    double GetMaxRelError(const double min_sum = 0.0) const;
+    std::vector<double> GetErrors() const;
+};
+
+#endif //BATCH_STATS_HPP
@@ -0,0 +1,74 @@
+﻿#ifndef DETECTOR_HPP
+#define DETECTOR_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "observer.hpp"
+#include "math.hpp"
+
+class Geometry;
+class Reflector;
+
+/*!Small sphere with the given cross section, or small disk when the
+ * normal is given. Detectors are not walls, particles fly through them*/
+struct Detector{
+    std::string name_;
+    Vec3 point_;
+    double area_;                   //cm^2
+    std::optional<Vec3> normal_;    //unit normal of the disk
+};
+
+/*!Next-event estimator: at the source, at every gas collision and at
+ * every wall hit the probability to fly straight into each detector is scored
+ *   density(dir)*solid_angle*exp(-r/mfp),
+ * density of the new direction per steradian is 1/(4 pi) for the gas,
+ * 1/(2 pi) over the hemisphere of the random source direction, and is given
+ * by the reflector for the walls (zero for specular ones). Wall hits add the
+ * expected secondaries of the reflector, so first flights of the
+ * secondaries are scored at their birth, also of those dropped by the stack
+ * limits. The solid angle is area/r^2 (times |cos| for the disk) and at
+ * most 2 pi, so scatters right at the detector stay finite. A source with
+ * the fixed direction scores exp(-r/mfp) when its ray crosses the detector.
+ * The ray is checked against the walls, the detector is seen if nothing is
+ * hit before it. Straight flights do not hold in the field, and the
+ * periodic and symmetry boundaries would need the images of the detectors*/
+class DetectorTally : public TraceObserver {
+private:
+    std::vector<Detector> detectors_;
+    double inv_mfp_;
+    std::vector<double> history_;       //scores of the current history
+    std::vector<double> sum_;
+    std::vector<double> sum2_;
+    size_t history_num_ = 0;
+
+    //density(dir) of the flight direction per steradian
+    template<typename Density>
+    void Score(const Geometry& geo, const Vec3& start, const Density& density);
+    void ScoreBeam(const Geometry& geo, const Vec3& start, const Vec3& dir);
+public:
+    DetectorTally(std::vector<Detector> detectors, const Background& gas);
+
+    void OnSource(const Particle& pt, const Geometry& geo,
+                  const ParticleSource& source) override;
+    void OnScatter(const Particle& pt, const Geometry& geo, const Reflector* reflector,
+                   const Vec3& normal) override;
+    void OnHistoryEnd() override;
+
+    void Merge(const DetectorTally& other);
+    /*!Adds the sums saved from another tally with the same detectors*/
+    void AddSums(const std::vector<double>& sum, const std::vector<double>& sum2,
+                 const size_t history_num);
+    size_t GetHistoryNum() const;
+    size_t GetDetectorNum() const;
+    /*!Probability per history to reach the detector and its standard error*/
+    double GetMean(const size_t detector) const;
+    double GetError(const size_t detector) const;
+    const std::vector<double>& GetSums() const;
+    const std::vector<double>& GetSquareSums() const;
+    void WriteResults(std::ostream& out) const;
+};
+
+#endif //DETECTOR_HPP
@@ -0,0 +1,77 @@
+﻿#ifndef FIELD_HPP
+#define FIELD_HPP
+
+#include <array>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "math.hpp"
+
+/*!Static electric (V/cm) and magnetic (T) fields*/
+class FieldMap{
+public:
+    virtual void GetFields(const Vec3& pos, Vec3& E, Vec3& B) const = 0;
+    virtual ~FieldMap() = default;
+};
+
+class UniformField : public FieldMap{
+private:
+    Vec3 E_;
+    Vec3 B_;
+public:
+    UniformField(const Vec3& E, const Vec3& B);
+    void GetFields(const Vec3& pos, Vec3& E, Vec3& B) const override;
+};
+
+/*!Fields in the nodes of the regular grid, trilinear interpolation
+ * between them and zero outside. Nodes are stored in float by blocks of
+ * 4x4x4 nodes with all six components of a node together, so the eight
+ * corners of a cell are in one block (1.5 kB) most of the time instead
+ * of eight rows of the plain x-fastest array*/
+class GridField : public FieldMap{
+private:
+    static constexpr size_t kBlock = 4;
+    static constexpr size_t kComponents = 6;
+    Vec3 origin_;
+    Vec3 inv_cell_;
+    std::array<size_t, 3> nodes_;
+    std::array<size_t, 3> blocks_;
+    std::vector<float> data_;
+
+    size_t GetOffset(const size_t ix, const size_t iy, const size_t iz) const;
+public:
+    /*!E and B are given for every node, x index changes first*/
+    GridField(const Vec3& origin, const Vec3& cell, const std::array<size_t, 3>& nodes,
+              const std::vector<Vec3>& E, const std::vector<Vec3>& B);
+    void GetFields(const Vec3& pos, Vec3& E, Vec3& B) const override;
+};
+
+/*!Limits of one substep: rotation in the magnetic field, relative speed
+ * change in the electric field and length. Without a field the step is
+ * only limited by the length, infinite length gives the straight flight
+ * to the next wall*/
+struct FieldStepping{
+    double max_angle_ = 0.1;            //rad
+    double max_speed_change_ = 0.02;    //of the speed
+    double max_step_ = std::numeric_limits<double>::infinity();    //cm
+    size_t max_substeps_ = 1000000;     //per flight, then the particle is lost
+    double charge_to_mass_ = -1.75882001076e11;     //C/kg, electron
+};
+
+/*!Boris pusher: half kick by E, rotation by B, half kick by E.
+ * Speed is kept in the pure magnetic field for any time step*/
+class FieldTransport{
+private:
+    std::unique_ptr<FieldMap> map_;
+    FieldStepping stepping_;
+public:
+    FieldTransport(std::unique_ptr<FieldMap>&& map, const FieldStepping& stepping);
+    /*!Updates the velocity (cm/s) at the position for the adaptive time
+     * step and returns the step, s. Infinite step means no field and
+     * no length limit: the velocity is not changed*/
+    double Push(const Vec3& pos, Vec3& velocity) const;
+    const FieldStepping& GetStepping() const;
+};
+
+#endif //FIELD_HPP
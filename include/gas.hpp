@@ -0,0 +1,38 @@
+﻿#ifndef GAS_HPP
+#define GAS_HPP
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "math.hpp"
+
+/*!Particles count collisions of each species in a fixed array*/
+constexpr size_t kMaxSpecies = 8;
+
+struct GasSpecies{
+    std::string name_;
+    double sigma_;  //crossection cm^2
+    double p_;      //partial pressure Pa
+};
+
+/*!Collision partners of the gas mixture. Species is hit with the
+ * probability proportional to its partial pressure times cross section,
+ * the alias table picks it with one random number in constant time*/
+class GasMixture{
+private:
+    std::vector<GasSpecies> species_;
+    std::vector<double> threshold_;     //probability to keep the column
+    std::vector<size_t> alias_;         //species of the rest of the column
+public:
+    explicit GasMixture(std::vector<GasSpecies> species);
+    size_t SampleSpecies(std::mt19937& rnd_gen) const;
+    size_t GetSpeciesNum() const;
+    const GasSpecies& GetSpecies(const size_t idx) const;
+    /*!Total pressure and the mean cross section, so the free path of the
+     * background follows the combined macroscopic cross section*/
+    double GetPressure() const;
+    double GetMeanSigma() const;
+};
+
+#endif //GAS_HPP
@@ -0,0 +1,128 @@
+﻿#ifndef GEOMETRY_HPP
+#define GEOMETRY_HPP
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "surface.hpp"
+#include "math.hpp"
+#include "field.hpp"
+
+struct SurfaceHit{
+    size_t wall_id_;
+    Vec3 point_;
+    Vec3 normal_;
+};
+
+//ray which only crosses periodic boundaries is treated as lost
+constexpr size_t kMaxBoundaryCrossings = 10000;
+
+/*!Moves the ray over the boundary surface it hits: periodic boundary shifts
+ * the position to the paired face, symmetry boundary mirrors the direction*/
+void CrossBoundary(const Surface& boundary, const SurfaceHit& hit, Vec3& pos, Vec3& dir);
+
+/*!Axis aligned rectangles with the same normal axis stored as structure
+ * of arrays. The ray is tested against all of them with a single division.
+ * In mixed precision the nearest rectangle is searched in float and its
+ * cross point is found in double*/
+class AxisRectBatch{
+private:
+    int axis_;
+    bool is_mixed_precision_ = false;
+    std::vector<size_t> wall_ids_;
+    std::vector<double> plane_;
+    std::vector<double> normal_sign_;
+    std::vector<double> u_min_;
+    std::vector<double> u_max_;
+    std::vector<double> v_min_;
+    std::vector<double> v_max_;
+public:
+    explicit AxisRectBatch(const int axis);
+    void Add(const size_t wall_id, const AxisAlignedRect::RectData& rect);
+    void SetMixedPrecision(const bool is_mixed);
+    size_t GetSize() const;
+    std::optional<SurfaceHit> FindClosestHit(const ShearedRay& ray) const;
+};
+
+/*!Surfaces which are tested together. Axis aligned rectangles go
+ * through the batch kernels, the rest are tested one by one*/
+class SurfaceSet{
+private:
+    std::array<AxisRectBatch, 3> rect_batches_;
+    std::vector<size_t> generic_ids_;
+    BoundingBox box_;
+public:
+    SurfaceSet();
+    void Add(const size_t wall_id, const Surface& surface);
+    void SetMixedPrecision(const bool is_mixed);
+    std::optional<SurfaceHit> FindClosestHit(const ShearedRay& ray,
+                        const std::vector<std::unique_ptr<Surface>>& walls) const;
+    const BoundingBox& GetBoundingBox() const;
+};
+
+/*!Owns the surfaces and finds the nearest one along the ray.
+ * Top level surfaces are stored as they are. Prototypes are surface sets
+ * placed many times by rigid transforms; instances are kept in a bounding
+ * volume hierarchy and the ray is moved into the prototype frame.
+ * All instances of a prototype surface share its wall id, reflector and output.
+ * Replica is a copy of the search structures which uses surfaces of the
+ * origin, so each NUMA node can read its own copy of the hot data.
+ * Optional field bends the flights between the walls, replicas share it*/
+class Geometry{
+private:
+    struct Instance{
+        size_t prototype_;
+        RigidTransform transform_;
+        BoundingBox box_;
+    };
+    struct BvhNode{
+        BoundingBox box_;
+        size_t first_;      //first instance of the leaf
+        size_t count_;      //zero for inner nodes
+        size_t right_;      //left child is the next node
+    };
+    static constexpr size_t kNoPrototype = static_cast<size_t>(-1);
+    static constexpr size_t kBvhLeafSize = 2;
+    static constexpr size_t kBvhStackSize = 64;
+
+    std::vector<std::unique_ptr<Surface>> walls_;
+    Geometry* origin_ = nullptr;    //owner of the surfaces for replicas
+    std::vector<size_t> wall_prototype_;
+    SurfaceSet top_set_;
+    std::vector<SurfaceSet> prototypes_;
+    std::vector<Instance> instances_;
+    std::vector<BvhNode> bvh_;
+    std::shared_ptr<const FieldTransport> field_;
+
+    size_t BuildNode(const size_t begin, const size_t end);
+
+public:
+    explicit Geometry(std::vector<std::unique_ptr<Surface>>&& walls);
+    size_t AddPrototype(std::vector<std::unique_ptr<Surface>>&& surfaces);
+    void AddInstance(const size_t prototype, const RigidTransform& transform);
+    /*!Should be called after all instances are added*/
+    void BuildInstanceTree();
+    /*!Copy is allocated by the calling thread. Surfaces stay shared with
+     * this geometry, which should outlive the replica*/
+    std::unique_ptr<Geometry> MakeReplica();
+    bool IsReplicaOf(const Geometry& origin) const;
+
+    std::optional<SurfaceHit> FindClosestHit(const ShearedRay& ray) const;
+    /*!Ray from each surface along its normal should hit something.
+     * Prototype surfaces are checked in their first instance*/
+    bool CheckOrientations() const;
+    /*!Sets the precision of the surfaces and of the search structures,
+     * replicas made afterwards keep it*/
+    void SetMixedPrecision(const bool is_mixed);
+    void SetField(std::shared_ptr<const FieldTransport> field);
+    /*!Null if particles fly straight*/
+    const FieldTransport* GetField() const;
+    Surface& GetSurface(const size_t wall_id);
+    const std::vector<std::unique_ptr<Surface>>& GetSurfaces() const;
+    size_t GetSurfaceNum() const;
+    size_t GetInstanceNum() const;
+};
+
+#endif //GEOMETRY_HPP
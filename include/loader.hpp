@@ -4,16 +4,53 @@
 #include <nlohmann/json.hpp>
 #include <memory>
 #include <vector>
+#include <optional>
 
 #include "particle.hpp"
 #include "surface.hpp"
+#include "quadric.hpp"
+#include "geometry.hpp"
+#include "field.hpp"
+#include "sweep.hpp"
+#include "voxel.hpp"
+#include "time_tally.hpp"
+#include "simulation.hpp"
+#include "view_factor.hpp"
+#include "output.hpp"
 
 using json = nlohmann::json;
 
 json load_json_config(const std::string& file_name);
 Background load_background(const json& json_data);
-std::unique_ptr<Surface> read_surface_parameters(const json& this_surf_data);
-std::vector<std::unique_ptr<Surface>> load_geometry(const json& json_data);
+OutputSettings load_output_settings(const json& json_data);
+std::unique_ptr<Reflector> read_reflector(const json& this_surf_data);
+QuadricSide read_quadric_side(const json& this_surf_data);
+std::unique_ptr<Surface> read_surface_shape(const json& this_surf_data,
+                                     std::unique_ptr<Reflector>&& reflector,
+                                     std::unique_ptr<ParticleWriter>&& writer);
+std::unique_ptr<Surface> read_surface_parameters(const json& this_surf_data,
+                                     const OutputSettings& settings = {});
+std::vector<std::unique_ptr<Surface>> read_surface_list(const json& surf_list,
+                                     const OutputSettings& settings = {});
+RigidTransform read_transform(const json& instance_data);
+Geometry load_geometry(const json& json_data, const FileMode mode = FileMode::TRUNCATE);
 bool check_surface_orientations(const std::vector<std::unique_ptr<Surface>>& geo);
+std::vector<std::string> load_surface_names(const json& json_data);
+std::optional<VoxelGrid> load_voxel_grid(const json& json_data);
+double load_particle_speed(const json& json_data);
+ParticleSource load_particle_source(const json& json_data);
+std::optional<TimeBins> load_time_bins(const json& json_data);
+std::vector<Detector> load_detectors(const json& json_data);
+/*!Null without the field section. Grid steps are limited by the cell*/
+std::shared_ptr<const FieldTransport> load_field(const json& json_data);
+/*!Geometry, gas and all tallies of the config. Random seed is
+ * general.seed or the current time. Mode is passed to the surface files*/
+Simulation load_simulation(const json& json_data, const FileMode mode = FileMode::TRUNCATE);
+std::optional<StopCriteria> load_stop_criteria(const json& json_data);
+/*!View factor mode replaces tracing, it needs zero gas pressure*/
+std::optional<ViewFactorSettings> load_view_factor_settings(const json& json_data);
+std::vector<SweepPoint> load_sweep_points(const json& json_data,
+                                const Background& gas,
+                                const std::vector<std::unique_ptr<Surface>>& walls);
 
 #endif //LOADER_HPP
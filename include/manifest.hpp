@@ -0,0 +1,41 @@
+﻿#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "simulation.hpp"
+
+/*!Random streams [first_, end_) of one run*/
+struct StreamRange{
+    size_t first_;
+    size_t end_;
+};
+
+/*!Record of the traced histories kept next to the outputs: config hash,
+ * seed and random streams of every run, and the raw tally sums. Top-up
+ * run takes the streams after the used ones and merges its tallies into
+ * the saved sums. Sweep and record tallies are not kept*/
+struct RunManifest{
+    uint64_t config_hash_;
+    unsigned seed_;
+    std::vector<StreamRange> streams_;
+    RunResult result_;
+
+    /*!First stream which was not used yet*/
+    size_t GetNextStream() const;
+};
+
+/*!Hash of the config without the keys which do not change the histories:
+ * threads and their placement, output buffering, number of particles,
+ * stopping criteria and the seed, which is kept in the manifest itself*/
+uint64_t CalcPhysicsHash(const nlohmann::json& config);
+void WriteManifest(std::ostream& out, const RunManifest& manifest);
+/*!Exits if the manifest cannot be parsed. The manifest keeps only the
+ * detector sums, so the empty tally of the config gets them*/
+RunManifest ReadManifest(std::istream& in,
+                         const std::optional<DetectorTally>& detector = std::nullopt);
+
+#endif //MANIFEST_HPP
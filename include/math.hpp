@@ -1,69 +1,225 @@
 ﻿#ifndef MATH_HPP
 #define MATH_HPP
 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <math.h>
 
 class Surface;
+class GasMixture;
 
 struct Background{
-    double sigma_; 	//crossection cm^2
+    double sigma_; 	//crossection cm^2, mean over the species of the mixture
     double T_; 	 	//temperature K
-    double p_; 	 	//pressure Pa
+    double p_; 	 	//pressure Pa, total of the mixture
+    //collision partners, empty for the single gas
+    std::shared_ptr<const GasMixture> mixture_ = nullptr;
+
+    double GetMeanFreePath() const;
+    size_t GetSpeciesNum() const;
 };
 
 
-class Vec3{
+/*!Vector of the given scalar type. Tracing is done in double,
+ * float is used by the mixed precision geometry kernels.
+ * Everything is defined here, so the compiler sees through each
+ * coordinate access of the intersection kernels without LTO*/
+template<typename T>
+class Vec3T{
 private:
-    double x_ = 0.0;
-    double y_ = 0.0;
-    double z_ = 0.0;
+    T x_ = 0;
+    T y_ = 0;
+    T z_ = 0;
 public:
-    Vec3(const double x, const double y, const double z):
+    constexpr Vec3T(const T x, const T y, const T z):
         x_(x), y_(y), z_(z) {}
-    Vec3(const std::vector<double>& vec):
+    Vec3T(const std::vector<T>& vec):
         x_(vec[0]), y_(vec[1]), z_(vec[2]) {}
-    Vec3(const Vec3& start_point, const Vec3& end_point);
-    Vec3()=default;
-
-    double GetX() const;
-    double GetY() const;
-    double GetZ() const;
-
-    double Dot(const Vec3& rhs) const;
-    Vec3 Cross(const Vec3& rhs) const;
-    double Length2() const;
-    double Length() const;
-    Vec3& Norm();
-    Vec3 Times(const double d) const ;
-    double GetDistance(const Vec3& end) const;
-
-    Vec3 operator +(const Vec3& other) const;
-    Vec3 operator -(const Vec3& other) const;
-    bool operator ==(const Vec3& other) const;
-    bool operator !=(const Vec3& other) const;
+    //vector from start_point to end_point
+    constexpr Vec3T(const Vec3T& start_point, const Vec3T& end_point):
+        x_(end_point.x_ - start_point.x_),
+        y_(end_point.y_ - start_point.y_),
+        z_(end_point.z_ - start_point.z_) {}
+    constexpr Vec3T()=default;
+    template<typename U>
+    constexpr explicit Vec3T(const Vec3T<U>& other):
+        x_(static_cast<T>(other.GetX())),
+        y_(static_cast<T>(other.GetY())),
+        z_(static_cast<T>(other.GetZ())) {}
+
+    constexpr T GetX() const {return x_;}
+    constexpr T GetY() const {return y_;}
+    constexpr T GetZ() const {return z_;}
+    constexpr T operator [](const int idx) const {
+        return idx == 0 ? x_ : (idx == 1 ? y_ : z_);
+    }
+
+    constexpr T Dot(const Vec3T& rhs) const {
+        return x_*rhs.x_ + y_*rhs.y_ + z_*rhs.z_;
+    }
+    /*!Dot product with end - start, without the difference vector*/
+    constexpr T DotDiff(const Vec3T& start, const Vec3T& end) const {
+        return x_*(end.x_ - start.x_) + y_*(end.y_ - start.y_) + z_*(end.z_ - start.z_);
+    }
+    /*!Value of the plane with this normal and the offset at the point:
+     * Ax + By + Cz + D*/
+    constexpr T EvalPlane(const Vec3T& point, const T offset) const {
+        return x_*point.x_ + y_*point.y_ + z_*point.z_ + offset;
+    }
+    constexpr Vec3T Cross(const Vec3T& rhs) const {
+        return Vec3T(y_*rhs.z_ - z_*rhs.y_,
+                     z_*rhs.x_ - x_*rhs.z_,
+                     x_*rhs.y_ - y_*rhs.x_);
+    }
+    constexpr T Length2() const {return x_*x_ + y_*y_ + z_*z_;}
+    T Length() const {return std::sqrt(Length2());}
+    Vec3T& Norm(){
+        T l = Length();
+        x_ /= l;
+        y_ /= l;
+        z_ /= l;
+        return *this;
+    }
+    constexpr Vec3T Times(const T d) const {
+        return Vec3T(x_*d, y_*d, z_*d);
+    }
+    /*!this + dir*t, the point along the ray*/
+    constexpr Vec3T AddScaled(const Vec3T& dir, const T t) const {
+        return Vec3T(x_ + dir.x_*t, y_ + dir.y_*t, z_ + dir.z_*t);
+    }
+    T GetDistance(const Vec3T& end) const {
+        return std::sqrt((x_-end.x_)*(x_-end.x_) +
+                         (y_-end.y_)*(y_-end.y_) +
+                         (z_-end.z_)*(z_-end.z_));
+    }
+
+    constexpr Vec3T operator +(const Vec3T& other) const {
+        return Vec3T(x_ + other.x_, y_ + other.y_, z_ + other.z_);
+    }
+    constexpr Vec3T operator -(const Vec3T& other) const {
+        return Vec3T(x_ - other.x_, y_ - other.y_, z_ - other.z_);
+    }
+    constexpr bool operator ==(const Vec3T& other) const {
+        return x_ == other.x_ && y_ == other.y_ && z_ == other.z_;
+    }
+    constexpr bool operator !=(const Vec3T& other) const {
+        return x_ != other.x_ || y_ != other.y_ || z_ != other.z_;
+    }
+};
+
+template<typename T>
+std::ostream& operator <<(std::ostream& out, const Vec3T<T>& vec){
+    out << vec.GetX() << "\t" << vec.GetY() << "\t" << vec.GetZ();
+    return out;
+}
+
+using Vec3 = Vec3T<double>;
+using Vec3f = Vec3T<float>;
+
+/*!Orthonormal basis, the transforms are written out per component*/
+template<typename T>
+class ONBasisT{
+private:
+    Vec3T<T> i_;
+    Vec3T<T> j_;
+    Vec3T<T> k_;
+public:
+    constexpr ONBasisT(): i_(Vec3T<T>(1, 0, 0)),
+                          j_(Vec3T<T>(0, 1, 0)),
+                          k_(Vec3T<T>(0, 0, 1)) {}
+    ONBasisT(Vec3T<T> i, Vec3T<T> j, Vec3T<T> k):
+        i_(i), j_(j), k_(k)
+    {
+        if(i.Dot(j)!=0 || j.Dot(k)!=0 || i.Dot(k)!=0){
+            fprintf(stderr, "Basis is not orthogonal!\n");
+            exit(1);
+        }
+        i_.Norm();
+        j_.Norm();
+        k_.Norm();
+    }
+    explicit ONBasisT(Vec3T<T> given_z): k_(given_z){
+        Vec3T<T> tmp_cross_x = k_.Cross(Vec3T<T>(1, 0, 0));
+        Vec3T<T> tmp_cross_y = k_.Cross(Vec3T<T>(0, 1, 0));
+        j_ = tmp_cross_x.Length2()>tmp_cross_y.Length2() ?
+                    tmp_cross_x : tmp_cross_y;
+        i_ = j_.Cross(k_);
+        i_.Norm();
+        j_.Norm();
+        k_.Norm();
+    }
+    template<typename U>
+    constexpr explicit ONBasisT(const ONBasisT<U>& other):
+        i_(other.GetXVec()), j_(other.GetYVec()), k_(other.GetZVec()) {}
+    constexpr Vec3T<T> ApplyToVec(const Vec3T<T>& vec) const {
+        return FromThisCoorsToOriginal(vec);
+    }
+    constexpr Vec3T<T> FromOriginalCoorsToThis(const Vec3T<T>& vec) const {
+        return {vec.Dot(i_), vec.Dot(j_), vec.Dot(k_)};
+    }
+    constexpr Vec3T<T> FromThisCoorsToOriginal(const Vec3T<T>& vec) const {
+        return {i_.GetX()*vec.GetX() + j_.GetX()*vec.GetY() + k_.GetX()*vec.GetZ(),
+                i_.GetY()*vec.GetX() + j_.GetY()*vec.GetY() + k_.GetY()*vec.GetZ(),
+                i_.GetZ()*vec.GetX() + j_.GetZ()*vec.GetY() + k_.GetZ()*vec.GetZ()};
+    }
+    constexpr const Vec3T<T>& GetXVec() const {return i_;}
+    constexpr const Vec3T<T>& GetYVec() const {return j_;}
+    constexpr const Vec3T<T>& GetZVec() const {return k_;}
+};
+
+using ONBasis_3x3 = ONBasisT<double>;
+using ONBasis_3x3f = ONBasisT<float>;
+
+/*!Ray prepared for the watertight intersection test:
+ * coordinates are permuted so that kz is the largest direction component
+ * and sheared so that the ray goes along kz axis*/
+struct ShearedRay{
+    Vec3 org_;
+    Vec3 dir_;
+    int kx_;
+    int ky_;
+    int kz_;
+    double Sx_;
+    double Sy_;
+    ShearedRay(const Vec3& org, const Vec3& dir);
+};
+
+/*!Moves point on the surface a few ulps along the normal, so the
+ * rounding error of the cross point cannot leave it behind the surface*/
+Vec3 OffsetPointAlongNormal(const Vec3& point, const Vec3& normal);
+
+/*!Axis aligned bounding box*/
+struct BoundingBox{
+    Vec3 min_ = {INFINITY, INFINITY, INFINITY};
+    Vec3 max_ = {-INFINITY, -INFINITY, -INFINITY};
+
+    void Extend(const Vec3& point);
+    void Extend(const BoundingBox& box);
+    Vec3 GetCenter() const;
+    /*!Slab test, t_enter is set to the ray parameter of the entry point*/
+    bool IntersectRay(const Vec3& org, const Vec3& inv_dir, const double max_t,
+                      double& t_enter) const;
 };
-std::ostream& operator <<(std::ostream& out, const Vec3& vec);
 
-class ONBasis_3x3{
+/*!Rotation around the axis through the origin followed by the shift*/
+class RigidTransform{
 private:
-    Vec3 i_;
-    Vec3 j_;
-    Vec3 k_;
+    double rot_[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    Vec3 shift_ = {};
 public:
-    ONBasis_3x3(): i_(Vec3(1.0, 0.0, 0.0)),
-                   j_(Vec3(0.0, 1.0, 0.0)),
-                   k_(Vec3(0.0, 0.0, 1.0)) {}
-    ONBasis_3x3(Vec3 i, Vec3 j, Vec3 k);
-    explicit ONBasis_3x3(Vec3 given_z);
-    Vec3 ApplyToVec(const Vec3& vec) const ;
-    Vec3 FromOriginalCoorsToThis(const Vec3& vec) const;
-    Vec3 FromThisCoorsToOriginal(const Vec3& vec) const;
-    const Vec3& GetXVec() const;
-    const Vec3& GetYVec() const;
-    const Vec3& GetZVec() const;
+    RigidTransform() = default;
+    RigidTransform(const Vec3& shift, const Vec3& axis, const double angle);
+    Vec3 PointToWorld(const Vec3& point) const;
+    Vec3 DirToWorld(const Vec3& dir) const;
+    Vec3 PointToLocal(const Vec3& point) const;
+    Vec3 DirToLocal(const Vec3& dir) const;
+    BoundingBox BoxToWorld(const BoundingBox& box) const;
+    /*!Same transform with additional shift in the world frame*/
+    RigidTransform Shifted(const Vec3& shift) const;
 };
 
 #endif //MATH_HEADER
@@ -0,0 +1,47 @@
+﻿#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <string>
+#include <vector>
+
+/*!CPU numbers from the sysfs list format, e.g. "0-3,8,10-11"*/
+std::vector<int> ParseCpuList(const std::string& list);
+
+/*!Allowed CPUs of each NUMA node from /sys/devices/system/node.
+ * Nodes without allowed CPUs are skipped; without NUMA information all
+ * allowed CPUs form one node*/
+std::vector<std::vector<int>> ReadNumaNodes();
+
+/*!Pins the calling thread to the CPU, false if it is not allowed*/
+bool PinCurrentThread(const int cpu);
+
+/*!Keeps the allowed CPUs of the calling thread and gives them back on
+ * destruction, so pinning does not outlive the parallel region*/
+class AffinityGuard{
+private:
+    std::vector<int> cpus_;
+public:
+    AffinityGuard();
+    ~AffinityGuard();
+    AffinityGuard(const AffinityGuard&) = delete;
+    AffinityGuard& operator=(const AffinityGuard&) = delete;
+};
+
+/*!Threads are spread round robin over the nodes, so any thread number
+ * uses the memory bandwidth of all sockets. Inside the node the threads
+ * take the CPUs in order*/
+class ThreadPlacement{
+private:
+    std::vector<int> cpu_;
+    std::vector<size_t> node_;
+    std::vector<size_t> first_thread_;     //for each node
+public:
+    ThreadPlacement(const std::vector<std::vector<int>>& nodes, const size_t thread_num);
+    int GetCpu(const size_t tid) const;
+    size_t GetNode(const size_t tid) const;
+    size_t GetNodeNum() const;
+    /*!Lowest thread of the node, it makes the node replica*/
+    bool IsFirstOnNode(const size_t tid) const;
+};
+
+#endif //NUMA_HPP
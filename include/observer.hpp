@@ -0,0 +1,81 @@
+﻿#ifndef OBSERVER_HPP
+#define OBSERVER_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "math.hpp"
+
+class Particle;
+class Geometry;
+class Reflector;
+struct ParticleSource;
+
+/*!Receives the events of a particle history from Particle::Trace.
+ * Every callback is invoked before the particle state is changed by
+ * the event, so GetPosition() still returns the flight start point.
+ * One observer instance belongs to one thread.*/
+class TraceObserver{
+public:
+    //particle is at the source point before its first flight, the direction
+    //is already drawn from the source; called by the caller of Trace
+    virtual void OnSource([[maybe_unused]] const Particle& pt,
+                          [[maybe_unused]] const Geometry& geo,
+                          [[maybe_unused]] const ParticleSource& source) {}
+    //particle flies given distance and collides with gas or with a wall;
+    //in the field the flight is split into straight substeps, the middle
+    //ones end in the volume and are reported as not gas collisions
+    virtual void OnFlight([[maybe_unused]] const Particle& pt,
+                          [[maybe_unused]] const double distance,
+                          [[maybe_unused]] const bool is_gas_collision) {}
+    //particle is already on the wall, is_reflected == false ends history
+    virtual void OnWallHit([[maybe_unused]] const Particle& pt,
+                           [[maybe_unused]] const size_t wall_id,
+                           [[maybe_unused]] const bool is_reflected) {}
+    //particle missed all surfaces, history is dropped
+    virtual void OnLost([[maybe_unused]] const Particle& pt) {}
+    //particle is at the scattering point and its new direction is not
+    //chosen yet: gas collision with null reflector, or wall hit with the
+    //normal to the particle side; geo is the one the particle is traced in
+    virtual void OnScatter([[maybe_unused]] const Particle& pt,
+                           [[maybe_unused]] const Geometry& geo,
+                           [[maybe_unused]] const Reflector* reflector,
+                           [[maybe_unused]] const Vec3& normal) {}
+    //primary and all its secondaries are absorbed or lost, per history
+    //tallies score here rather than on the end of every particle
+    virtual void OnHistoryEnd() {}
+    virtual ~TraceObserver() = default;
+};
+
+/*!Passes every event to all observers of the group*/
+class ObserverGroup : public TraceObserver{
+private:
+    std::vector<TraceObserver*> observers_;
+public:
+    void Add(TraceObserver* observer){observers_.push_back(observer);}
+    bool IsEmpty() const {return observers_.empty();}
+    void OnSource(const Particle& pt, const Geometry& geo,
+                  const ParticleSource& source) override {
+        for(auto obs : observers_) obs->OnSource(pt, geo, source);
+    }
+    void OnFlight(const Particle& pt, const double distance,
+                  const bool is_gas_collision) override {
+        for(auto obs : observers_) obs->OnFlight(pt, distance, is_gas_collision);
+    }
+    void OnWallHit(const Particle& pt, const size_t wall_id,
+                   const bool is_reflected) override {
+        for(auto obs : observers_) obs->OnWallHit(pt, wall_id, is_reflected);
+    }
+    void OnLost(const Particle& pt) override {
+        for(auto obs : observers_) obs->OnLost(pt);
+    }
+    void OnScatter(const Particle& pt, const Geometry& geo, const Reflector* reflector,
+                   const Vec3& normal) override {
+        for(auto obs : observers_) obs->OnScatter(pt, geo, reflector, normal);
+    }
+    void OnHistoryEnd() override {
+        for(auto obs : observers_) obs->OnHistoryEnd();
+    }
+};
+
+#endif //OBSERVER_HPP
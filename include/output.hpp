@@ -0,0 +1,110 @@
+﻿#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+
+class Particle;
+
+/*!Columns of the absorbed particle record, same order as in text output*/
+constexpr size_t kColumnNum = 8;
+extern const std::array<const char*, kColumnNum> kColumnNames;
+extern const std::array<const char*, kColumnNum> kColumnUnits;
+
+enum class ColumnType {F32, F64, U32, U64, VARINT};
+//how the surface files are opened: a fresh run truncates them, a top-up
+//appends to them, NONE builds no particle writers
+enum class FileMode {TRUNCATE, APPEND, NONE};
+
+struct OutputSettings{
+    std::string format_ = "text";           //"text" or "columnar"
+    std::array<ColumnType, kColumnNum> column_types_ = {
+        ColumnType::F64, ColumnType::F64, ColumnType::F64,
+        ColumnType::F32, ColumnType::F32, ColumnType::F32,
+        ColumnType::VARINT, ColumnType::VARINT};
+    bool compress_ = false;                 //zlib compression of blocks
+    size_t block_records_ = 65536;          //records in one columnar block
+    uint64_t config_hash_ = 0;
+    FileMode file_mode_ = FileMode::TRUNCATE;
+};
+
+/*!Everything writers need from the absorbed particle*/
+struct ParticleRecord{
+    double pos_[3];
+    double dir_[3];
+    uint64_t vol_count_;
+    uint64_t surf_count_;
+};
+
+ParticleRecord MakeRecord(const Particle& pt);
+uint64_t CalcConfigHash(const std::string& config_text);
+ColumnType ParseColumnType(const std::string& name);
+const char* GetColumnTypeName(const ColumnType type);
+bool IsCompressionAvailable();
+
+class ParticleWriter{
+public:
+    virtual void WriteHeader() = 0;
+    virtual void Write(const ParticleRecord& rec) = 0;
+    virtual void Flush() = 0;
+    virtual ~ParticleWriter() = default;
+};
+
+class TextWriter : public ParticleWriter{
+private:
+    std::ofstream out_;
+public:
+    explicit TextWriter(std::ofstream&& out): out_(std::move(out)) {}
+    void WriteHeader() override;
+    void Write(const ParticleRecord& rec) override;
+    void Flush() override;
+};
+
+/*!Binary columnar file (*.ptc layout):
+ * file header - 8 byte magic "PTCOL01\0", uint64 length of the json
+ *               description (columns, types, units, config hash,
+ *               compression), json text padded to 8 bytes;
+ * blocks      - uint32 magic "PBLK", uint32 record number, for each column
+ *               {uint8 codec, 7 pad bytes, uint64 stored size, uint64 raw
+ *               size}, then column payloads each padded to 8 bytes.
+ * Uncompressed fixed width columns can be memory mapped directly.
+ * Appending to the existing file starts a new header segment.
+ * All numbers are little endian.*/
+class ColumnarWriter : public ParticleWriter{
+private:
+    std::ofstream out_;
+    OutputSettings settings_;
+    std::array<std::vector<double>, 6> float_cols_;
+    std::array<std::vector<uint64_t>, 2> count_cols_;
+    std::vector<uint8_t> raw_buf_;
+    std::vector<uint8_t> packed_buf_;
+    std::vector<uint8_t> block_buf_;
+    std::vector<uint8_t> payload_buf_;
+    //deflate state made once and reset for every column, empty without compression
+    struct Deflater;
+    std::unique_ptr<Deflater> deflater_;
+
+    void EncodeColumn(const size_t col);
+public:
+    ColumnarWriter(std::ofstream&& out, const OutputSettings& settings);
+    ~ColumnarWriter() override;
+    void WriteHeader() override;
+    void Write(const ParticleRecord& rec) override;
+    void Flush() override;
+};
+
+/*!Columns of the columnar file converted into double and uint64*/
+struct ColumnarData{
+    std::array<std::vector<double>, 6> float_cols_;
+    std::array<std::vector<uint64_t>, 2> count_cols_;
+    uint64_t config_hash_ = 0;
+    size_t GetRecordNum() const;
+};
+
+ColumnarData ReadColumnarFile(const std::string& file_name);
+
+#endif //OUTPUT_HPP
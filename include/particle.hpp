@@ -1,16 +1,27 @@
 ﻿#ifndef PARTICLE_HPP
 #define PARTICLE_HPP
 
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <random>
 #include <utility>
 #include <optional>
-#include <functional>
 
 #include "surface.hpp"
 #include "math.hpp"
+#include "gas.hpp"
+#include "observer.hpp"
 
 class Surface;
+class Geometry;
+class ParticleStack;
+class FieldTransport;
+struct SurfaceHit;
+
+/*!Speed in cm/s of the electron with the energy in eV and back*/
+double ElectronSpeed(const double energy);
+double ElectronEnergy(const double speed);
 
 class Particle{
 private:
@@ -18,27 +29,84 @@ private:
     Vec3 V_ = {};
     size_t vol_count_ = {}; 	//number of volume collisions happened
     size_t surf_count_ = {};	//number of surface collisions happened
+    size_t boundary_count_ = {};	//boundary crossings since the last collision
+    double speed_ = {};     //cm/s, zero when time is not tracked
+    double time_ = {};      //s, time since the particle start
+    //volume collisions with each species of the mixture
+    std::array<uint32_t, kMaxSpecies> species_count_ = {};
+
+    size_t TraceHistory(Geometry& geo, const Background& gas,
+                        std::mt19937& rnd_gen, TraceObserver* observer,
+                        ParticleStack* stack);
+    /*!Substeps of the field pusher until the wall hit or the end of the
+     * free path, each straight segment is tested against the walls. The
+     * hit is empty after the gas collision; false means the particle is lost*/
+    bool FlyInField(const Geometry& geo, const FieldTransport& field, double distance,
+                    std::optional<SurfaceHit>& hit, TraceObserver* observer);
 public:
     Particle() = default;
     Particle(const Vec3& given_p, const Vec3& given_v);
     Particle(const Vec3& given_p, const Vec3& direction,
                                                      std::mt19937& rnd_gen);
 
-    using GenFunc = std::function<Particle(const Vec3&, const Vec3&, std::mt19937&)>;
+    //plain function pointer: no type erasure in the source loop
+    using GenFunc = Particle(*)(const Vec3&, const Vec3&, std::mt19937&);
     static GenFunc GetGenerator(bool is_rand_dir);
 
     double GetDistanceInGas(const Background& gas,
                             std::mt19937& rnd_gen) const;
+    /*!With the mixture the collision partner is sampled and counted*/
     void MakeGasCollision(const double distance,
-                          std::mt19937& rnd_gen);
-    size_t Trace(std::vector<std::unique_ptr<Surface>>& walls, const Background& gas,
-                  std::mt19937& rnd_gen);
+                          std::mt19937& rnd_gen, const GasMixture* mixture = nullptr);
+    /*!Returns 1 if the particle is absorbed, 0 if it is lost. With the
+     * stack, secondaries emitted by the walls are pushed to it and traced
+     * after the particle, until the whole cascade is done, and only then
+     * the history ends for the observer*/
+    size_t Trace(Geometry& geo, const Background& gas,
+                  std::mt19937& rnd_gen, TraceObserver* observer = nullptr,
+                  ParticleStack* stack = nullptr);
+    /*!New particle at the given point which keeps the time of this one*/
+    Particle MakeSecondary(const Vec3& pos, const Vec3& direction,
+                           const double speed) const;
     Vec3 GetRandomVel(const Vec3& direction, std::mt19937& rnd_gen) const;
 
     const Vec3& GetPosition() const;
     const Vec3& GetDirection() const;
     size_t GetVolCount() const;
     size_t GetSurfCount() const;
+    size_t GetSpeciesCount(const size_t species) const;
+    void SetSpeed(const double speed);
+    double GetSpeed() const;
+    double GetTime() const;
+};
+
+/*!Particles waiting to be traced, filled by the emitting reflectors.
+ * Storage is allocated once for the capacity and reused by every
+ * history. Particles over the capacity, or over the history limit of
+ * secondaries of one primary, are dropped and counted: the capacity keeps
+ * the memory, the limit keeps the time of a cascade with the yield above one*/
+class ParticleStack{
+private:
+    std::vector<Particle> particles_;
+    size_t capacity_;
+    size_t history_limit_;
+    size_t history_num_ = 0;
+    size_t pushed_num_ = 0;
+    size_t dropped_num_ = 0;
+public:
+    ParticleStack(const size_t capacity, const size_t history_limit);
+    /*!Called by Trace for every primary*/
+    void StartHistory();
+    void Push(const Particle& pt);
+    /*!Stack should not be empty*/
+    Particle Pop();
+    bool IsEmpty() const;
+    size_t GetSize() const;
+    size_t GetCapacity() const;
+    /*!Accepted and dropped particles since the last reset*/
+    size_t GetPushedNum() const;
+    size_t GetDroppedNum() const;
+    void ResetCounters();
 };
 
 
@@ -0,0 +1,87 @@
+﻿#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*!Parts of Particle::Trace the counters are attributed to. OTHER is
+ * everything between the traces: particle generation, the run loop*/
+enum class TracePhase : size_t {
+    FREE_PATH,      //distance to the gas collision
+    INTERSECTION,   //closest wall search
+    REFLECTION,     //gas collision, reflector and boundary conditions
+    OUTPUT,         //observers and saved particles
+    OTHER
+};
+constexpr size_t kTracePhaseNum = 5;
+
+struct PerfEvent{
+    std::string name_;
+    uint32_t type_;     //perf_event_attr type and config
+    uint64_t config_;
+};
+
+/*!cycles, instructions, branch-misses, LLC-misses*/
+std::vector<PerfEvent> GetHardwareEvents();
+
+/*!Counts of one thread: [phase][event]*/
+struct PerfReport{
+    std::vector<std::string> event_names_;
+    std::vector<uint64_t> counts_;
+    size_t switch_num_ = 0;
+
+    uint64_t GetCount(const TracePhase phase, const size_t event) const;
+    void Merge(const PerfReport& other);
+};
+
+/*!Per thread table of every phase and the sum over the threads*/
+void WritePerfReports(std::ostream& out, const std::vector<PerfReport>& reports);
+
+/*!Linux perf_event_open counters of the calling thread, user space only.
+ * The events are opened as one group, so they are scheduled together and
+ * their ratios are consistent. Switch reads the group and adds the counts
+ * since the previous switch to the previous phase, so one read is made
+ * per phase change. The read is a syscall, its kernel part is excluded,
+ * the user part (tens of instructions) goes to the ending phase.
+ * Trace marks the phases with TRACE_PHASE, which is compiled only with
+ * TRACER_PERF_COUNTERS (BUILD_PERF_COUNTERS cmake option)*/
+class PerfCounters{
+private:
+    std::vector<int> fds_;
+    std::vector<std::string> names_;
+    std::vector<uint64_t> last_;
+    std::vector<uint64_t> read_buf_;
+    PerfReport report_;
+    TracePhase phase_ = TracePhase::OTHER;
+    std::string error_;
+
+    bool Read();
+public:
+    explicit PerfCounters(const std::vector<PerfEvent>& events = GetHardwareEvents());
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /*!False if any event could not be opened (perf_event_paranoid > 2,
+     * no PMU in the virtual machine ...), then Switch does nothing*/
+    bool IsOpen() const;
+    const std::string& GetError() const;
+    void Switch(const TracePhase phase);
+    const PerfReport& GetReport() const;
+
+    /*!Counters of the calling thread, used by TRACE_PHASE; nullptr to detach*/
+    static void SetCurrent(PerfCounters* counters);
+    static PerfCounters* GetCurrent();
+};
+
+#ifdef TRACER_PERF_COUNTERS
+#define TRACE_PHASE(phase) do{ \
+        if(PerfCounters* perf_ = PerfCounters::GetCurrent()) perf_->Switch(TracePhase::phase); \
+    }while(0)
+#else
+#define TRACE_PHASE(phase) do{}while(0)
+#endif
+
+#endif //PERF_COUNTERS_HPP
@@ -0,0 +1,114 @@
+﻿#ifndef QUADRIC_HPP
+#define QUADRIC_HPP
+
+#include <optional>
+#include <memory>
+
+#include "surface.hpp"
+#include "math.hpp"
+
+/*!Side of the quadric where the traced volume is.
+ * Normal is directed to this side.*/
+enum class QuadricSide {INSIDE, OUTSIDE};
+
+/*!Base for analytic surfaces with closed form intersection.
+ * Mixed precision setting is ignored, these kernels always work in double.*/
+class QuadricSurface : public Surface{
+protected:
+    double side_sign_;  //+1 when volume is outside, -1 when inside
+
+    /*!Returns nearest root of a*t^2 + b*t + c = 0 which lies in bounds
+     * and where ray moves against the normal*/
+    std::optional<Vec3> PickEntryRoot(const ShearedRay& ray, const double a,
+                                      const double b, const double c) const;
+    virtual bool IsInBounds(const Vec3& point) const;
+
+public:
+    QuadricSurface(const QuadricSide side, std::unique_ptr<Reflector>&& g_reflector,
+                   std::unique_ptr<ParticleWriter>&& writer);
+};
+
+class SphereSurface : public QuadricSurface{
+private:
+    Vec3 center_;
+    double radius_;
+public:
+    SphereSurface(const Vec3& center, const double radius, const QuadricSide side,
+                  std::unique_ptr<Reflector>&& g_reflector,
+                  std::unique_ptr<ParticleWriter>&& writer);
+    using Surface::GetCrossPoint;
+    std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const override;
+    Vec3 GetNormalAt(const Vec3& point) const override;
+    Vec3 GetReferencePoint() const override;
+    BoundingBox GetBoundingBox() const override;
+    double GetArea() const override;
+    Vec3 GetRandomPoint(std::mt19937& rng) const override;
+};
+
+/*!Lateral surface of the finite cylinder, caps are separate disks*/
+class CylinderSurface : public QuadricSurface{
+private:
+    Vec3 base_center_;
+    Vec3 axis_;
+    double radius_;
+    double height_;
+    bool IsInBounds(const Vec3& point) const override;
+public:
+    CylinderSurface(const Vec3& base_center, const Vec3& axis,
+                    const double radius, const double height, const QuadricSide side,
+                    std::unique_ptr<Reflector>&& g_reflector,
+                    std::unique_ptr<ParticleWriter>&& writer);
+    using Surface::GetCrossPoint;
+    std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const override;
+    Vec3 GetNormalAt(const Vec3& point) const override;
+    Vec3 GetReferencePoint() const override;
+    BoundingBox GetBoundingBox() const override;
+    double GetArea() const override;
+    Vec3 GetRandomPoint(std::mt19937& rng) const override;
+};
+
+/*!Lateral surface of the truncated cone.
+ * Radius changes linearly from base_radius to top_radius along the axis*/
+class ConeSurface : public QuadricSurface{
+private:
+    Vec3 base_center_;
+    Vec3 axis_;
+    double base_radius_;
+    double slope_;      //radius change per unit of height
+    double height_;
+    bool IsInBounds(const Vec3& point) const override;
+public:
+    ConeSurface(const Vec3& base_center, const Vec3& axis, const double base_radius,
+                const double top_radius, const double height, const QuadricSide side,
+                std::unique_ptr<Reflector>&& g_reflector,
+                std::unique_ptr<ParticleWriter>&& writer);
+    using Surface::GetCrossPoint;
+    std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const override;
+    Vec3 GetNormalAt(const Vec3& point) const override;
+    Vec3 GetReferencePoint() const override;
+    BoundingBox GetBoundingBox() const override;
+    double GetArea() const override;
+    Vec3 GetRandomPoint(std::mt19937& rng) const override;
+};
+
+/*!Flat disk or annulus, normal is directed inside the volume*/
+class DiskSurface : public Surface{
+private:
+    Vec3 center_;
+    Vec3 normal_;
+    double radius_;
+    double inner_radius_;
+public:
+    DiskSurface(const Vec3& center, const Vec3& normal, const double radius,
+                const double inner_radius, std::unique_ptr<Reflector>&& g_reflector,
+                std::unique_ptr<ParticleWriter>&& writer);
+    using Surface::GetCrossPoint;
+    std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const override;
+    Vec3 GetNormalAt(const Vec3& point) const override;
+    Vec3 GetReferencePoint() const override;
+    BoundingBox GetBoundingBox() const override;
+    double GetArea() const override;
+    Vec3 GetRandomPoint(std::mt19937& rng) const override;
+};
+
+#endif
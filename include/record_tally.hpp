@@ -0,0 +1,39 @@
+﻿#ifndef RECORD_TALLY_HPP
+#define RECORD_TALLY_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "observer.hpp"
+
+/*!Absorbed particle records kept in memory instead of the surface files.
+ * Columns are stored separately, so they can be handed out as arrays*/
+class RecordTally : public TraceObserver {
+private:
+    std::vector<double> pos_;           //[record][3]
+    std::vector<double> dir_;           //[record][3]
+    std::vector<double> time_;
+    std::vector<uint64_t> vol_count_;
+    std::vector<uint64_t> surf_count_;
+    std::vector<uint64_t> wall_id_;
+    size_t species_num_;
+    std::vector<uint64_t> species_count_;   //[record][species]
+public:
+    explicit RecordTally(const size_t species_num = 0);
+    void OnWallHit(const Particle& pt, const size_t wall_id,
+                   const bool is_reflected) override;
+
+    void Merge(const RecordTally& other);
+    size_t GetRecordNum() const;
+    const std::vector<double>& GetPositions() const;
+    const std::vector<double>& GetDirections() const;
+    const std::vector<double>& GetTimes() const;
+    const std::vector<uint64_t>& GetVolCounts() const;
+    const std::vector<uint64_t>& GetSurfCounts() const;
+    const std::vector<uint64_t>& GetWallIds() const;
+    /*!Gas collisions of the particle with each species of the mixture*/
+    const std::vector<uint64_t>& GetSpeciesCounts() const;
+    size_t GetSpeciesNum() const;
+};
+
+#endif //RECORD_TALLY_HPP
@@ -9,11 +9,25 @@
 
 class Surface;
 class Particle;
+class ParticleStack;
 
 class Reflector{
 public:
     virtual std::optional<Vec3> ReflectParticle(const Particle& pt,
                            const Vec3& normal, std::mt19937& rnd_gen) const = 0;
+    virtual double GetReflectionCoefficient() const = 0;
+    /*!New particles born by the hit, called for every hit after
+     * ReflectParticle when the trace has a particle stack*/
+    virtual void EmitSecondaries(const Particle& pt, const Vec3& normal,
+                                 std::mt19937& rnd_gen, ParticleStack& stack) const;
+    virtual bool IsEmitting() const;
+    /*!Probability density per steradian that the particle leaves the wall
+     * along dir, reflection coefficient included; zero for the specular part*/
+    virtual double GetDiffuseDensity(const Vec3& normal, const Vec3& dir) const;
+    /*!Mean number of secondaries per steradian which EmitSecondaries sends
+     * along dir after the hit of the particle*/
+    virtual double GetSecondaryDensity(const Particle& pt, const Vec3& normal,
+                                       const Vec3& dir) const;
     virtual ~Reflector() = default;
 };
 
@@ -24,6 +38,7 @@ public:
     explicit MirrorReflector(const double val): reflection_coefficient_(val) {}
     std::optional<Vec3> ReflectParticle(const Particle &pt,
                   const Vec3& normal, std::mt19937& rnd_gen) const override;
+    double GetReflectionCoefficient() const override;
 };
 
 class LambertianReflector : public Reflector {
@@ -33,7 +48,43 @@ public:
     explicit LambertianReflector(const double val): reflection_coefficient_(val) {}
     std::optional<Vec3> ReflectParticle(const Particle &pt,
                  const Vec3& normal, std::mt19937& rnd_gen) const override;
+    double GetReflectionCoefficient() const override;
+    double GetDiffuseDensity(const Vec3& normal, const Vec3& dir) const override;
 };
 
+struct SecondaryYield{
+    double max_yield_;          //at normal incidence
+    double max_yield_energy_;   //eV
+    double threshold_energy_;   //eV, no secondaries below
+    double smoothness_;         //angular dependence, 1 for dull, 2 for polished
+    double emission_energy_;    //eV, mean energy of the secondaries
+};
+
+/*!Wall of the electron device: elastic diffuse reflection with the
+ * reflection coefficient and true secondaries with the Vaughan yield
+ *   delta = delta_max(theta)*(w*exp(1 - w))^k, w = (E - E0)/(E_max(theta) - E0),
+ *   delta_max(theta) = delta_max*(1 + ks*theta^2/(2*pi)),
+ *   E_max(theta) = E_max*(1 + ks*theta^2/pi), k = 0.62 (w < 1), 0.25 (w > 1).
+ * Number of secondaries is Poisson with the mean delta, they leave the wall
+ * diffusely with the energy E*exp(-E/T)/T^2, T = emission_energy/2.
+ * Incident energy is taken from the particle speed, so it should be set*/
+class SecondaryEmissionReflector : public Reflector {
+private:
+    double reflection_coefficient_;
+    SecondaryYield yield_;
+public:
+    SecondaryEmissionReflector(const double reflection, const SecondaryYield& yield);
+    std::optional<Vec3> ReflectParticle(const Particle &pt,
+                 const Vec3& normal, std::mt19937& rnd_gen) const override;
+    double GetReflectionCoefficient() const override;
+    void EmitSecondaries(const Particle& pt, const Vec3& normal,
+                         std::mt19937& rnd_gen, ParticleStack& stack) const override;
+    bool IsEmitting() const override;
+    double GetDiffuseDensity(const Vec3& normal, const Vec3& dir) const override;
+    double GetSecondaryDensity(const Particle& pt, const Vec3& normal,
+                               const Vec3& dir) const override;
+    /*!Mean number of secondaries, energy in eV, cos_theta to the normal*/
+    double GetYield(const double energy, const double cos_theta) const;
+};
 
 #endif //REFLECTOR_HEADER
@@ -0,0 +1,185 @@
+﻿#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <functional>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "geometry.hpp"
+#include "observer.hpp"
+#include "sweep.hpp"
+#include "voxel.hpp"
+#include "time_tally.hpp"
+#include "record_tally.hpp"
+#include "detector.hpp"
+#include "batch_stats.hpp"
+#include "numa.hpp"
+#include "perf_counters.hpp"
+
+struct ParticleSource{
+    Vec3 point_;
+    Vec3 direction_;
+    bool is_dir_random_ = false;    //cosine law around direction_
+    double speed_ = 0.0;            //cm/s, zero when time is not tracked
+};
+
+/*!Number of absorbed particles for every wall and number of flights.
+ * Every flight ends with an event: gas or wall collision, or boundary crossing.
+ * Gas collisions of each species of the mixture are taken from the particle
+ * when its history ends, absorbed or lost, so nothing is done per collision*/
+class AbsorptionCounter : public TraceObserver {
+private:
+    std::vector<size_t> counts_;
+    std::vector<size_t> species_counts_;
+    size_t flight_num_ = 0;
+
+    void AddSpecies(const Particle& pt);
+public:
+    explicit AbsorptionCounter(const size_t wall_num, const size_t species_num = 0);
+    void OnFlight(const Particle& pt, const double distance,
+                  const bool is_gas_collision) override;
+    void OnWallHit(const Particle& pt, const size_t wall_id,
+                   const bool is_reflected) override;
+    void OnLost(const Particle& pt) override;
+    void Merge(const AbsorptionCounter& other);
+    /*!Adds the counts saved from another counter*/
+    void AddCounts(const std::vector<size_t>& counts, const size_t flight_num);
+    void AddSpeciesCounts(const std::vector<size_t>& species_counts);
+    size_t GetCount(const size_t wall) const;
+    const std::vector<size_t>& GetCounts() const;
+    size_t GetFlightNum() const;
+    /*!Gas collisions of each species, empty for the single gas*/
+    const std::vector<size_t>& GetSpeciesCounts() const;
+};
+
+/*!Tallies of one Run call, already merged over threads*/
+struct RunResult{
+    size_t traced_num_ = 0;
+    size_t lost_num_ = 0;
+    AbsorptionCounter absorbed_;
+    std::optional<SweepTally> sweep_;
+    std::optional<VoxelTally> voxel_;
+    std::optional<TimeTally> time_;
+    std::optional<RecordTally> records_;
+    //for each thread, filled only with TRACER_PERF_COUNTERS
+    std::vector<PerfReport> perf_;
+    size_t secondary_num_ = 0;      //traced secondaries of the cascades
+    size_t dropped_num_ = 0;        //secondaries over the stack capacity
+    std::optional<DetectorTally> detector_ = std::nullopt;
+
+    void Merge(const RunResult& other);
+};
+
+/*!Adaptive run goes in batches of equal size until every targeted value
+ * reaches the relative error or one of the limits is hit. At least one
+ * of the limits should be finite*/
+struct StopCriteria{
+    size_t batch_size_ = 10000;     //absorbed particles in one batch
+    double rel_error_ = 0.01;
+    size_t min_batches_ = 10;
+    double max_time_ = std::numeric_limits<double>::infinity();    //s
+    size_t max_particles_ = std::numeric_limits<size_t>::max();
+    //walls and time bins with fewer counts over all batches are not
+    //targeted, voxels are targeted wherever the track length is nonzero
+    size_t min_count_ = 100;
+    //absorption fractions are always targeted
+    bool is_time_targeted_ = false;
+    bool is_voxel_targeted_ = false;
+};
+
+/*!Batch statistics of the values as they are written to the output:
+ * absorbed_ - fraction of histories for each wall,
+ * time_     - TimeTally::GetCounts() per history,
+ * voxel_    - VoxelTally::GetTrackLengths() per history and voxel volume*/
+struct AdaptiveResult{
+    RunResult total_;
+    BatchStats absorbed_;
+    std::optional<BatchStats> time_;
+    std::optional<BatchStats> voxel_;
+    bool is_converged_ = false;
+    double elapsed_ = 0.0;          //s
+};
+
+/*!Traces particles in the prebuilt geometry without any config or file.
+ * Geometry, per-thread random generators and tallies are created once
+ * and reused by every Run call; OpenMP keeps its worker threads between
+ * the parallel regions, so repeated runs pay only for the tracing.
+ * Random streams continue from one run to the next. Thread tid draws from
+ * the stream first_stream + tid of the seed; streams are seeded with both
+ * numbers, so other streams of the same seed give independent histories*/
+class Simulation{
+private:
+    Geometry geo_;
+    Background gas_;
+    size_t thread_num_;
+    unsigned seed_ = 0;
+    size_t first_stream_ = 0;
+    std::vector<std::mt19937> rnd_gens_;
+    std::function<void(size_t)> progress_;
+    std::function<void(size_t, double)> batch_progress_;
+    std::optional<ThreadPlacement> placement_;
+    bool is_replicated_ = false;
+    std::vector<std::unique_ptr<Geometry>> replicas_;   //for each NUMA node
+    bool is_perf_warned_ = false;
+    size_t stack_capacity_ = 1 << 16;
+    size_t history_limit_ = 1 << 20;
+    std::vector<ParticleStack> stacks_;     //for each thread, with emitting walls
+    //empty tallies to reset the per-thread ones
+    std::optional<SweepTally> sweep_proto_;
+    std::optional<VoxelTally> voxel_proto_;
+    std::optional<TimeTally> time_proto_;
+    std::optional<RecordTally> records_proto_;
+    std::optional<DetectorTally> detector_proto_;
+    std::vector<AbsorptionCounter> absorbed_;
+    std::vector<SweepTally> sweep_tallies_;
+    std::vector<VoxelTally> voxel_tallies_;
+    std::vector<TimeTally> time_tallies_;
+    std::vector<RecordTally> record_tallies_;
+    std::vector<DetectorTally> detector_tallies_;
+
+public:
+    Simulation(Geometry&& geo, const Background& gas, const size_t thread_num,
+               const unsigned seed);
+
+    /*!Restarts the generators of all threads*/
+    void SetRandomStreams(const unsigned seed, const size_t first_stream);
+    void SetSweepPoints(std::vector<SweepPoint> points);
+    void SetVoxelGrid(const VoxelGrid& grid);
+    void SetTimeBins(const TimeBins& bins);
+    /*!Next-event estimate of the direct flights into the detectors,
+     * the geometry should have no periodic or symmetry boundaries*/
+    void SetDetectors(std::vector<Detector> detectors);
+    /*!Keeps every absorbed particle in RunResult::records_*/
+    void SetRecordAbsorbed(const bool is_recorded);
+    /*!Pins threads over the NUMA nodes. With replicas the first thread of
+     * every node copies the geometry search structures, and the threads
+     * of the node trace in this copy. Replicas need more than one node
+     * and pinned threads. Threads get their CPU masks back after each run*/
+    void SetThreadPlacement(const bool is_pinned, const bool is_replicated);
+    void SetThreadPlacement(const ThreadPlacement& placement, const bool is_replicated);
+    /*!Secondaries waiting in one thread and secondaries of one primary,
+     * the rest are dropped*/
+    void SetSecondaryLimits(const size_t capacity, const size_t history_limit);
+    /*!Called from the first thread with its progress in percent*/
+    void SetProgressCallback(std::function<void(size_t)> progress);
+    /*!Called after each batch of the adaptive run with the batch number
+     * and the largest relative error of the targeted values*/
+    void SetBatchCallback(std::function<void(size_t, double)> progress);
+
+    /*!Traces until n particles are absorbed, particles are split evenly
+     * between the sources. Lost particles are counted, but not traced again*/
+    RunResult Run(const std::vector<ParticleSource>& sources, const size_t n);
+    AdaptiveResult RunAdaptive(const std::vector<ParticleSource>& sources,
+                               const StopCriteria& criteria);
+
+    Geometry& GetGeometry();
+    size_t GetReplicaNum() const;
+    const Background& GetBackground() const;
+    size_t GetThreadNum() const;
+    unsigned GetSeed() const;
+    size_t GetFirstStream() const;
+};
+
+#endif //SIMULATION_HPP
@@ -9,11 +9,57 @@
 #include "particle.hpp"
 #include "reflector.hpp"
 #include "math.hpp"
+#include "output.hpp"
+#include "async_output.hpp"
 
 class Reflector;
 class Particle;
 
+/*!WALL is a physical surface with its reflector.
+ * PERIODIC moves particle by the shift to the paired face,
+ * SYMMETRY reflects it specularly. Both are not counted and not saved*/
+enum class BoundaryType {WALL, PERIODIC, SYMMETRY};
+
 class Surface{
+protected:
+    std::unique_ptr<Reflector> reflector_;
+    std::unique_ptr<ParticleWriter> writer_;
+    AsyncWriter* async_writer_ = nullptr;
+    bool is_mixed_precision_ = false;
+    BoundaryType boundary_type_ = BoundaryType::WALL;
+    Vec3 periodic_shift_ = {};
+
+public:
+    Surface(std::unique_ptr<Reflector>&& g_reflector,
+            std::unique_ptr<ParticleWriter>&& writer);
+    virtual ~Surface() = default;
+    void WriteFileHeader();
+    void SaveParticle(const Particle& pt);
+    void SetAsyncWriter(AsyncWriter* async_writer);
+    virtual void SetMixedPrecision(const bool is_mixed);
+    void SetBoundary(const BoundaryType type, const Vec3& periodic_shift = {});
+    BoundaryType GetBoundaryType() const;
+    const Vec3& GetPeriodicShift() const;
+    bool IsSaveStat() const;
+    /*!Null for periodic and symmetry boundaries*/
+    const Reflector* GetReflector() const ;
+
+    std::optional<Vec3> GetCrossPoint(const Vec3& position,
+                                      const Vec3& direction) const;
+    /*!Returns the first point where ray enters the volume through this surface.
+     * Crossings from the back side (against the normal) are ignored.*/
+    virtual std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const = 0;
+    /*!Unit normal at the given point of the surface, directed inside the volume*/
+    virtual Vec3 GetNormalAt(const Vec3& point) const = 0;
+    /*!Some point on the surface, used for the orientation check*/
+    virtual Vec3 GetReferencePoint() const = 0;
+    virtual BoundingBox GetBoundingBox() const = 0;
+    virtual double GetArea() const = 0;
+    /*!Point uniformly distributed over the area*/
+    virtual Vec3 GetRandomPoint(std::mt19937& rng) const = 0;
+};
+
+class PolygonSurface : public Surface{
 public:
     struct SurfaceCoeficients{
         //Ax + By + Cz + D = 0
@@ -25,37 +71,49 @@ public:
 
 private:
     std::vector<Vec3> contour_; 	//points which build the surface contour
-    std::unique_ptr<Reflector> reflector_;
-    std::ofstream output_file_;
     SurfaceCoeficients coefs_;
-    std::vector<double> tri_areas_;
+    std::vector<double> cum_areas_;     //running sum of the fan triangle areas
     Vec3 mass_center_;
     ONBasis_3x3 surf_basis_;
     std::vector<Vec3> basis_contour_;
+    //float copy for the mixed precision kernel
+    Vec3f plane_normal_f_;
 
-    int GetQuarter(const Vec3& point, const Vec3& node) const;
-    double GetOrientationWinding(const Vec3& point, const Vec3& prev_node,
-                                 const Vec3& next_node) const;
-    int CalcWindChange(const Vec3& prev_node, const Vec3& next_node,
-                            const Vec3& point) const ;
+    template<typename T>
+    int GetQuarter(const Vec3T<T>& point, const Vec3T<T>& node) const;
+    template<typename T>
+    T GetOrientationWinding(const Vec3T<T>& point, const Vec3T<T>& prev_node,
+                                 const Vec3T<T>& next_node) const;
+    template<typename T>
+    int CalcWindChange(const Vec3T<T>& prev_node, const Vec3T<T>& next_node,
+                            const Vec3T<T>& point) const ;
+    template<typename T>
+    bool IsInsideContour(const Vec3T<T>& basis_point,
+                         const std::vector<Vec3T<T>>& basis_contour) const;
+    template<typename T>
+    bool IsRayInsideContour(const ShearedRay& ray) const;
 
 public:
 
-    Surface(std::vector<Vec3>&& g_contour,
+    PolygonSurface(std::vector<Vec3>&& g_contour,
             std::unique_ptr<Reflector>&& g_reflector, std::ofstream&& out_file);
-    void WriteFileHeader();
-    void SaveParticle(const Particle& pt);
+    PolygonSurface(std::vector<Vec3>&& g_contour,
+            std::unique_ptr<Reflector>&& g_reflector,
+            std::unique_ptr<ParticleWriter>&& writer);
     bool CheckIfPointOnSurface(const Vec3& point) const;
-    std::optional<Vec3> GetCrossPoint(const Vec3& position,
-                                      const Vec3& direction) const;
+    using Surface::GetCrossPoint;
+    std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const override;
+    Vec3 GetNormalAt(const Vec3& point) const override;
+    Vec3 GetReferencePoint() const override;
+    BoundingBox GetBoundingBox() const override;
+    double GetArea() const override;
+    Vec3 GetRandomPoint(std::mt19937& rng) const override;
     void VerifyPointInVolume(const Vec3& start, Vec3 &end) const;
 
     Vec3 GetRandomPointInContour(std::mt19937& rng) const;
     const Vec3& GetMassCenter() const;
     const std::vector<Vec3>& GetContour() const ;
     const Vec3& GetNormal() const;
-    bool IsSaveStat() const;
-    const Reflector* GetReflector() const ;
     const SurfaceCoeficients& GetSurfaceCoefficients() const ;
 
     static std::vector<double> CalcTriangleAreas(const std::vector<Vec3>& contour);
@@ -66,6 +124,32 @@ public:
                                                 const std::vector<Vec3> contour);
 };
 
+/*!Rectangle with edges parallel to the coordinate axes.
+ * Cross point needs one division and four compares*/
+class AxisAlignedRect : public PolygonSurface{
+public:
+    struct RectData{
+        int axis_;              //index of the normal axis
+        double plane_;          //coordinate of the plane along the normal axis
+        double normal_sign_;
+        double u_min_;          //bounds along axis_+1 and axis_+2 (mod 3)
+        double u_max_;
+        double v_min_;
+        double v_max_;
+    };
+
+private:
+    RectData rect_;
 
+public:
+    AxisAlignedRect(std::vector<Vec3>&& g_contour,
+            std::unique_ptr<Reflector>&& g_reflector,
+            std::unique_ptr<ParticleWriter>&& writer);
+    using Surface::GetCrossPoint;
+    std::optional<Vec3> GetCrossPoint(const ShearedRay& ray) const override;
+    const RectData& GetRectData() const;
+
+    static bool IsAxisAlignedRect(const std::vector<Vec3>& contour);
+};
 
 #endif
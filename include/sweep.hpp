@@ -0,0 +1,67 @@
+﻿#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "observer.hpp"
+#include "math.hpp"
+
+/*!One point of the parameter sweep: gas pressure and reflection
+ * coefficients of all walls (in the geometry order)*/
+struct SweepPoint{
+    std::string name_;
+    double p_;                  //pressure Pa
+    std::vector<double> R_;     //reflection coefficient of each wall
+};
+
+/*!Correlated sampling of several sweep points with one set of histories.
+ * Particles are traced with the nominal parameters and every sweep point
+ * gets a likelihood ratio weight which is updated on each event.
+ * Absorption fraction of each wall is scored with these weights, so the
+ * differences between sweep points have low variance.
+ * Weights spread out with the number of events in history, therefore
+ * sweep points should stay close to the nominal ones. Walls with the
+ * secondary emission are not supported.*/
+class SweepTally : public TraceObserver {
+private:
+    std::vector<SweepPoint> points_;
+    std::vector<double> nominal_R_;
+    double nominal_inv_mfp_;
+    std::vector<double> inv_mfp_;   //for each sweep point
+    std::vector<double> weights_;   //of the current history
+    //for [point][wall]
+    std::vector<double> sum_w_;
+    std::vector<double> sum_w2_;
+    std::vector<double> sum_diff2_; //(w-1)^2 -- for difference with nominal
+    //for [wall]
+    std::vector<size_t> nominal_count_;
+    size_t history_num_ = 0;
+
+    size_t GetIdx(const size_t point, const size_t wall) const;
+    void ResetWeights();
+public:
+    SweepTally(const Background& gas, std::vector<double> nominal_R,
+               std::vector<SweepPoint> points);
+
+    void OnFlight(const Particle& pt, const double distance,
+                  const bool is_gas_collision) override;
+    void OnWallHit(const Particle& pt, const size_t wall_id,
+                   const bool is_reflected) override;
+    void OnLost(const Particle& pt) override;
+
+    void Merge(const SweepTally& other);
+    size_t GetHistoryNum() const;
+    size_t GetPointNum() const;
+    size_t GetWallNum() const;
+    double GetNominalFraction(const size_t wall) const;
+    double GetFraction(const size_t point, const size_t wall) const;
+    double GetFractionError(const size_t point, const size_t wall) const;
+    double GetDiffToNominal(const size_t point, const size_t wall) const;
+    double GetDiffError(const size_t point, const size_t wall) const;
+    void WriteResults(std::ostream& out,
+                      const std::vector<std::string>& wall_names) const;
+};
+
+#endif //SWEEP_HPP
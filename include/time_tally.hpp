@@ -0,0 +1,49 @@
+﻿#ifndef TIME_TALLY_HPP
+#define TIME_TALLY_HPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "observer.hpp"
+
+struct TimeBins{
+    double t_max_;      //s, later arrivals go to the overflow bin
+    size_t bin_num_;
+};
+
+/*!Arrival time histogram of absorbed particles for every wall.
+ * Time is taken from the particle, so source speed should be set.*/
+class TimeTally : public TraceObserver {
+private:
+    TimeBins bins_;
+    size_t wall_num_;
+    double bin_width_;
+    std::vector<double> counts_;    //[wall][bin], last bin is overflow
+    size_t history_num_ = 0;
+
+    size_t GetIdx(const size_t wall, const size_t bin) const;
+public:
+    TimeTally(const TimeBins& bins, const size_t wall_num);
+
+    void OnWallHit(const Particle& pt, const size_t wall_id,
+                   const bool is_reflected) override;
+    void OnHistoryEnd() override;
+
+    void Merge(const TimeTally& other);
+    /*!Adds the counts saved from another tally with the same bins*/
+    void AddSums(const std::vector<double>& counts, const size_t history_num);
+    size_t GetHistoryNum() const;
+    double GetCount(const size_t wall, const size_t bin) const;
+    double GetOverflow(const size_t wall) const;
+    const TimeBins& GetBins() const;
+    /*![wall][bin] with the overflow bin at the end of each wall*/
+    const std::vector<double>& GetCounts() const;
+    /*!errors are per history in the GetCounts() layout, each wall gets
+     * an error column when they are given*/
+    void WriteResults(std::ostream& out,
+                      const std::vector<std::string>& wall_names,
+                      const std::vector<double>& errors = {}) const;
+};
+
+#endif //TIME_TALLY_HPP
@@ -0,0 +1,58 @@
+﻿#ifndef VIEW_FACTOR_HPP
+#define VIEW_FACTOR_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "geometry.hpp"
+#include "simulation.hpp"
+
+struct ViewFactorSettings{
+    size_t rays_per_wall_;
+    size_t source_rays_;
+    unsigned seed_;
+    std::string output_;    //matrix file, empty if it is not written
+};
+
+/*!Transfer probabilities between the walls without gas (p = 0):
+ * Get(i, j) is the fraction of particles leaving wall i diffusely, as
+ * from LambertianReflector, which hit wall j next. Emission points are uniform over the wall,
+ * so the wall is treated as a patch of uniform flux; large walls with
+ * uneven flux should be split into smaller ones.
+ * Symmetry and periodic boundaries are crossed as in Particle::Trace, their
+ * rows and columns stay zero. Rays which hit nothing are the escape*/
+class ViewFactorMatrix{
+private:
+    size_t wall_num_;
+    std::vector<double> factors_;   //[from][to]
+public:
+    explicit ViewFactorMatrix(const size_t wall_num);
+    size_t GetWallNum() const;
+    double Get(const size_t from, const size_t to) const;
+    void Set(const size_t from, const size_t to, const double value);
+    double GetEscape(const size_t from) const;
+    /*!Fraction of the source particles absorbed by each wall. Particle
+     * hitting wall j is absorbed with 1 - R_j and diffusely reflected
+     * with R_j, so the hit numbers solve h = s + F^T diag(R) h with the
+     * first hit fractions s of the source. Exits if the system is singular
+     * (no absorbing walls in the closed geometry)*/
+    std::vector<double> SolveAbsorption(const std::vector<double>& reflection,
+                                        const std::vector<double>& first_hits) const;
+    void WriteResults(std::ostream& out, const std::vector<std::string>& wall_names) const;
+};
+
+/*!Rays from every wall are sampled with their own generator seeded by
+ * seed + wall id, so the matrix does not depend on the thread number.
+ * Geometry with instances is not supported*/
+ViewFactorMatrix EstimateViewFactors(const Geometry& geo, const size_t rays_per_wall,
+                                     const unsigned seed);
+/*!First hit fractions of the source particles for every wall*/
+std::vector<double> EstimateFirstHits(const Geometry& geo,
+                                      const std::vector<ParticleSource>& sources,
+                                      const size_t ray_num, const unsigned seed);
+/*!Reflection coefficients of the walls, zero for the boundaries.
+ * Exits if a wall reflects specularly*/
+std::vector<double> GetLambertianCoefficients(const Geometry& geo);
+
+#endif //VIEW_FACTOR_HPP
@@ -0,0 +1,60 @@
+﻿#ifndef VOXEL_HPP
+#define VOXEL_HPP
+
+#include <array>
+#include <vector>
+#include <iostream>
+
+#include "observer.hpp"
+#include "math.hpp"
+
+struct VoxelGrid{
+    Vec3 min_;
+    Vec3 max_;
+    std::array<size_t, 3> bins_;
+};
+
+/*!Track length estimator on the regular voxel grid.
+ * Each flight segment is split between the voxels it crosses (3D-DDA),
+ * gas collisions are counted in the voxel where they happen.
+ * Track length per voxel volume and history is the particle density
+ * integrated over time (per unit source rate and speed), collision
+ * count per volume and history is the collision rate density.*/
+class VoxelTally : public TraceObserver {
+private:
+    VoxelGrid grid_;
+    std::array<double, 3> step_;
+    std::vector<double> track_length_;
+    std::vector<double> collisions_;
+    size_t history_num_ = 0;
+
+    size_t GetIdx(const size_t ix, const size_t iy, const size_t iz) const;
+    bool ClipToGrid(const Vec3& start, const Vec3& dir, const double length,
+                    double& t_in, double& t_out) const;
+public:
+    explicit VoxelTally(const VoxelGrid& grid);
+
+    void OnFlight(const Particle& pt, const double distance,
+                  const bool is_gas_collision) override;
+    void OnHistoryEnd() override;
+
+    /*!Adds segment from start along unit direction dir*/
+    void AddTrack(const Vec3& start, const Vec3& dir, const double length);
+    void AddCollision(const Vec3& point);
+    void Merge(const VoxelTally& other);
+    /*!Adds the sums saved from another tally on the same grid*/
+    void AddSums(const std::vector<double>& track_length,
+                 const std::vector<double>& collisions, const size_t history_num);
+    size_t GetHistoryNum() const;
+    double GetTrackLength(const size_t ix, const size_t iy, const size_t iz) const;
+    double GetCollisions(const size_t ix, const size_t iy, const size_t iz) const;
+    double GetVoxelVolume() const;
+    const VoxelGrid& GetGrid() const;
+    /*![ix][iy][iz] sums, not normalized*/
+    const std::vector<double>& GetTrackLengths() const;
+    const std::vector<double>& GetCollisionCounts() const;
+    /*!errors of the track density adds a column when they are given*/
+    void WriteResults(std::ostream& out, const std::vector<double>& errors = {}) const;
+};
+
+#endif //VOXEL_HPP
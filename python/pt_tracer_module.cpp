@@ -0,0 +1,203 @@
+﻿#include <memory>
+#include <optional>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include "loader.hpp"
+#include "simulation.hpp"
+
+namespace py = pybind11;
+
+namespace {
+
+json to_json(const py::object& config){
+    if(py::isinstance<py::str>(config)){
+        return load_json_config(config.cast<std::string>());
+    }
+    //dict goes through the json module, so the loader sees the same data
+    std::string text = py::module::import("json").attr("dumps")(config).cast<std::string>();
+    return json::parse(text);
+}
+
+/*!Array over the vector owned by the result, the result is kept alive
+ * by the array, nothing is copied*/
+template<typename T>
+py::array_t<T> make_view(const std::vector<T>& data,
+                         const std::vector<py::ssize_t>& shape,
+                         const py::object& owner){
+    return py::array_t<T>(shape, data.data(), owner);
+}
+
+py::ssize_t to_ssize(const size_t n){
+    return static_cast<py::ssize_t>(n);
+}
+
+class PySimulation{
+private:
+    json config_;
+    Simulation sim_;
+    ParticleSource source_;
+    size_t pt_num_;
+    std::vector<std::string> wall_names_;
+public:
+    //absorbed particles kept in memory are not written to the surface files
+    PySimulation(const py::object& config, const bool record_absorbed):
+        config_(to_json(config)),
+        sim_(load_simulation(config_, record_absorbed ? FileMode::NONE : FileMode::TRUNCATE)),
+        source_(load_particle_source(config_)),
+        pt_num_(config_["particles"]["number"].get<size_t>()),
+        wall_names_(load_surface_names(config_))
+    {
+        for(const auto& s : sim_.GetGeometry().GetSurfaces()){
+            s->WriteFileHeader();
+        }
+        sim_.SetRecordAbsorbed(record_absorbed);
+    }
+
+    std::shared_ptr<RunResult> Run(const std::optional<size_t> n){
+        size_t pt_num = n.value_or(pt_num_);
+        py::gil_scoped_release release;
+        return std::make_shared<RunResult>(sim_.Run({source_}, pt_num));
+    }
+
+    const std::vector<std::string>& GetWallNames() const {return wall_names_;}
+};
+
+py::object get_records(const py::object& self){
+    const RunResult& result = self.cast<const RunResult&>();
+    if(!result.records_){
+        return py::none();
+    }
+    const RecordTally& records = result.records_.value();
+    py::ssize_t n = to_ssize(records.GetRecordNum());
+    py::dict out;
+    out["pos"] = make_view(records.GetPositions(), {n, 3}, self);
+    out["dir"] = make_view(records.GetDirections(), {n, 3}, self);
+    out["time"] = make_view(records.GetTimes(), {n}, self);
+    out["vol_count"] = make_view(records.GetVolCounts(), {n}, self);
+    out["surf_count"] = make_view(records.GetSurfCounts(), {n}, self);
+    out["wall"] = make_view(records.GetWallIds(), {n}, self);
+    out["species_count"] = make_view(records.GetSpeciesCounts(),
+                                     {n, to_ssize(records.GetSpeciesNum())}, self);
+    return out;
+}
+
+py::object get_voxel(const py::object& self){
+    const RunResult& result = self.cast<const RunResult&>();
+    if(!result.voxel_){
+        return py::none();
+    }
+    const VoxelTally& voxel = result.voxel_.value();
+    const auto& bins = voxel.GetGrid().bins_;
+    std::vector<py::ssize_t> shape {to_ssize(bins[0]), to_ssize(bins[1]), to_ssize(bins[2])};
+    py::dict out;
+    out["track_length"] = make_view(voxel.GetTrackLengths(), shape, self);
+    out["collisions"] = make_view(voxel.GetCollisionCounts(), shape, self);
+    out["voxel_volume"] = voxel.GetVoxelVolume();
+    out["histories"] = voxel.GetHistoryNum();
+    return out;
+}
+
+py::object get_time(const py::object& self){
+    const RunResult& result = self.cast<const RunResult&>();
+    if(!result.time_){
+        return py::none();
+    }
+    const TimeTally& tally = result.time_.value();
+    const TimeBins& bins = tally.GetBins();
+    py::ssize_t wall_num = to_ssize(tally.GetCounts().size()/(bins.bin_num_ + 1));
+    py::dict out;
+    //last column is the overflow bin
+    out["counts"] = make_view(tally.GetCounts(), {wall_num, to_ssize(bins.bin_num_ + 1)},
+                              self);
+    out["max_time"] = bins.t_max_;
+    out["histories"] = tally.GetHistoryNum();
+    return out;
+}
+
+py::object get_sweep(const py::object& self){
+    const RunResult& result = self.cast<const RunResult&>();
+    if(!result.sweep_){
+        return py::none();
+    }
+    //fractions are computed from the sums, so these are small copies
+    const SweepTally& sweep = result.sweep_.value();
+    size_t point_num = sweep.GetPointNum();
+    size_t wall_num = sweep.GetWallNum();
+    py::array_t<double> fraction({to_ssize(point_num), to_ssize(wall_num)});
+    py::array_t<double> error({to_ssize(point_num), to_ssize(wall_num)});
+    py::array_t<double> nominal(to_ssize(wall_num));
+    auto f = fraction.mutable_unchecked<2>();
+    auto e = error.mutable_unchecked<2>();
+    auto nom = nominal.mutable_unchecked<1>();
+    for(size_t j=0; j<wall_num; j++){
+        nom(to_ssize(j)) = sweep.GetNominalFraction(j);
+        for(size_t i=0; i<point_num; i++){
+            f(to_ssize(i), to_ssize(j)) = sweep.GetFraction(i, j);
+            e(to_ssize(i), to_ssize(j)) = sweep.GetFractionError(i, j);
+        }
+    }
+    py::dict out;
+    out["fraction"] = fraction;
+    out["error"] = error;
+    out["nominal"] = nominal;
+    out["histories"] = sweep.GetHistoryNum();
+    return out;
+}
+
+py::object get_detector(const py::object& self){
+    const RunResult& result = self.cast<const RunResult&>();
+    if(!result.detector_){
+        return py::none();
+    }
+    const DetectorTally& tally = result.detector_.value();
+    py::array_t<double> mean(to_ssize(tally.GetDetectorNum()));
+    py::array_t<double> error(to_ssize(tally.GetDetectorNum()));
+    auto m = mean.mutable_unchecked<1>();
+    auto e = error.mutable_unchecked<1>();
+    for(size_t i=0; i<tally.GetDetectorNum(); i++){
+        m(to_ssize(i)) = tally.GetMean(i);
+        e(to_ssize(i)) = tally.GetError(i);
+    }
+    py::dict out;
+    out["probability"] = mean;
+    out["error"] = error;
+    out["histories"] = tally.GetHistoryNum();
+    return out;
+}
+
+}
+
+PYBIND11_MODULE(pt_tracer, m){
+    m.doc() = "In-process particle tracing, results are numpy views of the C++ buffers";
+
+    py::class_<RunResult, std::shared_ptr<RunResult>>(m, "RunResult")
+        .def_readonly("traced", &RunResult::traced_num_)
+        .def_readonly("lost", &RunResult::lost_num_)
+        .def_readonly("secondaries", &RunResult::secondary_num_)
+        .def_readonly("dropped", &RunResult::dropped_num_)
+        .def_property_readonly("absorbed", [](const py::object& self){
+                const auto& counts = self.cast<const RunResult&>().absorbed_.GetCounts();
+                return make_view(counts, {to_ssize(counts.size())}, self);
+            }, "Number of absorbed particles for every wall")
+        .def_property_readonly("species_collisions", [](const py::object& self){
+                const auto& counts = self.cast<const RunResult&>().absorbed_.GetSpeciesCounts();
+                return make_view(counts, {to_ssize(counts.size())}, self);
+            }, "Gas collisions with every species of the mixture")
+        .def_property_readonly("records", &get_records,
+            "Absorbed particles: pos, dir, time, vol_count, surf_count, wall, species_count")
+        .def_property_readonly("voxel", &get_voxel)
+        .def_property_readonly("time", &get_time)
+        .def_property_readonly("sweep", &get_sweep)
+        .def_property_readonly("detector", &get_detector,
+            "Next-event probability per history to reach each detector");
+
+    py::class_<PySimulation>(m, "Simulation")
+        .def(py::init<const py::object&, const bool>(),
+             py::arg("config"), py::arg("record_absorbed") = true,
+             "config is a dict with the json config layout or a path to the config file")
+        .def("run", &PySimulation::Run, py::arg("n") = py::none(),
+             "Traces n particles (particles.number by default) without the GIL")
+        .def_property_readonly("wall_names", &PySimulation::GetWallNames);
+}
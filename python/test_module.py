@@ -0,0 +1,53 @@
+"""Smoke test of the pt_tracer module, run by ctest from an empty directory"""
+import os
+import tempfile
+
+import pt_tracer
+
+
+def make_config(pt_num):
+    walls = []
+    contours = [
+        [[0, 0, 0], [0, 1, 0], [0, 1, 1], [0, 0, 1]],
+        [[0, 0, 0], [0, 0, 1], [1, 0, 1], [1, 0, 0]],
+        [[0, 0, 0], [1, 0, 0], [1, 1, 0], [0, 1, 0]],
+        [[1, 0, 0], [1, 0, 1], [1, 1, 1], [1, 1, 0]],
+        [[0, 1, 0], [1, 1, 0], [1, 1, 1], [0, 1, 1]],
+        [[0, 0, 1], [0, 1, 1], [1, 1, 1], [1, 0, 1]]]
+    for i, contour in enumerate(contours):
+        walls.append({"name": f"surface_{i}", "reflector_type": "cosine",
+                      "reflection_coefficient": 0.5, "collect_statistics": True,
+                      "contour": contour})
+    return {
+        "gas": {"sigma": 2e-16, "temperature": 300.0, "pressure": 5.0},
+        "particles": {"number": pt_num, "source_point": [0.1, 0.5, 0.5],
+                      "direction": [1.0, 0.0, 0.0], "is_dir_random": False},
+        "general": {"number_of_threads": 2, "seed": 7},
+        "geometry": walls}
+
+
+def main():
+    os.chdir(tempfile.mkdtemp())
+    config = make_config(1000)
+    sim = pt_tracer.Simulation(config)
+    res = sim.run()
+    assert sim.wall_names == [f"surface_{i}" for i in range(6)]
+    assert res.traced == 1000
+    assert int(res.absorbed.sum()) + res.lost == 1000
+    assert res.records["pos"].shape == (int(res.absorbed.sum()), 3)
+    #records are kept in memory, so no surface files are written
+    assert not any(os.path.exists(name) for name in sim.wall_names)
+    file_sim = pt_tracer.Simulation(config, record_absorbed=False)
+    file_res = file_sim.run(500)
+    assert file_res.records is None
+    #files are flushed when the simulation goes away
+    names = file_sim.wall_names
+    del file_sim
+    for i, name in enumerate(names):
+        with open(name) as f:
+            rows = [line for line in f if not line.startswith("#")]
+        assert len(rows) == file_res.absorbed[i]
+
+
+if __name__ == "__main__":
+    main()
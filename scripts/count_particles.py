@@ -1,4 +1,5 @@
 import numpy as np
+import ptc_reader
 
 
 if __name__ == "__main__":
@@ -10,7 +11,10 @@ if __name__ == "__main__":
     
     total = 0
     for fname in args.files:
-        data = np.loadtxt(fname)
+        if ptc_reader.is_columnar(fname):
+            data = ptc_reader.load(fname)[1]["x"]
+        else:
+            data = np.loadtxt(fname, ndmin=2)
         print("%s --> %i particles" % (fname, len(data)))
         total += len(data)
     print("TOTAL PARTICLES --> %i" % total)
\ No newline at end of file
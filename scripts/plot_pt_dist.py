@@ -1,5 +1,6 @@
 import numpy as np
 import matplotlib.pyplot as plt
+import ptc_reader
 
 
 def get_par_index(par):
@@ -46,7 +47,7 @@ if __name__ == "__main__":
     if args.file=='':
         raise Warning("File with statistics was not set!")
         
-    data = np.loadtxt(args.file)
+    data = ptc_reader.load_table(args.file)
     fname = args.file.split('/')[-1]
     if args.parameters!="":
         par_list = args.parameters.split(' ')
@@ -0,0 +1,95 @@
+import json
+import mmap
+import zlib
+import numpy as np
+
+# Reader of the columnar particle files written with
+# "output_format" : "columnar" (see ColumnarWriter in include/output.hpp)
+
+FILE_MAGIC = b"PTCOL01\0"
+BLOCK_MAGIC = 0x4B4C4250
+COLUMN_NUM = 8
+DTYPES = {"f32": np.float32, "f64": np.float64, "u32": np.uint32, "u64": np.uint64}
+
+
+def decode_varint(raw, rec_num):
+    data = np.frombuffer(raw, dtype=np.uint8)
+    ends = np.flatnonzero(data < 0x80)[:rec_num]
+    if len(ends) == len(data):
+        return data.astype(np.uint64)
+    starts = np.empty_like(ends)
+    starts[0] = 0
+    starts[1:] = ends[:-1] + 1
+    lengths = ends - starts + 1
+    values = np.zeros(rec_num, dtype=np.uint64)
+    for shift in range(lengths.max()):
+        mask = lengths > shift
+        byte = data[starts[mask] + shift].astype(np.uint64) & np.uint64(0x7F)
+        values[mask] |= byte << np.uint64(7*shift)
+    return values
+
+
+def read_blocks(buf):
+    """Yields (header, [column arrays]) for every block of the file.
+    Uncompressed fixed width columns are views into the given buffer."""
+    pos = 0
+    header = None
+    while pos < len(buf):
+        if buf[pos:pos+8] == FILE_MAGIC:
+            text_size = int(np.frombuffer(buf, np.uint64, 1, pos+8)[0])
+            header = json.loads(bytes(buf[pos+16:pos+16+text_size]))
+            pos += 16 + text_size
+            continue
+        if header is None or np.frombuffer(buf, np.uint32, 1, pos)[0] != BLOCK_MAGIC:
+            raise ValueError("wrong columnar file format")
+        rec_num = int(np.frombuffer(buf, np.uint32, 1, pos+4)[0])
+        desc = np.frombuffer(buf, np.uint64, 3*COLUMN_NUM, pos+8).reshape(COLUMN_NUM, 3)
+        pos += 8 + 24*COLUMN_NUM
+        columns = []
+        for col in range(COLUMN_NUM):
+            codec = int(desc[col, 0]) & 0xFF
+            stored_size, raw_size = int(desc[col, 1]), int(desc[col, 2])
+            col_type = header["columns"][col]["type"]
+            if codec == 1:
+                raw = zlib.decompress(buf[pos:pos+stored_size])
+                assert len(raw) == raw_size
+            else:
+                raw = buf[pos:pos+stored_size]
+            if col_type == "varint":
+                columns.append(decode_varint(raw, rec_num))
+            else:
+                columns.append(np.frombuffer(raw, DTYPES[col_type], rec_num))
+            pos += stored_size + (8 - stored_size % 8) % 8
+        yield header, columns
+
+
+def load(fname):
+    """Returns the header of the first segment and dict name -> numpy array"""
+    with open(fname, "rb") as f:
+        buf = memoryview(mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ))
+    header = None
+    parts = [[] for _ in range(COLUMN_NUM)]
+    for block_header, columns in read_blocks(buf):
+        header = header or block_header
+        for col in range(COLUMN_NUM):
+            parts[col].append(columns[col])
+    if header is None:
+        raise ValueError("file %s has no columnar header" % fname)
+    names = [c["name"] for c in header["columns"]]
+    data = {}
+    for name, part in zip(names, parts):
+        data[name] = part[0] if len(part) == 1 else np.concatenate(part) if part else np.empty(0)
+    return header, data
+
+
+def is_columnar(fname):
+    with open(fname, "rb") as f:
+        return f.read(8) == FILE_MAGIC
+
+
+def load_table(fname):
+    """Same 8 column float table as np.loadtxt gives for the text output"""
+    if not is_columnar(fname):
+        return np.loadtxt(fname, ndmin=2)
+    header, data = load(fname)
+    return np.column_stack([data[c["name"]].astype(np.float64) for c in header["columns"]])
@@ -0,0 +1,89 @@
+﻿#include <algorithm>
+#include <chrono>
+
+#include "async_output.hpp"
+
+AsyncWriter::AsyncWriter(const size_t thread_num, const size_t buffer_size,
+                         const size_t queue_depth):
+    buffer_size_(std::max<size_t>(buffer_size, 1))
+{
+    for(size_t i=0; i<thread_num; i++){
+        auto prod = std::make_unique<Producer>(queue_depth);
+        //queue_depth buffers can wait in the queue and one is being filled
+        for(size_t j=0; j<queue_depth+1; j++){
+            prod->storage_.push_back(std::make_unique<Buffer>());
+            prod->storage_.back()->items_.reserve(buffer_size_);
+            prod->free_.TryPush(prod->storage_.back().get());
+        }
+        prod->free_.TryPop(prod->current_);
+        producers_.push_back(std::move(prod));
+    }
+}
+
+AsyncWriter::~AsyncWriter(){
+    Finish();
+}
+
+void AsyncWriter::Start(){
+    if(!thread_.joinable()){
+        stop_.store(false);
+        thread_ = std::thread(&AsyncWriter::WriterLoop, this);
+    }
+}
+
+void AsyncWriter::HandOver(Producer& prod){
+    //full_ can hold all buffers of the producer, so only free_ can block
+    prod.full_.TryPush(prod.current_);
+    while(!prod.free_.TryPop(prod.current_)){
+        std::this_thread::yield();
+    }
+}
+
+void AsyncWriter::Push(const size_t tid, ParticleWriter* writer,
+                       const ParticleRecord& rec){
+    Producer& prod = *producers_[tid];
+    prod.current_->items_.push_back({writer, rec});
+    if(prod.current_->items_.size() >= buffer_size_){
+        HandOver(prod);
+    }
+}
+
+bool AsyncWriter::DrainQueues(){
+    bool found_work = false;
+    for(auto& prod : producers_){
+        Buffer* buf = nullptr;
+        while(prod->full_.TryPop(buf)){
+            found_work = true;
+            for(const auto& item : buf->items_){
+                item.writer_->Write(item.record_);
+            }
+            buf->items_.clear();
+            prod->free_.TryPush(buf);
+        }
+    }
+    return found_work;
+}
+
+void AsyncWriter::WriterLoop(){
+    while(!stop_.load(std::memory_order_acquire)){
+        if(!DrainQueues()){
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    DrainQueues();
+}
+
+void AsyncWriter::Finish(){
+    if(thread_.joinable()){
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+    //compute threads are stopped --> the rest is written from here
+    DrainQueues();
+    for(auto& prod : producers_){
+        for(const auto& item : prod->current_->items_){
+            item.writer_->Write(item.record_);
+        }
+        prod->current_->items_.clear();
+    }
+}
@@ -0,0 +1,56 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "batch_stats.hpp"
+
+BatchStats::BatchStats(const size_t size): sum_(size, 0.0), sum2_(size, 0.0) {}
+
+void BatchStats::AddBatch(const std::vector<double>& values){
+    for(size_t i=0; i<sum_.size(); i++){
+        sum_[i] += values[i];
+        sum2_[i] += values[i]*values[i];
+    }
+    batch_num_++;
+}
+
+size_t BatchStats::GetBatchNum() const {return batch_num_;}
+
+size_t BatchStats::GetSize() const {return sum_.size();}
+
+double BatchStats::GetMean(const size_t i) const {
+    return batch_num_ > 0 ? sum_[i]/static_cast<double>(batch_num_) : 0.0;
+}
+
+double BatchStats::GetError(const size_t i) const {
+    if(batch_num_ < 2){
+        return 0.0;
+    }
+    double n = static_cast<double>(batch_num_);
+    double mean = sum_[i]/n;
+    //rounding can make the variance slightly negative for equal batches
+    double var = std::max(sum2_[i]/n - mean*mean, 0.0)*n/(n - 1.0);
+    return sqrt(var/n);
+}
+
+double BatchStats::GetMaxRelError(const double min_sum) const {
+    if(batch_num_ < 2){
+        return std::numeric_limits<double>::infinity();
+    }
+    double max_err = 0.0;
+    for(size_t i=0; i<sum_.size(); i++){
+        double mean = GetMean(i);
+        if(mean != 0.0 && std::fabs(sum_[i]) > min_sum){
+            max_err = std::max(max_err, GetError(i)/std::fabs(mean));
+        }
+    }
+    return max_err;
+}
+
+std::vector<double> BatchStats::GetErrors() const {
+    std::vector<double> errors(sum_.size());
+    for(size_t i=0; i<errors.size(); i++){
+        errors[i] = GetError(i);
+    }
+    return errors;
+}
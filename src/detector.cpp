@@ -0,0 +1,183 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <fmt/core.h>
+
+#include "detector.hpp"
+#include "geometry.hpp"
+#include "particle.hpp"
+#include "reflector.hpp"
+#include "simulation.hpp"
+
+namespace {
+
+//isotropic gas scattering
+constexpr double kGasDensity = 0.25/M_PI;
+//random source direction, GetRandomVel draws cos_theta uniformly
+constexpr double kHemisphereDensity = 0.5/M_PI;
+//wall hit this close to the detector does not hide it, so disks may lie on the walls
+constexpr double kVisibleTolerance = 1e-6;
+
+//nothing is hit on the way to the detector at the distance r along dir
+bool IsVisible(const Geometry& geo, const Vec3& start, const Vec3& dir, const double r){
+    std::optional<SurfaceHit> hit = geo.FindClosestHit(ShearedRay(start, dir));
+    return !hit || start.GetDistance(hit->point_) >= r*(1.0 - kVisibleTolerance);
+}
+
+}
+
+DetectorTally::DetectorTally(std::vector<Detector> detectors, const Background& gas):
+    detectors_(std::move(detectors)),
+    inv_mfp_(gas.p_ == 0.0 ? 0.0 : 1.0/gas.GetMeanFreePath()),
+    history_(detectors_.size(), 0.0),
+    sum_(detectors_.size(), 0.0),
+    sum2_(detectors_.size(), 0.0)
+{
+    for(auto& det : detectors_){
+        if(det.area_ <= 0.0){
+            fprintf(stderr, "detector %s: area should be positive\n", det.name_.c_str());
+            exit(1);
+        }
+        if(det.normal_){
+            det.normal_->Norm();
+        }
+    }
+}
+
+template<typename Density>
+void DetectorTally::Score(const Geometry& geo, const Vec3& start, const Density& density){
+    for(size_t i=0; i<detectors_.size(); i++){
+        const Detector& det = detectors_[i];
+        Vec3 dir(start, det.point_);
+        double r = dir.Length();
+        if(r == 0.0){
+            continue;
+        }
+        dir = dir.Times(1.0/r);
+        double solid_angle = det.area_/(r*r);
+        if(det.normal_){
+            solid_angle *= std::fabs(det.normal_->Dot(dir));
+        }
+        double score = density(dir)*std::min(solid_angle, 2.0*M_PI)*std::exp(-r*inv_mfp_);
+        if(score <= 0.0 || !IsVisible(geo, start, dir, r)){
+            continue;
+        }
+        history_[i] += score;
+    }
+}
+
+void DetectorTally::ScoreBeam(const Geometry& geo, const Vec3& start, const Vec3& dir){
+    for(size_t i=0; i<detectors_.size(); i++){
+        const Detector& det = detectors_[i];
+        //sphere or disk of the detector area
+        double radius2 = det.area_/M_PI;
+        Vec3 to_det(start, det.point_);
+        double r;
+        if(det.normal_){
+            double cos_dir = det.normal_->Dot(dir);
+            if(cos_dir == 0.0){
+                continue;
+            }
+            r = det.normal_->Dot(to_det)/cos_dir;
+            Vec3 cross = start.AddScaled(dir, r);
+            double offset = cross.GetDistance(det.point_);
+            if(offset*offset > radius2){
+                continue;
+            }
+        } else {
+            r = to_det.Dot(dir);
+            if(to_det.Dot(to_det) - r*r > radius2){
+                continue;
+            }
+        }
+        if(r <= 0.0 || !IsVisible(geo, start, dir, r)){
+            continue;
+        }
+        history_[i] += std::exp(-r*inv_mfp_);
+    }
+}
+
+void DetectorTally::OnSource(const Particle& pt, const Geometry& geo,
+                             const ParticleSource& source){
+    if(!source.is_dir_random_){
+        ScoreBeam(geo, pt.GetPosition(), pt.GetDirection());
+        return;
+    }
+    Score(geo, pt.GetPosition(), [&source](const Vec3& dir){
+        return dir.Dot(source.direction_) > 0.0 ? kHemisphereDensity : 0.0;
+    });
+}
+
+void DetectorTally::OnScatter(const Particle& pt, const Geometry& geo,
+                              const Reflector* reflector, const Vec3& normal){
+    if(!reflector){
+        Score(geo, pt.GetPosition(), [](const Vec3&){return kGasDensity;});
+        return;
+    }
+    //rays leave the wall from the same offset point as the reflected particle
+    //and the secondaries, which are scored here at their birth
+    Score(geo, OffsetPointAlongNormal(pt.GetPosition(), normal),
+          [&pt, reflector, &normal](const Vec3& dir){
+              return reflector->GetDiffuseDensity(normal, dir) +
+                     reflector->GetSecondaryDensity(pt, normal, dir);
+          });
+}
+
+void DetectorTally::OnHistoryEnd(){
+    for(size_t i=0; i<detectors_.size(); i++){
+        sum_[i] += history_[i];
+        sum2_[i] += history_[i]*history_[i];
+        history_[i] = 0.0;
+    }
+    history_num_++;
+}
+
+void DetectorTally::Merge(const DetectorTally& other){
+    AddSums(other.sum_, other.sum2_, other.history_num_);
+}
+
+void DetectorTally::AddSums(const std::vector<double>& sum, const std::vector<double>& sum2,
+                            const size_t history_num){
+    if(sum.size() != sum_.size() || sum2.size() != sum2_.size()){
+        fprintf(stderr, "detector tally: saved sums do not match the detectors\n");
+        exit(1);
+    }
+    for(size_t i=0; i<sum_.size(); i++){
+        sum_[i] += sum[i];
+        sum2_[i] += sum2[i];
+    }
+    history_num_ += history_num;
+}
+
+size_t DetectorTally::GetHistoryNum() const {return history_num_;}
+
+size_t DetectorTally::GetDetectorNum() const {return detectors_.size();}
+
+double DetectorTally::GetMean(const size_t detector) const {
+    return sum_[detector]/static_cast<double>(std::max<size_t>(history_num_, 1));
+}
+
+double DetectorTally::GetError(const size_t detector) const {
+    if(history_num_ < 2){
+        return 0.0;
+    }
+    double n = static_cast<double>(history_num_);
+    double mean = sum_[detector]/n;
+    double variance = std::max(sum2_[detector]/n - mean*mean, 0.0);
+    return std::sqrt(variance/(n - 1.0));
+}
+
+const std::vector<double>& DetectorTally::GetSums() const {return sum_;}
+
+const std::vector<double>& DetectorTally::GetSquareSums() const {return sum2_;}
+
+void DetectorTally::WriteResults(std::ostream& out) const {
+    out << fmt::format("#Histories: {:d}\n", history_num_);
+    out << "#DETECTOR\tPROBABILITY\tERROR\n";
+    for(size_t i=0; i<detectors_.size(); i++){
+        out << fmt::format("{}\t{:.6e}\t{:.6e}\n", detectors_[i].name_, GetMean(i),
+                           GetError(i));
+    }
+}
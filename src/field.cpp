@@ -0,0 +1,129 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "field.hpp"
+
+namespace {
+
+//speed change of the particle at rest is limited as for this speed, cm/s
+constexpr double kMinSpeed = 1e6;
+
+}
+
+UniformField::UniformField(const Vec3& E, const Vec3& B): E_(E), B_(B) {}
+
+void UniformField::GetFields([[maybe_unused]] const Vec3& pos, Vec3& E, Vec3& B) const {
+    E = E_;
+    B = B_;
+}
+
+GridField::GridField(const Vec3& origin, const Vec3& cell, const std::array<size_t, 3>& nodes,
+                     const std::vector<Vec3>& E, const std::vector<Vec3>& B):
+    origin_(origin), nodes_(nodes)
+{
+    for(int k=0; k<3; k++){
+        size_t idx = static_cast<size_t>(k);
+        if(nodes_[idx] < 2 || cell[k] <= 0){
+            fprintf(stderr, "field grid: at least 2 nodes and positive cell along axis %d\n", k);
+            exit(1);
+        }
+        blocks_[idx] = (nodes_[idx] + kBlock - 1)/kBlock;
+    }
+    inv_cell_ = Vec3(1.0/cell[0], 1.0/cell[1], 1.0/cell[2]);
+    size_t node_num = nodes_[0]*nodes_[1]*nodes_[2];
+    if(E.size() != node_num || B.size() != node_num){
+        fprintf(stderr, "field grid: %zu nodes expected, %zu given\n", node_num,
+                std::min(E.size(), B.size()));
+        exit(1);
+    }
+    //partial blocks at the far edges are padded
+    data_.assign(blocks_[0]*blocks_[1]*blocks_[2]*kBlock*kBlock*kBlock*kComponents, 0.0f);
+    size_t node = 0;
+    for(size_t iz=0; iz<nodes_[2]; iz++){
+        for(size_t iy=0; iy<nodes_[1]; iy++){
+            for(size_t ix=0; ix<nodes_[0]; ix++, node++){
+                float* values = &data_[GetOffset(ix, iy, iz)];
+                for(int k=0; k<3; k++){
+                    values[k] = static_cast<float>(E[node][k]);
+                    values[k + 3] = static_cast<float>(B[node][k]);
+                }
+            }
+        }
+    }
+}
+
+size_t GridField::GetOffset(const size_t ix, const size_t iy, const size_t iz) const {
+    size_t block = (iz/kBlock*blocks_[1] + iy/kBlock)*blocks_[0] + ix/kBlock;
+    size_t local = ((iz%kBlock)*kBlock + iy%kBlock)*kBlock + ix%kBlock;
+    return (block*kBlock*kBlock*kBlock + local)*kComponents;
+}
+
+void GridField::GetFields(const Vec3& pos, Vec3& E, Vec3& B) const {
+    size_t cell[3];
+    double frac[3];
+    for(int k=0; k<3; k++){
+        size_t idx = static_cast<size_t>(k);
+        double t = (pos[k] - origin_[k])*inv_cell_[k];
+        double last = static_cast<double>(nodes_[idx] - 1);
+        if(!(t >= 0.0 && t <= last)){
+            E = Vec3(0.0, 0.0, 0.0);
+            B = Vec3(0.0, 0.0, 0.0);
+            return;
+        }
+        //the far face belongs to the last cell
+        cell[idx] = std::min(static_cast<size_t>(t), nodes_[idx] - 2);
+        frac[idx] = t - static_cast<double>(cell[idx]);
+    }
+    double sum[kComponents] = {};
+    for(size_t corner=0; corner<8; corner++){
+        size_t dx = corner & 1;
+        size_t dy = (corner >> 1) & 1;
+        size_t dz = (corner >> 2) & 1;
+        double weight = (dx ? frac[0] : 1.0 - frac[0])*
+                        (dy ? frac[1] : 1.0 - frac[1])*
+                        (dz ? frac[2] : 1.0 - frac[2]);
+        const float* values = &data_[GetOffset(cell[0] + dx, cell[1] + dy, cell[2] + dz)];
+        for(size_t c=0; c<kComponents; c++){
+            sum[c] += weight*static_cast<double>(values[c]);
+        }
+    }
+    E = Vec3(sum[0], sum[1], sum[2]);
+    B = Vec3(sum[3], sum[4], sum[5]);
+}
+
+FieldTransport::FieldTransport(std::unique_ptr<FieldMap>&& map, const FieldStepping& stepping):
+    map_(std::move(map)), stepping_(stepping) {}
+
+const FieldStepping& FieldTransport::GetStepping() const {return stepping_;}
+
+double FieldTransport::Push(const Vec3& pos, Vec3& velocity) const {
+    Vec3 E;
+    Vec3 B;
+    map_->GetFields(pos, E, B);
+    double q_m = stepping_.charge_to_mass_;
+    double speed = velocity.Length();
+    double dt = stepping_.max_step_/speed;
+    //Larmor frequency, 1/s
+    double omega = std::fabs(q_m)*B.Length();
+    if(omega > 0.0){
+        dt = std::min(dt, stepping_.max_angle_/omega);
+    }
+    //V/cm is 100 V/m, m/s^2 is 100 cm/s^2
+    Vec3 accel = E.Times(1e4*q_m);
+    double accel_len = accel.Length();
+    if(accel_len > 0.0){
+        dt = std::min(dt, stepping_.max_speed_change_*std::max(speed, kMinSpeed)/accel_len);
+    }
+    if(std::isinf(dt)){
+        return dt;
+    }
+    Vec3 v_minus = velocity + accel.Times(0.5*dt);
+    Vec3 t = B.Times(0.5*q_m*dt);
+    Vec3 s = t.Times(2.0/(1.0 + t.Length2()));
+    Vec3 v_prime = v_minus + v_minus.Cross(t);
+    Vec3 v_plus = v_minus + v_prime.Cross(s);
+    velocity = v_plus + accel.Times(0.5*dt);
+    return dt;
+}
@@ -0,0 +1,82 @@
+﻿#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+#include "gas.hpp"
+
+GasMixture::GasMixture(std::vector<GasSpecies> species): species_(std::move(species)){
+    size_t n = species_.size();
+    if(n == 0 || n > kMaxSpecies){
+        fprintf(stderr, "gas mixture: 1 to %zu species are supported, %zu given\n",
+                kMaxSpecies, n);
+        exit(1);
+    }
+    double total = 0.0;
+    for(const auto& s : species_){
+        if(s.sigma_ < 0.0 || s.p_ < 0.0){
+            fprintf(stderr, "gas mixture: negative cross section or pressure of %s\n",
+                    s.name_.c_str());
+            exit(1);
+        }
+        total += s.p_*s.sigma_;
+    }
+    //Vose alias method: columns of the mean height, every column is
+    //filled by its own species and at most one other
+    threshold_.assign(n, 1.0);
+    alias_.resize(n);
+    std::vector<double> height(n, 1.0);
+    std::vector<size_t> small;
+    std::vector<size_t> large;
+    for(size_t i=0; i<n; i++){
+        alias_[i] = i;
+        if(total > 0.0){
+            height[i] = species_[i].p_*species_[i].sigma_*static_cast<double>(n)/total;
+        }
+        (height[i] < 1.0 ? small : large).push_back(i);
+    }
+    while(!small.empty() && !large.empty()){
+        size_t s = small.back();
+        small.pop_back();
+        size_t l = large.back();
+        threshold_[s] = height[s];
+        alias_[s] = l;
+        height[l] -= 1.0 - height[s];
+        if(height[l] < 1.0){
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    //leftovers are full columns up to the rounding
+}
+
+size_t GasMixture::SampleSpecies(std::mt19937& rnd_gen) const {
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    double u = rnd(rnd_gen)*static_cast<double>(species_.size());
+    size_t col = std::min(static_cast<size_t>(u), species_.size() - 1);
+    return u - static_cast<double>(col) < threshold_[col] ? col : alias_[col];
+}
+
+size_t GasMixture::GetSpeciesNum() const {return species_.size();}
+
+const GasSpecies& GasMixture::GetSpecies(const size_t idx) const {return species_[idx];}
+
+double GasMixture::GetPressure() const {
+    double p = 0.0;
+    for(const auto& s : species_){
+        p += s.p_;
+    }
+    return p;
+}
+
+double GasMixture::GetMeanSigma() const {
+    double p = GetPressure();
+    if(p == 0.0){
+        return species_[0].sigma_;
+    }
+    double sum = 0.0;
+    for(const auto& s : species_){
+        sum += s.p_*s.sigma_;
+    }
+    return sum/p;
+}
@@ -0,0 +1,340 @@
+﻿#include <limits>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+
+#include "geometry.hpp"
+
+AxisRectBatch::AxisRectBatch(const int axis): axis_(axis) {}
+
+void AxisRectBatch::Add(const size_t wall_id, const AxisAlignedRect::RectData& rect){
+    wall_ids_.push_back(wall_id);
+    plane_.push_back(rect.plane_);
+    normal_sign_.push_back(rect.normal_sign_);
+    u_min_.push_back(rect.u_min_);
+    u_max_.push_back(rect.u_max_);
+    v_min_.push_back(rect.v_min_);
+    v_max_.push_back(rect.v_max_);
+}
+
+size_t AxisRectBatch::GetSize() const {return wall_ids_.size();}
+
+namespace {
+
+//Index of the nearest rectangle hit by the ray, n if there is none.
+//In float the bounds are taken relative to the ray origin in double,
+//so the float rounding does not grow with the distance from zero
+template<typename T>
+size_t FindClosestRect(const size_t n, const double* plane, const double* normal_sign,
+                       const double* u_min, const double* u_max,
+                       const double* v_min, const double* v_max,
+                       const double o, const double o_u, const double o_v,
+                       const double d, const double d_u, const double d_v){
+    T inv_d = static_cast<T>(1.0/d);
+    T best_t = std::numeric_limits<T>::infinity();
+    size_t best_idx = n;
+    for(size_t i=0; i<n; i++){
+        bool is_inside;
+        T t;
+        if constexpr(std::is_same_v<T, double>){
+            t = (plane[i] - o)*inv_d;
+            double u = o_u + t*d_u;
+            double v = o_v + t*d_v;
+            is_inside = (u >= u_min[i]) & (u <= u_max[i]) & (v >= v_min[i]) & (v <= v_max[i]);
+        } else {
+            t = static_cast<T>(plane[i] - o)*inv_d;
+            T u = t*static_cast<T>(d_u);
+            T v = t*static_cast<T>(d_v);
+            is_inside = (u >= static_cast<T>(u_min[i] - o_u)) &
+                        (u <= static_cast<T>(u_max[i] - o_u)) &
+                        (v >= static_cast<T>(v_min[i] - o_v)) &
+                        (v <= static_cast<T>(v_max[i] - o_v));
+        }
+        //non short-circuit checks keep the loop free of data dependent branches
+        bool is_hit = (d*normal_sign[i] < 0.0) & (t > 0) & (t < best_t) & is_inside;
+        if(is_hit){
+            best_t = t;
+            best_idx = i;
+        }
+    }
+    return best_idx;
+}
+
+}
+
+void AxisRectBatch::SetMixedPrecision(const bool is_mixed){
+    is_mixed_precision_ = is_mixed;
+}
+
+std::optional<SurfaceHit> AxisRectBatch::FindClosestHit(const ShearedRay& ray) const {
+    int u_axis = (axis_+1)%3;
+    int v_axis = (axis_+2)%3;
+    double d = ray.dir_[axis_];
+    if(wall_ids_.empty() || d == 0.0){
+        return std::nullopt;
+    }
+    double o = ray.org_[axis_];
+    double o_u = ray.org_[u_axis];
+    double o_v = ray.org_[v_axis];
+    double d_u = ray.dir_[u_axis];
+    double d_v = ray.dir_[v_axis];
+    auto find = is_mixed_precision_ ? FindClosestRect<float> : FindClosestRect<double>;
+    size_t best_idx = find(plane_.size(), plane_.data(), normal_sign_.data(),
+                           u_min_.data(), u_max_.data(), v_min_.data(), v_max_.data(),
+                           o, o_u, o_v, d, d_u, d_v);
+    if(best_idx == wall_ids_.size()){
+        return std::nullopt;
+    }
+    double best_t = (plane_[best_idx] - o)*(1.0/d);
+    double coors[3];
+    coors[axis_] = plane_[best_idx];
+    coors[u_axis] = o_u + best_t*d_u;
+    coors[v_axis] = o_v + best_t*d_v;
+    double normal[3] = {0.0, 0.0, 0.0};
+    normal[axis_] = normal_sign_[best_idx];
+    return SurfaceHit{wall_ids_[best_idx], Vec3(coors[0], coors[1], coors[2]),
+                      Vec3(normal[0], normal[1], normal[2])};
+}
+
+
+SurfaceSet::SurfaceSet():
+    rect_batches_{AxisRectBatch(0), AxisRectBatch(1), AxisRectBatch(2)} {}
+
+void SurfaceSet::Add(const size_t wall_id, const Surface& surface){
+    auto rect = dynamic_cast<const AxisAlignedRect*>(&surface);
+    if(rect){
+        const AxisAlignedRect::RectData& data = rect->GetRectData();
+        rect_batches_[static_cast<size_t>(data.axis_)].Add(wall_id, data);
+    } else {
+        generic_ids_.push_back(wall_id);
+    }
+    box_.Extend(surface.GetBoundingBox());
+}
+
+std::optional<SurfaceHit> SurfaceSet::FindClosestHit(const ShearedRay& ray,
+                    const std::vector<std::unique_ptr<Surface>>& walls) const {
+    std::optional<SurfaceHit> best;
+    double best_dist = std::numeric_limits<double>::infinity();
+    auto update = [&](std::optional<SurfaceHit>&& hit){
+        if(!hit){
+            return;
+        }
+        double dist = ray.org_.GetDistance(hit->point_);
+        if(dist < best_dist){
+            best_dist = dist;
+            best = std::move(hit);
+        }
+    };
+    for(const auto& batch : rect_batches_){
+        update(batch.FindClosestHit(ray));
+    }
+    for(size_t id : generic_ids_){
+        auto cross_res = walls[id]->GetCrossPoint(ray);
+        if(cross_res){
+            update(SurfaceHit{id, cross_res.value(),
+                              walls[id]->GetNormalAt(cross_res.value())});
+        }
+    }
+    return best;
+}
+
+void SurfaceSet::SetMixedPrecision(const bool is_mixed){
+    for(auto& batch : rect_batches_){
+        batch.SetMixedPrecision(is_mixed);
+    }
+}
+
+const BoundingBox& SurfaceSet::GetBoundingBox() const {return box_;}
+
+
+Geometry::Geometry(std::vector<std::unique_ptr<Surface>>&& walls):
+    walls_(std::move(walls)),
+    wall_prototype_(walls_.size(), kNoPrototype)
+{
+    for(size_t i=0; i<walls_.size(); i++){
+        top_set_.Add(i, *walls_[i]);
+    }
+}
+
+size_t Geometry::AddPrototype(std::vector<std::unique_ptr<Surface>>&& surfaces){
+    size_t prototype = prototypes_.size();
+    prototypes_.emplace_back();
+    for(auto& s : surfaces){
+        prototypes_.back().Add(walls_.size(), *s);
+        walls_.push_back(std::move(s));
+        wall_prototype_.push_back(prototype);
+    }
+    return prototype;
+}
+
+void Geometry::AddInstance(const size_t prototype, const RigidTransform& transform){
+    instances_.push_back({prototype, transform,
+                transform.BoxToWorld(prototypes_[prototype].GetBoundingBox())});
+}
+
+void Geometry::BuildInstanceTree(){
+    bvh_.clear();
+    if(!instances_.empty()){
+        BuildNode(0, instances_.size());
+    }
+}
+
+size_t Geometry::BuildNode(const size_t begin, const size_t end){
+    size_t idx = bvh_.size();
+    bvh_.emplace_back();
+    BoundingBox box;
+    BoundingBox centers;
+    for(size_t i=begin; i<end; i++){
+        box.Extend(instances_[i].box_);
+        centers.Extend(instances_[i].box_.GetCenter());
+    }
+    if(end - begin <= kBvhLeafSize){
+        bvh_[idx] = {box, begin, end - begin, 0};
+        return idx;
+    }
+    //median split along the longest extent of the instance centers
+    Vec3 extent = centers.max_ - centers.min_;
+    int axis = 0;
+    for(int k=1; k<3; k++){
+        if(extent[k] > extent[axis]){
+            axis = k;
+        }
+    }
+    size_t mid = (begin + end)/2;
+    using diff_t = std::vector<Instance>::difference_type;
+    std::nth_element(instances_.begin() + static_cast<diff_t>(begin),
+                     instances_.begin() + static_cast<diff_t>(mid),
+                     instances_.begin() + static_cast<diff_t>(end),
+                     [axis](const Instance& lhs, const Instance& rhs){
+        return lhs.box_.GetCenter()[axis] < rhs.box_.GetCenter()[axis];
+    });
+    BuildNode(begin, mid);
+    size_t right = BuildNode(mid, end);
+    bvh_[idx] = {box, 0, 0, right};
+    return idx;
+}
+
+std::unique_ptr<Geometry> Geometry::MakeReplica(){
+    auto replica = std::make_unique<Geometry>(std::vector<std::unique_ptr<Surface>>{});
+    replica->origin_ = origin_ ? origin_ : this;
+    replica->wall_prototype_ = wall_prototype_;
+    replica->top_set_ = top_set_;
+    replica->prototypes_ = prototypes_;
+    replica->instances_ = instances_;
+    replica->bvh_ = bvh_;
+    replica->field_ = field_;
+    return replica;
+}
+
+bool Geometry::IsReplicaOf(const Geometry& origin) const {
+    return origin_ == &origin;
+}
+
+std::optional<SurfaceHit> Geometry::FindClosestHit(const ShearedRay& ray) const {
+    const auto& walls = GetSurfaces();
+    std::optional<SurfaceHit> best = top_set_.FindClosestHit(ray, walls);
+    if(bvh_.empty()){
+        return best;
+    }
+    double dir_len = ray.dir_.Length();
+    double best_t = best ? ray.org_.GetDistance(best->point_)/dir_len
+                         : std::numeric_limits<double>::infinity();
+    Vec3 inv_dir(1.0/ray.dir_.GetX(), 1.0/ray.dir_.GetY(), 1.0/ray.dir_.GetZ());
+    size_t stack[kBvhStackSize];
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while(stack_size > 0){
+        size_t node_idx = stack[--stack_size];
+        const BvhNode& node = bvh_[node_idx];
+        double t_enter;
+        if(!node.box_.IntersectRay(ray.org_, inv_dir, best_t, t_enter)){
+            continue;
+        }
+        if(node.count_ == 0){
+            stack[stack_size++] = node.right_;
+            stack[stack_size++] = node_idx + 1;
+            continue;
+        }
+        for(size_t i=node.first_; i<node.first_ + node.count_; i++){
+            const Instance& inst = instances_[i];
+            ShearedRay local_ray(inst.transform_.PointToLocal(ray.org_),
+                                 inst.transform_.DirToLocal(ray.dir_));
+            auto hit = prototypes_[inst.prototype_].FindClosestHit(local_ray, walls);
+            if(!hit){
+                continue;
+            }
+            double t = local_ray.org_.GetDistance(hit->point_)/dir_len;
+            if(t < best_t){
+                best_t = t;
+                best = SurfaceHit{hit->wall_id_,
+                                  inst.transform_.PointToWorld(hit->point_),
+                                  inst.transform_.DirToWorld(hit->normal_)};
+            }
+        }
+    }
+    return best;
+}
+
+bool Geometry::CheckOrientations() const {
+    const auto& walls = GetSurfaces();
+    for(size_t i=0; i<walls.size(); i++){
+        RigidTransform transform;
+        if(wall_prototype_[i] != kNoPrototype){
+            auto it = std::find_if(instances_.begin(), instances_.end(),
+                                   [this, i](const Instance& inst){
+                return inst.prototype_ == wall_prototype_[i];
+            });
+            if(it == instances_.end()){
+                continue;
+            }
+            transform = it->transform_;
+        }
+        Vec3 point = walls[i]->GetReferencePoint();
+        Vec3 direction = walls[i]->GetNormalAt(point);
+        if(!FindClosestHit(ShearedRay(transform.PointToWorld(point),
+                                      transform.DirToWorld(direction)))){
+            return false;
+        }
+    }
+    return true;
+}
+
+void Geometry::SetMixedPrecision(const bool is_mixed){
+    for(const auto& s : GetSurfaces()){
+        s->SetMixedPrecision(is_mixed);
+    }
+    top_set_.SetMixedPrecision(is_mixed);
+    for(auto& set : prototypes_){
+        set.SetMixedPrecision(is_mixed);
+    }
+}
+
+void Geometry::SetField(std::shared_ptr<const FieldTransport> field){
+    field_ = std::move(field);
+}
+
+const FieldTransport* Geometry::GetField() const {return field_.get();}
+
+Surface& Geometry::GetSurface(const size_t wall_id){
+    return origin_ ? origin_->GetSurface(wall_id) : *walls_[wall_id];
+}
+
+const std::vector<std::unique_ptr<Surface>>& Geometry::GetSurfaces() const {
+    return origin_ ? origin_->walls_ : walls_;
+}
+
+size_t Geometry::GetSurfaceNum() const {return GetSurfaces().size();}
+
+size_t Geometry::GetInstanceNum() const {return instances_.size();}
+
+void CrossBoundary(const Surface& boundary, const SurfaceHit& hit, Vec3& pos, Vec3& dir){
+    const Vec3& normal = hit.normal_;
+    if(boundary.GetBoundaryType() == BoundaryType::PERIODIC){
+        //paired face has the opposite normal
+        pos = OffsetPointAlongNormal(hit.point_ + boundary.GetPeriodicShift(),
+                                     normal.Times(-1.0));
+    } else {
+        dir = dir - normal.Times(2.0*dir.Dot(normal));
+        pos = OffsetPointAlongNormal(hit.point_, normal);
+    }
+}
@@ -1,4 +1,7 @@
-﻿#include "loader.hpp"
+﻿#include <algorithm>
+#include <ctime>
+
+#include "loader.hpp"
 
 using json = nlohmann::json;
 
@@ -14,34 +17,110 @@ json load_json_config(const std::string& file_name){
 }
 
 Background load_background(const json& json_data){
-    return {json_data["gas"]["sigma"].get<double>(),
-            json_data["gas"]["temperature"].get<double>(),
-            json_data["gas"]["pressure"].get<double>()};
+    const json& gas = json_data["gas"];
+    if(!gas.contains("species")){
+        return {gas["sigma"].get<double>(),
+                gas["temperature"].get<double>(),
+                gas["pressure"].get<double>()};
+    }
+    if(gas.contains("sigma") || gas.contains("pressure")){
+        fprintf(stderr, "gas: sigma and pressure are given for each species of the mixture\n");
+        exit(1);
+    }
+    std::vector<GasSpecies> species;
+    for(const auto& el : gas["species"]){
+        species.push_back({el["name"].get<std::string>(), el["sigma"].get<double>(),
+                           el["pressure"].get<double>()});
+    }
+    auto mixture = std::make_shared<const GasMixture>(std::move(species));
+    return {mixture->GetMeanSigma(), gas["temperature"].get<double>(),
+            mixture->GetPressure(), mixture};
 }
 
-std::unique_ptr<Surface> read_surface_parameters(const json& this_surf_data){
-    std::string name = this_surf_data["name"].get<std::string>();
-    std::vector<Vec3> contour;
-    for(const auto& el : this_surf_data["contour"]){
-        contour.push_back(Vec3(el.get<std::vector<double>>()));
+OutputSettings load_output_settings(const json& json_data){
+    OutputSettings settings;
+    settings.config_hash_ = CalcConfigHash(json_data.dump());
+    const json& general = json_data["general"];
+    if(general.contains("output_format")){
+        settings.format_ = general["output_format"].get<std::string>();
     }
+    if(settings.format_ != "text" && settings.format_ != "columnar"){
+        fprintf(stderr, "unknown output format %s\n", settings.format_.c_str());
+        exit(1);
+    }
+    if(!general.contains("columnar")){
+        return settings;
+    }
+    const json& columnar = general["columnar"];
+    if(columnar.contains("compression")){
+        std::string codec = columnar["compression"].get<std::string>();
+        if(codec != "none" && codec != "zlib"){
+            fprintf(stderr, "unknown compression %s\n", codec.c_str());
+            exit(1);
+        }
+        settings.compress_ = codec == "zlib";
+        if(settings.compress_ && !IsCompressionAvailable()){
+            fprintf(stderr, "zlib compression is not available in this build\n");
+            exit(1);
+        }
+    }
+    if(columnar.contains("block_records")){
+        settings.block_records_ = columnar["block_records"].get<size_t>();
+        if(settings.block_records_ < 1){
+            fprintf(stderr, "block_records should be positive\n");
+            exit(1);
+        }
+    }
+    if(columnar.contains("columns")){
+        for(const auto& [col_name, val] : columnar["columns"].items()){
+            auto it = std::find_if(kColumnNames.begin(), kColumnNames.end(),
+                               [&col_name](const char* n){return col_name == n;});
+            if(it == kColumnNames.end()){
+                fprintf(stderr, "unknown column %s\n", col_name.c_str());
+                exit(1);
+            }
+            size_t idx = static_cast<size_t>(it - kColumnNames.begin());
+            ColumnType type = ParseColumnType(val.get<std::string>());
+            bool is_float = type == ColumnType::F32 || type == ColumnType::F64;
+            if(is_float != (idx < 6)){
+                fprintf(stderr, "wrong type for column %s\n", col_name.c_str());
+                exit(1);
+            }
+            settings.column_types_[idx] = type;
+        }
+    }
+    return settings;
+}
+
+std::unique_ptr<Reflector> read_reflector(const json& this_surf_data){
     std::string ref_type = this_surf_data["reflector_type"].get<std::string>();
-    double R = this_surf_data["reflection_coefficient"].get<double>();
-    bool stat_flag = this_surf_data["collect_statistics"].get<bool>();
-    std::ofstream out_file;
-    if(stat_flag){
-        out_file.open(name, std::ios_base::app);
-        if(!out_file.is_open()){fprintf(stderr, "could not open file\n"); exit(1);}
+    if(ref_type == "periodic" || ref_type == "symmetry"){
+        //particles cross boundaries without reflection
+        return nullptr;
     }
+    double R = this_surf_data["reflection_coefficient"].get<double>();
     if(ref_type == "mirror"){
-        return std::make_unique<Surface>(std::move(contour),
-                   std::make_unique<MirrorReflector>(R),
-                   std::move(out_file));
+        return std::make_unique<MirrorReflector>(R);
     }
     else if (ref_type == "cosine"){
-        return std::make_unique<Surface>(std::move(contour),
-              std::make_unique<LambertianReflector>(R),
-                  std::move(out_file));
+        return std::make_unique<LambertianReflector>(R);
+    }
+    else if (ref_type == "secondary_emission"){
+        const json& data = this_surf_data["secondary_emission"];
+        SecondaryYield yield{data["max_yield"].get<double>(),
+                             data["max_yield_energy"].get<double>(),
+                             data.contains("threshold_energy") ?
+                                data["threshold_energy"].get<double>() : 0.0,
+                             data.contains("smoothness") ?
+                                data["smoothness"].get<double>() : 1.0,
+                             data.contains("emission_energy") ?
+                                data["emission_energy"].get<double>() : 4.0};
+        if(yield.max_yield_energy_ <= yield.threshold_energy_ || yield.emission_energy_ <= 0){
+            fprintf(stderr, "secondary_emission: max_yield_energy should be above "
+                            "threshold_energy, emission_energy should be positive\n");
+            exit(1);
+        }
+        return std::make_unique<SecondaryEmissionReflector>(R, yield);
     }
     else {
         fprintf(stderr, "unknown reflector type %s", ref_type.c_str());
@@ -49,22 +128,208 @@ std::unique_ptr<Surface> read_surface_parameters(const json& this_surf_data){
     }
 }
 
-std::vector<std::unique_ptr<Surface>> load_geometry(const json& json_data){
+QuadricSide read_quadric_side(const json& this_surf_data){
+    std::string side = "inside";
+    if(this_surf_data.contains("side")){
+        side = this_surf_data["side"].get<std::string>();
+    }
+    if(side == "inside"){
+        return QuadricSide::INSIDE;
+    }
+    else if(side == "outside"){
+        return QuadricSide::OUTSIDE;
+    }
+    fprintf(stderr, "unknown side %s for surface %s\n", side.c_str(),
+            this_surf_data["name"].get<std::string>().c_str());
+    exit(1);
+}
+
+std::unique_ptr<Surface> read_surface_parameters(const json& this_surf_data,
+                                                 const OutputSettings& settings){
+    std::string name = this_surf_data["name"].get<std::string>();
+    std::string ref_type = this_surf_data["reflector_type"].get<std::string>();
+    bool stat_flag = this_surf_data["collect_statistics"].get<bool>();
+    BoundaryType boundary = BoundaryType::WALL;
+    Vec3 periodic_shift;
+    if(ref_type == "periodic"){
+        boundary = BoundaryType::PERIODIC;
+        periodic_shift = Vec3(this_surf_data["periodic_shift"].get<std::vector<double>>());
+    }
+    else if(ref_type == "symmetry"){
+        boundary = BoundaryType::SYMMETRY;
+    }
+    if(boundary != BoundaryType::WALL && stat_flag){
+        fprintf(stderr, "boundary surface %s cannot collect statistics\n", name.c_str());
+        exit(1);
+    }
+    std::unique_ptr<ParticleWriter> writer;
+    if(stat_flag && settings.file_mode_ != FileMode::NONE){
+        bool is_columnar = settings.format_ == "columnar";
+        std::ios_base::openmode open_mode = settings.file_mode_ == FileMode::APPEND ?
+                    std::ios_base::app : std::ios_base::out | std::ios_base::trunc;
+        std::ofstream out_file;
+        out_file.open(name, is_columnar ? open_mode | std::ios_base::binary : open_mode);
+        if(!out_file.is_open()){fprintf(stderr, "could not open file\n"); exit(1);}
+        if(is_columnar){
+            writer = std::make_unique<ColumnarWriter>(std::move(out_file), settings);
+        } else {
+            writer = std::make_unique<TextWriter>(std::move(out_file));
+        }
+    }
+    auto surface = read_surface_shape(this_surf_data, read_reflector(this_surf_data),
+                                      std::move(writer));
+    surface->SetBoundary(boundary, periodic_shift);
+    return surface;
+}
+
+std::unique_ptr<Surface> read_surface_shape(const json& this_surf_data,
+                                            std::unique_ptr<Reflector>&& reflector,
+                                            std::unique_ptr<ParticleWriter>&& writer){
+    std::string type = "polygon";
+    if(this_surf_data.contains("type")){
+        type = this_surf_data["type"].get<std::string>();
+    }
+    if(type == "polygon"){
+        std::vector<Vec3> contour;
+        for(const auto& el : this_surf_data["contour"]){
+            contour.push_back(Vec3(el.get<std::vector<double>>()));
+        }
+        if(AxisAlignedRect::IsAxisAlignedRect(contour)){
+            return std::make_unique<AxisAlignedRect>(std::move(contour),
+                                                std::move(reflector), std::move(writer));
+        }
+        return std::make_unique<PolygonSurface>(std::move(contour),
+                                                std::move(reflector), std::move(writer));
+    }
+    Vec3 center(this_surf_data["center"].get<std::vector<double>>());
+    if(type == "sphere"){
+        return std::make_unique<SphereSurface>(center,
+                    this_surf_data["radius"].get<double>(),
+                    read_quadric_side(this_surf_data),
+                    std::move(reflector), std::move(writer));
+    }
+    else if(type == "cylinder"){
+        return std::make_unique<CylinderSurface>(center,
+                    Vec3(this_surf_data["axis"].get<std::vector<double>>()),
+                    this_surf_data["radius"].get<double>(),
+                    this_surf_data["height"].get<double>(),
+                    read_quadric_side(this_surf_data),
+                    std::move(reflector), std::move(writer));
+    }
+    else if(type == "cone"){
+        return std::make_unique<ConeSurface>(center,
+                    Vec3(this_surf_data["axis"].get<std::vector<double>>()),
+                    this_surf_data["base_radius"].get<double>(),
+                    this_surf_data["top_radius"].get<double>(),
+                    this_surf_data["height"].get<double>(),
+                    read_quadric_side(this_surf_data),
+                    std::move(reflector), std::move(writer));
+    }
+    else if(type == "disk"){
+        double inner_radius = 0;
+        if(this_surf_data.contains("inner_radius")){
+            inner_radius = this_surf_data["inner_radius"].get<double>();
+        }
+        return std::make_unique<DiskSurface>(center,
+                    Vec3(this_surf_data["normal"].get<std::vector<double>>()),
+                    this_surf_data["radius"].get<double>(), inner_radius,
+                    std::move(reflector), std::move(writer));
+    }
+    fprintf(stderr, "unknown surface type %s\n", type.c_str());
+    exit(1);
+}
+
+std::vector<std::unique_ptr<Surface>> read_surface_list(const json& surf_list,
+                                            const OutputSettings& settings){
     std::vector<std::unique_ptr<Surface>> walls;
-    for(const auto& el : json_data["geometry"]){
-        walls.push_back(read_surface_parameters(el));
+    for(const auto& el : surf_list){
+        walls.push_back(read_surface_parameters(el, settings));
+    }
+    return walls;
+}
+
+RigidTransform read_transform(const json& instance_data){
+    Vec3 shift;
+    if(instance_data.contains("shift")){
+        shift = Vec3(instance_data["shift"].get<std::vector<double>>());
+    }
+    if(!instance_data.contains("rotation_axis")){
+        return RigidTransform(shift, Vec3(0.0, 0.0, 1.0), 0.0);
+    }
+    double angle = instance_data["rotation_angle"].get<double>()*M_PI/180;
+    return RigidTransform(shift,
+                Vec3(instance_data["rotation_axis"].get<std::vector<double>>()), angle);
+}
+
+Geometry load_geometry(const json& json_data, const FileMode mode){
+    OutputSettings settings = load_output_settings(json_data);
+    settings.file_mode_ = mode;
+    Geometry geo(read_surface_list(json_data["geometry"], settings));
+    std::vector<std::string> prototype_names;
+    if(json_data.contains("prototypes")){
+        for(const auto& el : json_data["prototypes"]){
+            prototype_names.push_back(el["name"].get<std::string>());
+            auto surfaces = read_surface_list(el["surfaces"], settings);
+            for(const auto& s : surfaces){
+                if(s->GetBoundaryType() != BoundaryType::WALL){
+                    fprintf(stderr, "prototype %s: boundary surfaces are allowed"
+                            " only at the top level\n", prototype_names.back().c_str());
+                    exit(1);
+                }
+            }
+            geo.AddPrototype(std::move(surfaces));
+        }
+    }
+    if(json_data.contains("instances")){
+        for(const auto& el : json_data["instances"]){
+            std::string name = el["prototype"].get<std::string>();
+            auto it = std::find(prototype_names.begin(), prototype_names.end(), name);
+            if(it == prototype_names.end()){
+                fprintf(stderr, "unknown prototype %s\n", name.c_str());
+                exit(1);
+            }
+            size_t prototype = static_cast<size_t>(it - prototype_names.begin());
+            RigidTransform transform = read_transform(el);
+            //optional regular array of copies shifted by step
+            std::vector<size_t> repeat {1, 1, 1};
+            Vec3 step;
+            if(el.contains("repeat")){
+                repeat = el["repeat"].get<std::vector<size_t>>();
+                step = Vec3(el["step"].get<std::vector<double>>());
+            }
+            for(size_t i=0; i<repeat[0]; i++){
+                for(size_t j=0; j<repeat[1]; j++){
+                    for(size_t k=0; k<repeat[2]; k++){
+                        Vec3 shift(static_cast<double>(i)*step.GetX(),
+                                   static_cast<double>(j)*step.GetY(),
+                                   static_cast<double>(k)*step.GetZ());
+                        geo.AddInstance(prototype, transform.Shifted(shift));
+                    }
+                }
+            }
+        }
+    }
+    geo.BuildInstanceTree();
+    std::string precision = "double";
+    if(json_data["general"].contains("precision")){
+        precision = json_data["general"]["precision"].get<std::string>();
+    }
+    if(precision != "double" && precision != "mixed"){
+        fprintf(stderr, "unknown precision %s\n", precision.c_str());
+        exit(1);
     }
-    if(!check_surface_orientations(walls)){
+    geo.SetMixedPrecision(precision == "mixed");
+    if(!geo.CheckOrientations()){
         fprintf(stderr, "Some surfaces has bad orientation. check contour numeration\n");
         exit(1);
     }
-    return walls;
+    return geo;
 }
 
 bool check_surface_orientations(const std::vector<std::unique_ptr<Surface>>& geo){
     for(const auto& s : geo){
-        auto point = s->GetMassCenter();
-        auto direction = s->GetNormal();
+        auto point = s->GetReferencePoint();
+        auto direction = s->GetNormalAt(point);
         auto found_crossetion = false;
         for(const auto& other_s : geo){
             if(other_s->GetCrossPoint(point, direction))
@@ -76,3 +341,361 @@ bool check_surface_orientations(const std::vector<std::unique_ptr<Surface>>& geo
     return true;
 }
 
+std::vector<std::string> load_surface_names(const json& json_data){
+    //same order as wall ids in Geometry: top level surfaces, then prototypes
+    std::vector<std::string> names;
+    for(const auto& el : json_data["geometry"]){
+        names.push_back(el["name"].get<std::string>());
+    }
+    if(json_data.contains("prototypes")){
+        for(const auto& prototype : json_data["prototypes"]){
+            for(const auto& el : prototype["surfaces"]){
+                names.push_back(el["name"].get<std::string>());
+            }
+        }
+    }
+    return names;
+}
+
+std::vector<SweepPoint> load_sweep_points(const json& json_data,
+                                const Background& gas,
+                                const std::vector<std::unique_ptr<Surface>>& walls){
+    std::vector<SweepPoint> points;
+    if(!json_data.contains("sweep")){
+        return points;
+    }
+    std::vector<std::string> names = load_surface_names(json_data);
+    std::vector<double> nominal_R;
+    for(const auto& s : walls){
+        nominal_R.push_back(s->GetBoundaryType() == BoundaryType::WALL ?
+                                s->GetReflector()->GetReflectionCoefficient() : 0.0);
+    }
+    for(const auto& el : json_data["sweep"]["points"]){
+        SweepPoint point{el["name"].get<std::string>(), gas.p_, nominal_R};
+        if(el.contains("pressure")){
+            point.p_ = el["pressure"].get<double>();
+        }
+        if(point.p_ != gas.p_ && gas.p_ == 0.0){
+            fprintf(stderr, "sweep point %s: cannot reweight from zero pressure\n",
+                    point.name_.c_str());
+            exit(1);
+        }
+        if(el.contains("reflection_coefficients")){
+            for(const auto& [surf_name, val] : el["reflection_coefficients"].items()){
+                auto it = std::find(names.begin(), names.end(), surf_name);
+                if(it == names.end()){
+                    fprintf(stderr, "sweep point %s: unknown surface %s\n",
+                            point.name_.c_str(), surf_name.c_str());
+                    exit(1);
+                }
+                size_t idx = static_cast<size_t>(it - names.begin());
+                double R = val.get<double>();
+                if(R != nominal_R[idx] &&
+                        (nominal_R[idx] == 0.0 || nominal_R[idx] == 1.0)){
+                    fprintf(stderr, "sweep point %s: nominal reflection coefficient"
+                            " of %s should be in (0, 1) for reweighting\n",
+                            point.name_.c_str(), surf_name.c_str());
+                    exit(1);
+                }
+                point.R_[idx] = R;
+            }
+        }
+        points.push_back(std::move(point));
+    }
+    return points;
+}
+
+std::optional<VoxelGrid> load_voxel_grid(const json& json_data){
+    if(!json_data.contains("voxel_tally")){
+        return std::nullopt;
+    }
+    const json& data = json_data["voxel_tally"];
+    VoxelGrid grid{Vec3(data["min"].get<std::vector<double>>()),
+                   Vec3(data["max"].get<std::vector<double>>()),
+                   {}};
+    std::vector<size_t> bins = data["bins"].get<std::vector<size_t>>();
+    if(bins.size() != 3){
+        fprintf(stderr, "voxel_tally: bins should have 3 values\n");
+        exit(1);
+    }
+    for(int k=0; k<3; k++){
+        size_t idx = static_cast<size_t>(k);
+        if(bins[idx] == 0 || grid.max_[k] <= grid.min_[k]){
+            fprintf(stderr, "voxel_tally: empty grid along axis %d\n", k);
+            exit(1);
+        }
+        grid.bins_[idx] = bins[idx];
+    }
+    return grid;
+}
+
+double load_particle_speed(const json& json_data){
+    const json& data = json_data["particles"];
+    if(data.contains("speed")){
+        return data["speed"].get<double>();
+    }
+    if(data.contains("energy")){
+        //electron with the given energy in eV
+        return ElectronSpeed(data["energy"].get<double>());
+    }
+    return 0.0;
+}
+
+ParticleSource load_particle_source(const json& json_data){
+    const json& data = json_data["particles"];
+    ParticleSource source;
+    source.point_ = Vec3(data["source_point"].get<std::vector<double>>());
+    source.direction_ = Vec3(data["direction"].get<std::vector<double>>());
+    source.is_dir_random_ = data["is_dir_random"].get<bool>();
+    source.speed_ = load_particle_speed(json_data);
+    return source;
+}
+
+std::optional<TimeBins> load_time_bins(const json& json_data){
+    if(!json_data.contains("time_tally")){
+        return std::nullopt;
+    }
+    const json& data = json_data["time_tally"];
+    TimeBins bins{data["max_time"].get<double>(), data["bins"].get<size_t>()};
+    if(bins.bin_num_ == 0 || bins.t_max_ <= 0){
+        fprintf(stderr, "time_tally: max_time and bins should be positive\n");
+        exit(1);
+    }
+    if(load_particle_speed(json_data) <= 0){
+        fprintf(stderr, "time_tally: particles speed or energy should be given\n");
+        exit(1);
+    }
+    return bins;
+}
+
+std::vector<Detector> load_detectors(const json& json_data){
+    std::vector<Detector> detectors;
+    if(!json_data.contains("detectors")){
+        return detectors;
+    }
+    if(json_data.contains("field")){
+        fprintf(stderr, "detectors: straight flights only, field is not supported\n");
+        exit(1);
+    }
+    for(const auto& el : json_data["detectors"]["list"]){
+        Detector det{el["name"].get<std::string>(),
+                     Vec3(el["point"].get<std::vector<double>>()),
+                     el["area"].get<double>(), std::nullopt};
+        if(el.contains("normal")){
+            det.normal_ = Vec3(el["normal"].get<std::vector<double>>());
+            if(det.normal_->Length() == 0.0){
+                fprintf(stderr, "detector %s: zero normal\n", det.name_.c_str());
+                exit(1);
+            }
+        }
+        detectors.push_back(std::move(det));
+    }
+    if(detectors.empty()){
+        fprintf(stderr, "detectors: the list is empty\n");
+        exit(1);
+    }
+    return detectors;
+}
+
+std::shared_ptr<const FieldTransport> load_field(const json& json_data){
+    if(!json_data.contains("field")){
+        return nullptr;
+    }
+    const json& data = json_data["field"];
+    std::string type = data["type"].get<std::string>();
+    FieldStepping stepping;
+    std::unique_ptr<FieldMap> map;
+    if(type == "uniform"){
+        map = std::make_unique<UniformField>(
+                data.contains("E") ? Vec3(data["E"].get<std::vector<double>>()) : Vec3(),
+                data.contains("B") ? Vec3(data["B"].get<std::vector<double>>()) : Vec3());
+    } else if(type == "grid"){
+        std::string file_name = data["file"].get<std::string>();
+        Vec3 cell(data["cell"].get<std::vector<double>>());
+        std::vector<size_t> nodes = data["nodes"].get<std::vector<size_t>>();
+        if(nodes.size() != 3){
+            fprintf(stderr, "field: nodes should have 3 values\n");
+            exit(1);
+        }
+        //lines "Ex Ey Ez Bx By Bz" for every node, x index changes first
+        std::ifstream file(file_name);
+        if(!file.is_open()){
+            fprintf(stderr, "field: file %s cannot be open\n", file_name.c_str());
+            exit(1);
+        }
+        std::vector<Vec3> E;
+        std::vector<Vec3> B;
+        double v[6];
+        while(file >> v[0] >> v[1] >> v[2] >> v[3] >> v[4] >> v[5]){
+            E.emplace_back(v[0], v[1], v[2]);
+            B.emplace_back(v[3], v[4], v[5]);
+        }
+        map = std::make_unique<GridField>(Vec3(data["origin"].get<std::vector<double>>()), cell,
+                                          std::array<size_t, 3>{nodes[0], nodes[1], nodes[2]},
+                                          E, B);
+        //a step should not jump over the cell
+        stepping.max_step_ = std::min({cell[0], cell[1], cell[2]});
+    } else {
+        fprintf(stderr, "field: unknown type %s\n", type.c_str());
+        exit(1);
+    }
+    if(data.contains("max_angle")){
+        stepping.max_angle_ = data["max_angle"].get<double>();
+    }
+    if(data.contains("max_speed_change")){
+        stepping.max_speed_change_ = data["max_speed_change"].get<double>();
+    }
+    if(data.contains("max_step")){
+        stepping.max_step_ = data["max_step"].get<double>();
+    }
+    if(data.contains("max_substeps")){
+        stepping.max_substeps_ = data["max_substeps"].get<size_t>();
+    }
+    if(data.contains("charge_to_mass")){
+        stepping.charge_to_mass_ = data["charge_to_mass"].get<double>();
+    }
+    if(stepping.max_angle_ <= 0 || stepping.max_speed_change_ <= 0 ||
+       stepping.max_step_ <= 0 || stepping.max_substeps_ == 0){
+        fprintf(stderr, "field: step limits should be positive\n");
+        exit(1);
+    }
+    if(load_particle_speed(json_data) <= 0){
+        fprintf(stderr, "field: particles speed or energy should be given\n");
+        exit(1);
+    }
+    return std::make_shared<const FieldTransport>(std::move(map), stepping);
+}
+
+Simulation load_simulation(const json& json_data, const FileMode mode){
+    Background gas = load_background(json_data);
+    const json& general = json_data["general"];
+    size_t thread_num = general["number_of_threads"].get<size_t>();
+    unsigned seed = general.contains("seed") ? general["seed"].get<unsigned>() :
+                                              static_cast<unsigned>(time(0));
+    Simulation sim(load_geometry(json_data, mode), gas, thread_num, seed);
+    bool is_pinned = general.contains("pin_threads") && general["pin_threads"].get<bool>();
+    bool is_replicated = general.contains("numa_replicas") &&
+                         general["numa_replicas"].get<bool>();
+    if(is_replicated && !is_pinned){
+        fprintf(stderr, "general: numa_replicas needs pin_threads\n");
+        exit(1);
+    }
+    sim.SetThreadPlacement(is_pinned, is_replicated);
+    sim.GetGeometry().SetField(load_field(json_data));
+    if(general.contains("secondary_stack_size") || general.contains("secondary_history_limit")){
+        sim.SetSecondaryLimits(general.contains("secondary_stack_size") ?
+                                   general["secondary_stack_size"].get<size_t>() : 1 << 16,
+                               general.contains("secondary_history_limit") ?
+                                   general["secondary_history_limit"].get<size_t>() : 1 << 20);
+    }
+    for(const auto& wall : sim.GetGeometry().GetSurfaces()){
+        if(wall->GetBoundaryType() == BoundaryType::WALL && wall->GetReflector()->IsEmitting() &&
+                load_particle_speed(json_data) <= 0){
+            fprintf(stderr, "secondary_emission: particles speed or energy should be given\n");
+            exit(1);
+        }
+    }
+    std::vector<SweepPoint> sweep_points = load_sweep_points(json_data, gas,
+                                                sim.GetGeometry().GetSurfaces());
+    if(!sweep_points.empty()){
+        sim.SetSweepPoints(std::move(sweep_points));
+    }
+    std::optional<VoxelGrid> voxel_grid = load_voxel_grid(json_data);
+    if(voxel_grid){
+        sim.SetVoxelGrid(voxel_grid.value());
+    }
+    std::optional<TimeBins> time_bins = load_time_bins(json_data);
+    if(time_bins){
+        sim.SetTimeBins(time_bins.value());
+    }
+    std::vector<Detector> detectors = load_detectors(json_data);
+    if(!detectors.empty()){
+        sim.SetDetectors(std::move(detectors));
+    }
+    return sim;
+}
+
+std::optional<StopCriteria> load_stop_criteria(const json& json_data){
+    if(!json_data.contains("stopping")){
+        return std::nullopt;
+    }
+    const json& data = json_data["stopping"];
+    StopCriteria criteria;
+    criteria.rel_error_ = data["relative_error"].get<double>();
+    if(data.contains("batch_size")){
+        criteria.batch_size_ = data["batch_size"].get<size_t>();
+    }
+    if(data.contains("min_batches")){
+        criteria.min_batches_ = std::max<size_t>(data["min_batches"].get<size_t>(), 2);
+    }
+    if(data.contains("max_time")){
+        criteria.max_time_ = data["max_time"].get<double>();
+    }
+    if(data.contains("max_particles")){
+        criteria.max_particles_ = data["max_particles"].get<size_t>();
+    }
+    if(!data.contains("max_time") && !data.contains("max_particles")){
+        fprintf(stderr, "stopping: max_time or max_particles should be given\n");
+        exit(1);
+    }
+    if(data.contains("min_count")){
+        criteria.min_count_ = data["min_count"].get<size_t>();
+    }
+    if(data.contains("targets")){
+        auto targets = data["targets"].get<std::vector<std::string>>();
+        auto has = [&targets](const char* name){
+            return std::find(targets.begin(), targets.end(), name) != targets.end();
+        };
+        for(const auto& name : targets){
+            if(name != "absorption" && name != "time" && name != "voxel"){
+                fprintf(stderr, "stopping: unknown target %s\n", name.c_str());
+                exit(1);
+            }
+        }
+        criteria.is_time_targeted_ = has("time");
+        criteria.is_voxel_targeted_ = has("voxel");
+    }
+    if(criteria.batch_size_ == 0 || criteria.rel_error_ <= 0){
+        fprintf(stderr, "stopping: batch_size and relative_error should be positive\n");
+        exit(1);
+    }
+    if(criteria.max_particles_ < criteria.batch_size_){
+        fprintf(stderr, "stopping: max_particles should not be less than batch_size\n");
+        exit(1);
+    }
+    return criteria;
+}
+
+std::optional<ViewFactorSettings> load_view_factor_settings(const json& json_data){
+    if(!json_data.contains("view_factor")){
+        return std::nullopt;
+    }
+    if(load_background(json_data).p_ != 0.0){
+        fprintf(stderr, "view_factor: gas pressure should be zero\n");
+        exit(1);
+    }
+    if(json_data.contains("field")){
+        fprintf(stderr, "view_factor: straight flights only, field is not supported\n");
+        exit(1);
+    }
+    const json& data = json_data["view_factor"];
+    const json& general = json_data["general"];
+    ViewFactorSettings settings{100000, 1000000, 0, ""};
+    if(data.contains("rays_per_wall")){
+        settings.rays_per_wall_ = data["rays_per_wall"].get<size_t>();
+    }
+    if(data.contains("source_rays")){
+        settings.source_rays_ = data["source_rays"].get<size_t>();
+    }
+    if(general.contains("seed")){
+        settings.seed_ = general["seed"].get<unsigned>();
+    }
+    if(data.contains("output")){
+        settings.output_ = data["output"].get<std::string>();
+    }
+    if(settings.rays_per_wall_ == 0 || settings.source_rays_ == 0){
+        fprintf(stderr, "view_factor: rays_per_wall and source_rays should be positive\n");
+        exit(1);
+    }
+    return settings;
+}
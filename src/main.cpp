@@ -5,20 +5,31 @@
 #include <nlohmann/json.hpp>
 #include <lyra/lyra.hpp>
 #include<fmt/core.h>
-#include <omp.h>
 
 #include "particle.hpp"
 #include "surface.hpp"
+#include "geometry.hpp"
 #include "math.hpp"
 #include "reflector.hpp"
 #include "loader.hpp"
+#include "sweep.hpp"
+#include "voxel.hpp"
+#include "time_tally.hpp"
+#include "simulation.hpp"
+#include "async_output.hpp"
+#include "view_factor.hpp"
+#include "manifest.hpp"
 
 int main(int argc, const char ** argv){
     std::string config_file = "NO_FILE_WAS_GIVEN";
     bool show_help = false;
+    size_t top_up = 0;
     auto cli = lyra::cli()
             | lyra::opt(config_file, "config")["-c"]["--config"]
                 ("Path to the json config file [no default value!]")
+            | lyra::opt(top_up, "N")["--top-up"]
+                ("Trace N more particles from unused random streams and merge "
+                 "them into the results of the run manifest")
             | lyra::help(show_help);
     auto cmd_parse = cli.parse({argc, argv});
     if(show_help){
@@ -30,45 +41,188 @@ int main(int argc, const char ** argv){
     }
 
     json json_data = load_json_config(config_file);
-    Background gas = load_background(json_data);
-    std::vector<std::unique_ptr<Surface>> walls = load_geometry(json_data);
-    std::for_each(walls.cbegin(), walls.cend(),
-                  [](const std::unique_ptr<Surface>& s){
-                                s->WriteFileHeader();
-                    });
-    size_t pt_num = json_data["particles"]["number"].get<size_t>();
-    Vec3 source_point(json_data["particles"]["source_point"].get<std::vector<double>>());
-    Vec3 direction(json_data["particles"]["direction"].get<std::vector<double>>());
-    bool is_dir_random = json_data["particles"]["is_dir_random"].get<bool>();
-
-
-    auto pt_generator = Particle::GetGenerator(is_dir_random);
-    //************MAIN CYLE******************
-    size_t thread_num = json_data["general"]["number_of_threads"].get<size_t>();
-    if(thread_num<1) {std::cerr << "Wrong thread number\n"; exit(1);}
-    omp_set_dynamic(0);
-    omp_set_num_threads(static_cast<int>(thread_num));
-    std::vector<size_t> thread_load(thread_num, pt_num/thread_num);
-    thread_load.back() += pt_num % thread_num;
-    #pragma omp parallel
-    {
-        size_t traced_pt_num = 0;
-        size_t tid = static_cast<size_t>(omp_get_thread_num());
-        std::mt19937 rnd_gen;
-        rnd_gen.seed(static_cast<uint>(time(0))+tid);
-        while(traced_pt_num<thread_load[tid]){
-            traced_pt_num += pt_generator(source_point, direction, rnd_gen)
-                    .Trace(walls, gas, rnd_gen);
-            #pragma omp master
-            {
-                if((traced_pt_num+1)%(thread_load[tid]/10)==0){
-                    std::cout << fmt::format("{:d} %\n",
-                    (100*(traced_pt_num+1))/thread_load[tid]);
-                }
+    std::optional<ViewFactorSettings> view_factor = load_view_factor_settings(json_data);
+    //surface files of a fresh run start empty, top-up appends to them and
+    //view factor mode does not write them at all
+    FileMode file_mode = view_factor ? FileMode::NONE :
+                         top_up > 0 ? FileMode::APPEND : FileMode::TRUNCATE;
+    Simulation sim = load_simulation(json_data, file_mode);
+    size_t thread_num = sim.GetThreadNum();
+    if(view_factor){
+        //collisionless limit: solve the wall to wall transfer instead of tracing
+        const Geometry& geo = sim.GetGeometry();
+        std::vector<double> reflection = GetLambertianCoefficients(geo);
+        ViewFactorMatrix matrix = EstimateViewFactors(geo, view_factor->rays_per_wall_,
+                                                      view_factor->seed_);
+        std::vector<double> first_hits = EstimateFirstHits(geo, {load_particle_source(json_data)},
+                                                           view_factor->source_rays_,
+                                                           view_factor->seed_);
+        std::vector<double> absorbed = matrix.SolveAbsorption(reflection, first_hits);
+        std::vector<std::string> names = load_surface_names(json_data);
+        std::cout << "#SURFACE\tFRACTION\n";
+        for(size_t i=0; i<names.size(); i++){
+            std::cout << fmt::format("{}\t{:.6e}\n", names[i], absorbed[i]);
+        }
+        if(!view_factor->output_.empty()){
+            std::ofstream out(view_factor->output_);
+            if(!out.is_open()){
+                fprintf(stderr, "could not open file %s\n", view_factor->output_.c_str());
+                exit(1);
             }
+            matrix.WriteResults(out, names);
+        }
+        return 0;
+    }
+    const json& general = json_data["general"];
+    std::string manifest_file = general.contains("manifest") ?
+                general["manifest"].get<std::string>() : "run_manifest.json";
+    uint64_t config_hash = CalcPhysicsHash(json_data);
+    std::optional<RunManifest> saved;
+    const std::vector<std::unique_ptr<Surface>>& walls = sim.GetGeometry().GetSurfaces();
+    if(top_up > 0){
+        std::ifstream in(manifest_file);
+        if(!in.is_open()){
+            fprintf(stderr, "could not open manifest %s\n", manifest_file.c_str());
+            exit(1);
+        }
+        std::vector<Detector> detectors = load_detectors(json_data);
+        saved = ReadManifest(in, detectors.empty() ? std::nullopt :
+                std::make_optional<DetectorTally>(std::move(detectors), sim.GetBackground()));
+        if(saved->config_hash_ != config_hash){
+            fprintf(stderr, "config was changed after the manifest %s was written\n",
+                    manifest_file.c_str());
+            exit(1);
+        }
+        if(json_data.contains("sweep")){
+            fprintf(stderr, "top-up: sweep tallies are not kept in the manifest\n");
+            exit(1);
+        }
+        //surface files already have the headers, new particles are appended
+        sim.SetRandomStreams(saved->seed_, saved->GetNextStream());
+    } else {
+        std::for_each(walls.cbegin(), walls.cend(),
+                      [](const std::unique_ptr<Surface>& s){
+                                    s->WriteFileHeader();
+                        });
+    }
+    ParticleSource source = load_particle_source(json_data);
+    //top-up traces the given number of particles
+    std::optional<StopCriteria> criteria = top_up > 0 ? std::nullopt :
+                                           load_stop_criteria(json_data);
+    if(criteria){
+        sim.SetBatchCallback([](size_t batch, double rel_error){
+                                std::cout << fmt::format("batch {:d}: max relative error {:.3e}\n",
+                                                         batch, rel_error);
+                            });
+    } else {
+        sim.SetProgressCallback([](size_t percent){
+                                std::cout << fmt::format("{:d} %\n", percent);
+                            });
+    }
+    std::unique_ptr<AsyncWriter> async_writer;
+    if(general.contains("async_output") && general["async_output"].get<bool>()){
+        size_t dump_size = general.contains("particle_dump_size") ?
+                    general["particle_dump_size"].get<size_t>() : 500;
+        size_t queue_depth = general.contains("async_queue_depth") ?
+                    general["async_queue_depth"].get<size_t>() : 4;
+        async_writer = std::make_unique<AsyncWriter>(thread_num, dump_size,
+                                                     queue_depth);
+        for(auto& s : walls){
+            s->SetAsyncWriter(async_writer.get());
+        }
+        async_writer->Start();
+    }
+    std::optional<AdaptiveResult> adaptive;
+    if(criteria){
+        adaptive = sim.RunAdaptive({source}, criteria.value());
+    }
+    RunResult result = adaptive ? std::move(adaptive->total_) :
+            sim.Run({source}, top_up > 0 ? top_up :
+                              json_data["particles"]["number"].get<size_t>());
+    RunManifest manifest{config_hash, sim.GetSeed(), {}, result};
+    if(saved){
+        std::cout << fmt::format("Top-up: {:d} particles from streams {:d}-{:d}\n", top_up,
+                                 sim.GetFirstStream(), sim.GetFirstStream() + thread_num - 1);
+        manifest = std::move(saved.value());
+        manifest.result_.Merge(result);
+        result = manifest.result_;
+    }
+    manifest.streams_.push_back({sim.GetFirstStream(), sim.GetFirstStream() + thread_num});
+    std::cout << fmt::format("Lost particles: {:d}\n", result.lost_num_);
+    if(result.secondary_num_ + result.dropped_num_ > 0){
+        std::cout << fmt::format("Secondary particles: {:d}, dropped: {:d}\n",
+                                 result.secondary_num_, result.dropped_num_);
+    }
+    if(const GasMixture* mixture = sim.GetBackground().mixture_.get()){
+        std::cout << "#SPECIES\tCOLLISIONS\n";
+        for(size_t i=0; i<mixture->GetSpeciesNum(); i++){
+            std::cout << fmt::format("{}\t{:d}\n", mixture->GetSpecies(i).name_,
+                                     result.absorbed_.GetSpeciesCounts()[i]);
+        }
+    }
+    WritePerfReports(std::cout, result.perf_);
+    std::vector<double> time_errors;
+    std::vector<double> voxel_errors;
+    if(adaptive){
+        std::cout << fmt::format("{} after {:d} batches, {:d} particles, {:.1f} s\n",
+                                 adaptive->is_converged_ ? "Converged" : "Not converged",
+                                 adaptive->absorbed_.GetBatchNum(), result.traced_num_,
+                                 adaptive->elapsed_);
+        std::vector<std::string> names = load_surface_names(json_data);
+        std::cout << "#SURFACE\tFRACTION\tERROR\n";
+        for(size_t i=0; i<names.size(); i++){
+            std::cout << fmt::format("{}\t{:.6e}\t{:.6e}\n", names[i],
+                                     adaptive->absorbed_.GetMean(i),
+                                     adaptive->absorbed_.GetError(i));
+        }
+        if(adaptive->time_) time_errors = adaptive->time_->GetErrors();
+        if(adaptive->voxel_) voxel_errors = adaptive->voxel_->GetErrors();
+    }
+    if(async_writer){
+        async_writer->Finish();
+    }
+    if(result.sweep_){
+        std::string sweep_file = json_data["sweep"]["output"].get<std::string>();
+        std::ofstream out(sweep_file);
+        if(!out.is_open()){
+            fprintf(stderr, "could not open file %s\n", sweep_file.c_str());
+            exit(1);
         }
+        result.sweep_->WriteResults(out, load_surface_names(json_data));
+    }
+    if(result.voxel_){
+        std::string voxel_file = json_data["voxel_tally"]["output"].get<std::string>();
+        std::ofstream out(voxel_file);
+        if(!out.is_open()){
+            fprintf(stderr, "could not open file %s\n", voxel_file.c_str());
+            exit(1);
+        }
+        result.voxel_->WriteResults(out, voxel_errors);
+    }
+    if(result.time_){
+        std::string time_file = json_data["time_tally"]["output"].get<std::string>();
+        std::ofstream out(time_file);
+        if(!out.is_open()){
+            fprintf(stderr, "could not open file %s\n", time_file.c_str());
+            exit(1);
+        }
+        result.time_->WriteResults(out, load_surface_names(json_data), time_errors);
+    }
+    if(result.detector_){
+        std::string detector_file = json_data["detectors"]["output"].get<std::string>();
+        std::ofstream out(detector_file);
+        if(!out.is_open()){
+            fprintf(stderr, "could not open file %s\n", detector_file.c_str());
+            exit(1);
+        }
+        result.detector_->WriteResults(out);
+    }
+    std::ofstream manifest_out(manifest_file);
+    if(!manifest_out.is_open()){
+        fprintf(stderr, "could not open file %s\n", manifest_file.c_str());
+        exit(1);
     }
-    //***********CYCLE END*******************
+    WriteManifest(manifest_out, manifest);
     return 0;
 }
 
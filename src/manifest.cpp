@@ -0,0 +1,120 @@
+﻿#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fmt/core.h>
+
+#include "manifest.hpp"
+#include "output.hpp"
+
+using json = nlohmann::json;
+
+size_t RunManifest::GetNextStream() const {
+    size_t next = 0;
+    for(const auto& range : streams_){
+        next = std::max(next, range.end_);
+    }
+    return next;
+}
+
+uint64_t CalcPhysicsHash(const json& config){
+    json physics = config;
+    for(const char* key : {"number_of_threads", "pin_threads", "numa_replicas",
+                           "async_output", "async_queue_depth", "particle_dump_size",
+                           "seed", "manifest"}){
+        physics["general"].erase(key);
+    }
+    physics["particles"].erase("number");
+    physics.erase("stopping");
+    return CalcConfigHash(physics.dump());
+}
+
+void WriteManifest(std::ostream& out, const RunManifest& manifest){
+    const RunResult& result = manifest.result_;
+    json data;
+    data["config_hash"] = fmt::format("{:016x}", manifest.config_hash_);
+    data["seed"] = manifest.seed_;
+    data["streams"] = json::array();
+    for(const auto& range : manifest.streams_){
+        data["streams"].push_back({range.first_, range.end_});
+    }
+    data["histories"] = result.traced_num_;
+    data["lost"] = result.lost_num_;
+    data["secondaries"] = result.secondary_num_;
+    data["dropped"] = result.dropped_num_;
+    data["absorbed"] = result.absorbed_.GetCounts();
+    data["flights"] = result.absorbed_.GetFlightNum();
+    if(!result.absorbed_.GetSpeciesCounts().empty()){
+        data["species_collisions"] = result.absorbed_.GetSpeciesCounts();
+    }
+    if(result.voxel_){
+        const VoxelGrid& grid = result.voxel_->GetGrid();
+        data["voxel"] = {{"min", {grid.min_[0], grid.min_[1], grid.min_[2]}},
+                         {"max", {grid.max_[0], grid.max_[1], grid.max_[2]}},
+                         {"bins", grid.bins_},
+                         {"histories", result.voxel_->GetHistoryNum()},
+                         {"track_length", result.voxel_->GetTrackLengths()},
+                         {"collisions", result.voxel_->GetCollisionCounts()}};
+    }
+    if(result.time_){
+        data["time"] = {{"max_time", result.time_->GetBins().t_max_},
+                        {"bins", result.time_->GetBins().bin_num_},
+                        {"histories", result.time_->GetHistoryNum()},
+                        {"counts", result.time_->GetCounts()}};
+    }
+    if(result.detector_){
+        data["detectors"] = {{"histories", result.detector_->GetHistoryNum()},
+                             {"sum", result.detector_->GetSums()},
+                             {"sum2", result.detector_->GetSquareSums()}};
+    }
+    out << data.dump(1) << "\n";
+}
+
+RunManifest ReadManifest(std::istream& in, const std::optional<DetectorTally>& detector){
+    json data = json::parse(in, nullptr, false);
+    if(data.is_discarded() || !data.contains("config_hash") || !data.contains("absorbed")){
+        fprintf(stderr, "manifest cannot be parsed\n");
+        exit(1);
+    }
+    std::vector<size_t> counts = data["absorbed"].get<std::vector<size_t>>();
+    std::vector<size_t> species_counts = data.contains("species_collisions") ?
+                data["species_collisions"].get<std::vector<size_t>>() : std::vector<size_t>();
+    RunManifest manifest{std::stoull(data["config_hash"].get<std::string>(), nullptr, 16),
+                         data["seed"].get<unsigned>(), {},
+                         RunResult{data["histories"].get<size_t>(), data["lost"].get<size_t>(),
+                                   AbsorptionCounter(counts.size(), species_counts.size()),
+                                   {}, {}, {}, {}, {},
+                                   data["secondaries"].get<size_t>(),
+                                   data["dropped"].get<size_t>()}};
+    for(const auto& range : data["streams"]){
+        manifest.streams_.push_back({range[0].get<size_t>(), range[1].get<size_t>()});
+    }
+    RunResult& result = manifest.result_;
+    result.absorbed_.AddCounts(counts, data["flights"].get<size_t>());
+    result.absorbed_.AddSpeciesCounts(species_counts);
+    if(data.contains("voxel")){
+        const json& voxel = data["voxel"];
+        std::vector<size_t> bins = voxel["bins"].get<std::vector<size_t>>();
+        result.voxel_.emplace(VoxelGrid{Vec3(voxel["min"].get<std::vector<double>>()),
+                                        Vec3(voxel["max"].get<std::vector<double>>()),
+                                        {bins.at(0), bins.at(1), bins.at(2)}});
+        result.voxel_->AddSums(voxel["track_length"].get<std::vector<double>>(),
+                               voxel["collisions"].get<std::vector<double>>(),
+                               voxel["histories"].get<size_t>());
+    }
+    if(data.contains("time")){
+        const json& time = data["time"];
+        result.time_.emplace(TimeBins{time["max_time"].get<double>(),
+                                      time["bins"].get<size_t>()}, counts.size());
+        result.time_->AddSums(time["counts"].get<std::vector<double>>(),
+                              time["histories"].get<size_t>());
+    }
+    if(data.contains("detectors") && detector){
+        const json& saved = data["detectors"];
+        result.detector_ = detector;
+        result.detector_->AddSums(saved["sum"].get<std::vector<double>>(),
+                                  saved["sum2"].get<std::vector<double>>(),
+                                  saved["histories"].get<size_t>());
+    }
+    return manifest;
+}
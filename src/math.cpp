@@ -1,125 +1,146 @@
 ﻿#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <vector>
 #include <random>
 #include <utility>
 
 #include "math.hpp"
 #include "surface.hpp"
-
-double Vec3::GetX() const {return x_;}
-double Vec3::GetY() const {return y_;}
-double Vec3::GetZ() const {return z_;}
-
-
-
-double Vec3::Dot(const Vec3 &rhs) const{
-    return x_*rhs.GetX() + y_*rhs.GetY() + z_*rhs.GetZ();
-}
-
-Vec3::Vec3(const Vec3 &start_point, const Vec3 &end_point){
-    x_ = end_point.GetX() - start_point.GetX();
-    y_ = end_point.GetY() - start_point.GetY();
-    z_ = end_point.GetZ() - start_point.GetZ();
+#include "gas.hpp"
+
+double Background::GetMeanFreePath() const {
+    return 1.38e-17*T_/(p_*sigma_);
+}
+
+size_t Background::GetSpeciesNum() const {
+    return mixture_ ? mixture_->GetSpeciesNum() : 0;
+}
+
+ShearedRay::ShearedRay(const Vec3& org, const Vec3& dir):
+    org_(org), dir_(dir){
+    double ax = std::fabs(dir.GetX());
+    double ay = std::fabs(dir.GetY());
+    double az = std::fabs(dir.GetZ());
+    kz_ = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+    kx_ = (kz_+1)%3;
+    ky_ = (kx_+1)%3;
+    Sx_ = dir[kx_]/dir[kz_];
+    Sy_ = dir[ky_]/dir[kz_];
+}
+
+Vec3 OffsetPointAlongNormal(const Vec3& point, const Vec3& normal){
+    //offset is done in integer ulps for large coordinates
+    //and in absolute value close to zero
+    constexpr double kOrigin = 1.0/32.0;
+    constexpr double kFloatScale = 1.0/35184372088832.0; //2^-45
+    constexpr double kIntScale = 256.0;
+    double res[3];
+    for(int i=0; i<3; i++){
+        double p = point[i];
+        double n = normal[i];
+        if(std::fabs(p) < kOrigin){
+            res[i] = p + kFloatScale*n;
+            continue;
+        }
+        int64_t offset = static_cast<int64_t>(kIntScale*n);
+        int64_t p_int;
+        memcpy(&p_int, &p, sizeof(p));
+        p_int += p < 0 ? -offset : offset;
+        memcpy(&res[i], &p_int, sizeof(p));
+    }
+    return {res[0], res[1], res[2]};
 }
 
-Vec3 Vec3::Cross(const Vec3& rhs) const{
-    return Vec3(y_*rhs.GetZ() - z_*rhs.GetY(),
-                  z_*rhs.GetX() - x_*rhs.GetZ(),
-                  x_*rhs.GetY() - y_*rhs.GetX());
+void BoundingBox::Extend(const Vec3& point){
+    min_ = {std::min(min_.GetX(), point.GetX()), std::min(min_.GetY(), point.GetY()),
+            std::min(min_.GetZ(), point.GetZ())};
+    max_ = {std::max(max_.GetX(), point.GetX()), std::max(max_.GetY(), point.GetY()),
+            std::max(max_.GetZ(), point.GetZ())};
 }
 
-
-
-double Vec3::Length2() const {return x_*x_ + y_*y_ + z_*z_;}
-double Vec3::Length() const {return sqrt(Length2());}
-
-Vec3& Vec3::Norm() {
-    double l = Length();
-    x_ /= l;
-    y_ /= l;
-    z_ /= l;
-    return *this;
+void BoundingBox::Extend(const BoundingBox& box){
+    Extend(box.min_);
+    Extend(box.max_);
 }
 
-Vec3 Vec3::Times(const double d) const{
-    return Vec3(x_*d, y_*d, z_*d);
+Vec3 BoundingBox::GetCenter() const {
+    return (min_ + max_).Times(0.5);
 }
 
-Vec3 Vec3::operator +(const Vec3& other) const {
-    return Vec3(this->x_ + other.x_,
-                this->y_ + other.y_,
-                this->z_ + other.z_);
+bool BoundingBox::IntersectRay(const Vec3& org, const Vec3& inv_dir,
+                               const double max_t, double& t_enter) const {
+    double t_min = 0.0;
+    double t_max = max_t;
+    for(int i=0; i<3; i++){
+        double t1 = (min_[i] - org[i])*inv_dir[i];
+        double t2 = (max_[i] - org[i])*inv_dir[i];
+        if(std::isnan(t1) || std::isnan(t2)){
+            //ray lies in the slab boundary plane
+            continue;
+        }
+        t_min = std::max(t_min, std::min(t1, t2));
+        t_max = std::min(t_max, std::max(t1, t2));
+    }
+    t_enter = t_min;
+    return t_min <= t_max;
+}
+
+RigidTransform::RigidTransform(const Vec3& shift, const Vec3& axis,
+                               const double angle): shift_(shift) {
+    //Rodrigues formula
+    Vec3 k = axis;
+    k.Norm();
+    double c = cos(angle);
+    double s = sin(angle);
+    double kv[3] = {k.GetX(), k.GetY(), k.GetZ()};
+    for(size_t i=0; i<3; i++){
+        for(size_t j=0; j<3; j++){
+            rot_[i][j] = (i == j ? c : 0.0) + (1 - c)*kv[i]*kv[j];
+        }
+    }
+    rot_[0][1] -= s*kv[2];
+    rot_[0][2] += s*kv[1];
+    rot_[1][0] += s*kv[2];
+    rot_[1][2] -= s*kv[0];
+    rot_[2][0] -= s*kv[1];
+    rot_[2][1] += s*kv[0];
 }
 
-Vec3 Vec3::operator -(const Vec3& other) const {
-    return Vec3(this->x_ - other.x_,
-                this->y_ - other.y_,
-                this->z_ - other.z_);
+Vec3 RigidTransform::DirToWorld(const Vec3& dir) const {
+    return {rot_[0][0]*dir.GetX() + rot_[0][1]*dir.GetY() + rot_[0][2]*dir.GetZ(),
+            rot_[1][0]*dir.GetX() + rot_[1][1]*dir.GetY() + rot_[1][2]*dir.GetZ(),
+            rot_[2][0]*dir.GetX() + rot_[2][1]*dir.GetY() + rot_[2][2]*dir.GetZ()};
 }
 
-bool Vec3::operator ==(const Vec3& other) const {
-    return this->x_==other.x_ && this->y_ == other.y_ && this->z_ == other.z_;
+Vec3 RigidTransform::DirToLocal(const Vec3& dir) const {
+    //inverse rotation is the transposed matrix
+    return {rot_[0][0]*dir.GetX() + rot_[1][0]*dir.GetY() + rot_[2][0]*dir.GetZ(),
+            rot_[0][1]*dir.GetX() + rot_[1][1]*dir.GetY() + rot_[2][1]*dir.GetZ(),
+            rot_[0][2]*dir.GetX() + rot_[1][2]*dir.GetY() + rot_[2][2]*dir.GetZ()};
 }
 
-bool Vec3::operator !=(const Vec3& other) const{
-    return this->x_!=other.x_ || this->y_ != other.y_ || this->z_ != other.z_;
+Vec3 RigidTransform::PointToWorld(const Vec3& point) const {
+    return DirToWorld(point) + shift_;
 }
 
-std::ostream& operator<<(std::ostream& out, const Vec3& vec){
-    out << vec.GetX() << "\t" << vec.GetY() << "\t" << vec.GetZ();
-    return out;
+Vec3 RigidTransform::PointToLocal(const Vec3& point) const {
+    return DirToLocal(point - shift_);
 }
 
-double Vec3::GetDistance(const Vec3& end) const {
-    return sqrt((x_-end.GetX())*(x_-end.GetX()) +
-                (y_-end.GetY())*(y_-end.GetY()) +
-                (z_-end.GetZ())*(z_-end.GetZ()));
+RigidTransform RigidTransform::Shifted(const Vec3& shift) const {
+    RigidTransform res = *this;
+    res.shift_ = shift_ + shift;
+    return res;
 }
 
-
-ONBasis_3x3::ONBasis_3x3(Vec3 i, Vec3 j,Vec3 k):
-    i_(std::move(i)), j_(std::move(j)), k_(std::move(k)){
-    if(i.Dot(j)!=0 || j.Dot(k)!=0 || i.Dot(k)!=0){
-        fprintf(stderr, "Basis is not orthogonal!\n");
-        exit(1);
+BoundingBox RigidTransform::BoxToWorld(const BoundingBox& box) const {
+    BoundingBox res;
+    for(int i=0; i<8; i++){
+        res.Extend(PointToWorld({(i & 1) ? box.max_.GetX() : box.min_.GetX(),
+                                 (i & 2) ? box.max_.GetY() : box.min_.GetY(),
+                                 (i & 4) ? box.max_.GetZ() : box.min_.GetZ()}));
     }
-    i_.Norm();
-    j_.Norm();
-    k_.Norm();
+    return res;
 }
-
-
-ONBasis_3x3::ONBasis_3x3(Vec3 new_z): k_(std::move(new_z)){
-    Vec3 tmp_cross_x = k_.Cross(Vec3(1.0, 0.0, 0.0));
-    Vec3 tmp_cross_y = k_.Cross(Vec3(0.0, 1.0, 0.0));
-    j_ = tmp_cross_x.Length2()>tmp_cross_y.Length2() ?
-                tmp_cross_x : tmp_cross_y;
-    i_ = j_.Cross(k_);
-    i_.Norm();
-    j_.Norm();
-    k_.Norm();
-}
-
-const Vec3& ONBasis_3x3::GetXVec() const{return i_;}
-const Vec3& ONBasis_3x3::GetYVec() const{return j_;}
-const Vec3& ONBasis_3x3::GetZVec() const{return k_;}
-
-
-Vec3 ONBasis_3x3::ApplyToVec(const Vec3& vec) const {
-    return i_.Times(vec.GetX()) +
-           j_.Times(vec.GetY()) +
-           k_.Times(vec.GetZ());
-}
-
-Vec3 ONBasis_3x3::FromOriginalCoorsToThis(const Vec3& vec) const {
-    return {vec.Dot(i_), vec.Dot(j_), vec.Dot(k_)};
-}
-
-Vec3 ONBasis_3x3::FromThisCoorsToOriginal(const Vec3& vec) const{
-    return i_.Times(vec.GetX()) +
-           j_.Times(vec.GetY()) +
-           k_.Times(vec.GetZ());
-}
-
-
-
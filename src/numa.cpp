@@ -0,0 +1,130 @@
+﻿#include <fstream>
+#include <sstream>
+#include <sched.h>
+#include <dirent.h>
+#include <algorithm>
+
+#include "numa.hpp"
+
+std::vector<int> ParseCpuList(const std::string& list){
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while(std::getline(ss, range, ',')){
+        if(range.empty() || range == "\n"){
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for(int cpu=first; cpu<=last; cpu++){
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+namespace {
+
+std::vector<int> GetAllowedCpus(){
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if(sched_getaffinity(0, sizeof(mask), &mask) != 0){
+        return cpus;
+    }
+    for(size_t cpu=0; cpu<static_cast<size_t>(CPU_SETSIZE); cpu++){
+        if(CPU_ISSET(cpu, &mask)){
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> GetNodeIds(){
+    std::vector<int> ids;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if(!dir){
+        return ids;
+    }
+    while(dirent* entry = readdir(dir)){
+        std::string name = entry->d_name;
+        if(name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                std::all_of(name.begin() + 4, name.end(), ::isdigit)){
+            ids.push_back(std::stoi(name.substr(4)));
+        }
+    }
+    closedir(dir);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+}
+
+std::vector<std::vector<int>> ReadNumaNodes(){
+    std::vector<int> allowed = GetAllowedCpus();
+    std::vector<std::vector<int>> nodes;
+    for(int id : GetNodeIds()){
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for(int cpu : ParseCpuList(list)){
+            if(std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()){
+                cpus.push_back(cpu);
+            }
+        }
+        if(!cpus.empty()){
+            nodes.push_back(std::move(cpus));
+        }
+    }
+    if(nodes.empty() && !allowed.empty()){
+        nodes.push_back(std::move(allowed));
+    }
+    return nodes;
+}
+
+bool PinCurrentThread(const int cpu){
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(static_cast<size_t>(cpu), &mask);
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+}
+
+AffinityGuard::AffinityGuard(): cpus_(GetAllowedCpus()) {}
+
+AffinityGuard::~AffinityGuard(){
+    if(cpus_.empty()){
+        return;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for(int cpu : cpus_){
+        CPU_SET(static_cast<size_t>(cpu), &mask);
+    }
+    sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+ThreadPlacement::ThreadPlacement(const std::vector<std::vector<int>>& nodes,
+                                 const size_t thread_num):
+    cpu_(thread_num), node_(thread_num), first_thread_(nodes.size(), thread_num)
+{
+    std::vector<size_t> used(nodes.size(), 0);
+    for(size_t tid=0; tid<thread_num; tid++){
+        size_t node = tid % nodes.size();
+        //more threads than CPUs share them
+        cpu_[tid] = nodes[node][used[node]++ % nodes[node].size()];
+        node_[tid] = node;
+        first_thread_[node] = std::min(first_thread_[node], tid);
+    }
+}
+
+int ThreadPlacement::GetCpu(const size_t tid) const {return cpu_[tid];}
+
+size_t ThreadPlacement::GetNode(const size_t tid) const {return node_[tid];}
+
+size_t ThreadPlacement::GetNodeNum() const {return first_thread_.size();}
+
+bool ThreadPlacement::IsFirstOnNode(const size_t tid) const {
+    return first_thread_[node_[tid]] == tid;
+}
@@ -0,0 +1,459 @@
+﻿#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <fmt/format.h>
+#ifdef TRACER_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#include "output.hpp"
+#include "particle.hpp"
+
+const std::array<const char*, kColumnNum> kColumnNames = {
+    "x", "y", "z", "vx", "vy", "vz", "volume_count", "surface_count"};
+const std::array<const char*, kColumnNum> kColumnUnits = {
+    "cm", "cm", "cm", "1", "1", "1", "count", "count"};
+
+namespace {
+
+constexpr char kFileMagic[8] = {'P', 'T', 'C', 'O', 'L', '0', '1', '\0'};
+constexpr uint32_t kBlockMagic = 0x4B4C4250; //"PBLK"
+constexpr uint8_t kCodecRaw = 0;
+constexpr uint8_t kCodecZlib = 1;
+
+template<typename T>
+void AppendPod(std::vector<uint8_t>& buf, const T val){
+    size_t old_size = buf.size();
+    buf.resize(old_size + sizeof(T));
+    memcpy(buf.data() + old_size, &val, sizeof(T));
+}
+
+template<typename T>
+T ReadPod(const std::vector<uint8_t>& buf, size_t& pos){
+    if(pos + sizeof(T) > buf.size()){
+        fprintf(stderr, "Columnar file is truncated\n");
+        exit(1);
+    }
+    T val;
+    memcpy(&val, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return val;
+}
+
+size_t GetPadding(const size_t size){
+    return (8 - size%8)%8;
+}
+
+size_t GetMaxValueSize(const ColumnType type){
+    switch(type){
+    case ColumnType::F32:
+    case ColumnType::U32:
+        return 4;
+    case ColumnType::F64:
+    case ColumnType::U64:
+        return 8;
+    case ColumnType::VARINT:
+        return 10;
+    }
+    return 10;
+}
+
+void AppendVarint(std::vector<uint8_t>& buf, uint64_t val){
+    while(val >= 0x80){
+        buf.push_back(static_cast<uint8_t>(val | 0x80));
+        val >>= 7;
+    }
+    buf.push_back(static_cast<uint8_t>(val));
+}
+
+uint64_t ReadVarint(const uint8_t* data, const size_t size, size_t& pos){
+    uint64_t val = 0;
+    unsigned shift = 0;
+    while(pos < size){
+        uint8_t byte = data[pos++];
+        val |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if(!(byte & 0x80)){
+            return val;
+        }
+        shift += 7;
+    }
+    fprintf(stderr, "Broken varint in columnar file\n");
+    exit(1);
+}
+
+std::vector<uint8_t> Decompress(const std::vector<uint8_t>& buf,
+                                const size_t pos, const size_t stored_size,
+                                const size_t raw_size){
+#ifdef TRACER_HAS_ZLIB
+    std::vector<uint8_t> raw(raw_size);
+    uLongf dest_len = static_cast<uLongf>(raw_size);
+    if(uncompress(raw.data(), &dest_len, buf.data() + pos,
+                  static_cast<uLong>(stored_size)) != Z_OK || dest_len != raw_size){
+        fprintf(stderr, "Cannot decompress columnar block\n");
+        exit(1);
+    }
+    return raw;
+#else
+    (void)buf; (void)pos; (void)stored_size; (void)raw_size;
+    fprintf(stderr, "Columnar file is compressed, but zlib is not available\n");
+    exit(1);
+#endif
+}
+
+template<typename T>
+void DecodeFloats(const uint8_t* data, const size_t rec_num,
+                  std::vector<double>& col){
+    for(size_t i=0; i<rec_num; i++){
+        T val;
+        memcpy(&val, data + i*sizeof(T), sizeof(T));
+        col.push_back(static_cast<double>(val));
+    }
+}
+
+template<typename T>
+void DecodeCounts(const uint8_t* data, const size_t rec_num,
+                  std::vector<uint64_t>& col){
+    for(size_t i=0; i<rec_num; i++){
+        T val;
+        memcpy(&val, data + i*sizeof(T), sizeof(T));
+        col.push_back(static_cast<uint64_t>(val));
+    }
+}
+
+}
+
+ParticleRecord MakeRecord(const Particle& pt){
+    return {{pt.GetPosition().GetX(), pt.GetPosition().GetY(), pt.GetPosition().GetZ()},
+            {pt.GetDirection().GetX(), pt.GetDirection().GetY(), pt.GetDirection().GetZ()},
+            pt.GetVolCount(), pt.GetSurfCount()};
+}
+
+uint64_t CalcConfigHash(const std::string& config_text){
+    //FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for(const char c : config_text){
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+ColumnType ParseColumnType(const std::string& name){
+    if(name == "f32") return ColumnType::F32;
+    if(name == "f64") return ColumnType::F64;
+    if(name == "u32") return ColumnType::U32;
+    if(name == "u64") return ColumnType::U64;
+    if(name == "varint") return ColumnType::VARINT;
+    fprintf(stderr, "unknown column type %s\n", name.c_str());
+    exit(1);
+}
+
+const char* GetColumnTypeName(const ColumnType type){
+    switch(type){
+    case ColumnType::F32: return "f32";
+    case ColumnType::F64: return "f64";
+    case ColumnType::U32: return "u32";
+    case ColumnType::U64: return "u64";
+    case ColumnType::VARINT: return "varint";
+    }
+    return "";
+}
+
+bool IsCompressionAvailable(){
+#ifdef TRACER_HAS_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TextWriter::WriteHeader(){
+    out_ << "#POS_X\tPOS_Y\tPOS_Z"
+         << "\tVX\tVY\tVZ\tVolumeCount\tSurfaceCount\n";
+}
+
+void TextWriter::Write(const ParticleRecord& rec){
+    //line fits into the inline storage of the buffer, so nothing is allocated
+    fmt::memory_buffer line;
+    fmt::format_to(std::back_inserter(line),
+                   "{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:d}\t{:d}\n",
+                   rec.pos_[0], rec.pos_[1], rec.pos_[2],
+                   rec.dir_[0], rec.dir_[1], rec.dir_[2],
+                   rec.vol_count_, rec.surf_count_);
+    out_.write(line.data(), static_cast<std::streamsize>(line.size()));
+}
+
+void TextWriter::Flush(){
+    out_.flush();
+}
+
+#ifdef TRACER_HAS_ZLIB
+//zlib memory goes through operator new, so the allocation tests see it
+struct ColumnarWriter::Deflater{
+    z_stream stream_{};
+
+    Deflater(){
+        stream_.zalloc = [](voidpf, uInt items, uInt size) -> voidpf {
+            return ::operator new(static_cast<size_t>(items)*size, std::nothrow);
+        };
+        stream_.zfree = [](voidpf, voidpf ptr){
+            ::operator delete(ptr);
+        };
+        if(deflateInit(&stream_, 6) != Z_OK){
+            fprintf(stderr, "Cannot start zlib compression\n");
+            exit(1);
+        }
+    }
+    ~Deflater(){
+        deflateEnd(&stream_);
+    }
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+};
+#else
+struct ColumnarWriter::Deflater{};
+#endif
+
+ColumnarWriter::ColumnarWriter(std::ofstream&& out,
+                               const OutputSettings& settings):
+    out_(std::move(out)), settings_(settings){
+    for(auto& col : float_cols_){
+        col.reserve(settings_.block_records_);
+    }
+    for(auto& col : count_cols_){
+        col.reserve(settings_.block_records_);
+    }
+    //buffers fit the largest block, so writing never allocates
+    size_t max_column = 0;
+    size_t max_payload = 0;
+    for(const ColumnType type : settings_.column_types_){
+        size_t column = GetMaxValueSize(type)*settings_.block_records_;
+        max_column = std::max(max_column, column);
+        max_payload += column + GetPadding(column);
+    }
+    raw_buf_.reserve(max_column);
+    payload_buf_.reserve(max_payload);
+    block_buf_.reserve(2*sizeof(uint32_t) + kColumnNum*(8 + 2*sizeof(uint64_t)));
+#ifdef TRACER_HAS_ZLIB
+    if(settings_.compress_){
+        deflater_ = std::make_unique<Deflater>();
+        packed_buf_.reserve(deflateBound(&deflater_->stream_, max_column));
+    }
+#endif
+}
+
+ColumnarWriter::~ColumnarWriter(){
+    Flush();
+}
+
+void ColumnarWriter::WriteHeader(){
+    nlohmann::json header;
+    header["format"] = "ptc";
+    header["version"] = 1;
+    header["config_hash"] = fmt::format("{:016x}", settings_.config_hash_);
+    header["compression"] = settings_.compress_ ? "zlib" : "none";
+    header["block_records"] = settings_.block_records_;
+    for(size_t i=0; i<kColumnNum; i++){
+        header["columns"].push_back({{"name", kColumnNames[i]},
+                           {"type", GetColumnTypeName(settings_.column_types_[i])},
+                           {"unit", kColumnUnits[i]}});
+    }
+    std::string text = header.dump();
+    text.append(GetPadding(text.size()), ' ');
+    uint64_t text_size = text.size();
+    out_.write(kFileMagic, sizeof(kFileMagic));
+    out_.write(reinterpret_cast<const char*>(&text_size), sizeof(text_size));
+    out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+void ColumnarWriter::Write(const ParticleRecord& rec){
+    for(size_t i=0; i<3; i++){
+        float_cols_[i].push_back(rec.pos_[i]);
+        float_cols_[i+3].push_back(rec.dir_[i]);
+    }
+    count_cols_[0].push_back(rec.vol_count_);
+    count_cols_[1].push_back(rec.surf_count_);
+    if(float_cols_[0].size() >= settings_.block_records_){
+        Flush();
+    }
+}
+
+void ColumnarWriter::EncodeColumn(const size_t col){
+    raw_buf_.clear();
+    ColumnType type = settings_.column_types_[col];
+    if(col < float_cols_.size()){
+        for(const double val : float_cols_[col]){
+            if(type == ColumnType::F32){
+                AppendPod(raw_buf_, static_cast<float>(val));
+            } else {
+                AppendPod(raw_buf_, val);
+            }
+        }
+        return;
+    }
+    for(const uint64_t val : count_cols_[col - float_cols_.size()]){
+        switch(type){
+        case ColumnType::U32:
+            AppendPod(raw_buf_, static_cast<uint32_t>(val));
+            break;
+        case ColumnType::U64:
+            AppendPod(raw_buf_, val);
+            break;
+        default:
+            AppendVarint(raw_buf_, val);
+        }
+    }
+}
+
+void ColumnarWriter::Flush(){
+    uint32_t rec_num = static_cast<uint32_t>(float_cols_[0].size());
+    if(rec_num == 0){
+        out_.flush();
+        return;
+    }
+    //buffers keep their capacity, so only the first blocks allocate
+    std::vector<uint8_t>& block = block_buf_;
+    std::vector<uint8_t>& payloads = payload_buf_;
+    block.clear();
+    payloads.clear();
+    AppendPod(block, kBlockMagic);
+    AppendPod(block, rec_num);
+    for(size_t col=0; col<kColumnNum; col++){
+        EncodeColumn(col);
+        const std::vector<uint8_t>* stored = &raw_buf_;
+        uint8_t codec = kCodecRaw;
+#ifdef TRACER_HAS_ZLIB
+        if(deflater_){
+            //same stream as compress2 gives, without a new deflate state per column
+            z_stream& stream = deflater_->stream_;
+            deflateReset(&stream);
+            packed_buf_.resize(deflateBound(&stream, raw_buf_.size()));
+            stream.next_in = raw_buf_.data();
+            stream.avail_in = static_cast<uInt>(raw_buf_.size());
+            stream.next_out = packed_buf_.data();
+            stream.avail_out = static_cast<uInt>(packed_buf_.size());
+            if(deflate(&stream, Z_FINISH) == Z_STREAM_END
+                    && stream.total_out < raw_buf_.size()){
+                packed_buf_.resize(stream.total_out);
+                stored = &packed_buf_;
+                codec = kCodecZlib;
+            }
+        }
+#endif
+        AppendPod(block, codec);
+        block.insert(block.end(), 7, 0);
+        AppendPod<uint64_t>(block, stored->size());
+        AppendPod<uint64_t>(block, raw_buf_.size());
+        payloads.insert(payloads.end(), stored->begin(), stored->end());
+        payloads.insert(payloads.end(), GetPadding(stored->size()), 0);
+    }
+    out_.write(reinterpret_cast<const char*>(block.data()),
+               static_cast<std::streamsize>(block.size()));
+    out_.write(reinterpret_cast<const char*>(payloads.data()),
+               static_cast<std::streamsize>(payloads.size()));
+    out_.flush();
+    for(auto& col : float_cols_){
+        col.clear();
+    }
+    for(auto& col : count_cols_){
+        col.clear();
+    }
+}
+
+size_t ColumnarData::GetRecordNum() const {
+    return float_cols_[0].size();
+}
+
+ColumnarData ReadColumnarFile(const std::string& file_name){
+    std::ifstream file(file_name, std::ios_base::binary);
+    if(!file.is_open()){
+        fprintf(stderr, "File %s cannot be open", file_name.c_str());
+        exit(1);
+    }
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+    ColumnarData data;
+    std::array<ColumnType, kColumnNum> types{};
+    bool header_found = false;
+    size_t pos = 0;
+    while(pos < buf.size()){
+        if(pos + sizeof(kFileMagic) <= buf.size() &&
+                memcmp(buf.data() + pos, kFileMagic, sizeof(kFileMagic)) == 0){
+            pos += sizeof(kFileMagic);
+            uint64_t text_size = ReadPod<uint64_t>(buf, pos);
+            if(pos + text_size > buf.size()){
+                fprintf(stderr, "Columnar file is truncated\n");
+                exit(1);
+            }
+            auto header = nlohmann::json::parse(buf.begin() + static_cast<long>(pos),
+                               buf.begin() + static_cast<long>(pos + text_size));
+            pos += text_size;
+            for(size_t i=0; i<kColumnNum; i++){
+                types[i] = ParseColumnType(
+                          header["columns"][i]["type"].get<std::string>());
+            }
+            data.config_hash_ = std::stoull(
+                          header["config_hash"].get<std::string>(), nullptr, 16);
+            header_found = true;
+            continue;
+        }
+        if(!header_found || ReadPod<uint32_t>(buf, pos) != kBlockMagic){
+            fprintf(stderr, "Wrong columnar file format: %s\n", file_name.c_str());
+            exit(1);
+        }
+        size_t rec_num = ReadPod<uint32_t>(buf, pos);
+        std::array<uint8_t, kColumnNum> codecs{};
+        std::array<size_t, kColumnNum> stored_sizes{};
+        std::array<size_t, kColumnNum> raw_sizes{};
+        for(size_t col=0; col<kColumnNum; col++){
+            codecs[col] = ReadPod<uint8_t>(buf, pos);
+            pos += 7;
+            stored_sizes[col] = ReadPod<uint64_t>(buf, pos);
+            raw_sizes[col] = ReadPod<uint64_t>(buf, pos);
+        }
+        for(size_t col=0; col<kColumnNum; col++){
+            if(pos + stored_sizes[col] > buf.size()){
+                fprintf(stderr, "Columnar file is truncated\n");
+                exit(1);
+            }
+            std::vector<uint8_t> raw;
+            const uint8_t* col_data = buf.data() + pos;
+            size_t col_size = stored_sizes[col];
+            if(codecs[col] == kCodecZlib){
+                raw = Decompress(buf, pos, stored_sizes[col], raw_sizes[col]);
+                col_data = raw.data();
+                col_size = raw.size();
+            }
+            //fixed-width columns must hold all records of the block
+            if(types[col] != ColumnType::VARINT &&
+               rec_num*GetMaxValueSize(types[col]) > col_size){
+                fprintf(stderr, "Columnar file is truncated\n");
+                exit(1);
+            }
+            if(col < data.float_cols_.size()){
+                auto& out = data.float_cols_[col];
+                if(types[col] == ColumnType::F32){
+                    DecodeFloats<float>(col_data, rec_num, out);
+                } else {
+                    DecodeFloats<double>(col_data, rec_num, out);
+                }
+            } else {
+                auto& out = data.count_cols_[col - data.float_cols_.size()];
+                if(types[col] == ColumnType::U32){
+                    DecodeCounts<uint32_t>(col_data, rec_num, out);
+                } else if(types[col] == ColumnType::U64){
+                    DecodeCounts<uint64_t>(col_data, rec_num, out);
+                } else {
+                    size_t var_pos = 0;
+                    for(size_t i=0; i<rec_num; i++){
+                        out.push_back(ReadVarint(col_data, col_size, var_pos));
+                    }
+                }
+            }
+            pos += stored_sizes[col] + GetPadding(stored_sizes[col]);
+        }
+    }
+    return data;
+}
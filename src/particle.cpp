@@ -1,14 +1,33 @@
-﻿#include <optional>
+﻿#include <cassert>
+#include <optional>
 #include <random>
 #include <utility>
 #include <limits>
-#include <fmt/core.h>
 #include <omp.h>
 
 #include "particle.hpp"
+#include "geometry.hpp"
+#include "field.hpp"
+#include "perf_counters.hpp"
 
 
 
+namespace {
+
+constexpr double kElectronMass = 9.1093837e-31;    //kg
+constexpr double kElectronCharge = 1.602176634e-19; //C
+
+}
+
+double ElectronSpeed(const double energy){
+    return 100*sqrt(2*energy*kElectronCharge/kElectronMass);
+}
+
+double ElectronEnergy(const double speed){
+    double v = speed/100;
+    return 0.5*kElectronMass*v*v/kElectronCharge;
+}
+
 Particle::Particle(const Vec3& given_p, const Vec3& given_v):
 pos_(given_p), V_(given_v), vol_count_(0), surf_count_(0){
     V_.Norm();
@@ -22,23 +41,31 @@ pos_(given_p), vol_count_(0), surf_count_(0){
 
 Particle::GenFunc Particle::GetGenerator(bool is_rand_dir){
     if(is_rand_dir){
-        auto generator = [](const Vec3& p, const Vec3& v,
-                std::mt19937& rnd_gen){
+        return [](const Vec3& p, const Vec3& v, std::mt19937& rnd_gen){
             return Particle(p, v, rnd_gen);
         };
-        return {generator};
     }
-    auto generator = [](const Vec3& p, const Vec3& v,
-            [[maybe_unused]] std::mt19937& rnd_gen){
+    return [](const Vec3& p, const Vec3& v, [[maybe_unused]] std::mt19937& rnd_gen){
         return Particle(p, v);
     };
-    return {generator};
 }
 
 const Vec3& Particle::GetPosition() const{return pos_;}
 const Vec3& Particle::GetDirection() const {return V_;}
 size_t Particle::GetVolCount() const {return vol_count_;}
 size_t Particle::GetSurfCount() const {return surf_count_;}
+size_t Particle::GetSpeciesCount(const size_t species) const {return species_count_[species];}
+void Particle::SetSpeed(const double speed){speed_ = speed;}
+double Particle::GetSpeed() const {return speed_;}
+double Particle::GetTime() const {return time_;}
+
+Particle Particle::MakeSecondary(const Vec3& pos, const Vec3& direction,
+                                 const double speed) const {
+    Particle secondary(pos, direction);
+    secondary.speed_ = speed;
+    secondary.time_ = time_;
+    return secondary;
+}
 
 
 
@@ -47,16 +74,19 @@ double Particle::GetDistanceInGas(const Background& gas,
     if (gas.p_ == 0.0){
         return std::numeric_limits<double>::max();
     }
-    double mfp = 1.38e-17*gas.T_/(gas.p_*gas.sigma_);
+    double mfp = gas.GetMeanFreePath();
     std::uniform_real_distribution<double> rnd(0.0, 1.0);
     return mfp*log(1.0/(1.0-rnd(rnd_gen)));
 }
 
 
 void Particle::MakeGasCollision(const double distance,
-                                std::mt19937& rnd_gen){
-    pos_ = pos_ + V_.Times(distance);
+                                std::mt19937& rnd_gen, const GasMixture* mixture){
+    pos_ = pos_.AddScaled(V_, distance);
     vol_count_++;
+    if(mixture){
+        species_count_[mixture->SampleSpecies(rnd_gen)]++;
+    }
     std::uniform_real_distribution<double> rnd(0.0, 1.0);
     double costheta = 2*rnd(rnd_gen)-1;
     double sintheta = sqrt(1-costheta*costheta);
@@ -82,54 +112,195 @@ Vec3 Particle::GetRandomVel(const Vec3& direction,
 }
 
 
-size_t Particle::Trace(std::vector<std::unique_ptr<Surface>>& walls,
-                        const Background& gas, std::mt19937 &rnd_gen){
-    double min_dist = GetDistanceInGas(gas, rnd_gen);
-    size_t wall_id = 0;
-    Vec3 point_on_surf;
-    bool colide_in_gas_flag = true;
-    bool found_crossection_with_surface = false;
-    for(size_t i=0; i<walls.size(); i++){
-        auto cross_res = walls[i]->GetCrossPoint(pos_, V_);
-        if(cross_res){
-            found_crossection_with_surface = true;
-            if(pos_.GetDistance(cross_res.value())<min_dist){
-                min_dist = pos_.GetDistance(cross_res.value());
-                wall_id = i;
+size_t Particle::Trace(Geometry& geo, const Background& gas,
+                       std::mt19937 &rnd_gen, TraceObserver* observer,
+                       ParticleStack* stack){
+    if(stack){
+        stack->StartHistory();
+    }
+    size_t is_absorbed = TraceHistory(geo, gas, rnd_gen, observer, stack);
+    if(stack){
+        //depth first, so the stack holds one branch of the cascade
+        while(!stack->IsEmpty()){
+            Particle secondary = stack->Pop();
+            secondary.TraceHistory(geo, gas, rnd_gen, observer, stack);
+        }
+    }
+    if(observer) observer->OnHistoryEnd();
+    return is_absorbed;
+}
+
+size_t Particle::TraceHistory(Geometry& geo, const Background& gas,
+                              std::mt19937 &rnd_gen, TraceObserver* observer,
+                              ParticleStack* stack){
+    //every collision and boundary crossing starts the next flight, loop keeps
+    //the stack flat however long the particle lives
+    while(true){
+        TRACE_PHASE(FREE_PATH);
+        double min_dist = GetDistanceInGas(gas, rnd_gen);
+        std::optional<SurfaceHit> hit;
+        if(const FieldTransport* field = geo.GetField()){
+            if(!FlyInField(geo, *field, min_dist, hit, observer)){
+                TRACE_PHASE(OUTPUT);
+                if(observer) observer->OnLost(*this);
+                return 0;
+            }
+            TRACE_PHASE(REFLECTION);
+            if(!hit){
+                //particle is already at the collision point
+                if(observer) observer->OnScatter(*this, geo, nullptr, V_);
+                boundary_count_ = 0;
+                MakeGasCollision(0.0, rnd_gen, gas.mixture_.get());
+                continue;
+            }
+        } else {
+            TRACE_PHASE(INTERSECTION);
+            hit = geo.FindClosestHit(ShearedRay(pos_, V_));
+            if(!hit){
+                TRACE_PHASE(OUTPUT);
+                //geometry is not closed or particle is outside --> caller counts it
+                if(observer) observer->OnLost(*this);
+                return 0;
+            }
+            bool colide_in_gas_flag = true;
+            double wall_dist = pos_.GetDistance(hit->point_);
+            if(wall_dist < min_dist){
+                min_dist = wall_dist;
                 colide_in_gas_flag = false;
-                point_on_surf = cross_res.value();
+            }
+            TRACE_PHASE(OUTPUT);
+            if(observer) observer->OnFlight(*this, min_dist, colide_in_gas_flag);
+            if(speed_ > 0){
+                //collisions are elastic, so speed stays the same
+                time_ += min_dist/speed_;
+            }
+            TRACE_PHASE(REFLECTION);
+            if(colide_in_gas_flag){
+                //moved first, so the observers see the collision point
+                pos_ = pos_.AddScaled(V_, min_dist);
+                if(observer) observer->OnScatter(*this, geo, nullptr, V_);
+                boundary_count_ = 0;
+                MakeGasCollision(0.0, rnd_gen, gas.mixture_.get());
+                continue;
             }
         }
+        Surface& wall = geo.GetSurface(hit->wall_id_);
+        const Vec3& normal = hit->normal_;
+        if(wall.GetBoundaryType() != BoundaryType::WALL){
+            if(++boundary_count_ > kMaxBoundaryCrossings){
+                TRACE_PHASE(OUTPUT);
+                if(observer) observer->OnLost(*this);
+                return 0;
+            }
+            CrossBoundary(wall, *hit, pos_, V_);
+            continue;
+        }
+        //Here we collide with surface --> can die
+        pos_ = hit->point_;
+        surf_count_++;
+        boundary_count_ = 0;
+        auto surf_refl = wall.GetReflector()->ReflectParticle(*this, normal, rnd_gen);
+        if(stack){
+            wall.GetReflector()->EmitSecondaries(*this, normal, rnd_gen, *stack);
+        }
+        TRACE_PHASE(OUTPUT);
+        if(observer){
+            observer->OnScatter(*this, geo, wall.GetReflector(), normal);
+            observer->OnWallHit(*this, hit->wall_id_, surf_refl.has_value());
+        }
+        if(surf_refl){
+            V_ = surf_refl.value();
+            pos_ = OffsetPointAlongNormal(pos_, normal);
+            continue;
+        }
+        //Here particle is dead --> save its position
+        if (wall.IsSaveStat()){
+            wall.SaveParticle(*this);
+        }
+        return 1;
     }
-    if(!found_crossection_with_surface){
-        //should be that one particle which missed all surfaces due to double precision
-        std::cerr << fmt::format("Particle missed all surfacces\n"
-        "POS = ({:.6e} ; {:.6e} ; {:.6e}) \t V = ({:.6e} ; {:.6e} ; {:.6e})\n",
-        pos_.GetX(), pos_.GetY(), pos_.GetZ(), V_.GetX(), V_.GetY(), V_.GetZ());
-        return 0;
-    }
-    if(colide_in_gas_flag){
-        MakeGasCollision(min_dist, rnd_gen);
-        return Trace(walls, gas, rnd_gen);
-    }
-    //Here we collide with surface --> can die
-    pos_ = point_on_surf;
-    surf_count_++;
-    auto surf_refl = walls[wall_id]->GetReflector()->ReflectParticle(*this,
-                                           walls[wall_id]->GetNormal(), rnd_gen);
-    if(surf_refl){
-        V_ = surf_refl.value();
-        return Trace(walls, gas, rnd_gen);
-    }
-    //Here particle is dead --> save its position
-    if (walls[wall_id]->IsSaveStat()){
-        //#pragma omp critical
-        walls[wall_id]->SaveParticle(*this);
+}
+
+bool Particle::FlyInField(const Geometry& geo, const FieldTransport& field, double distance,
+                          std::optional<SurfaceHit>& hit, TraceObserver* observer){
+    const FieldStepping& stepping = field.GetStepping();
+    Vec3 velocity = V_.Times(speed_);
+    for(size_t step=0; step<stepping.max_substeps_; step++){
+        TRACE_PHASE(FREE_PATH);
+        double dt = field.Push(pos_, velocity);
+        speed_ = velocity.Length();
+        if(speed_ == 0.0){
+            //stopped by the electric field exactly at the turning point
+            return false;
+        }
+        V_ = velocity.Times(1.0/speed_);
+        double length = speed_*dt;
+        bool is_gas_collision = distance <= length;
+        if(is_gas_collision){
+            length = distance;
+        }
+        TRACE_PHASE(INTERSECTION);
+        hit = geo.FindClosestHit(ShearedRay(pos_, V_));
+        if(hit){
+            double wall_dist = pos_.GetDistance(hit->point_);
+            if(wall_dist < length){
+                length = wall_dist;
+                is_gas_collision = false;
+            } else {
+                hit.reset();
+            }
+        } else if(std::isinf(length)){
+            //straight flight out of the geometry
+            return false;
+        }
+        TRACE_PHASE(OUTPUT);
+        if(observer) observer->OnFlight(*this, length, is_gas_collision);
+        time_ += length/speed_;
+        if(hit){
+            return true;
+        }
+        pos_ = pos_.AddScaled(V_, length);
+        if(is_gas_collision){
+            return true;
+        }
+        distance -= length;
     }
-    return 1;
+    return false;
 }
 
 
+ParticleStack::ParticleStack(const size_t capacity, const size_t history_limit):
+    capacity_(capacity), history_limit_(history_limit)
+{
+    particles_.reserve(capacity_);
+}
 
+void ParticleStack::StartHistory(){history_num_ = 0;}
 
+void ParticleStack::Push(const Particle& pt){
+    if(particles_.size() == capacity_ || history_num_ == history_limit_){
+        dropped_num_++;
+        return;
+    }
+    particles_.push_back(pt);
+    history_num_++;
+    pushed_num_++;
+}
+
+Particle ParticleStack::Pop(){
+    assert(!particles_.empty());
+    Particle pt = particles_.back();
+    particles_.pop_back();
+    return pt;
+}
 
+bool ParticleStack::IsEmpty() const {return particles_.empty();}
+size_t ParticleStack::GetSize() const {return particles_.size();}
+size_t ParticleStack::GetCapacity() const {return capacity_;}
+size_t ParticleStack::GetPushedNum() const {return pushed_num_;}
+size_t ParticleStack::GetDroppedNum() const {return dropped_num_;}
+
+void ParticleStack::ResetCounters(){
+    pushed_num_ = 0;
+    dropped_num_ = 0;
+}
@@ -0,0 +1,160 @@
+﻿#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+#include "perf_counters.hpp"
+
+namespace {
+
+thread_local PerfCounters* current_counters = nullptr;
+
+const char* kPhaseNames[kTracePhaseNum] = {"free_path", "intersection", "reflection",
+                                           "output", "other"};
+
+int OpenEvent(const PerfEvent& event, const int group_fd){
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type_;
+    attr.config = event.config_;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group_fd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+}
+
+std::vector<PerfEvent> GetHardwareEvents(){
+    //generic cache misses are the last level cache misses on x86 and arm
+    return {{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}};
+}
+
+uint64_t PerfReport::GetCount(const TracePhase phase, const size_t event) const {
+    return counts_[static_cast<size_t>(phase)*event_names_.size() + event];
+}
+
+void PerfReport::Merge(const PerfReport& other){
+    if(counts_.empty()){
+        *this = other;
+        return;
+    }
+    for(size_t i=0; i<counts_.size() && i<other.counts_.size(); i++){
+        counts_[i] += other.counts_[i];
+    }
+    switch_num_ += other.switch_num_;
+}
+
+void WritePerfReports(std::ostream& out, const std::vector<PerfReport>& reports){
+    if(reports.empty()){
+        return;
+    }
+    PerfReport total;
+    for(const auto& report : reports){
+        total.Merge(report);
+    }
+    const std::vector<std::string>& names = total.event_names_;
+    out << "#THREAD\tPHASE";
+    for(const auto& name : names){
+        out << "\t" << name;
+    }
+    //share of the first event (cycles) spent in the phase
+    out << "\tSHARE\n";
+    auto write_rows = [&out, &names](const std::string& thread, const PerfReport& report){
+        uint64_t sum = 0;
+        for(size_t p=0; p<kTracePhaseNum; p++){
+            sum += names.empty() ? 0 : report.GetCount(static_cast<TracePhase>(p), 0);
+        }
+        for(size_t p=0; p<kTracePhaseNum; p++){
+            TracePhase phase = static_cast<TracePhase>(p);
+            out << thread << "\t" << kPhaseNames[p];
+            for(size_t e=0; e<names.size(); e++){
+                out << "\t" << report.GetCount(phase, e);
+            }
+            double share = sum == 0 || names.empty() ? 0.0 :
+                    static_cast<double>(report.GetCount(phase, 0))/static_cast<double>(sum);
+            out << fmt::format("\t{:.3f}\n", share);
+        }
+    };
+    for(size_t tid=0; tid<reports.size(); tid++){
+        write_rows(std::to_string(tid), reports[tid]);
+    }
+    write_rows("all", total);
+}
+
+PerfCounters::PerfCounters(const std::vector<PerfEvent>& events){
+    for(const auto& event : events){
+        int fd = OpenEvent(event, fds_.empty() ? -1 : fds_.front());
+        if(fd == -1){
+            error_ = fmt::format("could not open {} counter: {}", event.name_,
+                                 strerror(errno));
+            break;
+        }
+        fds_.push_back(fd);
+        names_.push_back(event.name_);
+    }
+    if(!error_.empty() || fds_.empty()){
+        for(int fd : fds_){
+            close(fd);
+        }
+        fds_.clear();
+        return;
+    }
+    last_.assign(fds_.size(), 0);
+    read_buf_.assign(fds_.size() + 1, 0);
+    report_.event_names_ = names_;
+    report_.counts_.assign(kTracePhaseNum*fds_.size(), 0);
+    ioctl(fds_.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    Read();
+}
+
+PerfCounters::~PerfCounters(){
+    if(current_counters == this){
+        current_counters = nullptr;
+    }
+    for(int fd : fds_){
+        close(fd);
+    }
+}
+
+bool PerfCounters::Read(){
+    //group read: number of events, then the values in the opening order
+    size_t size = read_buf_.size()*sizeof(uint64_t);
+    if(read(fds_.front(), read_buf_.data(), size) != static_cast<ssize_t>(size)){
+        return false;
+    }
+    for(size_t i=0; i<last_.size(); i++){
+        uint64_t value = read_buf_[i + 1];
+        report_.counts_[static_cast<size_t>(phase_)*last_.size() + i] += value - last_[i];
+        last_[i] = value;
+    }
+    return true;
+}
+
+bool PerfCounters::IsOpen() const {return !fds_.empty();}
+
+const std::string& PerfCounters::GetError() const {return error_;}
+
+void PerfCounters::Switch(const TracePhase phase){
+    if(fds_.empty()){
+        return;
+    }
+    Read();
+    phase_ = phase;
+    report_.switch_num_++;
+}
+
+const PerfReport& PerfCounters::GetReport() const {return report_;}
+
+void PerfCounters::SetCurrent(PerfCounters* counters){current_counters = counters;}
+
+PerfCounters* PerfCounters::GetCurrent(){return current_counters;}
@@ -0,0 +1,296 @@
+﻿#include <utility>
+#include <cmath>
+#include <algorithm>
+
+#include "quadric.hpp"
+
+namespace {
+
+BoundingBox GetDiskBox(const Vec3& center, const Vec3& normal, const double radius){
+    //extent along each axis is radius times sine of its angle with the normal
+    Vec3 n = normal;
+    n.Norm();
+    Vec3 half(radius*std::sqrt(std::max(0.0, 1 - n.GetX()*n.GetX())),
+              radius*std::sqrt(std::max(0.0, 1 - n.GetY()*n.GetY())),
+              radius*std::sqrt(std::max(0.0, 1 - n.GetZ()*n.GetZ())));
+    BoundingBox box;
+    box.Extend(center - half);
+    box.Extend(center + half);
+    return box;
+}
+
+//Point on the circle of the given radius around the axis
+Vec3 GetCirclePoint(const ONBasis_3x3& basis, const double radius, const double phi){
+    return basis.GetXVec().Times(radius*std::cos(phi)) +
+           basis.GetYVec().Times(radius*std::sin(phi));
+}
+
+}
+
+QuadricSurface::QuadricSurface(const QuadricSide side,
+                               std::unique_ptr<Reflector>&& g_reflector,
+                               std::unique_ptr<ParticleWriter>&& writer):
+    Surface(std::move(g_reflector), std::move(writer)),
+    side_sign_(side == QuadricSide::OUTSIDE ? 1.0 : -1.0) {}
+
+bool QuadricSurface::IsInBounds([[maybe_unused]] const Vec3& point) const {
+    return true;
+}
+
+std::optional<Vec3> QuadricSurface::PickEntryRoot(const ShearedRay& ray,
+                        const double a, const double b, const double c) const {
+    double roots[2];
+    size_t root_num = 0;
+    if(a == 0.0){
+        if(b == 0.0){
+            return std::nullopt;
+        }
+        roots[root_num++] = -c/b;
+    } else {
+        double disc = b*b - 4*a*c;
+        if(disc < 0){
+            return std::nullopt;
+        }
+        //numerically stable form, avoids cancellation in the small root
+        double q = -0.5*(b + std::copysign(std::sqrt(disc), b));
+        roots[root_num++] = q/a;
+        roots[root_num++] = q != 0.0 ? c/q : q/a;
+        if(roots[0] > roots[1]){
+            std::swap(roots[0], roots[1]);
+        }
+    }
+    for(size_t i=0; i<root_num; i++){
+        if(roots[i] <= 0){
+            continue;
+        }
+        Vec3 point = ray.org_.AddScaled(ray.dir_, roots[i]);
+        if(!IsInBounds(point)){
+            continue;
+        }
+        //the root where ray leaves the volume is skipped, so particle
+        //sitting on the surface after reflection does not hit it again
+        if(ray.dir_.Dot(GetNormalAt(point)) < 0){
+            return point;
+        }
+    }
+    return std::nullopt;
+}
+
+
+SphereSurface::SphereSurface(const Vec3& center, const double radius,
+                             const QuadricSide side,
+                             std::unique_ptr<Reflector>&& g_reflector,
+                             std::unique_ptr<ParticleWriter>&& writer):
+    QuadricSurface(side, std::move(g_reflector), std::move(writer)),
+    center_(center), radius_(radius) {}
+
+std::optional<Vec3> SphereSurface::GetCrossPoint(const ShearedRay& ray) const {
+    Vec3 o(center_, ray.org_);
+    return PickEntryRoot(ray, ray.dir_.Length2(), 2*o.Dot(ray.dir_),
+                         o.Length2() - radius_*radius_);
+}
+
+Vec3 SphereSurface::GetNormalAt(const Vec3& point) const {
+    return Vec3(center_, point).Times(side_sign_/radius_);
+}
+
+Vec3 SphereSurface::GetReferencePoint() const {
+    return center_ + Vec3(radius_, 0, 0);
+}
+
+BoundingBox SphereSurface::GetBoundingBox() const {
+    BoundingBox box;
+    box.Extend(center_ - Vec3(radius_, radius_, radius_));
+    box.Extend(center_ + Vec3(radius_, radius_, radius_));
+    return box;
+}
+
+double SphereSurface::GetArea() const {return 4*M_PI*radius_*radius_;}
+
+Vec3 SphereSurface::GetRandomPoint(std::mt19937& rng) const {
+    //uniform cos(theta) gives uniform area (Archimedes)
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    double cos_theta = 2*rnd(rng) - 1;
+    double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta*cos_theta));
+    double phi = 2*M_PI*rnd(rng);
+    return center_ + Vec3(sin_theta*std::cos(phi), sin_theta*std::sin(phi),
+                          cos_theta).Times(radius_);
+}
+
+
+CylinderSurface::CylinderSurface(const Vec3& base_center, const Vec3& axis,
+                                 const double radius, const double height,
+                                 const QuadricSide side,
+                                 std::unique_ptr<Reflector>&& g_reflector,
+                                 std::unique_ptr<ParticleWriter>&& writer):
+    QuadricSurface(side, std::move(g_reflector), std::move(writer)),
+    base_center_(base_center), axis_(axis), radius_(radius), height_(height)
+{
+    axis_.Norm();
+}
+
+bool CylinderSurface::IsInBounds(const Vec3& point) const {
+    double h = axis_.DotDiff(base_center_, point);
+    return h >= 0 && h <= height_;
+}
+
+std::optional<Vec3> CylinderSurface::GetCrossPoint(const ShearedRay& ray) const {
+    Vec3 o(base_center_, ray.org_);
+    Vec3 o_perp = o - axis_.Times(o.Dot(axis_));
+    Vec3 d_perp = ray.dir_ - axis_.Times(ray.dir_.Dot(axis_));
+    return PickEntryRoot(ray, d_perp.Length2(), 2*o_perp.Dot(d_perp),
+                         o_perp.Length2() - radius_*radius_);
+}
+
+Vec3 CylinderSurface::GetNormalAt(const Vec3& point) const {
+    Vec3 r(base_center_, point);
+    Vec3 r_perp = r - axis_.Times(r.Dot(axis_));
+    return r_perp.Norm().Times(side_sign_);
+}
+
+Vec3 CylinderSurface::GetReferencePoint() const {
+    ONBasis_3x3 basis(axis_);
+    return base_center_ + axis_.Times(0.5*height_) + basis.GetXVec().Times(radius_);
+}
+
+BoundingBox CylinderSurface::GetBoundingBox() const {
+    BoundingBox box = GetDiskBox(base_center_, axis_, radius_);
+    box.Extend(GetDiskBox(base_center_ + axis_.Times(height_), axis_, radius_));
+    return box;
+}
+
+double CylinderSurface::GetArea() const {return 2*M_PI*radius_*height_;}
+
+Vec3 CylinderSurface::GetRandomPoint(std::mt19937& rng) const {
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    double h = height_*rnd(rng);
+    return base_center_ + axis_.Times(h) +
+           GetCirclePoint(ONBasis_3x3(axis_), radius_, 2*M_PI*rnd(rng));
+}
+
+
+ConeSurface::ConeSurface(const Vec3& base_center, const Vec3& axis,
+                         const double base_radius, const double top_radius,
+                         const double height, const QuadricSide side,
+                         std::unique_ptr<Reflector>&& g_reflector,
+                         std::unique_ptr<ParticleWriter>&& writer):
+    QuadricSurface(side, std::move(g_reflector), std::move(writer)),
+    base_center_(base_center), axis_(axis), base_radius_(base_radius),
+    slope_((top_radius - base_radius)/height), height_(height)
+{
+    axis_.Norm();
+}
+
+bool ConeSurface::IsInBounds(const Vec3& point) const {
+    double h = axis_.DotDiff(base_center_, point);
+    return h >= 0 && h <= height_;
+}
+
+std::optional<Vec3> ConeSurface::GetCrossPoint(const ShearedRay& ray) const {
+    //|r_perp|^2 = (base_radius + slope*h)^2
+    Vec3 o(base_center_, ray.org_);
+    double o_h = o.Dot(axis_);
+    double d_h = ray.dir_.Dot(axis_);
+    Vec3 o_perp = o - axis_.Times(o_h);
+    Vec3 d_perp = ray.dir_ - axis_.Times(d_h);
+    double o_r = base_radius_ + slope_*o_h;
+    return PickEntryRoot(ray, d_perp.Length2() - slope_*slope_*d_h*d_h,
+                         2*(o_perp.Dot(d_perp) - slope_*o_r*d_h),
+                         o_perp.Length2() - o_r*o_r);
+}
+
+Vec3 ConeSurface::GetNormalAt(const Vec3& point) const {
+    Vec3 r(base_center_, point);
+    double h = r.Dot(axis_);
+    Vec3 r_perp = r - axis_.Times(h);
+    Vec3 grad = r_perp - axis_.Times((base_radius_ + slope_*h)*slope_);
+    return grad.Norm().Times(side_sign_);
+}
+
+Vec3 ConeSurface::GetReferencePoint() const {
+    ONBasis_3x3 basis(axis_);
+    double h = 0.5*height_;
+    return base_center_ + axis_.Times(h) +
+           basis.GetXVec().Times(base_radius_ + slope_*h);
+}
+
+BoundingBox ConeSurface::GetBoundingBox() const {
+    BoundingBox box = GetDiskBox(base_center_, axis_, base_radius_);
+    box.Extend(GetDiskBox(base_center_ + axis_.Times(height_), axis_,
+                          base_radius_ + slope_*height_));
+    return box;
+}
+
+double ConeSurface::GetArea() const {
+    double top_radius = base_radius_ + slope_*height_;
+    return M_PI*(base_radius_ + top_radius)*height_*std::sqrt(1 + slope_*slope_);
+}
+
+Vec3 ConeSurface::GetRandomPoint(std::mt19937& rng) const {
+    //area density along the axis is proportional to the radius, so the
+    //radius is sampled with the linear pdf: r^2 is uniform
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    double top_radius = base_radius_ + slope_*height_;
+    double h;
+    if(slope_ != 0.0){
+        double r2 = base_radius_*base_radius_ +
+                rnd(rng)*(top_radius*top_radius - base_radius_*base_radius_);
+        h = (std::sqrt(r2) - base_radius_)/slope_;
+    } else {
+        h = height_*rnd(rng);
+    }
+    return base_center_ + axis_.Times(h) +
+           GetCirclePoint(ONBasis_3x3(axis_), base_radius_ + slope_*h, 2*M_PI*rnd(rng));
+}
+
+
+DiskSurface::DiskSurface(const Vec3& center, const Vec3& normal,
+                         const double radius, const double inner_radius,
+                         std::unique_ptr<Reflector>&& g_reflector,
+                         std::unique_ptr<ParticleWriter>&& writer):
+    Surface(std::move(g_reflector), std::move(writer)),
+    center_(center), normal_(normal), radius_(radius), inner_radius_(inner_radius)
+{
+    normal_.Norm();
+}
+
+std::optional<Vec3> DiskSurface::GetCrossPoint(const ShearedRay& ray) const {
+    double den = ray.dir_.Dot(normal_);
+    if(den >= 0.0){
+        return std::nullopt;
+    }
+    double t = normal_.DotDiff(ray.org_, center_)/den;
+    if(t <= 0){
+        return std::nullopt;
+    }
+    Vec3 point = ray.org_.AddScaled(ray.dir_, t);
+    double r2 = Vec3(center_, point).Length2();
+    if(r2 > radius_*radius_ || r2 < inner_radius_*inner_radius_){
+        return std::nullopt;
+    }
+    return point;
+}
+
+Vec3 DiskSurface::GetNormalAt([[maybe_unused]] const Vec3& point) const {
+    return normal_;
+}
+
+Vec3 DiskSurface::GetReferencePoint() const {
+    ONBasis_3x3 basis(normal_);
+    return center_ + basis.GetXVec().Times(0.5*(radius_ + inner_radius_));
+}
+
+BoundingBox DiskSurface::GetBoundingBox() const {
+    return GetDiskBox(center_, normal_, radius_);
+}
+
+double DiskSurface::GetArea() const {
+    return M_PI*(radius_*radius_ - inner_radius_*inner_radius_);
+}
+
+Vec3 DiskSurface::GetRandomPoint(std::mt19937& rng) const {
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    double r2 = inner_radius_*inner_radius_ +
+            rnd(rng)*(radius_*radius_ - inner_radius_*inner_radius_);
+    return center_ + GetCirclePoint(ONBasis_3x3(normal_), std::sqrt(r2), 2*M_PI*rnd(rng));
+}
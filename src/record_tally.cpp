@@ -0,0 +1,51 @@
+﻿#include "record_tally.hpp"
+#include "particle.hpp"
+#include "output.hpp"
+
+RecordTally::RecordTally(const size_t species_num): species_num_(species_num) {}
+
+void RecordTally::OnWallHit(const Particle& pt, const size_t wall_id,
+                            const bool is_reflected){
+    if(is_reflected){
+        return;
+    }
+    ParticleRecord rec = MakeRecord(pt);
+    pos_.insert(pos_.end(), rec.pos_, rec.pos_ + 3);
+    dir_.insert(dir_.end(), rec.dir_, rec.dir_ + 3);
+    time_.push_back(pt.GetTime());
+    vol_count_.push_back(rec.vol_count_);
+    surf_count_.push_back(rec.surf_count_);
+    wall_id_.push_back(wall_id);
+    for(size_t i=0; i<species_num_; i++){
+        species_count_.push_back(pt.GetSpeciesCount(i));
+    }
+}
+
+namespace {
+
+template<typename T>
+void Append(std::vector<T>& to, const std::vector<T>& from){
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+}
+
+void RecordTally::Merge(const RecordTally& other){
+    Append(pos_, other.pos_);
+    Append(dir_, other.dir_);
+    Append(time_, other.time_);
+    Append(vol_count_, other.vol_count_);
+    Append(surf_count_, other.surf_count_);
+    Append(wall_id_, other.wall_id_);
+    Append(species_count_, other.species_count_);
+}
+
+size_t RecordTally::GetRecordNum() const {return time_.size();}
+const std::vector<double>& RecordTally::GetPositions() const {return pos_;}
+const std::vector<double>& RecordTally::GetDirections() const {return dir_;}
+const std::vector<double>& RecordTally::GetTimes() const {return time_;}
+const std::vector<uint64_t>& RecordTally::GetVolCounts() const {return vol_count_;}
+const std::vector<uint64_t>& RecordTally::GetSurfCounts() const {return surf_count_;}
+const std::vector<uint64_t>& RecordTally::GetWallIds() const {return wall_id_;}
+const std::vector<uint64_t>& RecordTally::GetSpeciesCounts() const {return species_count_;}
+size_t RecordTally::GetSpeciesNum() const {return species_num_;}
@@ -1,5 +1,16 @@
-﻿#include "reflector.hpp"
+﻿#include <cmath>
 
+#include "reflector.hpp"
+
+namespace {
+
+//GetRandomVel draws cos_theta uniformly, so the density is the same over
+//the hemisphere around the normal; weight is the number of leaving particles
+double GetHemisphereDensity(const double weight, const Vec3& normal, const Vec3& dir){
+    return dir.Dot(normal) > 0.0 ? 0.5*weight/M_PI : 0.0;
+}
+
+}
 
 std::optional<Vec3> MirrorReflector::ReflectParticle(const Particle& pt,
                               const Vec3& normal, std::mt19937& rnd_gen)const{
@@ -20,3 +31,96 @@ std::optional<Vec3> LambertianReflector::ReflectParticle(const Particle& pt,
     }
     return pt.GetRandomVel(normal, rnd_gen);
 }
+
+double MirrorReflector::GetReflectionCoefficient() const {
+    return reflection_coefficient_;
+}
+
+double LambertianReflector::GetReflectionCoefficient() const {
+    return reflection_coefficient_;
+}
+
+double LambertianReflector::GetDiffuseDensity(const Vec3& normal, const Vec3& dir) const {
+    return GetHemisphereDensity(reflection_coefficient_, normal, dir);
+}
+
+void Reflector::EmitSecondaries([[maybe_unused]] const Particle& pt,
+                                [[maybe_unused]] const Vec3& normal,
+                                [[maybe_unused]] std::mt19937& rnd_gen,
+                                [[maybe_unused]] ParticleStack& stack) const {}
+
+bool Reflector::IsEmitting() const {return false;}
+
+double Reflector::GetDiffuseDensity([[maybe_unused]] const Vec3& normal,
+                                    [[maybe_unused]] const Vec3& dir) const {
+    return 0.0;
+}
+
+double Reflector::GetSecondaryDensity([[maybe_unused]] const Particle& pt,
+                                      [[maybe_unused]] const Vec3& normal,
+                                      [[maybe_unused]] const Vec3& dir) const {
+    return 0.0;
+}
+
+SecondaryEmissionReflector::SecondaryEmissionReflector(const double reflection,
+                                                       const SecondaryYield& yield):
+    reflection_coefficient_(reflection), yield_(yield) {}
+
+std::optional<Vec3> SecondaryEmissionReflector::ReflectParticle(const Particle& pt,
+                 const Vec3& normal, std::mt19937& rnd_gen)const{
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    if(rnd(rnd_gen)>reflection_coefficient_){
+        return std::nullopt; 	//particle died
+    }
+    return pt.GetRandomVel(normal, rnd_gen);
+}
+
+double SecondaryEmissionReflector::GetReflectionCoefficient() const {
+    return reflection_coefficient_;
+}
+
+double SecondaryEmissionReflector::GetDiffuseDensity(const Vec3& normal,
+                                                     const Vec3& dir) const {
+    return GetHemisphereDensity(reflection_coefficient_, normal, dir);
+}
+
+double SecondaryEmissionReflector::GetSecondaryDensity(const Particle& pt, const Vec3& normal,
+                                                       const Vec3& dir) const {
+    //same yield and directions as EmitSecondaries
+    return GetHemisphereDensity(GetYield(ElectronEnergy(pt.GetSpeed()),
+                                         pt.GetDirection().Dot(normal)), normal, dir);
+}
+
+double SecondaryEmissionReflector::GetYield(const double energy,
+                                            const double cos_theta) const {
+    if(energy <= yield_.threshold_energy_){
+        return 0.0;
+    }
+    double theta = std::acos(std::min(std::fabs(cos_theta), 1.0));
+    double angle_factor = yield_.smoothness_*theta*theta/M_PI;
+    double max_yield = yield_.max_yield_*(1 + 0.5*angle_factor);
+    double max_energy = yield_.max_yield_energy_*(1 + angle_factor);
+    double w = (energy - yield_.threshold_energy_)/(max_energy - yield_.threshold_energy_);
+    double k = w < 1 ? 0.62 : 0.25;
+    return max_yield*std::pow(w*std::exp(1 - w), k);
+}
+
+void SecondaryEmissionReflector::EmitSecondaries(const Particle& pt, const Vec3& normal,
+                                 std::mt19937& rnd_gen, ParticleStack& stack) const {
+    double yield = GetYield(ElectronEnergy(pt.GetSpeed()), pt.GetDirection().Dot(normal));
+    if(yield <= 0.0){
+        return;
+    }
+    std::poisson_distribution<int> secondary_num(yield);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    int num = secondary_num(rnd_gen);
+    Vec3 origin = OffsetPointAlongNormal(pt.GetPosition(), normal);
+    for(int i=0; i<num; i++){
+        //gamma distribution with shape 2: sum of two exponentials
+        double energy = -0.5*yield_.emission_energy_*std::log((1 - rnd(rnd_gen))*(1 - rnd(rnd_gen)));
+        stack.Push(pt.MakeSecondary(origin, pt.GetRandomVel(normal, rnd_gen),
+                                    ElectronSpeed(energy)));
+    }
+}
+
+bool SecondaryEmissionReflector::IsEmitting() const {return true;}
@@ -0,0 +1,456 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <omp.h>
+
+#include "simulation.hpp"
+#include "particle.hpp"
+
+AbsorptionCounter::AbsorptionCounter(const size_t wall_num, const size_t species_num):
+    counts_(wall_num, 0), species_counts_(species_num, 0) {}
+
+void AbsorptionCounter::AddSpecies(const Particle& pt){
+    for(size_t i=0; i<species_counts_.size(); i++){
+        species_counts_[i] += pt.GetSpeciesCount(i);
+    }
+}
+
+void AbsorptionCounter::OnFlight([[maybe_unused]] const Particle& pt,
+                                 [[maybe_unused]] const double distance,
+                                 [[maybe_unused]] const bool is_gas_collision){
+    flight_num_++;
+}
+
+void AbsorptionCounter::OnWallHit(const Particle& pt,
+                                  const size_t wall_id, const bool is_reflected){
+    if(!is_reflected){
+        counts_[wall_id]++;
+        AddSpecies(pt);
+    }
+}
+
+void AbsorptionCounter::OnLost(const Particle& pt){
+    AddSpecies(pt);
+}
+
+void AbsorptionCounter::Merge(const AbsorptionCounter& other){
+    for(size_t i=0; i<counts_.size(); i++){
+        counts_[i] += other.counts_[i];
+    }
+    for(size_t i=0; i<species_counts_.size(); i++){
+        species_counts_[i] += other.species_counts_[i];
+    }
+    flight_num_ += other.flight_num_;
+}
+
+void AbsorptionCounter::AddCounts(const std::vector<size_t>& counts, const size_t flight_num){
+    if(counts.size() != counts_.size()){
+        fprintf(stderr, "absorption counter: saved counts do not match the walls\n");
+        exit(1);
+    }
+    for(size_t i=0; i<counts_.size(); i++){
+        counts_[i] += counts[i];
+    }
+    flight_num_ += flight_num;
+}
+
+void AbsorptionCounter::AddSpeciesCounts(const std::vector<size_t>& species_counts){
+    if(species_counts.size() != species_counts_.size()){
+        fprintf(stderr, "absorption counter: saved counts do not match the gas species\n");
+        exit(1);
+    }
+    for(size_t i=0; i<species_counts_.size(); i++){
+        species_counts_[i] += species_counts[i];
+    }
+}
+
+size_t AbsorptionCounter::GetCount(const size_t wall) const {return counts_[wall];}
+
+const std::vector<size_t>& AbsorptionCounter::GetCounts() const {return counts_;}
+
+size_t AbsorptionCounter::GetFlightNum() const {return flight_num_;}
+
+const std::vector<size_t>& AbsorptionCounter::GetSpeciesCounts() const {
+    return species_counts_;
+}
+
+void RunResult::Merge(const RunResult& other){
+    traced_num_ += other.traced_num_;
+    lost_num_ += other.lost_num_;
+    absorbed_.Merge(other.absorbed_);
+    if(sweep_ && other.sweep_) sweep_->Merge(*other.sweep_);
+    if(voxel_ && other.voxel_) voxel_->Merge(*other.voxel_);
+    if(time_ && other.time_) time_->Merge(*other.time_);
+    if(records_ && other.records_) records_->Merge(*other.records_);
+    if(detector_ && other.detector_) detector_->Merge(*other.detector_);
+    secondary_num_ += other.secondary_num_;
+    dropped_num_ += other.dropped_num_;
+    perf_.resize(std::max(perf_.size(), other.perf_.size()));
+    for(size_t i=0; i<other.perf_.size(); i++){
+        perf_[i].Merge(other.perf_[i]);
+    }
+}
+
+namespace {
+
+std::vector<double> Scaled(const std::vector<double>& values, const double factor){
+    std::vector<double> out(values.size());
+    for(size_t i=0; i<values.size(); i++){
+        out[i] = values[i]*factor;
+    }
+    return out;
+}
+
+}
+
+Simulation::Simulation(Geometry&& geo, const Background& gas,
+                       const size_t thread_num, const unsigned seed):
+    geo_(std::move(geo)), gas_(gas), thread_num_(thread_num),
+    absorbed_(thread_num, AbsorptionCounter(geo_.GetSurfaceNum(), gas_.GetSpeciesNum()))
+{
+    if(thread_num_ < 1){
+        fprintf(stderr, "Wrong thread number\n");
+        exit(1);
+    }
+    rnd_gens_.resize(thread_num_);
+    SetRandomStreams(seed, 0);
+}
+
+void Simulation::SetRandomStreams(const unsigned seed, const size_t first_stream){
+    seed_ = seed;
+    first_stream_ = first_stream;
+    for(size_t tid=0; tid<thread_num_; tid++){
+        uint64_t stream = first_stream_ + tid;
+        std::seed_seq seq{seed_, static_cast<unsigned>(stream),
+                          static_cast<unsigned>(stream >> 32)};
+        rnd_gens_[tid].seed(seq);
+    }
+}
+
+void Simulation::SetSweepPoints(std::vector<SweepPoint> points){
+    std::vector<double> nominal_R;
+    for(const auto& s : geo_.GetSurfaces()){
+        //boundaries are never hit, so their weights stay at one
+        if(s->GetBoundaryType() != BoundaryType::WALL){
+            nominal_R.push_back(0.0);
+            continue;
+        }
+        //weights are per particle, secondaries would need the weights of the parent
+        if(s->GetReflector()->IsEmitting()){
+            fprintf(stderr, "sweep: walls with secondary emission are not supported\n");
+            exit(1);
+        }
+        nominal_R.push_back(s->GetReflector()->GetReflectionCoefficient());
+    }
+    sweep_proto_.emplace(gas_, std::move(nominal_R), std::move(points));
+    sweep_tallies_.assign(thread_num_, sweep_proto_.value());
+}
+
+void Simulation::SetVoxelGrid(const VoxelGrid& grid){
+    voxel_proto_.emplace(grid);
+    voxel_tallies_.assign(thread_num_, voxel_proto_.value());
+}
+
+void Simulation::SetTimeBins(const TimeBins& bins){
+    time_proto_.emplace(bins, geo_.GetSurfaceNum());
+    time_tallies_.assign(thread_num_, time_proto_.value());
+}
+
+void Simulation::SetDetectors(std::vector<Detector> detectors){
+    //rays to the detectors are not carried over to the detector images
+    for(const auto& s : geo_.GetSurfaces()){
+        if(s->GetBoundaryType() != BoundaryType::WALL){
+            fprintf(stderr, "detectors: periodic and symmetry boundaries are not supported\n");
+            exit(1);
+        }
+    }
+    detector_proto_.emplace(std::move(detectors), gas_);
+    detector_tallies_.assign(thread_num_, detector_proto_.value());
+}
+
+void Simulation::SetRecordAbsorbed(const bool is_recorded){
+    if(is_recorded){
+        records_proto_.emplace(gas_.GetSpeciesNum());
+        record_tallies_.assign(thread_num_, records_proto_.value());
+    } else {
+        records_proto_.reset();
+        record_tallies_.clear();
+    }
+}
+
+void Simulation::SetThreadPlacement(const bool is_pinned, const bool is_replicated){
+    placement_.reset();
+    replicas_.clear();
+    is_replicated_ = false;
+    if(!is_pinned && !is_replicated){
+        return;
+    }
+    if(!is_pinned){
+        //replicas are local to the node only when its threads stay there
+        fprintf(stderr, "numa replicas need pinned threads\n");
+        exit(1);
+    }
+    auto nodes = ReadNumaNodes();
+    if(nodes.empty()){
+        fprintf(stderr, "could not read CPU list, threads are not pinned\n");
+        return;
+    }
+    SetThreadPlacement(ThreadPlacement(nodes, thread_num_),
+                       is_replicated && nodes.size() > 1);
+}
+
+void Simulation::SetThreadPlacement(const ThreadPlacement& placement,
+                                    const bool is_replicated){
+    placement_ = placement;
+    replicas_.clear();
+    is_replicated_ = is_replicated;
+}
+
+void Simulation::SetSecondaryLimits(const size_t capacity, const size_t history_limit){
+    stack_capacity_ = capacity;
+    history_limit_ = history_limit;
+    stacks_.clear();
+}
+
+void Simulation::SetProgressCallback(std::function<void(size_t)> progress){
+    progress_ = std::move(progress);
+}
+
+void Simulation::SetBatchCallback(std::function<void(size_t, double)> progress){
+    batch_progress_ = std::move(progress);
+}
+
+RunResult Simulation::Run(const std::vector<ParticleSource>& sources, const size_t n){
+    RunResult result{0, 0, AbsorptionCounter(geo_.GetSurfaceNum(), gas_.GetSpeciesNum()),
+                     {}, {}, {}, {}, {}, 0, 0};
+    if(sources.empty() || n == 0){
+        return result;
+    }
+    std::vector<size_t> thread_load(thread_num_, n/thread_num_);
+    thread_load[thread_num_ - 1] += n % thread_num_;
+    //copy assignment keeps the allocated storage of the tallies
+    std::fill(absorbed_.begin(), absorbed_.end(), result.absorbed_);
+    if(sweep_proto_) std::fill(sweep_tallies_.begin(), sweep_tallies_.end(), *sweep_proto_);
+    if(voxel_proto_) std::fill(voxel_tallies_.begin(), voxel_tallies_.end(), *voxel_proto_);
+    if(time_proto_) std::fill(time_tallies_.begin(), time_tallies_.end(), *time_proto_);
+    if(records_proto_){
+        std::fill(record_tallies_.begin(), record_tallies_.end(), *records_proto_);
+    }
+    if(detector_proto_){
+        std::fill(detector_tallies_.begin(), detector_tallies_.end(), *detector_proto_);
+    }
+    bool is_emitting = std::any_of(geo_.GetSurfaces().begin(), geo_.GetSurfaces().end(),
+                                   [](const std::unique_ptr<Surface>& s){
+                                       return s->GetBoundaryType() == BoundaryType::WALL &&
+                                              s->GetReflector()->IsEmitting();
+                                   });
+    if(is_emitting && stacks_.empty()){
+        stacks_.reserve(thread_num_);
+        for(size_t tid=0; tid<thread_num_; tid++){
+            stacks_.emplace_back(stack_capacity_, history_limit_);
+        }
+    }
+    std::vector<Particle::GenFunc> generators;
+    for(const auto& source : sources){
+        generators.push_back(Particle::GetGenerator(source.is_dir_random_));
+    }
+    //replicas point to geo_, so they are made again after the move
+    bool is_replica_needed = is_replicated_ &&
+            (replicas_.empty() || !replicas_.front() || !replicas_.front()->IsReplicaOf(geo_));
+    if(is_replica_needed){
+        replicas_.clear();
+        replicas_.resize(placement_->GetNodeNum());
+    }
+    size_t lost_pt_num = 0;
+#ifdef TRACER_PERF_COUNTERS
+    std::vector<PerfReport> perf_reports(thread_num_);
+#endif
+    omp_set_dynamic(0);
+    #pragma omp parallel num_threads(static_cast<int>(thread_num_))
+    {
+        size_t traced_pt_num = 0;
+        size_t thread_lost_pt_num = 0;
+        size_t tid = static_cast<size_t>(omp_get_thread_num());
+        //the caller and the pool threads are free again after the run
+        std::optional<AffinityGuard> affinity;
+        if(placement_){
+            affinity.emplace();
+            PinCurrentThread(placement_->GetCpu(tid));
+        }
+        Geometry* geo = &geo_;
+        if(is_replicated_){
+            size_t node = placement_->GetNode(tid);
+            if(is_replica_needed){
+                //first touch after pinning puts the copy into the node memory
+                if(placement_->IsFirstOnNode(tid)){
+                    replicas_[node] = geo_.MakeReplica();
+                }
+                #pragma omp barrier
+            }
+            geo = replicas_[node].get();
+        }
+        std::mt19937& rnd_gen = rnd_gens_[tid];
+        ParticleStack* stack = is_emitting ? &stacks_[tid] : nullptr;
+        if(stack){
+            stack->ResetCounters();
+        }
+        ObserverGroup observers;
+        observers.Add(&absorbed_[tid]);
+        if(sweep_proto_) observers.Add(&sweep_tallies_[tid]);
+        if(voxel_proto_) observers.Add(&voxel_tallies_[tid]);
+        if(time_proto_) observers.Add(&time_tallies_[tid]);
+        if(records_proto_) observers.Add(&record_tallies_[tid]);
+        if(detector_proto_) observers.Add(&detector_tallies_[tid]);
+        size_t source_idx = (tid*(n/thread_num_)) % sources.size();
+        size_t progress_step = std::max<size_t>(thread_load[tid]/10, 1);
+#ifdef TRACER_PERF_COUNTERS
+        //opened after pinning, the counters follow the thread anyway
+        PerfCounters perf;
+        if(perf.IsOpen()){
+            PerfCounters::SetCurrent(&perf);
+        } else if(tid == 0 && !is_perf_warned_){
+            fprintf(stderr, "%s, phases are not counted\n", perf.GetError().c_str());
+            is_perf_warned_ = true;
+        }
+#endif
+        while(traced_pt_num<thread_load[tid]){
+            const ParticleSource& source = sources[source_idx];
+            Particle pt = generators[source_idx](source.point_, source.direction_,
+                                                 rnd_gen);
+            pt.SetSpeed(source.speed_);
+            observers.OnSource(pt, *geo, source);
+            size_t is_traced = pt.Trace(*geo, gas_, rnd_gen, &observers, stack);
+            TRACE_PHASE(OTHER);
+            traced_pt_num += is_traced;
+            thread_lost_pt_num += 1 - is_traced;
+            source_idx = source_idx + 1 == sources.size() ? 0 : source_idx + 1;
+            if(tid == 0 && progress_ && is_traced && traced_pt_num%progress_step == 0){
+                progress_((100*traced_pt_num)/thread_load[tid]);
+            }
+        }
+        #pragma omp atomic
+        lost_pt_num += thread_lost_pt_num;
+#ifdef TRACER_PERF_COUNTERS
+        PerfCounters::SetCurrent(nullptr);
+        if(perf.IsOpen()){
+            perf_reports[tid] = perf.GetReport();
+        }
+#endif
+    }
+    result.traced_num_ = n;
+    result.lost_num_ = lost_pt_num;
+    for(const auto& stack : stacks_){
+        result.secondary_num_ += stack.GetPushedNum();
+        result.dropped_num_ += stack.GetDroppedNum();
+    }
+#ifdef TRACER_PERF_COUNTERS
+    if(!perf_reports.front().counts_.empty()){
+        result.perf_ = std::move(perf_reports);
+    }
+#endif
+    for(const auto& counter : absorbed_){
+        result.absorbed_.Merge(counter);
+    }
+    if(sweep_proto_){
+        result.sweep_ = sweep_tallies_.front();
+        for(size_t i=1; i<thread_num_; i++) result.sweep_->Merge(sweep_tallies_[i]);
+    }
+    if(voxel_proto_){
+        result.voxel_ = voxel_tallies_.front();
+        for(size_t i=1; i<thread_num_; i++) result.voxel_->Merge(voxel_tallies_[i]);
+    }
+    if(time_proto_){
+        result.time_ = time_tallies_.front();
+        for(size_t i=1; i<thread_num_; i++) result.time_->Merge(time_tallies_[i]);
+    }
+    if(records_proto_){
+        result.records_.emplace(gas_.GetSpeciesNum());
+        for(const auto& records : record_tallies_) result.records_->Merge(records);
+    }
+    if(detector_proto_){
+        result.detector_ = detector_tallies_.front();
+        for(size_t i=1; i<thread_num_; i++) result.detector_->Merge(detector_tallies_[i]);
+    }
+    return result;
+}
+
+AdaptiveResult Simulation::RunAdaptive(const std::vector<ParticleSource>& sources,
+                                       const StopCriteria& criteria){
+    if(std::isinf(criteria.max_time_) &&
+            criteria.max_particles_ == std::numeric_limits<size_t>::max()){
+        fprintf(stderr, "adaptive run: max_time or max_particles should be given\n");
+        exit(1);
+    }
+    if(criteria.max_particles_ < criteria.batch_size_){
+        fprintf(stderr, "adaptive run: max_particles is less than one batch\n");
+        exit(1);
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t wall_num = geo_.GetSurfaceNum();
+    AdaptiveResult result{RunResult{0, 0, AbsorptionCounter(wall_num, gas_.GetSpeciesNum()),
+                                    {}, {}, {}, {}, {}, 0, 0},
+                          BatchStats(wall_num), {}, {}, false, 0.0};
+    size_t done = 0;
+    while(done + criteria.batch_size_ <= criteria.max_particles_){
+        RunResult batch = Run(sources, criteria.batch_size_);
+        done += criteria.batch_size_;
+        double inv_histories = 1.0/static_cast<double>(batch.traced_num_ + batch.lost_num_);
+        //batch values are counts per history, so their sum is the count over the histories of a batch
+        double min_sum = static_cast<double>(criteria.min_count_)*inv_histories;
+        std::vector<double> fractions(wall_num);
+        for(size_t i=0; i<wall_num; i++){
+            fractions[i] = static_cast<double>(batch.absorbed_.GetCount(i))*inv_histories;
+        }
+        result.absorbed_.AddBatch(fractions);
+        double max_err = result.absorbed_.GetMaxRelError(min_sum);
+        if(batch.time_){
+            if(!result.time_) result.time_.emplace(batch.time_->GetCounts().size());
+            result.time_->AddBatch(Scaled(batch.time_->GetCounts(), inv_histories));
+            if(criteria.is_time_targeted_){
+                max_err = std::max(max_err, result.time_->GetMaxRelError(min_sum));
+            }
+        }
+        if(batch.voxel_){
+            if(!result.voxel_) result.voxel_.emplace(batch.voxel_->GetTrackLengths().size());
+            result.voxel_->AddBatch(Scaled(batch.voxel_->GetTrackLengths(),
+                                inv_histories/batch.voxel_->GetVoxelVolume()));
+            if(criteria.is_voxel_targeted_){
+                max_err = std::max(max_err, result.voxel_->GetMaxRelError());
+            }
+        }
+        if(result.absorbed_.GetBatchNum() == 1){
+            result.total_ = std::move(batch);
+        } else {
+            result.total_.Merge(batch);
+        }
+        if(batch_progress_){
+            batch_progress_(result.absorbed_.GetBatchNum(), max_err);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        result.elapsed_ = elapsed.count();
+        if(result.absorbed_.GetBatchNum() >= criteria.min_batches_ &&
+                max_err <= criteria.rel_error_){
+            result.is_converged_ = true;
+            break;
+        }
+        if(result.elapsed_ >= criteria.max_time_){
+            break;
+        }
+    }
+    return result;
+}
+
+Geometry& Simulation::GetGeometry(){return geo_;}
+
+size_t Simulation::GetReplicaNum() const {return replicas_.size();}
+
+const Background& Simulation::GetBackground() const {return gas_;}
+
+size_t Simulation::GetThreadNum() const {return thread_num_;}
+
+unsigned Simulation::GetSeed() const {return seed_;}
+
+size_t Simulation::GetFirstStream() const {return first_stream_;}
@@ -3,26 +3,81 @@
 #include <iostream>
 #include <list>
 #include <algorithm>
+#include <cmath>
+#include <numeric>
 #include <fmt/core.h>
 #include <omp.h>
 
 #include "surface.hpp"
 
-Surface::Surface(std::vector<Vec3>&& g_contour,
-        std::unique_ptr<Reflector>&& g_reflector, std::ofstream&& out_file):
-    contour_(std::move(g_contour)),
+Surface::Surface(std::unique_ptr<Reflector>&& g_reflector,
+                 std::unique_ptr<ParticleWriter>&& writer):
     reflector_(std::move(g_reflector)),
-    output_file_(std::move(out_file))
+    writer_(std::move(writer)) {}
+
+bool Surface::IsSaveStat() const{ return writer_ != nullptr;}
+const Reflector* Surface::GetReflector() const {return reflector_.get();}
+
+void Surface::WriteFileHeader(){
+    if(writer_){
+        writer_->WriteHeader();
+    }
+}
+
+void Surface::SaveParticle(const Particle& pt){
+    if(async_writer_){
+        async_writer_->Push(static_cast<size_t>(omp_get_thread_num()),
+                            writer_.get(), MakeRecord(pt));
+        return;
+    }
+    #pragma omp critical
+    writer_->Write(MakeRecord(pt));
+}
+
+void Surface::SetAsyncWriter(AsyncWriter* async_writer){
+    async_writer_ = async_writer;
+}
+
+void Surface::SetMixedPrecision(const bool is_mixed){
+    is_mixed_precision_ = is_mixed;
+}
+
+void Surface::SetBoundary(const BoundaryType type, const Vec3& periodic_shift){
+    boundary_type_ = type;
+    periodic_shift_ = periodic_shift;
+}
+
+BoundaryType Surface::GetBoundaryType() const {return boundary_type_;}
+const Vec3& Surface::GetPeriodicShift() const {return periodic_shift_;}
+
+std::optional<Vec3> Surface::GetCrossPoint(const Vec3& pos,
+                                           const Vec3& dir) const {
+    return GetCrossPoint(ShearedRay(pos, dir));
+}
+
+PolygonSurface::PolygonSurface(std::vector<Vec3>&& g_contour,
+        std::unique_ptr<Reflector>&& g_reflector, std::ofstream&& out_file):
+    PolygonSurface(std::move(g_contour), std::move(g_reflector),
+            out_file.is_open() ? std::make_unique<TextWriter>(std::move(out_file))
+                               : std::unique_ptr<ParticleWriter>()) {}
+
+PolygonSurface::PolygonSurface(std::vector<Vec3>&& g_contour,
+        std::unique_ptr<Reflector>&& g_reflector,
+        std::unique_ptr<ParticleWriter>&& writer):
+    Surface(std::move(g_reflector), std::move(writer)),
+    contour_(std::move(g_contour))
 {
-    coefs_ = Surface::CalcSurfaceCoefficients(contour_);
-    tri_areas_ = Surface::CalcTriangleAreas(contour_);
-    mass_center_ = Surface::CalcCenterOfMass(contour_);
+    coefs_ = PolygonSurface::CalcSurfaceCoefficients(contour_);
+    cum_areas_ = PolygonSurface::CalcTriangleAreas(contour_);
+    std::partial_sum(cum_areas_.begin(), cum_areas_.end(), cum_areas_.begin());
+    mass_center_ = PolygonSurface::CalcCenterOfMass(contour_);
     surf_basis_ = ONBasis_3x3(Vec3(coefs_.A_, coefs_.B_, coefs_.C_).Norm());
-    basis_contour_ = Surface::TranslateContourIntoBasis(surf_basis_, contour_);
+    basis_contour_ = PolygonSurface::TranslateContourIntoBasis(surf_basis_, contour_);
+    plane_normal_f_ = Vec3f(Vec3(coefs_.A_, coefs_.B_, coefs_.C_));
 }
 
 
-std::vector<double> Surface::CalcTriangleAreas(const std::vector<Vec3> &contour){
+std::vector<double> PolygonSurface::CalcTriangleAreas(const std::vector<Vec3> &contour){
     std::vector<double> areas;
     areas.reserve(contour.size()-2);
     for(size_t i=1; i<contour.size()-1; i++){
@@ -33,7 +88,7 @@ std::vector<double> Surface::CalcTriangleAreas(const std::vector<Vec3> &contour)
     return areas;
 }
 
-Vec3 Surface::CalcCenterOfMass(const std::vector<Vec3>& contour){
+Vec3 PolygonSurface::CalcCenterOfMass(const std::vector<Vec3>& contour){
     double x = 0;
     double y = 0;
     double z = 0;
@@ -47,10 +102,13 @@ Vec3 Surface::CalcCenterOfMass(const std::vector<Vec3>& contour){
             z/static_cast<double>(contour.size())};
 }
 
-Vec3 Surface::GetRandomPointInContour(std::mt19937 &rng) const{
-    std::discrete_distribution<size_t> dist(tri_areas_.begin(), tri_areas_.end());
-    size_t tri_idx = dist(rng);
+Vec3 PolygonSurface::GetRandomPointInContour(std::mt19937 &rng) const{
     std::uniform_real_distribution<double> dist_2(0.0, 1.0);
+    //triangle is chosen by area from the precomputed running sum
+    double area = dist_2(rng)*cum_areas_.back();
+    size_t tri_idx = static_cast<size_t>(std::upper_bound(cum_areas_.begin(), cum_areas_.end(),
+                                                          area) - cum_areas_.begin());
+    tri_idx = std::min(tri_idx, cum_areas_.size() - 1);
     double r1 = dist_2(rng);
     double r2 = dist_2(rng);
     return contour_[0].Times(1-sqrt(r1)) +
@@ -58,7 +116,7 @@ Vec3 Surface::GetRandomPointInContour(std::mt19937 &rng) const{
             contour_[tri_idx+2].Times(r2*sqrt(r1));
 }
 
-Surface::SurfaceCoeficients Surface::CalcSurfaceCoefficients(
+PolygonSurface::SurfaceCoeficients PolygonSurface::CalcSurfaceCoefficients(
                                             const std::vector<Vec3> contour){
     double A = (contour[1].GetY() - contour[0].GetY())*(contour[2].GetZ()- contour[0].GetZ())
             - (contour[2].GetY() - contour[0].GetY())*(contour[1].GetZ()- contour[0].GetZ());
@@ -70,39 +128,31 @@ Surface::SurfaceCoeficients Surface::CalcSurfaceCoefficients(
     return {A, B, C, D};
 }
 
-const std::vector<Vec3>& Surface::GetContour() const{return contour_;}
-const Vec3& Surface::GetNormal() const{return surf_basis_.GetZVec();}
-bool Surface::IsSaveStat() const{ return output_file_.is_open();}
-const Reflector* Surface::GetReflector() const {return reflector_.get();}
-const Vec3& Surface::GetMassCenter() const{return mass_center_;}
-
-
-const Surface::SurfaceCoeficients& Surface::GetSurfaceCoefficients() const {
-    return coefs_;
+const std::vector<Vec3>& PolygonSurface::GetContour() const{return contour_;}
+const Vec3& PolygonSurface::GetNormal() const{return surf_basis_.GetZVec();}
+const Vec3& PolygonSurface::GetMassCenter() const{return mass_center_;}
+Vec3 PolygonSurface::GetNormalAt([[maybe_unused]] const Vec3& point) const{
+    return GetNormal();
 }
-
-void Surface::WriteFileHeader(){
-    if(output_file_.is_open()){
-        output_file_ << "#POS_X\tPOS_Y\tPOS_Z"
-                     << "\tVX\tVY\tVZ\tVolumeCount\tSurfaceCount\n";
+Vec3 PolygonSurface::GetReferencePoint() const{return mass_center_;}
+double PolygonSurface::GetArea() const{return cum_areas_.back();}
+Vec3 PolygonSurface::GetRandomPoint(std::mt19937& rng) const{
+    return GetRandomPointInContour(rng);
+}
+BoundingBox PolygonSurface::GetBoundingBox() const{
+    BoundingBox box;
+    for(const auto& node : contour_){
+        box.Extend(node);
     }
+    return box;
 }
 
-void Surface::SaveParticle(const Particle& pt){
-    #pragma omp critical
-    output_file_ << fmt::format("{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:d}\t{:d}\n",
-                                    pt.GetPosition().GetX(),
-                                    pt.GetPosition().GetY(),
-                                    pt.GetPosition().GetZ(),
-                                    pt.GetDirection().GetX(),
-                                    pt.GetDirection().GetY(),
-                                    pt.GetDirection().GetZ(),
-                                    pt.GetVolCount(),
-                                    pt.GetSurfCount());
 
+const PolygonSurface::SurfaceCoeficients& PolygonSurface::GetSurfaceCoefficients() const {
+    return coefs_;
 }
 
-std::vector<Vec3> Surface::TranslateContourIntoBasis(
+std::vector<Vec3> PolygonSurface::TranslateContourIntoBasis(
         const ONBasis_3x3 &basis, const std::vector<Vec3>& contour){
     std::vector<Vec3> basis_contour;
     basis_contour.reserve(contour.size()+1);
@@ -112,7 +162,7 @@ std::vector<Vec3> Surface::TranslateContourIntoBasis(
     return basis_contour;
 }
 
-bool Surface::CheckIfPointOnSurface(const Vec3& point) const{
+bool PolygonSurface::CheckIfPointOnSurface(const Vec3& point) const{
     //Due to the finite double precision we still expect that given point
     //will be not directly on the surface
     //anyway we will transform its and surface coordinates into the basis
@@ -120,47 +170,95 @@ bool Surface::CheckIfPointOnSurface(const Vec3& point) const{
     //of the point and surface polygon in order to answer the question whether
     //point is on the surface
     Vec3 basis_point = surf_basis_.FromOriginalCoorsToThis(point);
+    return IsInsideContour(basis_point, basis_contour_);
+}
+
+template<typename T>
+bool PolygonSurface::IsInsideContour(const Vec3T<T>& basis_point,
+                              const std::vector<Vec3T<T>>& basis_contour) const {
     //Counting rotations....
     int winding_num = 0;
-    for(size_t i=0; i<basis_contour_.size()-1; i++){
-        winding_num += CalcWindChange(basis_contour_[i], basis_contour_[i+1],
+    for(size_t i=0; i<basis_contour.size()-1; i++){
+        winding_num += CalcWindChange(basis_contour[i], basis_contour[i+1],
                 basis_point);
     }
-    winding_num += CalcWindChange(basis_contour_.back(), basis_contour_.front(),
+    winding_num += CalcWindChange(basis_contour.back(), basis_contour.front(),
                                   basis_point);
     winding_num/=4;
     return !(winding_num%2==0);
 }
 
-std::optional<Vec3> Surface::GetCrossPoint(const Vec3& pos,
-                                           const Vec3& dir) const {
-    if((coefs_.A_*dir.GetX()
-        + coefs_.B_*dir.GetY()
-        + coefs_.C_*dir.GetZ()) == 0.0){
-        //particle moves parallel to the surface
+template<typename T>
+bool PolygonSurface::IsRayInsideContour(const ShearedRay& ray) const {
+    //Crossing number test of the sheared contour around the ray axis.
+    //Decision for each edge depends only on its end points, so edges
+    //shared by several surfaces give consistent answers and ray cannot
+    //slip between them. Differences with ray origin are taken in double.
+    auto shear = [&ray](const Vec3& node, T& x, T& y){
+        double rx = node[ray.kx_] - ray.org_[ray.kx_];
+        double ry = node[ray.ky_] - ray.org_[ray.ky_];
+        double rz = node[ray.kz_] - ray.org_[ray.kz_];
+        x = static_cast<T>(rx) - static_cast<T>(ray.Sx_)*static_cast<T>(rz);
+        y = static_cast<T>(ry) - static_cast<T>(ray.Sy_)*static_cast<T>(rz);
+    };
+    bool inside = false;
+    T prev_x;
+    T prev_y;
+    shear(contour_.back(), prev_x, prev_y);
+    for(const auto& node : contour_){
+        T x;
+        T y;
+        shear(node, x, y);
+        if((prev_y > 0) != (y > 0)){
+            //edge crosses X axis on the positive side
+            T e = prev_x*y - prev_y*x;
+            if(e != 0 && ((e > 0) == (y > prev_y))){
+                inside = !inside;
+            }
+        }
+        prev_x = x;
+        prev_y = y;
+    }
+    return inside;
+}
+
+std::optional<Vec3> PolygonSurface::GetCrossPoint(const ShearedRay& ray) const {
+    const Vec3& pos = ray.org_;
+    const Vec3& dir = ray.dir_;
+    //in mixed precision the direction dependent part is done in float,
+    //while the plane offset and the cross point position are kept in double
+    Vec3 plane_normal(coefs_.A_, coefs_.B_, coefs_.C_);
+    double tmp_den = is_mixed_precision_ ?
+                static_cast<double>(plane_normal_f_.Dot(Vec3f(dir))) :
+                plane_normal.Dot(dir);
+    if(tmp_den >= 0.0){
+        //particle moves parallel to the surface or from its back side
+        //normal is directed inside the volume, so it is not our case
         return std::nullopt;
     }
     //Look at time needed to reach the surface
-    double tmp_num = coefs_.A_*pos.GetX() + coefs_.B_*pos.GetY() +
-                     coefs_.C_*pos.GetZ() + coefs_.D_;
-    double tmp_den = coefs_.A_*dir.GetX()
-            + coefs_.B_*dir.GetY() + coefs_.C_*dir.GetZ();
+    double tmp_num = plane_normal.EvalPlane(pos, coefs_.D_);
     double t = -1*tmp_num/tmp_den;
     if(t<=0){
         return std::nullopt;
     }
     //Here at least direction is correct --> check for boundaries
-    Vec3 cross_point = {pos.GetX() + dir.GetX()*t,
-                        pos.GetY() + dir.GetY()*t,
-                        pos.GetZ() + dir.GetZ()*t};
-    VerifyPointInVolume(pos, cross_point);
-    if(CheckIfPointOnSurface(cross_point)){
-        return cross_point;
+    bool inside = is_mixed_precision_ ? IsRayInsideContour<float>(ray)
+                                      : IsRayInsideContour<double>(ray);
+    if(!inside){
+        return std::nullopt;
+    }
+    Vec3 cross_point = pos.AddScaled(dir, t);
+    if(is_mixed_precision_){
+        //one correction step with the plane offset evaluated in double
+        //removes the error of float denominator
+        double residual = plane_normal.EvalPlane(cross_point, coefs_.D_);
+        cross_point = cross_point - dir.Times(residual/tmp_den);
     }
-    return std::nullopt;
+    return cross_point;
 }
 
-void Surface::VerifyPointInVolume(const Vec3& start, Vec3& end) const {
+void PolygonSurface::VerifyPointInVolume(const Vec3& start, Vec3& end) const {
     /*!Function assumes that surface normal is directed inside the volume!*/
     Vec3 from_s_to_point(mass_center_, end);
     Vec3 pt_direction(start, end);
@@ -176,7 +274,8 @@ void Surface::VerifyPointInVolume(const Vec3& start, Vec3& end) const {
 
 
 
-int Surface::GetQuarter(const Vec3& point, const Vec3& node) const {
+template<typename T>
+int PolygonSurface::GetQuarter(const Vec3T<T>& point, const Vec3T<T>& node) const {
     if(node.GetX()>point.GetX() && node.GetY()>=point.GetY()){
         return 0;
     }
@@ -194,17 +293,19 @@ int Surface::GetQuarter(const Vec3& point, const Vec3& node) const {
 }
 
 
-double Surface::GetOrientationWinding(const Vec3& point,
-                         const Vec3& prev_node, const Vec3& next_node) const {
-    double tmp_1 = (prev_node.GetX() - point.GetX())*
+template<typename T>
+T PolygonSurface::GetOrientationWinding(const Vec3T<T>& point,
+                    const Vec3T<T>& prev_node, const Vec3T<T>& next_node) const {
+    T tmp_1 = (prev_node.GetX() - point.GetX())*
             (next_node.GetY() - point.GetY());
-    double tmp_2 = (next_node.GetX() - point.GetX())*
+    T tmp_2 = (next_node.GetX() - point.GetX())*
             (prev_node.GetY() - point.GetY());
     return  tmp_1 - tmp_2;
 }
 
-int Surface::CalcWindChange(const Vec3& prev_node, const Vec3& next_node,
-                            const Vec3& point) const {
+template<typename T>
+int PolygonSurface::CalcWindChange(const Vec3T<T>& prev_node, const Vec3T<T>& next_node,
+                            const Vec3T<T>& point) const {
     int quarter_prev = GetQuarter(point, prev_node);
     int quarter_next = GetQuarter(point, next_node);
     switch (quarter_next-quarter_prev){
@@ -220,7 +321,7 @@ int Surface::CalcWindChange(const Vec3& prev_node, const Vec3& next_node,
     };
     case 2:
     case -2:{
-        double det = GetOrientationWinding(point, prev_node, next_node);
+        T det = GetOrientationWinding(point, prev_node, next_node);
         return det>0 ? 2 : -2;
     }
     default:{
@@ -229,3 +330,94 @@ int Surface::CalcWindChange(const Vec3& prev_node, const Vec3& next_node,
     }
     }
 }
+
+
+AxisAlignedRect::AxisAlignedRect(std::vector<Vec3>&& g_contour,
+        std::unique_ptr<Reflector>&& g_reflector,
+        std::unique_ptr<ParticleWriter>&& writer):
+    PolygonSurface(std::move(g_contour), std::move(g_reflector), std::move(writer))
+{
+    const std::vector<Vec3>& contour = GetContour();
+    int axis = 0;
+    for(int k=1; k<3; k++){
+        if(std::abs(GetNormal()[k]) > std::abs(GetNormal()[axis])){
+            axis = k;
+        }
+    }
+    int u_axis = (axis+1)%3;
+    int v_axis = (axis+2)%3;
+    rect_.axis_ = axis;
+    rect_.plane_ = contour[0][axis];
+    rect_.normal_sign_ = GetNormal()[axis] > 0 ? 1.0 : -1.0;
+    rect_.u_min_ = std::min(contour[0][u_axis], contour[2][u_axis]);
+    rect_.u_max_ = std::max(contour[0][u_axis], contour[2][u_axis]);
+    rect_.v_min_ = std::min(contour[0][v_axis], contour[2][v_axis]);
+    rect_.v_max_ = std::max(contour[0][v_axis], contour[2][v_axis]);
+}
+
+bool AxisAlignedRect::IsAxisAlignedRect(const std::vector<Vec3>& contour){
+    //every edge goes along one axis and consecutive edges are orthogonal,
+    //so closed contour of four such edges is a rectangle
+    if(contour.size() != 4){
+        return false;
+    }
+    int prev_edge_axis = -1;
+    for(size_t i=0; i<contour.size(); i++){
+        const Vec3& a = contour[i];
+        const Vec3& b = contour[(i+1)%contour.size()];
+        int edge_axis = -1;
+        for(int k=0; k<3; k++){
+            if(a[k] != b[k]){
+                if(edge_axis != -1){
+                    return false;
+                }
+                edge_axis = k;
+            }
+        }
+        if(edge_axis == -1 || edge_axis == prev_edge_axis){
+            return false;
+        }
+        prev_edge_axis = edge_axis;
+    }
+    return true;
+}
+
+const AxisAlignedRect::RectData& AxisAlignedRect::GetRectData() const {
+    return rect_;
+}
+
+std::optional<Vec3> AxisAlignedRect::GetCrossPoint(const ShearedRay& ray) const {
+    int u_axis = (rect_.axis_+1)%3;
+    int v_axis = (rect_.axis_+2)%3;
+    double d = ray.dir_[rect_.axis_];
+    if(d*rect_.normal_sign_ >= 0.0){
+        return std::nullopt;
+    }
+    double t = (rect_.plane_ - ray.org_[rect_.axis_])/d;
+    if(t <= 0){
+        return std::nullopt;
+    }
+    double u = ray.org_[u_axis] + t*ray.dir_[u_axis];
+    double v = ray.org_[v_axis] + t*ray.dir_[v_axis];
+    if(is_mixed_precision_){
+        //same float test as in the batch kernel, bounds relative to the origin
+        float t_f = static_cast<float>(rect_.plane_ - ray.org_[rect_.axis_])*
+                    static_cast<float>(1.0/d);
+        float u_f = t_f*static_cast<float>(ray.dir_[u_axis]);
+        float v_f = t_f*static_cast<float>(ray.dir_[v_axis]);
+        if(u_f < static_cast<float>(rect_.u_min_ - ray.org_[u_axis]) ||
+           u_f > static_cast<float>(rect_.u_max_ - ray.org_[u_axis]) ||
+           v_f < static_cast<float>(rect_.v_min_ - ray.org_[v_axis]) ||
+           v_f > static_cast<float>(rect_.v_max_ - ray.org_[v_axis])){
+            return std::nullopt;
+        }
+    } else if(u < rect_.u_min_ || u > rect_.u_max_ || v < rect_.v_min_ || v > rect_.v_max_){
+        return std::nullopt;
+    }
+    //cross point is put exactly on the plane
+    double coors[3];
+    coors[rect_.axis_] = rect_.plane_;
+    coors[u_axis] = u;
+    coors[v_axis] = v;
+    return Vec3(coors[0], coors[1], coors[2]);
+}
@@ -0,0 +1,157 @@
+﻿#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <fmt/core.h>
+
+#include "sweep.hpp"
+
+namespace {
+
+double CalcInvMeanFreePath(const Background& gas){
+    if(gas.p_ == 0.0){
+        return 0.0;
+    }
+    return 1.0/gas.GetMeanFreePath();
+}
+
+}
+
+SweepTally::SweepTally(const Background& gas, std::vector<double> nominal_R,
+                       std::vector<SweepPoint> points):
+    points_(std::move(points)),
+    nominal_R_(std::move(nominal_R)),
+    nominal_inv_mfp_(CalcInvMeanFreePath(gas)),
+    weights_(points_.size(), 1.0),
+    sum_w_(points_.size()*nominal_R_.size(), 0.0),
+    sum_w2_(points_.size()*nominal_R_.size(), 0.0),
+    sum_diff2_(points_.size()*nominal_R_.size(), 0.0),
+    nominal_count_(nominal_R_.size(), 0)
+{
+    inv_mfp_.reserve(points_.size());
+    for(const auto& point : points_){
+        Background point_gas = gas;
+        point_gas.p_ = point.p_;
+        inv_mfp_.push_back(CalcInvMeanFreePath(point_gas));
+    }
+}
+
+size_t SweepTally::GetIdx(const size_t point, const size_t wall) const {
+    return point*nominal_R_.size() + wall;
+}
+
+void SweepTally::ResetWeights(){
+    std::fill(weights_.begin(), weights_.end(), 1.0);
+}
+
+void SweepTally::OnFlight([[maybe_unused]] const Particle& pt,
+                          const double distance, const bool is_gas_collision){
+    for(size_t k=0; k<points_.size(); k++){
+        if(inv_mfp_[k] == nominal_inv_mfp_){
+            continue;
+        }
+        //ratio of probabilities to fly given distance without collision
+        weights_[k] *= exp(-(inv_mfp_[k] - nominal_inv_mfp_)*distance);
+        if(is_gas_collision){
+            //ratio of collision probability densities at the end point
+            weights_[k] *= inv_mfp_[k]/nominal_inv_mfp_;
+        }
+    }
+}
+
+void SweepTally::OnWallHit([[maybe_unused]] const Particle& pt,
+                           const size_t wall_id, const bool is_reflected){
+    const double R0 = nominal_R_[wall_id];
+    for(size_t k=0; k<points_.size(); k++){
+        const double R = points_[k].R_[wall_id];
+        if(R == R0){
+            continue;
+        }
+        weights_[k] *= is_reflected ? R/R0 : (1.0-R)/(1.0-R0);
+    }
+    if(is_reflected){
+        return;
+    }
+    //history is finished --> score it
+    history_num_++;
+    nominal_count_[wall_id]++;
+    for(size_t k=0; k<points_.size(); k++){
+        size_t idx = GetIdx(k, wall_id);
+        sum_w_[idx] += weights_[k];
+        sum_w2_[idx] += weights_[k]*weights_[k];
+        sum_diff2_[idx] += (weights_[k]-1.0)*(weights_[k]-1.0);
+    }
+    ResetWeights();
+}
+
+void SweepTally::OnLost([[maybe_unused]] const Particle& pt){
+    ResetWeights();
+}
+
+void SweepTally::Merge(const SweepTally& other){
+    history_num_ += other.history_num_;
+    for(size_t i=0; i<sum_w_.size(); i++){
+        sum_w_[i] += other.sum_w_[i];
+        sum_w2_[i] += other.sum_w2_[i];
+        sum_diff2_[i] += other.sum_diff2_[i];
+    }
+    for(size_t i=0; i<nominal_count_.size(); i++){
+        nominal_count_[i] += other.nominal_count_[i];
+    }
+}
+
+size_t SweepTally::GetHistoryNum() const {return history_num_;}
+size_t SweepTally::GetPointNum() const {return points_.size();}
+size_t SweepTally::GetWallNum() const {return nominal_R_.size();}
+
+double SweepTally::GetNominalFraction(const size_t wall) const {
+    if(history_num_ == 0){
+        return 0.0;
+    }
+    return static_cast<double>(nominal_count_[wall])/
+           static_cast<double>(history_num_);
+}
+
+double SweepTally::GetFraction(const size_t point, const size_t wall) const {
+    if(history_num_ == 0){
+        return 0.0;
+    }
+    return sum_w_[GetIdx(point, wall)]/static_cast<double>(history_num_);
+}
+
+double SweepTally::GetFractionError(const size_t point, const size_t wall) const {
+    if(history_num_ < 2){
+        return 0.0;
+    }
+    double n = static_cast<double>(history_num_);
+    double mean = GetFraction(point, wall);
+    double var = sum_w2_[GetIdx(point, wall)]/n - mean*mean;
+    return sqrt(std::max(var, 0.0)/(n-1));
+}
+
+double SweepTally::GetDiffToNominal(const size_t point, const size_t wall) const {
+    return GetFraction(point, wall) - GetNominalFraction(wall);
+}
+
+double SweepTally::GetDiffError(const size_t point, const size_t wall) const {
+    if(history_num_ < 2){
+        return 0.0;
+    }
+    double n = static_cast<double>(history_num_);
+    double mean = GetDiffToNominal(point, wall);
+    double var = sum_diff2_[GetIdx(point, wall)]/n - mean*mean;
+    return sqrt(std::max(var, 0.0)/(n-1));
+}
+
+void SweepTally::WriteResults(std::ostream& out,
+                          const std::vector<std::string>& wall_names) const {
+    out << fmt::format("#Histories: {:d}\n", history_num_);
+    out << "#POINT\tSURFACE\tFRACTION\tERROR\tDIFF_TO_NOMINAL\tDIFF_ERROR\n";
+    for(size_t k=0; k<points_.size(); k++){
+        for(size_t j=0; j<nominal_R_.size(); j++){
+            out << fmt::format("{:s}\t{:s}\t{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\n",
+                               points_[k].name_, wall_names[j],
+                               GetFraction(k, j), GetFractionError(k, j),
+                               GetDiffToNominal(k, j), GetDiffError(k, j));
+        }
+    }
+}
@@ -0,0 +1,92 @@
+﻿#include <algorithm>
+#include <cstdio>
+#include <fmt/core.h>
+
+#include "time_tally.hpp"
+#include "particle.hpp"
+
+TimeTally::TimeTally(const TimeBins& bins, const size_t wall_num):
+    bins_(bins), wall_num_(wall_num),
+    bin_width_(bins.t_max_/static_cast<double>(bins.bin_num_)),
+    counts_(wall_num*(bins.bin_num_ + 1), 0.0) {}
+
+size_t TimeTally::GetIdx(const size_t wall, const size_t bin) const {
+    return wall*(bins_.bin_num_ + 1) + bin;
+}
+
+void TimeTally::OnWallHit(const Particle& pt, const size_t wall_id,
+                          const bool is_reflected){
+    if(is_reflected){
+        return;
+    }
+    size_t bin = pt.GetTime() < bins_.t_max_ ?
+                static_cast<size_t>(pt.GetTime()/bin_width_) : bins_.bin_num_;
+    counts_[GetIdx(wall_id, std::min(bin, bins_.bin_num_))] += 1.0;
+}
+
+void TimeTally::OnHistoryEnd(){
+    history_num_++;
+}
+
+void TimeTally::Merge(const TimeTally& other){
+    for(size_t i=0; i<counts_.size(); i++){
+        counts_[i] += other.counts_[i];
+    }
+    history_num_ += other.history_num_;
+}
+
+void TimeTally::AddSums(const std::vector<double>& counts, const size_t history_num){
+    if(counts.size() != counts_.size()){
+        fprintf(stderr, "time tally: saved counts do not match the bins\n");
+        exit(1);
+    }
+    for(size_t i=0; i<counts_.size(); i++){
+        counts_[i] += counts[i];
+    }
+    history_num_ += history_num;
+}
+
+size_t TimeTally::GetHistoryNum() const {return history_num_;}
+
+double TimeTally::GetCount(const size_t wall, const size_t bin) const {
+    return counts_[GetIdx(wall, bin)];
+}
+
+double TimeTally::GetOverflow(const size_t wall) const {
+    return counts_[GetIdx(wall, bins_.bin_num_)];
+}
+
+const TimeBins& TimeTally::GetBins() const {return bins_;}
+
+const std::vector<double>& TimeTally::GetCounts() const {return counts_;}
+
+void TimeTally::WriteResults(std::ostream& out,
+                             const std::vector<std::string>& wall_names,
+                             const std::vector<double>& errors) const {
+    //fraction of histories absorbed by the wall per time bin
+    double norm = 1.0/static_cast<double>(std::max<size_t>(history_num_, 1));
+    out << fmt::format("#Histories: {:d}\n", history_num_);
+    out << "#T_START\tT_END";
+    for(size_t j=0; j<wall_num_; j++){
+        out << "\t" << wall_names[j];
+        if(!errors.empty()){
+            out << "\t" << wall_names[j] << "_ERR";
+        }
+    }
+    out << "\n";
+    for(size_t i=0; i<=bins_.bin_num_; i++){
+        double t_start = static_cast<double>(i)*bin_width_;
+        if(i < bins_.bin_num_){
+            out << fmt::format("{:.6e}\t{:.6e}", t_start, t_start + bin_width_);
+        } else {
+            out << fmt::format("{:.6e}\tinf", t_start);
+        }
+        for(size_t j=0; j<wall_num_; j++){
+            out << fmt::format("\t{:.6e}", counts_[GetIdx(j, i)]*norm);
+            if(!errors.empty()){
+                out << fmt::format("\t{:.6e}", errors[GetIdx(j, i)]);
+            }
+        }
+        out << "\n";
+    }
+}
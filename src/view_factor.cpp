@@ -0,0 +1,194 @@
+﻿#include <cmath>
+#include <optional>
+#include <random>
+#include <fmt/core.h>
+
+#include "view_factor.hpp"
+#include "particle.hpp"
+#include "reflector.hpp"
+
+namespace {
+
+//Next wall along the ray, boundaries are crossed as in Particle::Trace
+std::optional<size_t> FindNextWall(const Geometry& geo, Vec3 pos, Vec3 dir){
+    const auto& walls = geo.GetSurfaces();
+    for(size_t crossing=0; crossing<=kMaxBoundaryCrossings; crossing++){
+        auto hit = geo.FindClosestHit(ShearedRay(pos, dir));
+        if(!hit){
+            return std::nullopt;
+        }
+        const Surface& wall = *walls[hit->wall_id_];
+        if(wall.GetBoundaryType() == BoundaryType::WALL){
+            return hit->wall_id_;
+        }
+        CrossBoundary(wall, *hit, pos, dir);
+    }
+    return std::nullopt;
+}
+
+}
+
+ViewFactorMatrix::ViewFactorMatrix(const size_t wall_num):
+    wall_num_(wall_num), factors_(wall_num*wall_num, 0.0) {}
+
+size_t ViewFactorMatrix::GetWallNum() const {return wall_num_;}
+
+double ViewFactorMatrix::Get(const size_t from, const size_t to) const {
+    return factors_[from*wall_num_ + to];
+}
+
+void ViewFactorMatrix::Set(const size_t from, const size_t to, const double value){
+    factors_[from*wall_num_ + to] = value;
+}
+
+double ViewFactorMatrix::GetEscape(const size_t from) const {
+    double sum = 0.0;
+    for(size_t to=0; to<wall_num_; to++){
+        sum += Get(from, to);
+    }
+    return 1.0 - sum;
+}
+
+std::vector<double> ViewFactorMatrix::SolveAbsorption(const std::vector<double>& reflection,
+                                            const std::vector<double>& first_hits) const {
+    //(I - F^T diag(R)) h = s by Gauss elimination with partial pivoting
+    size_t n = wall_num_;
+    std::vector<double> a(n*n);
+    std::vector<double> h = first_hits;
+    for(size_t j=0; j<n; j++){
+        for(size_t i=0; i<n; i++){
+            a[j*n + i] = (i == j ? 1.0 : 0.0) - Get(i, j)*reflection[i];
+        }
+    }
+    for(size_t col=0; col<n; col++){
+        size_t pivot = col;
+        for(size_t row=col+1; row<n; row++){
+            if(std::fabs(a[row*n + col]) > std::fabs(a[pivot*n + col])){
+                pivot = row;
+            }
+        }
+        if(std::fabs(a[pivot*n + col]) < 1e-12){
+            fprintf(stderr, "view factor system is singular: particles are never absorbed\n");
+            exit(1);
+        }
+        if(pivot != col){
+            for(size_t i=0; i<n; i++){
+                std::swap(a[col*n + i], a[pivot*n + i]);
+            }
+            std::swap(h[col], h[pivot]);
+        }
+        for(size_t row=col+1; row<n; row++){
+            double factor = a[row*n + col]/a[col*n + col];
+            if(factor == 0.0){
+                continue;
+            }
+            for(size_t i=col; i<n; i++){
+                a[row*n + i] -= factor*a[col*n + i];
+            }
+            h[row] -= factor*h[col];
+        }
+    }
+    for(size_t row=n; row-- > 0;){
+        double sum = h[row];
+        for(size_t i=row+1; i<n; i++){
+            sum -= a[row*n + i]*h[i];
+        }
+        h[row] = sum/a[row*n + row];
+    }
+    std::vector<double> absorbed(n);
+    for(size_t j=0; j<n; j++){
+        absorbed[j] = (1.0 - reflection[j])*h[j];
+    }
+    return absorbed;
+}
+
+void ViewFactorMatrix::WriteResults(std::ostream& out,
+                                    const std::vector<std::string>& wall_names) const {
+    out << "#FROM";
+    for(size_t j=0; j<wall_num_; j++){
+        out << "\t" << wall_names[j];
+    }
+    out << "\tESCAPE\n";
+    for(size_t i=0; i<wall_num_; i++){
+        out << wall_names[i];
+        for(size_t j=0; j<wall_num_; j++){
+            out << fmt::format("\t{:.6e}", Get(i, j));
+        }
+        out << fmt::format("\t{:.6e}\n", GetEscape(i));
+    }
+}
+
+ViewFactorMatrix EstimateViewFactors(const Geometry& geo, const size_t rays_per_wall,
+                                     const unsigned seed){
+    if(geo.GetInstanceNum() > 0){
+        fprintf(stderr, "view factors: geometry instances are not supported\n");
+        exit(1);
+    }
+    const auto& walls = geo.GetSurfaces();
+    size_t wall_num = walls.size();
+    ViewFactorMatrix matrix(wall_num);
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t from=0; from<wall_num; from++){
+        const Surface& wall = *walls[from];
+        if(wall.GetBoundaryType() != BoundaryType::WALL || rays_per_wall == 0){
+            continue;
+        }
+        std::mt19937 rng(seed + static_cast<unsigned>(from));
+        std::vector<size_t> hits(wall_num, 0);
+        for(size_t ray=0; ray<rays_per_wall; ray++){
+            Vec3 point = wall.GetRandomPoint(rng);
+            Vec3 normal = wall.GetNormalAt(point);
+            Particle pt(OffsetPointAlongNormal(point, normal), normal, rng);
+            auto to = FindNextWall(geo, pt.GetPosition(), pt.GetDirection());
+            if(to){
+                hits[*to]++;
+            }
+        }
+        for(size_t to=0; to<wall_num; to++){
+            matrix.Set(from, to, static_cast<double>(hits[to])/
+                                 static_cast<double>(rays_per_wall));
+        }
+    }
+    return matrix;
+}
+
+std::vector<double> EstimateFirstHits(const Geometry& geo,
+                                      const std::vector<ParticleSource>& sources,
+                                      const size_t ray_num, const unsigned seed){
+    std::vector<double> hits(geo.GetSurfaceNum(), 0.0);
+    if(sources.empty() || ray_num == 0){
+        return hits;
+    }
+    std::mt19937 rng(seed);
+    for(size_t ray=0; ray<ray_num; ray++){
+        const ParticleSource& source = sources[ray % sources.size()];
+        Particle pt = Particle::GetGenerator(source.is_dir_random_)(source.point_,
+                                                                  source.direction_, rng);
+        auto to = FindNextWall(geo, pt.GetPosition(), pt.GetDirection());
+        if(to){
+            hits[*to] += 1.0;
+        }
+    }
+    for(auto& h : hits){
+        h /= static_cast<double>(ray_num);
+    }
+    return hits;
+}
+
+std::vector<double> GetLambertianCoefficients(const Geometry& geo){
+    std::vector<double> reflection;
+    for(const auto& wall : geo.GetSurfaces()){
+        if(wall->GetBoundaryType() != BoundaryType::WALL){
+            reflection.push_back(0.0);
+            continue;
+        }
+        const Reflector* reflector = wall->GetReflector();
+        double R = reflector->GetReflectionCoefficient();
+        if(R > 0.0 && !dynamic_cast<const LambertianReflector*>(reflector)){
+            fprintf(stderr, "view factors: walls should have lambertian reflectors\n");
+            exit(1);
+        }
+        reflection.push_back(R);
+    }
+    return reflection;
+}
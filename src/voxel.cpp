@@ -0,0 +1,188 @@
+﻿#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <fmt/core.h>
+
+#include "voxel.hpp"
+#include "particle.hpp"
+
+VoxelTally::VoxelTally(const VoxelGrid& grid):
+    grid_(grid),
+    track_length_(grid.bins_[0]*grid.bins_[1]*grid.bins_[2], 0.0),
+    collisions_(track_length_.size(), 0.0)
+{
+    for(size_t k=0; k<3; k++){
+        int axis = static_cast<int>(k);
+        step_[k] = (grid_.max_[axis] - grid_.min_[axis])/static_cast<double>(grid_.bins_[k]);
+    }
+}
+
+size_t VoxelTally::GetIdx(const size_t ix, const size_t iy, const size_t iz) const {
+    return (ix*grid_.bins_[1] + iy)*grid_.bins_[2] + iz;
+}
+
+void VoxelTally::OnFlight(const Particle& pt, const double distance,
+                          const bool is_gas_collision){
+    AddTrack(pt.GetPosition(), pt.GetDirection(), distance);
+    if(is_gas_collision){
+        AddCollision(pt.GetPosition().AddScaled(pt.GetDirection(), distance));
+    }
+}
+
+void VoxelTally::OnHistoryEnd(){
+    //tracks of the lost particles are already scored, so they are counted
+    history_num_++;
+}
+
+bool VoxelTally::ClipToGrid(const Vec3& start, const Vec3& dir, const double length,
+                            double& t_in, double& t_out) const {
+    t_in = 0.0;
+    t_out = length;
+    for(int k=0; k<3; k++){
+        if(dir[k] == 0.0){
+            if(start[k] < grid_.min_[k] || start[k] > grid_.max_[k]){
+                return false;
+            }
+            continue;
+        }
+        double t1 = (grid_.min_[k] - start[k])/dir[k];
+        double t2 = (grid_.max_[k] - start[k])/dir[k];
+        t_in = std::max(t_in, std::min(t1, t2));
+        t_out = std::min(t_out, std::max(t1, t2));
+    }
+    return t_in < t_out;
+}
+
+void VoxelTally::AddTrack(const Vec3& start, const Vec3& dir, const double length){
+    double t;
+    double t_end;
+    if(!ClipToGrid(start, dir, length, t, t_end)){
+        return;
+    }
+    //Amanatides-Woo traversal: t_next is the distance to the next voxel
+    //border along each axis, t_delta is the distance between borders
+    long idx[3];
+    long step[3];
+    double t_next[3];
+    double t_delta[3];
+    for(size_t k=0; k<3; k++){
+        int axis = static_cast<int>(k);
+        long bins = static_cast<long>(grid_.bins_[k]);
+        double p = start[axis] + t*dir[axis];
+        idx[k] = static_cast<long>(std::floor((p - grid_.min_[axis])/step_[k]));
+        idx[k] = std::max(0L, std::min(bins - 1, idx[k]));
+        if(dir[axis] > 0){
+            step[k] = 1;
+            double border = grid_.min_[axis] + static_cast<double>(idx[k] + 1)*step_[k];
+            t_next[k] = t + (border - p)/dir[axis];
+            t_delta[k] = step_[k]/dir[axis];
+        } else if(dir[axis] < 0){
+            step[k] = -1;
+            double border = grid_.min_[axis] + static_cast<double>(idx[k])*step_[k];
+            t_next[k] = t + (border - p)/dir[axis];
+            t_delta[k] = -step_[k]/dir[axis];
+        } else {
+            step[k] = 0;
+            t_next[k] = std::numeric_limits<double>::infinity();
+            t_delta[k] = std::numeric_limits<double>::infinity();
+        }
+    }
+    while(t < t_end){
+        size_t k = 0;
+        if(t_next[1] < t_next[k]) k = 1;
+        if(t_next[2] < t_next[k]) k = 2;
+        double t_exit = std::min(t_next[k], t_end);
+        track_length_[GetIdx(static_cast<size_t>(idx[0]), static_cast<size_t>(idx[1]),
+                             static_cast<size_t>(idx[2]))] += t_exit - t;
+        t = t_exit;
+        idx[k] += step[k];
+        if(idx[k] < 0 || idx[k] >= static_cast<long>(grid_.bins_[k])){
+            break;
+        }
+        t_next[k] += t_delta[k];
+    }
+}
+
+void VoxelTally::AddCollision(const Vec3& point){
+    size_t idx[3];
+    for(size_t k=0; k<3; k++){
+        int axis = static_cast<int>(k);
+        if(point[axis] < grid_.min_[axis] || point[axis] >= grid_.max_[axis]){
+            return;
+        }
+        idx[k] = static_cast<size_t>((point[axis] - grid_.min_[axis])/step_[k]);
+        idx[k] = std::min(idx[k], grid_.bins_[k] - 1);
+    }
+    collisions_[GetIdx(idx[0], idx[1], idx[2])] += 1.0;
+}
+
+void VoxelTally::Merge(const VoxelTally& other){
+    for(size_t i=0; i<track_length_.size(); i++){
+        track_length_[i] += other.track_length_[i];
+        collisions_[i] += other.collisions_[i];
+    }
+    history_num_ += other.history_num_;
+}
+
+void VoxelTally::AddSums(const std::vector<double>& track_length,
+                         const std::vector<double>& collisions, const size_t history_num){
+    if(track_length.size() != track_length_.size() || collisions.size() != collisions_.size()){
+        fprintf(stderr, "voxel tally: saved sums do not match the grid\n");
+        exit(1);
+    }
+    for(size_t i=0; i<track_length_.size(); i++){
+        track_length_[i] += track_length[i];
+        collisions_[i] += collisions[i];
+    }
+    history_num_ += history_num;
+}
+
+size_t VoxelTally::GetHistoryNum() const {return history_num_;}
+
+double VoxelTally::GetTrackLength(const size_t ix, const size_t iy,
+                                  const size_t iz) const {
+    return track_length_[GetIdx(ix, iy, iz)];
+}
+
+double VoxelTally::GetCollisions(const size_t ix, const size_t iy,
+                                 const size_t iz) const {
+    return collisions_[GetIdx(ix, iy, iz)];
+}
+
+double VoxelTally::GetVoxelVolume() const {
+    return step_[0]*step_[1]*step_[2];
+}
+
+const VoxelGrid& VoxelTally::GetGrid() const {return grid_;}
+
+const std::vector<double>& VoxelTally::GetTrackLengths() const {return track_length_;}
+
+const std::vector<double>& VoxelTally::GetCollisionCounts() const {return collisions_;}
+
+void VoxelTally::WriteResults(std::ostream& out, const std::vector<double>& errors) const {
+    double norm = 1.0/(GetVoxelVolume()*static_cast<double>(std::max<size_t>(history_num_, 1)));
+    out << fmt::format("#Histories: {:d}\n", history_num_);
+    if(errors.empty()){
+        out << "#X\tY\tZ\tTRACK_DENSITY\tCOLLISION_DENSITY\n";
+        out << "#cm\tcm\tcm\tcm^-2\tcm^-3\n";
+    } else {
+        out << "#X\tY\tZ\tTRACK_DENSITY\tCOLLISION_DENSITY\tTRACK_DENSITY_ERR\n";
+        out << "#cm\tcm\tcm\tcm^-2\tcm^-3\tcm^-2\n";
+    }
+    for(size_t ix=0; ix<grid_.bins_[0]; ix++){
+        for(size_t iy=0; iy<grid_.bins_[1]; iy++){
+            for(size_t iz=0; iz<grid_.bins_[2]; iz++){
+                size_t i = GetIdx(ix, iy, iz);
+                out << fmt::format("{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}\t{:.6e}",
+                        grid_.min_.GetX() + (static_cast<double>(ix) + 0.5)*step_[0],
+                        grid_.min_.GetY() + (static_cast<double>(iy) + 0.5)*step_[1],
+                        grid_.min_.GetZ() + (static_cast<double>(iz) + 0.5)*step_[2],
+                        track_length_[i]*norm, collisions_[i]*norm);
+                if(!errors.empty()){
+                    out << fmt::format("\t{:.6e}", errors[i]);
+                }
+                out << "\n";
+            }
+        }
+    }
+}
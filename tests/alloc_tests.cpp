@@ -0,0 +1,204 @@
+﻿#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+#include "geometry.hpp"
+#include "quadric.hpp"
+#include "particle.hpp"
+#include "output.hpp"
+#include "async_output.hpp"
+#include "sweep.hpp"
+#include "voxel.hpp"
+#include "time_tally.hpp"
+#include "box.hpp"
+
+//Replaces the global allocation functions of the test binary. Only the
+//allocations of the thread inside AllocationCounter are counted
+namespace {
+
+std::atomic<size_t> g_alloc_count{0};
+thread_local bool t_is_counted = false;
+
+class AllocationCounter{
+private:
+    size_t start_;
+public:
+    AllocationCounter(): start_(g_alloc_count.load()) {t_is_counted = true;}
+    ~AllocationCounter(){t_is_counted = false;}
+    size_t GetCount() const {return g_alloc_count.load() - start_;}
+};
+
+}
+
+//not inlined, so the compiler does not pair the malloc and the free of the
+//hook with the new and delete expressions of the tests
+[[gnu::noinline]] void* operator new(std::size_t size){
+    if(t_is_counted){
+        g_alloc_count++;
+    }
+    if(void* ptr = std::malloc(size == 0 ? 1 : size)){
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {std::free(ptr);}
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept {std::free(ptr);}
+
+namespace {
+
+//Cube with every kind of surface: statistics of the polygon walls go
+//through the text and columnar writers, a sphere sits inside
+Geometry MakeMixedCube(const std::string& text_file, const std::string& col_file){
+    //small blocks are flushed and compressed while the allocations are counted
+    OutputSettings settings;
+    settings.block_records_ = 64;
+    settings.compress_ = IsCompressionAvailable();
+    auto walls = MakeBoxWalls(Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0),
+                              [&](size_t wall, std::vector<Vec3>&& contour)
+                                    -> std::unique_ptr<Surface>{
+        if(wall == 0){
+            return std::make_unique<PolygonSurface>(std::move(contour),
+                        std::make_unique<LambertianReflector>(0.5),
+                        std::make_unique<TextWriter>(std::ofstream(text_file)));
+        }
+        if(wall == 1){
+            return std::make_unique<PolygonSurface>(std::move(contour),
+                        std::make_unique<MirrorReflector>(0.5),
+                        std::make_unique<ColumnarWriter>(
+                            std::ofstream(col_file, std::ios_base::binary), settings));
+        }
+        return std::make_unique<AxisAlignedRect>(std::move(contour),
+                    std::make_unique<LambertianReflector>(0.5), nullptr);
+    });
+    walls.push_back(std::make_unique<SphereSurface>(Vec3(0.7, 0.7, 0.7), 0.1,
+                    QuadricSide::OUTSIDE, std::make_unique<LambertianReflector>(0.5),
+                    nullptr));
+    return Geometry(std::move(walls));
+}
+
+}
+
+TEST(AllocationTests, CounterSeesAllocations){
+    AllocationCounter counter;
+    auto ptr = std::make_unique<double>(1.0);
+    std::vector<int> vec(10);
+    EXPECT_EQ(counter.GetCount(), 2);
+}
+
+TEST(AllocationTests, TraceDoesNotAllocate){
+    std::string text_file = "alloc_test.txt";
+    std::string col_file = "alloc_test.ptc";
+    {
+        Geometry geo = MakeMixedCube(text_file, col_file);
+        Background gas = {2e-16, 300.0, 20.0};
+        std::vector<double> nominal_R(geo.GetSurfaceNum(), 0.5);
+        std::vector<double> swept_R = nominal_R;
+        swept_R[0] = 0.45;
+        SweepTally sweep(gas, nominal_R, {{"swept", 25.0, swept_R}});
+        VoxelTally voxel({Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0), {4, 4, 4}});
+        TimeTally time_tally({1e-4, 10}, geo.GetSurfaceNum());
+        ObserverGroup observers;
+        observers.Add(&sweep);
+        observers.Add(&voxel);
+        observers.Add(&time_tally);
+        std::mt19937 rng(17u);
+        Particle::GenFunc generator = Particle::GetGenerator(true);
+        auto trace = [&](const size_t num){
+            for(size_t i=0; i<num; i++){
+                Particle pt = generator(Vec3(0.3, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rng);
+                pt.SetSpeed(1e5);
+                pt.Trace(geo, gas, rng, &observers);
+            }
+        };
+        //first records open the stream buffers
+        trace(100);
+        AllocationCounter counter;
+        trace(5000);
+        EXPECT_EQ(counter.GetCount(), 0);
+    }
+    std::remove(text_file.c_str());
+    std::remove(col_file.c_str());
+}
+
+TEST(AllocationTests, CascadeDoesNotAllocate){
+    Geometry geo = MakeBox([]{
+        return std::make_unique<SecondaryEmissionReflector>(
+                    0.2, SecondaryYield{2.5, 200.0, 0.0, 1.0, 4.0});
+    }, Vec3(1.0, 1.0, 1.0));
+    Background gas = {2e-16, 300.0, 20.0};
+    ParticleStack stack(64, 1000);
+    std::mt19937 rng(23u);
+    auto trace = [&](const size_t num){
+        for(size_t i=0; i<num; i++){
+            Particle pt(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rng);
+            pt.SetSpeed(ElectronSpeed(200.0));
+            pt.Trace(geo, gas, rng, nullptr, &stack);
+        }
+    };
+    AllocationCounter counter;
+    trace(2000);
+    EXPECT_EQ(counter.GetCount(), 0);
+    EXPECT_GT(stack.GetPushedNum(), 2000);
+}
+
+TEST(AllocationTests, CompressedBlocksDoNotAllocate){
+    std::string col_file = "alloc_zlib_test.ptc";
+    {
+        OutputSettings settings;
+        settings.block_records_ = 16;
+        settings.compress_ = IsCompressionAvailable();
+        ColumnarWriter writer(std::ofstream(col_file, std::ios_base::binary), settings);
+        writer.WriteHeader();
+        std::mt19937 rng(5u);
+        std::vector<ParticleRecord> records;
+        for(size_t i=0; i<1000; i++){
+            Particle pt(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rng);
+            pt.MakeGasCollision(static_cast<double>(i%7)*0.01, rng);
+            records.push_back(MakeRecord(pt));
+        }
+        AllocationCounter counter;
+        for(const auto& rec : records){
+            writer.Write(rec);
+        }
+        EXPECT_EQ(counter.GetCount(), 0);
+    }
+    ColumnarData data = ReadColumnarFile(col_file);
+    std::remove(col_file.c_str());
+    EXPECT_EQ(data.GetRecordNum(), 1000);
+}
+
+TEST(AllocationTests, AsyncPushDoesNotAllocate){
+    std::string text_file = "alloc_async_test.txt";
+    {
+        TextWriter writer{std::ofstream(text_file)};
+        AsyncWriter async_writer(1, 64, 2);
+        async_writer.Start();
+        Particle pt(Vec3(0.1, 0.2, 0.3), Vec3(1.0, 0.0, 0.0));
+        {
+            AllocationCounter counter;
+            for(size_t i=0; i<1000; i++){
+                async_writer.Push(0, &writer, MakeRecord(pt));
+            }
+            EXPECT_EQ(counter.GetCount(), 0);
+        }
+        async_writer.Finish();
+    }
+    std::remove(text_file.c_str());
+}
+
+TEST(AllocationTests, RandomPointDoesNotAllocate){
+    PolygonSurface surface({Vec3(0.0, 0.0, 0.0), Vec3(2.0, 0.0, 0.0), Vec3(2.0, 1.0, 0.0),
+                            Vec3(1.0, 2.0, 0.0), Vec3(0.0, 1.0, 0.0)},
+                           std::make_unique<MirrorReflector>(1.0), nullptr);
+    std::mt19937 rng(3u);
+    AllocationCounter counter;
+    for(size_t i=0; i<1000; i++){
+        Vec3 point = surface.GetRandomPointInContour(rng);
+        EXPECT_TRUE(surface.CheckIfPointOnSurface(point));
+    }
+    EXPECT_EQ(counter.GetCount(), 0);
+}
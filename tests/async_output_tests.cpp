@@ -0,0 +1,64 @@
+﻿#include <gtest/gtest.h>
+#include <thread>
+#include "async_output.hpp"
+
+namespace {
+
+class CountingWriter : public ParticleWriter{
+public:
+    std::vector<ParticleRecord> records_;
+    std::thread::id writer_thread_;
+    void WriteHeader() override {}
+    void Write(const ParticleRecord& rec) override {
+        writer_thread_ = std::this_thread::get_id();
+        records_.push_back(rec);
+    }
+    void Flush() override {}
+};
+
+}
+
+TEST(AsyncOutputTests, SpscQueueTest){
+    SpscQueue<int> queue(2);
+    int val = 0;
+    EXPECT_FALSE(queue.TryPop(val));
+    EXPECT_TRUE(queue.TryPush(1));
+    EXPECT_TRUE(queue.TryPush(2));
+    EXPECT_FALSE(queue.TryPush(3));
+    EXPECT_TRUE(queue.TryPop(val));
+    EXPECT_EQ(val, 1);
+    EXPECT_TRUE(queue.TryPush(3));
+    EXPECT_TRUE(queue.TryPop(val));
+    EXPECT_EQ(val, 2);
+    EXPECT_TRUE(queue.TryPop(val));
+    EXPECT_EQ(val, 3);
+    EXPECT_FALSE(queue.TryPop(val));
+}
+
+TEST(AsyncOutputTests, AllRecordsAreWritten){
+    const size_t thread_num = 3;
+    const uint64_t rec_num = 10000;
+    CountingWriter writer;
+    AsyncWriter async(thread_num, 16, 2);
+    async.Start();
+    std::vector<std::thread> threads;
+    for(size_t tid=0; tid<thread_num; tid++){
+        threads.emplace_back([&async, &writer, tid, rec_num](){
+            for(uint64_t i=0; i<rec_num; i++){
+                async.Push(tid, &writer, {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, tid, i});
+            }
+        });
+    }
+    for(auto& t : threads){
+        t.join();
+    }
+    async.Finish();
+    ASSERT_EQ(writer.records_.size(), thread_num*rec_num);
+    EXPECT_NE(writer.writer_thread_, std::this_thread::get_id());
+    //order of records from one thread is kept
+    std::vector<uint64_t> next(thread_num, 0);
+    for(const auto& rec : writer.records_){
+        EXPECT_EQ(rec.surf_count_, next[rec.vol_count_]);
+        next[rec.vol_count_]++;
+    }
+}
@@ -0,0 +1,40 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include "batch_stats.hpp"
+
+TEST(BatchStatsTests, MeanAndError){
+    BatchStats stats(2);
+    EXPECT_TRUE(std::isinf(stats.GetMaxRelError()));
+    stats.AddBatch({1.0, 0.0});
+    stats.AddBatch({3.0, 0.0});
+    stats.AddBatch({2.0, 0.0});
+    EXPECT_EQ(stats.GetBatchNum(), 3);
+    EXPECT_NEAR(stats.GetMean(0), 2.0, 1e-15);
+    //sample variance is 1, error of the mean is sqrt(1/3)
+    EXPECT_NEAR(stats.GetError(0), sqrt(1.0/3.0), 1e-14);
+    EXPECT_EQ(stats.GetError(1), 0.0);
+    //zero mean values are not targeted
+    EXPECT_NEAR(stats.GetMaxRelError(), sqrt(1.0/3.0)/2.0, 1e-14);
+}
+
+TEST(BatchStatsTests, RareValuesSkipped){
+    BatchStats stats(2);
+    stats.AddBatch({1.0, 0.0});
+    stats.AddBatch({1.1, 0.02});
+    stats.AddBatch({0.9, 0.0});
+    //second value has the relative error of one
+    EXPECT_NEAR(stats.GetMaxRelError(), 1.0, 1e-12);
+    EXPECT_NEAR(stats.GetMaxRelError(0.1), 0.1/std::sqrt(3.0), 1e-12);
+}
+
+TEST(BatchStatsTests, ErrorFallsAsSqrtOfBatches){
+    std::mt19937 rng(4u);
+    std::normal_distribution<double> rnd(10.0, 1.0);
+    BatchStats stats(1);
+    for(size_t i=0; i<10000; i++){
+        stats.AddBatch({rnd(rng)});
+    }
+    EXPECT_NEAR(stats.GetMean(0), 10.0, 0.05);
+    EXPECT_NEAR(stats.GetError(0), 0.01, 0.001);
+}
@@ -0,0 +1,112 @@
+﻿#ifndef TEST_BOX_HPP
+#define TEST_BOX_HPP
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "geometry.hpp"
+#include "surface.hpp"
+#include "reflector.hpp"
+
+//Contours of the box walls in this order: x=min, y=min, z=min, x=max,
+//y=max, z=max; normals look inside the box unless is_outward
+inline std::vector<std::vector<Vec3>> MakeBoxContours(const Vec3& min, const Vec3& max,
+                                                      const bool is_outward = false){
+    double x0 = min.GetX(), y0 = min.GetY(), z0 = min.GetZ();
+    double x1 = max.GetX(), y1 = max.GetY(), z1 = max.GetZ();
+    std::vector<std::vector<Vec3>> contours {
+        {Vec3(x0, y0, z0), Vec3(x0, y1, z0), Vec3(x0, y1, z1), Vec3(x0, y0, z1)},
+        {Vec3(x0, y0, z0), Vec3(x0, y0, z1), Vec3(x1, y0, z1), Vec3(x1, y0, z0)},
+        {Vec3(x0, y0, z0), Vec3(x1, y0, z0), Vec3(x1, y1, z0), Vec3(x0, y1, z0)},
+        {Vec3(x1, y0, z0), Vec3(x1, y0, z1), Vec3(x1, y1, z1), Vec3(x1, y1, z0)},
+        {Vec3(x0, y1, z0), Vec3(x1, y1, z0), Vec3(x1, y1, z1), Vec3(x0, y1, z1)},
+        {Vec3(x0, y0, z1), Vec3(x0, y1, z1), Vec3(x1, y1, z1), Vec3(x1, y0, z1)}};
+    if(is_outward){
+        for(auto& contour : contours){
+            std::reverse(contour.begin(), contour.end());
+        }
+    }
+    return contours;
+}
+
+//Contours of the unit cube with every wall split into tiles x tiles
+//squares; walls follow in the MakeBoxContours order, normals look inside
+inline std::vector<std::vector<Vec3>> MakeTiledBoxContours(const size_t tiles){
+    std::vector<std::vector<Vec3>> contours;
+    double step = 1.0/static_cast<double>(tiles);
+    for(size_t face=0; face<6; face++){
+        int axis = static_cast<int>(face%3);
+        double side = face < 3 ? 0.0 : 1.0;
+        auto point = [axis, side](double u, double v){
+            double c[3];
+            c[axis] = side;
+            c[(axis + 1)%3] = u;
+            c[(axis + 2)%3] = v;
+            return Vec3(c[0], c[1], c[2]);
+        };
+        for(size_t i=0; i<tiles; i++){
+            for(size_t j=0; j<tiles; j++){
+                double u = static_cast<double>(i)*step;
+                double v = static_cast<double>(j)*step;
+                std::vector<Vec3> contour {point(u, v), point(u + step, v),
+                                           point(u + step, v + step), point(u, v + step)};
+                if(side == 1.0){
+                    std::reverse(contour.begin(), contour.end());
+                }
+                contours.push_back(std::move(contour));
+            }
+        }
+    }
+    return contours;
+}
+
+//Surface of the wall with the given index and contour
+using WallFactory = std::function<std::unique_ptr<Surface>(size_t, std::vector<Vec3>&&)>;
+
+inline std::vector<std::unique_ptr<Surface>> MakeBoxWalls(const Vec3& min, const Vec3& max,
+                                                          const WallFactory& make_wall){
+    std::vector<std::vector<Vec3>> contours = MakeBoxContours(min, max);
+    std::vector<std::unique_ptr<Surface>> walls;
+    for(size_t i=0; i<contours.size(); i++){
+        walls.push_back(make_wall(i, std::move(contours[i])));
+    }
+    return walls;
+}
+
+//Box of axis aligned rectangles from the origin to size, 2x1x1 by default,
+//walls in the MakeBoxContours order; each wall gets its own reflector
+inline Geometry MakeBox(const std::function<std::unique_ptr<Reflector>()>& make_reflector,
+                        const Vec3& size = Vec3(2.0, 1.0, 1.0)){
+    return Geometry(MakeBoxWalls(Vec3(0.0, 0.0, 0.0), size,
+                    [&make_reflector](size_t, std::vector<Vec3>&& contour){
+                        return std::make_unique<AxisAlignedRect>(std::move(contour),
+                                                                 make_reflector(), nullptr);
+                    }));
+}
+
+//all walls are cosine reflectors
+inline Geometry MakeBox(const double reflection, const Vec3& size = Vec3(2.0, 1.0, 1.0)){
+    return MakeBox([reflection]{return std::make_unique<LambertianReflector>(reflection);},
+                   size);
+}
+
+//Unit cube periodic along x, boundaries have no reflector, the other
+//walls are cosine reflectors
+inline Geometry MakePeriodicCube(const double reflection){
+    Geometry geo(MakeBoxWalls(Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0),
+                              [reflection](size_t wall, std::vector<Vec3>&& contour){
+        std::unique_ptr<Reflector> reflector;
+        if(wall%3 != 0){
+            reflector = std::make_unique<LambertianReflector>(reflection);
+        }
+        return std::make_unique<AxisAlignedRect>(std::move(contour), std::move(reflector),
+                                                 nullptr);
+    }));
+    geo.GetSurface(0).SetBoundary(BoundaryType::PERIODIC, Vec3(1.0, 0.0, 0.0));
+    geo.GetSurface(3).SetBoundary(BoundaryType::PERIODIC, Vec3(-1.0, 0.0, 0.0));
+    return geo;
+}
+
+#endif //TEST_BOX_HPP
@@ -0,0 +1,129 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include "detector.hpp"
+#include "reflector.hpp"
+#include "simulation.hpp"
+#include "particle.hpp"
+#include "box.hpp"
+
+namespace {
+
+const std::vector<ParticleSource> kSources {{Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                             false, 0.0}};
+
+//absorbed records on the wall closer than radius to the center
+size_t CountAbsorbed(const RecordTally& records, const size_t wall, const Vec3& center,
+                     const double radius){
+    size_t absorbed = 0;
+    for(size_t i=0; i<records.GetRecordNum(); i++){
+        Vec3 pos(records.GetPositions()[3*i], records.GetPositions()[3*i + 1],
+                 records.GetPositions()[3*i + 2]);
+        if(records.GetWallIds()[i] == wall && pos.GetDistance(center) < radius){
+            absorbed++;
+        }
+    }
+    return absorbed;
+}
+
+}
+
+TEST(DetectorTests, MatchesAnalogArrivals){
+    //disk on the wall y=0 out of the way of the source beam, and the disk
+    //on the wall x=2 where the beam ends
+    double radius = 0.1;
+    Vec3 center(1.0, 0.0, 0.5);
+    Vec3 beam_center(2.0, 0.5, 0.5);
+    double reflection = 0.5;
+    Simulation sim(MakeBox(reflection), {2e-16, 300.0, 20.0}, 1, 13u);
+    sim.SetDetectors({{"disk", center, M_PI*radius*radius, Vec3(0.0, 1.0, 0.0)},
+                      {"outside", Vec3(3.0, 0.5, 0.5), 1.0, std::nullopt},
+                      {"beam", beam_center, M_PI*radius*radius, Vec3(1.0, 0.0, 0.0)}});
+    sim.SetRecordAbsorbed(true);
+    size_t n = 200000;
+    RunResult result = sim.Run(kSources, n);
+    const RecordTally& records = result.records_.value();
+    size_t absorbed = CountAbsorbed(records, 1, center, radius);
+    //every arrival is absorbed with 1 - R
+    double arrivals = static_cast<double>(absorbed)/(1.0 - reflection)/static_cast<double>(n);
+    double arrivals_err = std::sqrt(static_cast<double>(absorbed))/(1.0 - reflection)/
+                          static_cast<double>(n);
+    const DetectorTally& detector = result.detector_.value();
+    EXPECT_EQ(detector.GetHistoryNum(), n);
+    EXPECT_GT(absorbed, 100);
+    EXPECT_NEAR(detector.GetMean(0), arrivals, 4.0*arrivals_err);
+    //next-event estimate is much more precise than the analog count
+    EXPECT_LT(detector.GetError(0), 0.3*arrivals_err);
+    //walls hide it
+    EXPECT_EQ(detector.GetMean(1), 0.0);
+    //uncollided beam is most of the arrivals there
+    size_t beam_absorbed = CountAbsorbed(records, 3, beam_center, radius);
+    double beam_arrivals = static_cast<double>(beam_absorbed)/(1.0 - reflection)/
+                           static_cast<double>(n);
+    double beam_err = std::sqrt(static_cast<double>(beam_absorbed))/(1.0 - reflection)/
+                      static_cast<double>(n);
+    double mfp = Background{2e-16, 300.0, 20.0}.GetMeanFreePath();
+    EXPECT_GT(detector.GetMean(2), std::exp(-1.0/mfp));
+    EXPECT_NEAR(detector.GetMean(2), beam_arrivals, 4.0*beam_err);
+}
+
+TEST(DetectorTests, SpecularWallsInVacuum){
+    //nothing scatters diffusely, only the flights from the random source are scored
+    Simulation sim(MakeBox([]{return std::make_unique<MirrorReflector>(0.9);}),
+                   {2e-16, 300.0, 0.0}, 1, 13u);
+    sim.SetDetectors({{"point", Vec3(1.5, 0.5, 0.5), 0.01, std::nullopt},
+                      {"behind", Vec3(0.5, 0.5, 0.5), 0.01, std::nullopt}});
+    RunResult result = sim.Run({{Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), true, 0.0}},
+                               1000);
+    EXPECT_NEAR(result.detector_->GetMean(0), 0.01/0.25/(2.0*M_PI), 1e-15);
+    //every history scores the same
+    EXPECT_LT(result.detector_->GetError(0), 1e-9);
+    EXPECT_EQ(result.detector_->GetMean(1), 0.0);
+    EXPECT_EQ(result.detector_->GetHistoryNum(), 1000);
+}
+
+TEST(DetectorTests, SecondariesMatchAnalogArrivals){
+    //no reflections, so every arrival is absorbed: from the random source
+    //directly, or as a secondary of any generation
+    auto make_wall = []{
+        return std::make_unique<SecondaryEmissionReflector>(
+                    0.0, SecondaryYield{3.0, 300.0, 0.0, 1.0, 4.0});
+    };
+    double radius = 0.1;
+    Vec3 center(1.5, 0.0, 0.5);
+    Simulation sim(MakeBox(make_wall), {2e-16, 300.0, 0.0}, 1, 3u);
+    sim.SetDetectors({{"disk", center, M_PI*radius*radius, Vec3(0.0, 1.0, 0.0)}});
+    sim.SetRecordAbsorbed(true);
+    size_t n = 100000;
+    RunResult result = sim.Run({{Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), true,
+                                 ElectronSpeed(300.0)}}, n);
+    EXPECT_EQ(result.dropped_num_, 0);
+    size_t absorbed = CountAbsorbed(result.records_.value(), 1, center, radius);
+    double arrivals = static_cast<double>(absorbed)/static_cast<double>(n);
+    double arrivals_err = std::sqrt(static_cast<double>(absorbed))/static_cast<double>(n);
+    EXPECT_GT(absorbed, 1000);
+    EXPECT_NEAR(result.detector_->GetMean(0), arrivals, 4.0*arrivals_err);
+    //direct flights alone are well below
+    double direct = 0.5/M_PI*M_PI*radius*radius*std::sqrt(0.5)/0.5;
+    EXPECT_GT(result.detector_->GetMean(0), 2.0*direct);
+}
+
+TEST(DetectorTests, SingleScatterAttenuation){
+    //gas collision at the origin: 1/(4 pi) times the solid angle and the attenuation
+    Background gas{2e-16, 300.0, 20.0};
+    Geometry geo(MakeBox(0.0));
+    DetectorTally tally({{"point", Vec3(1.5, 0.5, 0.5), 1e-4, std::nullopt},
+                         {"disk", Vec3(1.0, 0.5, 0.9), 1e-4, Vec3(1.0, 0.0, 1.0)}}, gas);
+    Particle pt(Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0));
+    tally.OnScatter(pt, geo, nullptr, pt.GetDirection());
+    tally.OnHistoryEnd();
+    double mfp = gas.GetMeanFreePath();
+    EXPECT_DOUBLE_EQ(tally.GetMean(0), 1e-4/0.25*std::exp(-0.5/mfp)/(4.0*M_PI));
+    EXPECT_DOUBLE_EQ(tally.GetMean(1), 1e-4/0.16*std::sqrt(0.5)*std::exp(-0.4/mfp)/(4.0*M_PI));
+}
+
+TEST(DetectorTests, BoundariesAreRejected){
+    //the ray to the detector would stop at the periodic boundary
+    Simulation sim(MakePeriodicCube(0.5), {2e-16, 300.0, 0.0}, 1, 3u);
+    EXPECT_DEATH(sim.SetDetectors({{"probe", Vec3(0.5, 0.5, 0.5), 1e-2, std::nullopt}}),
+                 "boundaries are not supported");
+}
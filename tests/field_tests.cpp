@@ -0,0 +1,153 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include "field.hpp"
+#include "particle.hpp"
+#include "reflector.hpp"
+#include "simulation.hpp"
+#include "box.hpp"
+
+namespace {
+
+std::shared_ptr<const FieldTransport> MakeUniform(const Vec3& E, const Vec3& B,
+                                                  const FieldStepping& stepping = {}){
+    return std::make_shared<const FieldTransport>(std::make_unique<UniformField>(E, B),
+                                                  stepping);
+}
+
+}
+
+TEST(FieldTests, Gyration){
+    auto field = MakeUniform(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.01));
+    double speed = ElectronSpeed(100.0);
+    double omega = std::fabs(field->GetStepping().charge_to_mass_)*0.01;
+    Vec3 start(0.0, 0.0, 0.0);
+    Vec3 pos = start;
+    Vec3 velocity(speed, 0.0, 0.0);
+    double max_dist = 0.0;
+    //Boris rotation per step is 2*atan(omega*dt/2)
+    double dt = 0.1/omega;
+    double angle = 2.0*std::atan(0.05);
+    size_t turn = static_cast<size_t>(std::round(2.0*M_PI/angle));
+    for(size_t step=0; step<turn; step++){
+        EXPECT_DOUBLE_EQ(field->Push(pos, velocity), dt);
+        pos = pos + velocity.Times(dt);
+        max_dist = std::max(max_dist, pos.GetDistance(start));
+    }
+    EXPECT_NEAR(velocity.Length(), speed, 1e-12*speed);
+    EXPECT_EQ(pos.GetZ(), 0.0);
+    EXPECT_NEAR(max_dist, 2.0*speed/omega, 0.01*max_dist);
+    EXPECT_LT(pos.GetDistance(start), speed*dt);
+}
+
+TEST(FieldTests, EnergyGain){
+    //electron is pushed against E: 10 V/cm along -x
+    auto field = MakeUniform(Vec3(-10.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.0));
+    Vec3 pos(0.0, 0.0, 0.0);
+    Vec3 velocity(ElectronSpeed(1.0), 0.0, 0.0);
+    size_t steps = 0;
+    while(pos.GetX() < 1.0){
+        Vec3 before = velocity;
+        double dt = field->Push(pos, velocity);
+        EXPECT_NEAR(velocity.Length()/before.Length() - 1.0, 0.0,
+                    field->GetStepping().max_speed_change_*1.001);
+        //position goes with the velocity of the half step
+        pos = pos + (before + velocity).Times(0.5*dt);
+        steps++;
+    }
+    EXPECT_NEAR(ElectronEnergy(velocity.Length()), 1.0 + 10.0*pos.GetX(), 1e-6);
+    EXPECT_GT(steps, 10);
+}
+
+TEST(FieldTests, NoFieldNoLimit){
+    auto field = MakeUniform(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.0));
+    Vec3 velocity(1.0, 2.0, 3.0);
+    EXPECT_TRUE(std::isinf(field->Push(Vec3(0.0, 0.0, 0.0), velocity)));
+    EXPECT_EQ(velocity, Vec3(1.0, 2.0, 3.0));
+    FieldStepping stepping;
+    stepping.max_step_ = 0.5;
+    auto limited = MakeUniform(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.0), stepping);
+    EXPECT_DOUBLE_EQ(limited->Push(Vec3(0.0, 0.0, 0.0), velocity), 0.5/velocity.Length());
+}
+
+TEST(FieldTests, GridInterpolation){
+    //linear fields are reproduced exactly, sizes are not multiples of the block
+    Vec3 origin(-1.0, 0.0, 2.0);
+    Vec3 cell(0.5, 0.25, 1.0);
+    std::array<size_t, 3> nodes {5, 6, 7};
+    auto E_at = [](const Vec3& p){
+        return Vec3(p.GetX() + 2.0*p.GetY(), 3.0*p.GetZ(), 1.0);
+    };
+    auto B_at = [](const Vec3& p){
+        return Vec3(0.5, p.GetX() - p.GetZ(), 2.0*p.GetY());
+    };
+    std::vector<Vec3> E;
+    std::vector<Vec3> B;
+    for(size_t iz=0; iz<nodes[2]; iz++){
+        for(size_t iy=0; iy<nodes[1]; iy++){
+            for(size_t ix=0; ix<nodes[0]; ix++){
+                Vec3 p = origin + Vec3(static_cast<double>(ix)*cell.GetX(),
+                                       static_cast<double>(iy)*cell.GetY(),
+                                       static_cast<double>(iz)*cell.GetZ());
+                E.push_back(E_at(p));
+                B.push_back(B_at(p));
+            }
+        }
+    }
+    GridField grid(origin, cell, nodes, E, B);
+    std::mt19937 rng(3u);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    Vec3 far = origin + Vec3(2.0, 1.25, 6.0);
+    std::vector<Vec3> points {origin, far};
+    for(size_t i=0; i<1000; i++){
+        points.push_back(origin + Vec3(2.0*rnd(rng), 1.25*rnd(rng), 6.0*rnd(rng)));
+    }
+    for(const Vec3& p : points){
+        Vec3 e;
+        Vec3 b;
+        grid.GetFields(p, e, b);
+        for(int k=0; k<3; k++){
+            EXPECT_NEAR(e[k], E_at(p)[k], 1e-5);
+            EXPECT_NEAR(b[k], B_at(p)[k], 1e-5);
+        }
+    }
+    Vec3 e;
+    Vec3 b;
+    grid.GetFields(far + Vec3(0.0, 0.0, 1e-9), e, b);
+    EXPECT_EQ(e, Vec3(0.0, 0.0, 0.0));
+    EXPECT_EQ(b, Vec3(0.0, 0.0, 0.0));
+}
+
+TEST(FieldTests, ZeroFieldMatchesStraightFlights){
+    //substeps of the straight flight reach the same walls
+    std::vector<ParticleSource> sources {{Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, ElectronSpeed(10.0)}};
+    Simulation straight(MakeBox(0.5), {2e-16, 300.0, 0.0}, 1, 7u);
+    Simulation stepped(MakeBox(0.5), {2e-16, 300.0, 0.0}, 1, 7u);
+    FieldStepping stepping;
+    stepping.max_step_ = 0.05;
+    stepped.GetGeometry().SetField(MakeUniform(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.0),
+                                               stepping));
+    RunResult expected = straight.Run(sources, 2000);
+    RunResult result = stepped.Run(sources, 2000);
+    EXPECT_EQ(result.lost_num_, 0);
+    EXPECT_EQ(result.absorbed_.GetCounts(), expected.absorbed_.GetCounts());
+}
+
+TEST(FieldTests, MagnetizedTrace){
+    //Larmor radius 0.03 cm: particles spiral along z and never reach the side walls
+    std::vector<ParticleSource> sources {{Vec3(1.0, 0.5, 0.5), Vec3(0.0, 0.0, 1.0),
+                                          true, ElectronSpeed(100.0)}};
+    Simulation sim(MakeBox(0.0), {2e-16, 300.0, 1.0}, 1, 5u);
+    sim.GetGeometry().SetField(MakeUniform(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 0.1)));
+    size_t n = 2000;
+    RunResult result = sim.Run(sources, n);
+    const auto& counts = result.absorbed_.GetCounts();
+    for(size_t wall : {size_t{0}, size_t{1}, size_t{3}, size_t{4}}){
+        EXPECT_EQ(counts[wall], 0) << "wall " << wall;
+    }
+    //gas collisions send some particles down
+    EXPECT_GT(counts[2], 0);
+    EXPECT_GT(counts[5], counts[2]);
+    EXPECT_EQ(counts[2] + counts[5] + result.lost_num_, n);
+    EXPECT_LT(result.lost_num_, n/100);
+}
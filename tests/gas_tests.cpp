@@ -0,0 +1,63 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include <numeric>
+#include "gas.hpp"
+#include "reflector.hpp"
+#include "simulation.hpp"
+#include "box.hpp"
+
+TEST(GasTests, AliasTableFrequencies){
+    //weights p*sigma: 8, 0, 3, 1, 4
+    GasMixture mixture({{"Ar", 2e-16, 4.0}, {"N2", 3e-16, 0.0}, {"He", 0.5e-16, 6.0},
+                        {"Ne", 1e-16, 1.0}, {"O2", 4e-16, 1.0}});
+    EXPECT_DOUBLE_EQ(mixture.GetPressure(), 12.0);
+    EXPECT_DOUBLE_EQ(mixture.GetMeanSigma(), 16e-16/12.0);
+    std::vector<double> expected {0.5, 0.0, 0.1875, 0.0625, 0.25};
+    std::mt19937 rnd_gen(9u);
+    size_t n = 400000;
+    std::vector<size_t> counts(expected.size(), 0);
+    for(size_t i=0; i<n; i++){
+        counts[mixture.SampleSpecies(rnd_gen)]++;
+    }
+    EXPECT_EQ(counts[1], 0);
+    for(size_t i=0; i<expected.size(); i++){
+        double sigma = std::sqrt(expected[i]*(1.0 - expected[i])/static_cast<double>(n));
+        EXPECT_NEAR(static_cast<double>(counts[i])/static_cast<double>(n), expected[i],
+                    5.0*sigma + 1e-12) << "species " << i;
+    }
+}
+
+TEST(GasTests, SingleSpecies){
+    GasMixture mixture({{"Ar", 2e-16, 5.0}});
+    std::mt19937 rnd_gen(1u);
+    for(size_t i=0; i<100; i++){
+        EXPECT_EQ(mixture.SampleSpecies(rnd_gen), 0);
+    }
+}
+
+TEST(GasTests, SpeciesCounters){
+    auto mixture = std::make_shared<const GasMixture>(
+                std::vector<GasSpecies>{{"Ar", 2e-16, 40.0}, {"He", 0.5e-16, 60.0}});
+    Background gas{mixture->GetMeanSigma(), 300.0, mixture->GetPressure(), mixture};
+    //free path of the mixture is set by the combined cross section
+    EXPECT_DOUBLE_EQ(gas.GetMeanFreePath(), 1.38e-17*300.0/(40.0*2e-16 + 60.0*0.5e-16));
+    Simulation sim(MakeBox(0.5), gas, 2, 3u);
+    sim.SetVoxelGrid({Vec3(0.0, 0.0, 0.0), Vec3(2.0, 1.0, 1.0), {1, 1, 1}});
+    sim.SetRecordAbsorbed(true);
+    RunResult result = sim.Run({{Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), true, 0.0}}, 4000);
+    const std::vector<size_t>& species = result.absorbed_.GetSpeciesCounts();
+    ASSERT_EQ(species.size(), 2);
+    size_t total = species[0] + species[1];
+    EXPECT_EQ(static_cast<double>(total), result.voxel_->GetCollisionCounts()[0]);
+    double sigma = std::sqrt(8.0*3.0/121.0/static_cast<double>(total));
+    EXPECT_NEAR(static_cast<double>(species[0])/static_cast<double>(total), 8.0/11.0,
+                5.0*sigma);
+    //every record has a row of the species counts which adds up to its volume count
+    const RecordTally& records = result.records_.value();
+    ASSERT_EQ(records.GetSpeciesNum(), 2);
+    ASSERT_EQ(records.GetSpeciesCounts().size(), 2*records.GetRecordNum());
+    for(size_t i=0; i<records.GetRecordNum(); i++){
+        EXPECT_EQ(records.GetSpeciesCounts()[2*i] + records.GetSpeciesCounts()[2*i + 1],
+                  records.GetVolCounts()[i]);
+    }
+}
@@ -0,0 +1,292 @@
+﻿#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <pthread.h>
+#include "geometry.hpp"
+#include "quadric.hpp"
+#include "loader.hpp"
+#include "box.hpp"
+
+namespace {
+
+std::vector<std::unique_ptr<Surface>> MakeBallBox(const bool is_axis_rect){
+    std::vector<std::unique_ptr<Surface>> walls;
+    for(auto& contour : MakeBoxContours(Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0))){
+        if(is_axis_rect){
+            walls.push_back(std::make_unique<AxisAlignedRect>(std::move(contour),
+                      std::make_unique<MirrorReflector>(0.0), nullptr));
+        } else {
+            walls.push_back(std::make_unique<PolygonSurface>(std::move(contour),
+                      std::make_unique<MirrorReflector>(0.0), std::ofstream()));
+        }
+    }
+    //sphere inside the box is tested by the general path
+    walls.push_back(std::make_unique<SphereSurface>(Vec3(0.5, 0.5, 0.5), 0.1,
+                    QuadricSide::OUTSIDE, std::make_unique<MirrorReflector>(0.0),
+                    nullptr));
+    return walls;
+}
+
+
+//small box with a ball on top, particles move outside of it
+std::vector<std::unique_ptr<Surface>> MakeObstacle(const RigidTransform& transform){
+    std::vector<std::unique_ptr<Surface>> surfaces;
+    for(auto& contour : MakeBoxContours(Vec3(-0.3, -0.3, 0.0), Vec3(0.3, 0.3, 0.4), true)){
+        for(auto& node : contour){
+            node = transform.PointToWorld(node);
+        }
+        surfaces.push_back(std::make_unique<PolygonSurface>(std::move(contour),
+                      std::make_unique<MirrorReflector>(0.0), std::ofstream()));
+    }
+    surfaces.push_back(std::make_unique<SphereSurface>(
+                    transform.PointToWorld(Vec3(0.0, 0.0, 0.6)), 0.2,
+                    QuadricSide::OUTSIDE, std::make_unique<MirrorReflector>(0.0),
+                    nullptr));
+    return surfaces;
+}
+
+std::vector<std::unique_ptr<Surface>> MakeChamber(){
+    std::vector<std::unique_ptr<Surface>> walls;
+    for(auto& contour : MakeBoxContours(Vec3(0.0, 0.0, 0.0), Vec3(10.0, 10.0, 2.0), false)){
+        walls.push_back(std::make_unique<AxisAlignedRect>(std::move(contour),
+                      std::make_unique<MirrorReflector>(0.0), nullptr));
+    }
+    return walls;
+}
+
+std::vector<RigidTransform> MakeGridTransforms(){
+    std::vector<RigidTransform> transforms;
+    for(size_t i=0; i<5; i++){
+        for(size_t j=0; j<5; j++){
+            Vec3 shift(1.0 + 2.0*static_cast<double>(i), 1.0 + 2.0*static_cast<double>(j), 0.5);
+            transforms.emplace_back(shift, Vec3(0.0, 0.0, 1.0),
+                                    0.1*static_cast<double>(i*5 + j));
+        }
+    }
+    return transforms;
+}
+
+}
+
+TEST(GeometryTests, BatchMatchesGeneralPath){
+    Geometry rect_geo(MakeBallBox(true));
+    Geometry poly_geo(MakeBallBox(false));
+    std::mt19937 rng(11u);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    size_t sphere_hits = 0;
+    for(size_t i=0; i<10000; i++){
+        Vec3 start(rnd(rng), rnd(rng), rnd(rng));
+        if(start.GetDistance(Vec3(0.5, 0.5, 0.5)) < 0.1){
+            continue;
+        }
+        Vec3 dir = Vec3(rnd(rng)-0.5, rnd(rng)-0.5, rnd(rng)-0.5).Norm();
+        ShearedRay ray(start, dir);
+        auto rect_hit = rect_geo.FindClosestHit(ray);
+        auto poly_hit = poly_geo.FindClosestHit(ray);
+        ASSERT_TRUE(rect_hit);
+        ASSERT_TRUE(poly_hit);
+        EXPECT_EQ(rect_hit->wall_id_, poly_hit->wall_id_);
+        EXPECT_NEAR(rect_hit->point_.GetDistance(poly_hit->point_), 0.0, 1e-12);
+        sphere_hits += rect_hit->wall_id_ == 6;
+    }
+    EXPECT_GT(sphere_hits, 0);
+}
+
+TEST(GeometryTests, MixedPrecisionBatch){
+    Geometry double_geo(MakeBallBox(true));
+    Geometry mixed_geo(MakeBallBox(true));
+    mixed_geo.SetMixedPrecision(true);
+    std::mt19937 rng(5u);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    for(size_t i=0; i<10000; i++){
+        Vec3 start(rnd(rng), rnd(rng), rnd(rng));
+        if(start.GetDistance(Vec3(0.5, 0.5, 0.5)) < 0.1){
+            continue;
+        }
+        Vec3 dir = Vec3(rnd(rng)-0.5, rnd(rng)-0.5, rnd(rng)-0.5).Norm();
+        ShearedRay ray(start, dir);
+        auto double_hit = double_geo.FindClosestHit(ray);
+        auto mixed_hit = mixed_geo.FindClosestHit(ray);
+        ASSERT_TRUE(double_hit);
+        ASSERT_TRUE(mixed_hit);
+        EXPECT_EQ(double_hit->wall_id_, mixed_hit->wall_id_);
+        //float only picks the wall, its cross point is found in double
+        EXPECT_NEAR(double_hit->point_.GetDistance(mixed_hit->point_), 0.0, 1e-12);
+    }
+    //single rectangle takes the same float test
+    const Surface& wall = *mixed_geo.GetSurfaces()[3];
+    auto cross = wall.GetCrossPoint(Vec3(0.5, 0.5, 0.5), Vec3(0.5, 0.25, 0.0));
+    ASSERT_TRUE(cross);
+    EXPECT_EQ(cross->GetX(), 1.0);
+    EXPECT_DOUBLE_EQ(cross->GetY(), 0.75);
+}
+
+TEST(GeometryTests, RigidTransformRoundTrip){
+    RigidTransform transform(Vec3(1.0, -2.0, 3.0), Vec3(1.0, 1.0, 0.0), 0.7);
+    Vec3 point(0.3, 0.2, -0.5);
+    Vec3 back = transform.PointToLocal(transform.PointToWorld(point));
+    EXPECT_NEAR(back.GetDistance(point), 0.0, 1e-15);
+    Vec3 dir = transform.DirToWorld(Vec3(0.0, 0.0, 1.0));
+    EXPECT_NEAR(dir.Length(), 1.0, 1e-15);
+    //rotation around (1,1,0) keeps it in place
+    Vec3 axis = transform.DirToWorld(Vec3(1.0, 1.0, 0.0));
+    EXPECT_NEAR(axis.GetDistance(Vec3(1.0, 1.0, 0.0)), 0.0, 1e-15);
+}
+
+TEST(GeometryTests, InstancesMatchFlatGeometry){
+    auto transforms = MakeGridTransforms();
+    Geometry instanced(MakeChamber());
+    size_t prototype = instanced.AddPrototype(MakeObstacle(RigidTransform()));
+    for(const auto& tr : transforms){
+        instanced.AddInstance(prototype, tr);
+    }
+    instanced.BuildInstanceTree();
+    std::vector<std::unique_ptr<Surface>> flat_walls = MakeChamber();
+    for(const auto& tr : transforms){
+        for(auto& s : MakeObstacle(tr)){
+            flat_walls.push_back(std::move(s));
+        }
+    }
+    Geometry flat(std::move(flat_walls));
+    EXPECT_EQ(instanced.GetSurfaceNum(), 13);
+    EXPECT_EQ(instanced.GetInstanceNum(), 25);
+    EXPECT_TRUE(instanced.CheckOrientations());
+
+    std::mt19937 rng(5u);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    size_t obstacle_hits = 0;
+    for(size_t i=0; i<20000; i++){
+        //start between the obstacles
+        Vec3 start(2.0*static_cast<double>(rng()%6), 10.0*rnd(rng), 2.0*rnd(rng));
+        Vec3 dir = Vec3(rnd(rng)-0.5, rnd(rng)-0.5, rnd(rng)-0.5).Norm();
+        ShearedRay ray(start, dir);
+        auto inst_hit = instanced.FindClosestHit(ray);
+        auto flat_hit = flat.FindClosestHit(ray);
+        ASSERT_EQ(inst_hit.has_value(), flat_hit.has_value());
+        if(!inst_hit){
+            continue;
+        }
+        EXPECT_NEAR(inst_hit->point_.GetDistance(flat_hit->point_), 0.0, 1e-12);
+        EXPECT_NEAR(inst_hit->normal_.Dot(flat_hit->normal_), 1.0, 1e-9);
+        if(flat_hit->wall_id_ < 6){
+            EXPECT_EQ(inst_hit->wall_id_, flat_hit->wall_id_);
+        } else {
+            EXPECT_EQ(inst_hit->wall_id_, 6 + (flat_hit->wall_id_ - 6)%7);
+            obstacle_hits++;
+        }
+    }
+    EXPECT_GT(obstacle_hits, 1000);
+}
+
+TEST(GeometryTests, LoadInstances){
+    json data = json::parse(R"({
+        "general" : {},
+        "geometry" : [],
+        "prototypes" : [
+            {"name" : "ball", "surfaces" : [
+                {"name" : "ball_surface", "type" : "sphere", "side" : "outside",
+                 "reflector_type" : "mirror", "reflection_coefficient" : 0.0,
+                 "collect_statistics" : false,
+                 "center" : [0.0, 0.0, 0.0], "radius" : 0.1}]},
+            {"name" : "room", "surfaces" : [
+                {"name" : "room_surface", "type" : "sphere",
+                 "reflector_type" : "mirror", "reflection_coefficient" : 0.0,
+                 "collect_statistics" : false,
+                 "center" : [0.0, 0.0, 0.0], "radius" : 10.0}]}
+        ],
+        "instances" : [
+            {"prototype" : "room"},
+            {"prototype" : "ball", "shift" : [-2.0, -2.0, 0.0],
+             "repeat" : [3, 2, 1], "step" : [1.0, 1.0, 0.0]}
+        ]})");
+    Geometry geo = load_geometry(data);
+    EXPECT_EQ(geo.GetSurfaceNum(), 2);
+    EXPECT_EQ(geo.GetInstanceNum(), 7);
+    EXPECT_EQ(load_surface_names(data).back(), "room_surface");
+    auto hit = geo.FindClosestHit(ShearedRay(Vec3(-5.0, -1.0, 0.0), Vec3(1.0, 0.0, 0.0)));
+    ASSERT_TRUE(hit);
+    EXPECT_EQ(hit->wall_id_, 0);
+    EXPECT_NEAR(hit->point_.GetX(), -2.1, 1e-12);
+}
+
+TEST(GeometryTests, LoadWithoutWriters){
+    json data = json::parse(R"({
+        "general" : {},
+        "geometry" : [
+            {"name" : "load_without_writers.txt", "type" : "sphere",
+             "reflector_type" : "mirror", "reflection_coefficient" : 0.0,
+             "collect_statistics" : true,
+             "center" : [0.0, 0.0, 0.0], "radius" : 1.0}]})");
+    Geometry geo = load_geometry(data, FileMode::NONE);
+    EXPECT_FALSE(geo.GetSurfaces()[0]->IsSaveStat());
+    EXPECT_FALSE(std::ifstream("load_without_writers.txt").is_open());
+    Geometry saved_geo = load_geometry(data);
+    EXPECT_TRUE(saved_geo.GetSurfaces()[0]->IsSaveStat());
+    std::remove("load_without_writers.txt");
+}
+
+namespace {
+
+//unit box: x=0 and x=1 faces are given boundaries, the others absorb
+Geometry MakeBoundaryBox(const BoundaryType low_x, const BoundaryType high_x){
+    std::vector<std::unique_ptr<Surface>> walls;
+    for(auto& contour : MakeBoxContours(Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0), false)){
+        walls.push_back(std::make_unique<AxisAlignedRect>(std::move(contour),
+                      std::make_unique<LambertianReflector>(0.0), nullptr));
+    }
+    walls[0]->SetBoundary(low_x, Vec3(1.0, 0.0, 0.0));
+    walls[3]->SetBoundary(high_x, Vec3(-1.0, 0.0, 0.0));
+    return Geometry(std::move(walls));
+}
+
+}
+
+TEST(GeometryTests, PeriodicBoundary){
+    Geometry geo = MakeBoundaryBox(BoundaryType::PERIODIC, BoundaryType::PERIODIC);
+    Background gas = {2e-16, 300.0, 0.0};
+    std::mt19937 rng(1u);
+    Particle pt(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.05, 0.0));
+    ASSERT_EQ(pt.Trace(geo, gas, rng), 1);
+    EXPECT_EQ(pt.GetSurfCount(), 1);
+    EXPECT_EQ(pt.GetPosition().GetY(), 1.0);
+    EXPECT_NEAR(pt.GetPosition().GetX(), 0.5, 1e-9);
+    EXPECT_NEAR(pt.GetPosition().GetZ(), 0.5, 1e-15);
+    //endless flight between periodic faces
+    Particle parallel(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0));
+    EXPECT_EQ(parallel.Trace(geo, gas, rng), 0);
+}
+
+TEST(GeometryTests, BoundaryCrossingsOnSmallStack){
+    //all the crossings up to the limit are made in one frame, so the
+    //particle is traced on a thread with a 64 kB stack
+    struct Run{
+        Geometry geo = MakeBoundaryBox(BoundaryType::PERIODIC, BoundaryType::PERIODIC);
+        size_t result = 1;
+    } run;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64*1024);
+    pthread_t thread;
+    ASSERT_EQ(pthread_create(&thread, &attr, [](void* arg) -> void* {
+        Run& r = *static_cast<Run*>(arg);
+        Background gas = {2e-16, 300.0, 0.0};
+        std::mt19937 rng(1u);
+        Particle parallel(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0));
+        r.result = parallel.Trace(r.geo, gas, rng);
+        return nullptr;
+    }, &run), 0);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+    EXPECT_EQ(run.result, 0);
+}
+
+TEST(GeometryTests, SymmetryBoundary){
+    Geometry geo = MakeBoundaryBox(BoundaryType::WALL, BoundaryType::SYMMETRY);
+    Background gas = {2e-16, 300.0, 0.0};
+    std::mt19937 rng(1u);
+    Particle pt(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.1, 0.0));
+    ASSERT_EQ(pt.Trace(geo, gas, rng), 1);
+    EXPECT_EQ(pt.GetSurfCount(), 1);
+    EXPECT_EQ(pt.GetPosition().GetX(), 0.0);
+    EXPECT_NEAR(pt.GetPosition().GetY(), 0.65, 1e-12);
+}
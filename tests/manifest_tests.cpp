@@ -0,0 +1,153 @@
+﻿#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include "manifest.hpp"
+#include "loader.hpp"
+#include "reflector.hpp"
+#include "box.hpp"
+
+namespace {
+
+Simulation MakeSimulation(const size_t thread_num){
+    Simulation sim(MakeBox(0.5), {2e-16, 300.0, 10.0}, thread_num, 17u);
+    sim.SetVoxelGrid({Vec3(0.0, 0.0, 0.0), Vec3(2.0, 1.0, 1.0), {4, 2, 2}});
+    sim.SetTimeBins({1e-7, 20});
+    return sim;
+}
+
+const std::vector<ParticleSource> kSources {{Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                             true, 1e7}};
+
+//rows of the text surface file, header lines start with #
+size_t CountRows(const std::string& name){
+    std::ifstream in(name);
+    size_t rows = 0;
+    std::string line;
+    while(std::getline(in, line)){
+        if(!line.empty() && line[0] != '#'){
+            rows++;
+        }
+    }
+    return rows;
+}
+
+}
+
+TEST(ManifestTests, RoundTrip){
+    Simulation sim = MakeSimulation(2);
+    RunManifest manifest{0x0123456789abcdefull, sim.GetSeed(), {{0, 2}, {2, 5}},
+                         sim.Run(kSources, 3000)};
+    std::stringstream stream;
+    WriteManifest(stream, manifest);
+    RunManifest read = ReadManifest(stream);
+    EXPECT_EQ(read.config_hash_, manifest.config_hash_);
+    EXPECT_EQ(read.seed_, 17u);
+    ASSERT_EQ(read.streams_.size(), 2);
+    EXPECT_EQ(read.GetNextStream(), 5);
+    const RunResult& expected = manifest.result_;
+    EXPECT_EQ(read.result_.traced_num_, expected.traced_num_);
+    EXPECT_EQ(read.result_.lost_num_, expected.lost_num_);
+    EXPECT_EQ(read.result_.absorbed_.GetCounts(), expected.absorbed_.GetCounts());
+    EXPECT_EQ(read.result_.absorbed_.GetFlightNum(), expected.absorbed_.GetFlightNum());
+    ASSERT_TRUE(read.result_.voxel_ && read.result_.time_);
+    //sums are written with the round trip precision
+    EXPECT_EQ(read.result_.voxel_->GetTrackLengths(), expected.voxel_->GetTrackLengths());
+    EXPECT_EQ(read.result_.voxel_->GetCollisionCounts(), expected.voxel_->GetCollisionCounts());
+    EXPECT_EQ(read.result_.voxel_->GetHistoryNum(), expected.voxel_->GetHistoryNum());
+    EXPECT_EQ(read.result_.time_->GetCounts(), expected.time_->GetCounts());
+    EXPECT_EQ(read.result_.time_->GetHistoryNum(), expected.time_->GetHistoryNum());
+}
+
+TEST(ManifestTests, TopUpMatchesLongerRun){
+    //one thread per stream: the first run and its top-up trace exactly the
+    //histories of one run with two threads
+    Simulation full = MakeSimulation(2);
+    RunResult expected = full.Run(kSources, 4000);
+    Simulation first = MakeSimulation(1);
+    RunResult result = first.Run(kSources, 2000);
+    Simulation top_up = MakeSimulation(1);
+    top_up.SetRandomStreams(17u, 1);
+    RunResult more = top_up.Run(kSources, 2000);
+    EXPECT_NE(result.absorbed_.GetCounts(), more.absorbed_.GetCounts());
+    result.Merge(more);
+    EXPECT_EQ(result.absorbed_.GetCounts(), expected.absorbed_.GetCounts());
+    EXPECT_EQ(result.voxel_->GetHistoryNum(), expected.voxel_->GetHistoryNum());
+    EXPECT_EQ(result.time_->GetCounts(), expected.time_->GetCounts());
+}
+
+TEST(ManifestTests, PhysicsHash){
+    nlohmann::json config = {{"general", {{"number_of_threads", 4}, {"seed", 1}}},
+                             {"particles", {{"number", 1000}, {"energy", 10.0}}},
+                             {"gas", {{"pressure", 10.0}}}};
+    uint64_t hash = CalcPhysicsHash(config);
+    nlohmann::json run_control = config;
+    run_control["general"]["number_of_threads"] = 8;
+    run_control["general"]["seed"] = 2;
+    run_control["particles"]["number"] = 5000;
+    run_control["stopping"] = {{"relative_error", 0.01}};
+    EXPECT_EQ(CalcPhysicsHash(run_control), hash);
+    nlohmann::json physics = config;
+    physics["gas"]["pressure"] = 20.0;
+    EXPECT_NE(CalcPhysicsHash(physics), hash);
+}
+
+TEST(ManifestTests, SurfaceFilesMatchRuns){
+    nlohmann::json config = nlohmann::json::parse(R"({
+        "general" : {"number_of_threads" : 1, "seed" : 5},
+        "gas" : {"sigma" : 2e-16, "temperature" : 300.0, "pressure" : 5.0},
+        "particles" : {"number" : 500, "source_point" : [0.5, 0.5, 0.5],
+                       "direction" : [1.0, 0.0, 0.0], "is_dir_random" : true},
+        "geometry" : [
+            {"name" : "manifest_x0.txt", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.5, "collect_statistics" : true,
+             "contour" : [[0, 0, 0], [0, 1, 0], [0, 1, 1], [0, 0, 1]]},
+            {"name" : "manifest_y0.txt", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.5, "collect_statistics" : true,
+             "contour" : [[0, 0, 0], [0, 0, 1], [1, 0, 1], [1, 0, 0]]},
+            {"name" : "manifest_z0.txt", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.5, "collect_statistics" : true,
+             "contour" : [[0, 0, 0], [1, 0, 0], [1, 1, 0], [0, 1, 0]]},
+            {"name" : "manifest_x1.txt", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.5, "collect_statistics" : true,
+             "contour" : [[1, 0, 0], [1, 0, 1], [1, 1, 1], [1, 1, 0]]},
+            {"name" : "manifest_y1.txt", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.5, "collect_statistics" : true,
+             "contour" : [[0, 1, 0], [1, 1, 0], [1, 1, 1], [0, 1, 1]]},
+            {"name" : "manifest_z1.txt", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.5, "collect_statistics" : true,
+             "contour" : [[0, 0, 1], [0, 1, 1], [1, 1, 1], [1, 0, 1]]}
+        ]})");
+    std::vector<std::string> names = load_surface_names(config);
+    //rows left by an earlier run
+    for(const auto& name : names){
+        std::ofstream(name) << "0 0 0 0 0 0 0 0\n";
+    }
+    ParticleSource source = load_particle_source(config);
+    std::optional<RunManifest> manifest;
+    {
+        //writers are flushed when the simulation goes away
+        Simulation sim = load_simulation(config);
+        for(const auto& s : sim.GetGeometry().GetSurfaces()){
+            s->WriteFileHeader();
+        }
+        manifest = RunManifest{CalcPhysicsHash(config), sim.GetSeed(),
+                               {{sim.GetFirstStream(), sim.GetFirstStream() + 1}},
+                               sim.Run({source}, 500)};
+    }
+    for(size_t i=0; i<names.size(); i++){
+        EXPECT_EQ(CountRows(names[i]), manifest->result_.absorbed_.GetCount(i)) << names[i];
+    }
+    {
+        Simulation sim = load_simulation(config, FileMode::APPEND);
+        sim.SetRandomStreams(manifest->seed_, manifest->GetNextStream());
+        manifest->result_.Merge(sim.Run({source}, 300));
+    }
+    EXPECT_EQ(manifest->result_.traced_num_, 800);
+    for(size_t i=0; i<names.size(); i++){
+        EXPECT_EQ(CountRows(names[i]), manifest->result_.absorbed_.GetCount(i)) << names[i];
+        std::remove(names[i].c_str());
+    }
+}
@@ -0,0 +1,56 @@
+﻿#include <gtest/gtest.h>
+#include "numa.hpp"
+#include "geometry.hpp"
+#include "reflector.hpp"
+
+TEST(NumaTests, ParseCpuList){
+    EXPECT_EQ(ParseCpuList("0-3,8,10-11\n"), std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(ParseCpuList("5"), std::vector<int>({5}));
+    EXPECT_TRUE(ParseCpuList("").empty());
+}
+
+TEST(NumaTests, RoundRobinPlacement){
+    ThreadPlacement placement({{0, 1, 2}, {4, 5, 6}}, 5);
+    EXPECT_EQ(placement.GetNodeNum(), 2);
+    EXPECT_EQ(placement.GetCpu(0), 0);
+    EXPECT_EQ(placement.GetCpu(1), 4);
+    EXPECT_EQ(placement.GetCpu(2), 1);
+    EXPECT_EQ(placement.GetCpu(4), 2);
+    EXPECT_EQ(placement.GetNode(3), 1);
+    EXPECT_TRUE(placement.IsFirstOnNode(0));
+    EXPECT_TRUE(placement.IsFirstOnNode(1));
+    EXPECT_FALSE(placement.IsFirstOnNode(2));
+    //more threads than CPUs
+    ThreadPlacement crowded({{3}}, 2);
+    EXPECT_EQ(crowded.GetCpu(1), 3);
+}
+
+TEST(NumaTests, ReadNodesAndPin){
+    auto nodes = ReadNumaNodes();
+    ASSERT_FALSE(nodes.empty());
+    {
+        AffinityGuard guard;
+        EXPECT_TRUE(PinCurrentThread(nodes.front().front()));
+    }
+    //the rest of the tests run on all the allowed CPUs again
+    EXPECT_EQ(ReadNumaNodes(), nodes);
+}
+
+TEST(NumaTests, ReplicaSharesSurfaces){
+    std::vector<std::unique_ptr<Surface>> walls;
+    walls.push_back(std::make_unique<AxisAlignedRect>(
+            std::vector<Vec3>{Vec3(1.0, 0.0, 0.0), Vec3(1.0, 0.0, 1.0),
+                              Vec3(1.0, 1.0, 1.0), Vec3(1.0, 1.0, 0.0)},
+            std::make_unique<MirrorReflector>(1.0), nullptr));
+    Geometry geo(std::move(walls));
+    auto replica = geo.MakeReplica();
+    EXPECT_TRUE(replica->IsReplicaOf(geo));
+    EXPECT_EQ(replica->GetSurfaceNum(), 1);
+    EXPECT_EQ(&replica->GetSurface(0), &geo.GetSurface(0));
+    ShearedRay ray(Vec3(0.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0));
+    auto hit = replica->FindClosestHit(ray);
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(hit->point_.GetX(), 1.0);
+    //replica of the replica still uses the origin surfaces
+    EXPECT_TRUE(replica->MakeReplica()->IsReplicaOf(geo));
+}
@@ -0,0 +1,101 @@
+﻿#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include "output.hpp"
+#include "particle.hpp"
+
+namespace {
+
+std::vector<Particle> MakeParticles(const size_t num){
+    std::vector<Particle> pts;
+    std::mt19937 rnd_gen(42);
+    for(size_t i=0; i<num; i++){
+        pts.emplace_back(Vec3(0.1*static_cast<double>(i), 0.5, 1.0/3.0),
+                         Vec3(1.0, 0.0, 0.0), rnd_gen);
+    }
+    return pts;
+}
+
+void WriteFile(const std::string& name, const OutputSettings& settings,
+               const std::vector<Particle>& pts){
+    std::ofstream out(name, std::ios_base::binary);
+    ColumnarWriter writer(std::move(out), settings);
+    writer.WriteHeader();
+    for(const auto& pt : pts){
+        writer.Write(MakeRecord(pt));
+    }
+}
+
+}
+
+TEST(OutputTests, ColumnarRoundTrip){
+    std::string name = "columnar_round_trip.ptc";
+    auto pts = MakeParticles(1000);
+    OutputSettings settings;
+    settings.block_records_ = 300;
+    settings.config_hash_ = 0x1234abcdull;
+    WriteFile(name, settings, pts);
+    ColumnarData data = ReadColumnarFile(name);
+    std::remove(name.c_str());
+    ASSERT_EQ(data.GetRecordNum(), pts.size());
+    EXPECT_EQ(data.config_hash_, 0x1234abcdull);
+    for(size_t i=0; i<pts.size(); i++){
+        EXPECT_EQ(data.float_cols_[0][i], pts[i].GetPosition().GetX());
+        EXPECT_EQ(data.float_cols_[2][i], pts[i].GetPosition().GetZ());
+        EXPECT_EQ(data.float_cols_[3][i],
+                  static_cast<double>(static_cast<float>(pts[i].GetDirection().GetX())));
+        EXPECT_EQ(data.count_cols_[0][i], 0);
+    }
+}
+
+TEST(OutputTests, ColumnarTypesAndCompression){
+    std::string name = "columnar_types.ptc";
+    auto pts = MakeParticles(500);
+    OutputSettings settings;
+    settings.column_types_ = {ColumnType::F32, ColumnType::F64, ColumnType::F32,
+                              ColumnType::F64, ColumnType::F64, ColumnType::F64,
+                              ColumnType::U32, ColumnType::U64};
+    settings.compress_ = IsCompressionAvailable();
+    WriteFile(name, settings, pts);
+    //appended segment with other column types
+    {
+        std::ofstream out(name, std::ios_base::binary | std::ios_base::app);
+        ColumnarWriter writer(std::move(out), OutputSettings());
+        writer.WriteHeader();
+        writer.Write(MakeRecord(pts.front()));
+    }
+    ColumnarData data = ReadColumnarFile(name);
+    std::remove(name.c_str());
+    ASSERT_EQ(data.GetRecordNum(), pts.size()+1);
+    for(size_t i=0; i<pts.size(); i++){
+        EXPECT_EQ(data.float_cols_[0][i],
+                  static_cast<double>(static_cast<float>(pts[i].GetPosition().GetX())));
+        EXPECT_EQ(data.float_cols_[4][i], pts[i].GetDirection().GetY());
+        EXPECT_EQ(data.count_cols_[1][i], 0);
+    }
+    EXPECT_EQ(data.float_cols_[1].back(), pts.front().GetPosition().GetY());
+}
+
+TEST(OutputTests, ColumnarBrokenRecordNum){
+    std::string name = "columnar_broken.ptc";
+    WriteFile(name, OutputSettings(), MakeParticles(10));
+    std::fstream file(name, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    file.seekg(0, std::ios_base::end);
+    std::string bytes(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+    //the block claims more records than its columns hold
+    size_t block_pos = bytes.find("PBLK");
+    ASSERT_NE(block_pos, std::string::npos);
+    uint32_t rec_num = 1000;
+    file.seekp(static_cast<std::streamoff>(block_pos + 4));
+    file.write(reinterpret_cast<const char*>(&rec_num), sizeof(rec_num));
+    file.close();
+    EXPECT_DEATH(ReadColumnarFile(name), "Columnar file is truncated");
+    std::remove(name.c_str());
+}
+
+TEST(OutputTests, ConfigHashTest){
+    EXPECT_EQ(CalcConfigHash(""), 14695981039346656037ull);
+    EXPECT_NE(CalcConfigHash("{\"a\":1}"), CalcConfigHash("{\"a\":2}"));
+}
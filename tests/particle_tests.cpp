@@ -86,3 +86,46 @@ TEST(ParticleTests, GeneratorTest){
     Particle rnd_pt = rand_pt_gen(start_point, direction2, rnd_gen);
     EXPECT_NE(rnd_pt.GetDirection(), direction2.Norm());
 }
+
+
+TEST(ParticleTests, ParticleStack){
+    ParticleStack stack(2, 10);
+    Particle first(Vec3(1.0, 0.0, 0.0), Vec3(1.0, 0.0, 0.0));
+    first.SetSpeed(3.0);
+    Particle second = first.MakeSecondary(Vec3(2.0, 0.0, 0.0), Vec3(0.0, 1.0, 0.0), 5.0);
+    EXPECT_EQ(second.GetSpeed(), 5.0);
+    EXPECT_EQ(second.GetTime(), first.GetTime());
+    EXPECT_EQ(second.GetSurfCount(), 0);
+    stack.Push(first);
+    stack.Push(second);
+    stack.Push(first);
+    EXPECT_EQ(stack.GetSize(), 2);
+    EXPECT_EQ(stack.GetPushedNum(), 2);
+    EXPECT_EQ(stack.GetDroppedNum(), 1);
+    //last in, first out
+    EXPECT_EQ(stack.Pop().GetPosition().GetX(), 2.0);
+    EXPECT_EQ(stack.Pop().GetPosition().GetX(), 1.0);
+    EXPECT_TRUE(stack.IsEmpty());
+    EXPECT_EQ(stack.GetCapacity(), 2);
+    stack.ResetCounters();
+    EXPECT_EQ(stack.GetPushedNum(), 0);
+    EXPECT_EQ(stack.GetDroppedNum(), 0);
+    //history limit holds even when the stack is drained
+    ParticleStack limited(10, 3);
+    for(size_t i=0; i<5; i++){
+        limited.Push(first);
+        //dropped particles are not in the stack, so there is nothing to pop
+        EXPECT_EQ(limited.GetSize(), i < 3 ? 1 : 0);
+        if(i < 3) limited.Pop();
+    }
+    EXPECT_EQ(limited.GetPushedNum(), 3);
+    EXPECT_EQ(limited.GetDroppedNum(), 2);
+    limited.StartHistory();
+    limited.Push(first);
+    EXPECT_EQ(limited.GetPushedNum(), 4);
+}
+
+TEST(ParticleTests, ElectronEnergy){
+    EXPECT_NEAR(ElectronSpeed(1.0), 5.931e7, 1e4);
+    EXPECT_NEAR(ElectronEnergy(ElectronSpeed(250.0)), 250.0, 1e-9);
+}
@@ -0,0 +1,82 @@
+﻿#include <gtest/gtest.h>
+#include <linux/perf_event.h>
+#include <sstream>
+#include "perf_counters.hpp"
+
+namespace {
+
+//software events are available without PMU, e.g. in virtual machines
+std::vector<PerfEvent> SoftwareEvents(){
+    return {{"task_clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}};
+}
+
+double Spin(const size_t n){
+    volatile double x = 1.0;
+    for(size_t i=0; i<n; i++){
+        x = x*1.0000001 + 1e-9;
+    }
+    return x;
+}
+
+}
+
+TEST(PerfCountersTests, PhaseAttribution){
+    PerfCounters perf(SoftwareEvents());
+    if(!perf.IsOpen()){
+        GTEST_SKIP() << perf.GetError();
+    }
+    perf.Switch(TracePhase::INTERSECTION);
+    Spin(5000000);
+    perf.Switch(TracePhase::OUTPUT);
+    Spin(50000);
+    perf.Switch(TracePhase::OTHER);
+    const PerfReport& report = perf.GetReport();
+    ASSERT_EQ(report.event_names_.size(), 2);
+    EXPECT_EQ(report.switch_num_, 3);
+    EXPECT_EQ(report.GetCount(TracePhase::FREE_PATH, 0), 0);
+    EXPECT_EQ(report.GetCount(TracePhase::REFLECTION, 0), 0);
+    EXPECT_GT(report.GetCount(TracePhase::INTERSECTION, 0),
+              report.GetCount(TracePhase::OUTPUT, 0));
+    EXPECT_GT(report.GetCount(TracePhase::OUTPUT, 0), 0);
+}
+
+TEST(PerfCountersTests, CurrentThreadCounters){
+    EXPECT_EQ(PerfCounters::GetCurrent(), nullptr);
+    {
+        PerfCounters perf(SoftwareEvents());
+        PerfCounters::SetCurrent(&perf);
+        EXPECT_EQ(PerfCounters::GetCurrent(), &perf);
+    }
+    //destructor detaches the counters
+    EXPECT_EQ(PerfCounters::GetCurrent(), nullptr);
+}
+
+TEST(PerfCountersTests, MergeAndReport){
+    PerfReport first{{"cycles", "instructions"}, std::vector<uint64_t>(2*kTracePhaseNum, 0), 4};
+    first.counts_[0] = 30;      //free path cycles
+    first.counts_[2] = 10;      //intersection cycles
+    PerfReport second = first;
+    second.counts_[3] = 7;      //intersection instructions
+    PerfReport total;
+    total.Merge(first);
+    total.Merge(second);
+    EXPECT_EQ(total.GetCount(TracePhase::FREE_PATH, 0), 60);
+    EXPECT_EQ(total.GetCount(TracePhase::INTERSECTION, 1), 7);
+    EXPECT_EQ(total.switch_num_, 8);
+
+    std::stringstream out;
+    WritePerfReports(out, {first, second});
+    std::string line;
+    std::getline(out, line);
+    EXPECT_EQ(line, "#THREAD\tPHASE\tcycles\tinstructions\tSHARE");
+    std::getline(out, line);
+    EXPECT_EQ(line, "0\tfree_path\t30\t0\t0.750");
+    //two threads and the total, every phase
+    size_t rows = 1;
+    while(std::getline(out, line)) rows++;
+    EXPECT_EQ(rows, 3*kTracePhaseNum);
+    std::stringstream empty;
+    WritePerfReports(empty, {});
+    EXPECT_TRUE(empty.str().empty());
+}
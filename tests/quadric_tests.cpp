@@ -0,0 +1,154 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include "quadric.hpp"
+#include "loader.hpp"
+#include "geometry.hpp"
+
+namespace {
+
+std::vector<std::unique_ptr<Surface>> MakeClosedCylinder(){
+    std::vector<std::unique_ptr<Surface>> walls;
+    walls.push_back(std::make_unique<CylinderSurface>(Vec3(0.0, 0.0, 0.0),
+                Vec3(0.0, 0.0, 2.0), 0.5, 1.0, QuadricSide::INSIDE,
+                std::make_unique<MirrorReflector>(0.9), nullptr));
+    walls.push_back(std::make_unique<DiskSurface>(Vec3(0.0, 0.0, 0.0),
+                Vec3(0.0, 0.0, 1.0), 0.5, 0.0,
+                std::make_unique<LambertianReflector>(0.5), nullptr));
+    walls.push_back(std::make_unique<DiskSurface>(Vec3(0.0, 0.0, 1.0),
+                Vec3(0.0, 0.0, -1.0), 0.5, 0.0,
+                std::make_unique<LambertianReflector>(0.5), nullptr));
+    return walls;
+}
+
+}
+
+TEST(QuadricTests, SphereCrossPoint){
+    SphereSurface s(Vec3(1.0, 1.0, 1.0), 2.0, QuadricSide::INSIDE,
+                    std::make_unique<MirrorReflector>(0.0), nullptr);
+    auto res = s.GetCrossPoint(Vec3(1.0, 1.0, 1.0), Vec3(0.0, 1.0, 0.0));
+    ASSERT_TRUE(res);
+    EXPECT_NEAR(res->GetY(), 3.0, 1e-15);
+    Vec3 n = s.GetNormalAt(res.value());
+    EXPECT_NEAR(n.GetY(), -1.0, 1e-15);
+    //after reflection particle on the surface hits only the opposite side
+    res = s.GetCrossPoint(res.value(), Vec3(0.0, -1.0, 0.0));
+    ASSERT_TRUE(res);
+    EXPECT_NEAR(res->GetY(), -1.0, 1e-15);
+
+    SphereSurface ball(Vec3(0.0, 0.0, 0.0), 1.0, QuadricSide::OUTSIDE,
+                       std::make_unique<MirrorReflector>(0.0), nullptr);
+    res = ball.GetCrossPoint(Vec3(-3.0, 0.0, 0.0), Vec3(1.0, 0.0, 0.0));
+    ASSERT_TRUE(res);
+    EXPECT_NEAR(res->GetX(), -1.0, 1e-15);
+    EXPECT_FALSE(ball.GetCrossPoint(Vec3(-3.0, 0.0, 0.0), Vec3(-1.0, 0.0, 0.0)));
+    EXPECT_FALSE(ball.GetCrossPoint(Vec3(-3.0, 1.5, 0.0), Vec3(1.0, 0.0, 0.0)));
+}
+
+TEST(QuadricTests, CylinderCrossPoint){
+    CylinderSurface s(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 1.0), 0.5, 1.0,
+                      QuadricSide::INSIDE, std::make_unique<MirrorReflector>(0.0),
+                      nullptr);
+    Vec3 dir = Vec3(1.0, 0.0, 1.0).Norm();
+    auto res = s.GetCrossPoint(Vec3(0.0, 0.0, 0.2), dir);
+    ASSERT_TRUE(res);
+    EXPECT_NEAR(res->GetX(), 0.5, 1e-15);
+    EXPECT_NEAR(res->GetZ(), 0.7, 1e-15);
+    Vec3 n = s.GetNormalAt(res.value());
+    EXPECT_NEAR(n.GetX(), -1.0, 1e-15);
+    EXPECT_NEAR(n.GetZ(), 0.0, 1e-15);
+    //above the top edge and along the axis
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(0.0, 0.0, 0.8), dir));
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(0.1, 0.0, 0.5), Vec3(0.0, 0.0, 1.0)));
+}
+
+TEST(QuadricTests, ConeCrossPoint){
+    //radius goes from 1 at z=0 to 0.5 at z=1
+    ConeSurface s(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 1.0), 1.0, 0.5, 1.0,
+                  QuadricSide::INSIDE, std::make_unique<MirrorReflector>(0.0),
+                  nullptr);
+    auto res = s.GetCrossPoint(Vec3(0.0, 0.0, 0.5), Vec3(0.0, 1.0, 0.0));
+    ASSERT_TRUE(res);
+    EXPECT_NEAR(res->GetY(), 0.75, 1e-15);
+    Vec3 n = s.GetNormalAt(res.value());
+    EXPECT_NEAR(n.Length(), 1.0, 1e-15);
+    EXPECT_LT(n.GetY(), 0.0);
+    EXPECT_LT(n.GetZ(), 0.0);
+    EXPECT_NEAR(n.GetZ()/n.GetY(), 0.5, 1e-14);
+}
+
+TEST(QuadricTests, DiskCrossPoint){
+    DiskSurface s(Vec3(0.0, 0.0, 1.0), Vec3(0.0, 0.0, -1.0), 1.0, 0.25,
+                  std::make_unique<MirrorReflector>(0.0), nullptr);
+    Vec3 dir(0.0, 0.0, 1.0);
+    EXPECT_TRUE(s.GetCrossPoint(Vec3(0.5, 0.0, 0.0), dir));
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(0.1, 0.0, 0.0), dir));
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(1.1, 0.0, 0.0), dir));
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(0.5, 0.0, 2.0), Vec3(0.0, 0.0, -1.0)));
+}
+
+TEST(QuadricTests, TraceInClosedCylinder){
+    Geometry geo(MakeClosedCylinder());
+    EXPECT_TRUE(check_surface_orientations(geo.GetSurfaces()));
+    Background gas = {2e-16, 300.0, 0.0};
+    std::mt19937 rng(7u);
+    for(size_t i=0; i<2000; i++){
+        Particle pt(Vec3(0.1, 0.0, 0.5), Vec3(1.0, 0.0, 0.0), rng);
+        ASSERT_EQ(pt.Trace(geo, gas, rng), 1);
+        const Vec3& pos = pt.GetPosition();
+        double r = sqrt(pos.GetX()*pos.GetX() + pos.GetY()*pos.GetY());
+        bool on_side = std::abs(r - 0.5) < 1e-9;
+        bool on_cap = std::abs(pos.GetZ()) < 1e-9 || std::abs(pos.GetZ() - 1.0) < 1e-9;
+        EXPECT_TRUE(on_side || on_cap);
+    }
+}
+
+TEST(QuadricTests, LoadMixedGeometry){
+    json data = json::parse(R"({
+        "general" : {},
+        "geometry" : [
+            {"name" : "tube", "type" : "cylinder", "reflector_type" : "mirror",
+             "reflection_coefficient" : 0.5, "collect_statistics" : false,
+             "center" : [0.0, 0.0, 0.0], "axis" : [0.0, 0.0, 1.0],
+             "radius" : 0.5, "height" : 1.0},
+            {"name" : "bottom", "type" : "disk", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.0, "collect_statistics" : false,
+             "center" : [0.0, 0.0, 0.0], "normal" : [0.0, 0.0, 1.0], "radius" : 0.5},
+            {"name" : "top", "reflector_type" : "cosine",
+             "reflection_coefficient" : 0.0, "collect_statistics" : false,
+             "contour" : [[-1.0, -1.0, 1.0], [-1.0, 1.0, 1.0],
+                          [1.0, 1.0, 1.0], [1.0, -1.0, 1.0]]}
+        ]})");
+    Geometry geo = load_geometry(data);
+    const auto& walls = geo.GetSurfaces();
+    ASSERT_EQ(walls.size(), 3);
+    EXPECT_NE(dynamic_cast<CylinderSurface*>(walls[0].get()), nullptr);
+    EXPECT_NE(dynamic_cast<DiskSurface*>(walls[1].get()), nullptr);
+    EXPECT_NE(dynamic_cast<PolygonSurface*>(walls[2].get()), nullptr);
+    EXPECT_EQ(walls[0]->GetReflector()->GetReflectionCoefficient(), 0.5);
+}
+
+TEST(QuadricTests, RandomPointsCoverArea){
+    std::mt19937 rng(7u);
+    SphereSurface sphere(Vec3(1.0, 0.0, 0.0), 2.0, QuadricSide::INSIDE,
+                         std::make_unique<MirrorReflector>(0.0), nullptr);
+    EXPECT_NEAR(sphere.GetArea(), 16*M_PI, 1e-12);
+    DiskSurface annulus(Vec3(0.0, 0.0, 1.0), Vec3(0.0, 0.0, 1.0), 2.0, 1.0,
+                        std::make_unique<MirrorReflector>(0.0), nullptr);
+    EXPECT_NEAR(annulus.GetArea(), 3*M_PI, 1e-12);
+    ConeSurface cone(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, 1.0), 1.0, 0.0, 1.0,
+                     QuadricSide::INSIDE, std::make_unique<MirrorReflector>(0.0), nullptr);
+    EXPECT_NEAR(cone.GetArea(), M_PI*std::sqrt(2.0), 1e-12);
+    double cone_height = 0.0;
+    size_t n = 100000;
+    for(size_t i=0; i<n; i++){
+        EXPECT_NEAR(Vec3(Vec3(1.0, 0.0, 0.0), sphere.GetRandomPoint(rng)).Length(), 2.0, 1e-12);
+        Vec3 p = annulus.GetRandomPoint(rng);
+        double r = std::sqrt(p.GetX()*p.GetX() + p.GetY()*p.GetY());
+        EXPECT_TRUE(r >= 1.0 - 1e-12 && r <= 2.0 + 1e-12 && std::fabs(p.GetZ() - 1.0) < 1e-12);
+        Vec3 c = cone.GetRandomPoint(rng);
+        EXPECT_NEAR(std::sqrt(c.GetX()*c.GetX() + c.GetY()*c.GetY()), 1.0 - c.GetZ(), 1e-12);
+        cone_height += c.GetZ();
+    }
+    //area is denser near the base: mean height of the cone is 1/3
+    EXPECT_NEAR(cone_height/static_cast<double>(n), 1.0/3.0, 5e-3);
+}
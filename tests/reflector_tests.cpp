@@ -43,3 +43,42 @@ TEST(ReflectorTests, LambertianReflectorTest){
         EXPECT_LE(res->Dot(dir), 0);
     }
 }
+
+
+TEST(ReflectorTests, SecondaryYield){
+    SecondaryEmissionReflector wall(0.0, {2.0, 300.0, 10.0, 1.0, 4.0});
+    EXPECT_EQ(wall.GetYield(10.0, -1.0), 0.0);
+    EXPECT_NEAR(wall.GetYield(300.0, -1.0), 2.0, 1e-12);
+    EXPECT_LT(wall.GetYield(100.0, -1.0), 2.0);
+    EXPECT_LT(wall.GetYield(1000.0, -1.0), 2.0);
+    //oblique electrons go deeper along the surface: more secondaries
+    EXPECT_GT(wall.GetYield(300.0, -0.5), 2.0);
+    EXPECT_FALSE(LambertianReflector(0.5).IsEmitting());
+    EXPECT_TRUE(wall.IsEmitting());
+}
+
+TEST(ReflectorTests, SecondaryEmission){
+    //yield 2 at normal incidence, the incident electron is absorbed
+    SecondaryEmissionReflector wall(0.0, {2.0, 300.0, 0.0, 1.0, 4.0});
+    Vec3 normal(0.0, 0.0, 1.0);
+    Particle pt(Vec3(0.5, 0.5, 0.0), Vec3(0.0, 0.0, -1.0));
+    pt.SetSpeed(ElectronSpeed(300.0));
+    std::mt19937 rnd_gen(42);
+    ParticleStack stack(1000, 1000000);
+    size_t n = 20000;
+    double energy = 0.0;
+    size_t emitted = 0;
+    for(size_t i=0; i<n; i++){
+        EXPECT_FALSE(wall.ReflectParticle(pt, normal, rnd_gen).has_value());
+        wall.EmitSecondaries(pt, normal, rnd_gen, stack);
+        while(!stack.IsEmpty()){
+            Particle secondary = stack.Pop();
+            EXPECT_GT(secondary.GetDirection().Dot(normal), 0.0);
+            EXPECT_GT(secondary.GetPosition().GetZ(), 0.0);
+            energy += ElectronEnergy(secondary.GetSpeed());
+            emitted++;
+        }
+    }
+    EXPECT_NEAR(static_cast<double>(emitted)/static_cast<double>(n), 2.0, 0.05);
+    EXPECT_NEAR(energy/static_cast<double>(emitted), 4.0, 0.1);
+}
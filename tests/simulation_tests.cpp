@@ -0,0 +1,183 @@
+﻿#include <gtest/gtest.h>
+#include <algorithm>
+#include <numeric>
+#include "simulation.hpp"
+#include "particle.hpp"
+#include "reflector.hpp"
+#include "box.hpp"
+
+namespace {
+
+size_t Total(const RunResult& result){
+    const auto& counts = result.absorbed_.GetCounts();
+    return std::accumulate(counts.begin(), counts.end(), size_t{0});
+}
+
+}
+
+TEST(SimulationTests, RepeatedRuns){
+    Simulation sim(MakeBox(0.5), {2e-16, 300.0, 10.0}, 3, 11u);
+    sim.SetVoxelGrid({Vec3(0.0, 0.0, 0.0), Vec3(2.0, 1.0, 1.0), {2, 1, 1}});
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(-1.0, 0.0, 0.0),
+                                          false, 0.0}};
+    RunResult first = sim.Run(sources, 1000);
+    EXPECT_EQ(first.lost_num_, 0);
+    EXPECT_EQ(Total(first), 1000);
+    ASSERT_TRUE(first.voxel_.has_value());
+    EXPECT_EQ(first.voxel_->GetHistoryNum(), 1000);
+    EXPECT_FALSE(first.sweep_.has_value());
+    //per-thread tallies are reset, random streams go on
+    RunResult second = sim.Run(sources, 1000);
+    EXPECT_EQ(Total(second), 1000);
+    EXPECT_EQ(second.voxel_->GetHistoryNum(), 1000);
+    EXPECT_NE(first.absorbed_.GetCounts(), second.absorbed_.GetCounts());
+}
+
+TEST(SimulationTests, SourcesAreSplitEvenly){
+    Simulation sim(MakeBox(0.0), {2e-16, 300.0, 0.0}, 2, 1u);
+    sim.SetTimeBins({1e-4, 4});
+    std::vector<ParticleSource> sources {
+        {Vec3(0.5, 0.5, 0.5), Vec3(-1.0, 0.0, 0.0), false, 1e4},
+        {Vec3(1.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), false, 1e4}};
+    RunResult result = sim.Run(sources, 100);
+    EXPECT_EQ(result.absorbed_.GetCount(0), 50);
+    EXPECT_EQ(result.absorbed_.GetCount(3), 50);
+    ASSERT_TRUE(result.time_.has_value());
+    //0.5 cm at 1e4 cm/s
+    EXPECT_EQ(result.time_->GetCount(0, 2), 50.0);
+    EXPECT_EQ(result.time_->GetCount(3, 2), 50.0);
+}
+
+TEST(SimulationTests, RecordsOfAbsorbed){
+    Simulation sim(MakeBox(0.3), {2e-16, 300.0, 0.0}, 2, 7u);
+    sim.SetRecordAbsorbed(true);
+    std::vector<ParticleSource> sources {{Vec3(1.0, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, 1e5}};
+    for(size_t run=0; run<2; run++){
+        RunResult result = sim.Run(sources, 500);
+        ASSERT_TRUE(result.records_.has_value());
+        const RecordTally& records = *result.records_;
+        ASSERT_EQ(records.GetRecordNum(), 500);
+        ASSERT_EQ(records.GetPositions().size(), 1500);
+        for(size_t i=0; i<records.GetRecordNum(); i++){
+            size_t wall = records.GetWallIds()[i];
+            EXPECT_LT(wall, 6);
+            //all records lie on the box boundary
+            double x = records.GetPositions()[3*i];
+            double y = records.GetPositions()[3*i + 1];
+            double z = records.GetPositions()[3*i + 2];
+            double dist = std::min({x, 2.0 - x, y, 1.0 - y, z, 1.0 - z});
+            EXPECT_NEAR(dist, 0.0, 1e-9);
+            EXPECT_GE(records.GetTimes()[i], 0.5e-5 - 1e-15);
+            EXPECT_GE(records.GetSurfCounts()[i], 1);
+        }
+        const auto& wall_ids = records.GetWallIds();
+        for(size_t wall=0; wall<6; wall++){
+            EXPECT_EQ(static_cast<size_t>(std::count(wall_ids.begin(), wall_ids.end(), wall)),
+                      result.absorbed_.GetCount(wall));
+        }
+    }
+}
+
+TEST(SimulationTests, AdaptiveStopping){
+    Simulation sim(MakeBox(0.5), {2e-16, 300.0, 0.0}, 2, 5u);
+    sim.SetTimeBins({1e-3, 5});
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(-1.0, 0.0, 0.0),
+                                          true, 1e4}};
+    StopCriteria criteria;
+    criteria.batch_size_ = 2000;
+    criteria.rel_error_ = 0.05;
+    criteria.min_batches_ = 4;
+    criteria.max_particles_ = 1000000;
+    criteria.is_time_targeted_ = true;
+    //tail and overflow bins with a few hundred particles would hold the run
+    //for millions of particles
+    criteria.min_count_ = 400;
+    AdaptiveResult result = sim.RunAdaptive(sources, criteria);
+    EXPECT_TRUE(result.is_converged_);
+    size_t batches = result.absorbed_.GetBatchNum();
+    EXPECT_GE(batches, 4);
+    EXPECT_EQ(result.total_.traced_num_, batches*2000);
+    EXPECT_LE(result.absorbed_.GetMaxRelError(400.0/2000.0), 0.05);
+    ASSERT_TRUE(result.time_.has_value());
+    EXPECT_LE(result.time_->GetMaxRelError(400.0/2000.0), 0.05);
+    //mean of the batches is the fraction of the merged run
+    for(size_t wall=0; wall<6; wall++){
+        EXPECT_NEAR(result.absorbed_.GetMean(wall),
+                    static_cast<double>(result.total_.absorbed_.GetCount(wall))/
+                    static_cast<double>(result.total_.traced_num_), 1e-12);
+    }
+
+    //particle limit ends unreachable target
+    criteria.rel_error_ = 1e-6;
+    criteria.max_particles_ = 9000;
+    result = sim.RunAdaptive(sources, criteria);
+    EXPECT_FALSE(result.is_converged_);
+    EXPECT_EQ(result.absorbed_.GetBatchNum(), 4);
+    //limit below one batch would run nothing
+    criteria.max_particles_ = 1000;
+    EXPECT_DEATH(sim.RunAdaptive(sources, criteria), "less than one batch");
+}
+
+TEST(SimulationTests, NodeReplicas){
+    Simulation sim(MakeBox(0.5), {2e-16, 300.0, 10.0}, 3, 2u);
+    //two nodes on the first allowed CPU
+    auto nodes = ReadNumaNodes();
+    int cpu = nodes.front().front();
+    sim.SetThreadPlacement(ThreadPlacement({{cpu}, {cpu}}, 3), true);
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(-1.0, 0.0, 0.0),
+                                          true, 0.0}};
+    RunResult result = sim.Run(sources, 1000);
+    EXPECT_EQ(sim.GetReplicaNum(), 2);
+    EXPECT_EQ(result.lost_num_, 0);
+    EXPECT_EQ(Total(result), 1000);
+    result = sim.Run(sources, 1000);
+    EXPECT_EQ(Total(result), 1000);
+    //calling thread is not left pinned
+    EXPECT_EQ(ReadNumaNodes(), nodes);
+}
+
+TEST(SimulationTests, SecondaryCascade){
+    auto make_wall = []{
+        return std::make_unique<SecondaryEmissionReflector>(
+                    0.1, SecondaryYield{3.0, 300.0, 0.0, 1.0, 4.0});
+    };
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, ElectronSpeed(300.0)}};
+    Simulation sim(MakeBox(make_wall), {2e-16, 300.0, 0.0}, 2, 5u);
+    sim.SetVoxelGrid({Vec3(0.0, 0.0, 0.0), Vec3(2.0, 1.0, 1.0), {2, 1, 1}});
+    sim.SetTimeBins({1e-3, 5});
+    RunResult result = sim.Run(sources, 2000);
+    //each primary makes about 3 secondaries, they are too slow for more
+    EXPECT_GT(result.secondary_num_, 4000);
+    EXPECT_EQ(result.dropped_num_, 0);
+    EXPECT_EQ(result.lost_num_, 0);
+    EXPECT_EQ(Total(result), 2000 + result.secondary_num_);
+    //the cascade is one history, its arrivals are all counted in it
+    EXPECT_EQ(result.voxel_->GetHistoryNum(), 2000);
+    EXPECT_EQ(result.time_->GetHistoryNum(), 2000);
+    const std::vector<double>& counts = result.time_->GetCounts();
+    EXPECT_EQ(std::accumulate(counts.begin(), counts.end(), 0.0),
+              static_cast<double>(2000 + result.secondary_num_));
+    //sweep weights do not follow the secondaries
+    EXPECT_DEATH(sim.SetSweepPoints({}), "secondary emission");
+
+    //one waiting particle: the rest of every burst is dropped
+    sim.SetSecondaryLimits(1, 1000);
+    RunResult capped = sim.Run(sources, 2000);
+    EXPECT_GT(capped.dropped_num_, 0);
+    EXPECT_LT(capped.secondary_num_, result.secondary_num_);
+    EXPECT_EQ(Total(capped), 2000 + capped.secondary_num_);
+}
+
+TEST(SimulationTests, BoundariesHaveNoReflector){
+    Simulation sim(MakePeriodicCube(0.5), {2e-16, 300.0, 0.0}, 2, 3u);
+    sim.SetSweepPoints({{"low", 0.0, {0.0, 0.4, 0.4, 0.0, 0.4, 0.4}}});
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.3, 0.2),
+                                          false, 0.0}};
+    RunResult result = sim.Run(sources, 1000);
+    EXPECT_EQ(Total(result), 1000);
+    EXPECT_EQ(result.absorbed_.GetCounts()[0], 0);
+    EXPECT_EQ(result.absorbed_.GetCounts()[3], 0);
+    ASSERT_TRUE(result.sweep_.has_value());
+}
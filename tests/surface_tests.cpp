@@ -7,13 +7,13 @@ TEST(SurfaceTests, GenerationTest){
                                Vec3(1.0, 0.0, 1.0),
                                Vec3(1.0, 1.0, 1.0),
                                Vec3(1.0, 1.0, 0.0)};
-    Surface s(std::move(contour), std::make_unique<MirrorReflector>(0.0),
+    PolygonSurface s(std::move(contour), std::make_unique<MirrorReflector>(0.0),
               std::move(file));
     EXPECT_NEAR(s.GetNormal().Length(), 1.0, 1e-15);
     EXPECT_EQ(s.GetNormal().GetX(), -1.0);
     EXPECT_EQ(s.GetNormal().GetY(), 0.0);
     EXPECT_EQ(s.GetNormal().GetZ(), 0.0);
-    Surface::SurfaceCoeficients Sc = s.GetSurfaceCoefficients();
+    PolygonSurface::SurfaceCoeficients Sc = s.GetSurfaceCoefficients();
     EXPECT_EQ(Sc.A_, -1.0);
     EXPECT_EQ(Sc.B_, 0.0);
     EXPECT_EQ(Sc.C_, 0.0);
@@ -28,7 +28,7 @@ TEST(SurfaceTests, CheckIfPointOnSurface){
                                Vec3(1.0, 0.0, 1.0),
                                Vec3(1.0, 1.0, 1.0),
                                Vec3(1.0, 1.0, 0.0)};
-    Surface s(std::move(contour), std::make_unique<MirrorReflector>(0.0),
+    PolygonSurface s(std::move(contour), std::make_unique<MirrorReflector>(0.0),
               std::move(file));
     Vec3 point(1.0, 0.5, 0.7);
     EXPECT_TRUE(s.CheckIfPointOnSurface(point));
@@ -45,7 +45,7 @@ TEST(SurfaceTests, VerifyPointOnSurfaceTest){
                                Vec3(1.0, 0.0, 1.0),
                                Vec3(1.0, 1.0, 1.0),
                                Vec3(1.0, 1.0, 0.0)};
-    std::unique_ptr<Surface> s = std::make_unique<Surface>(std::move(contour),
+    std::unique_ptr<PolygonSurface> s = std::make_unique<PolygonSurface>(std::move(contour),
            std::make_unique<MirrorReflector>(0.0), std::move(file));
     Vec3 end(1+2e-6, 0.5, 0.4);
     Vec3 start(0.5, 0.5, 0.4);
@@ -69,7 +69,7 @@ TEST(SurfaceTests, TriangleAreas){
                                  Vec3(1.0, 0.0, 1.0),
                                  Vec3(1.0, 1.0, 1.0),
                                  Vec3(1.0, 2.0, 0.0)};
-    std::vector<double> areas = Surface::CalcTriangleAreas(contour);
+    std::vector<double> areas = PolygonSurface::CalcTriangleAreas(contour);
     EXPECT_EQ(areas.size(), 2);
     EXPECT_EQ(areas[0], 0.5);
     EXPECT_EQ(areas[1], 1.0);
@@ -84,10 +84,116 @@ TEST(SurfaceTests, RandomPointGeneration){
                                Vec3(1.0, 0.0, 1.0),
                                Vec3(1.0, 1.0, 1.0),
                                Vec3(1.0, 2.0, 0.0)};
-    std::unique_ptr<Surface> s = std::make_unique<Surface>(std::move(contour),
+    std::unique_ptr<PolygonSurface> s = std::make_unique<PolygonSurface>(std::move(contour),
            std::make_unique<MirrorReflector>(0.0), std::move(file));
     for(size_t i=0; i<100; i++){
         Vec3 point = s->GetRandomPointInContour(rng);
         EXPECT_TRUE(s->CheckIfPointOnSurface(point));
     }
 }
+
+TEST(SurfaceTests, MixedPrecisionCrossPoint){
+    std::mt19937 rng(42u);
+    std::vector<Vec3> contour {Vec3(1.0, 0.0, 0.0),
+                               Vec3(1.0, 0.0, 1.0),
+                               Vec3(1.0, 1.0, 1.0),
+                               Vec3(1.0, 1.0, 0.0)};
+    PolygonSurface s(std::move(contour), std::make_unique<MirrorReflector>(0.0),
+              std::ofstream());
+    Particle pt;
+    Vec3 start(0.5, 0.5, 0.5);
+    for(size_t i=0; i<100; i++){
+        Vec3 dir = pt.GetRandomVel(Vec3(1.0, 0.0, 0.0), rng);
+        s.SetMixedPrecision(false);
+        auto res_double = s.GetCrossPoint(start, dir);
+        s.SetMixedPrecision(true);
+        auto res_mixed = s.GetCrossPoint(start, dir);
+        ASSERT_EQ(res_double.has_value(), res_mixed.has_value());
+        if(res_double){
+            EXPECT_LE(res_mixed->GetX(), 1.0);
+            EXPECT_NEAR(res_mixed->GetX(), 1.0, 1e-12);
+            EXPECT_NEAR(res_mixed->GetY(), res_double->GetY(), 1e-5);
+            EXPECT_NEAR(res_mixed->GetZ(), res_double->GetZ(), 1e-5);
+        }
+    }
+}
+
+TEST(SurfaceTests, WatertightSharedEdge){
+    //unit square at z=1 is split into two triangles along its diagonal
+    std::vector<std::unique_ptr<Surface>> walls;
+    walls.push_back(std::make_unique<PolygonSurface>(
+            std::vector<Vec3>{Vec3(0.0, 0.0, 1.0), Vec3(0.0, 1.0, 1.0), Vec3(1.0, 1.0, 1.0)},
+            std::make_unique<MirrorReflector>(0.0), std::ofstream()));
+    walls.push_back(std::make_unique<PolygonSurface>(
+            std::vector<Vec3>{Vec3(0.0, 0.0, 1.0), Vec3(1.0, 1.0, 1.0), Vec3(1.0, 0.0, 1.0)},
+            std::make_unique<MirrorReflector>(0.0), std::ofstream()));
+    std::mt19937 rng(42u);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    for(bool is_mixed : {false, true}){
+        for(auto& s : walls){
+            s->SetMixedPrecision(is_mixed);
+        }
+        for(size_t i=0; i<10000; i++){
+            double d = 0.01 + 0.98*rnd(rng);
+            Vec3 target(d, d, 1.0);
+            Vec3 start(rnd(rng), rnd(rng), 0.9*rnd(rng));
+            Vec3 dir = Vec3(start, target).Norm();
+            ShearedRay ray(start, dir);
+            int hits = 0;
+            for(const auto& s : walls){
+                hits += s->GetCrossPoint(ray).has_value();
+            }
+            ASSERT_EQ(hits, 1);
+        }
+    }
+}
+
+TEST(SurfaceTests, BackSideIsNotCrossed){
+    std::vector<Vec3> contour {Vec3(1.0, 0.0, 0.0),
+                               Vec3(1.0, 0.0, 1.0),
+                               Vec3(1.0, 1.0, 1.0),
+                               Vec3(1.0, 1.0, 0.0)};
+    PolygonSurface s(std::move(contour), std::make_unique<MirrorReflector>(0.0),
+              std::ofstream());
+    EXPECT_TRUE(s.GetCrossPoint(Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0)));
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(1.5, 0.5, 0.5), Vec3(-1.0, 0.0, 0.0)));
+    EXPECT_FALSE(s.GetCrossPoint(Vec3(0.5, 0.5, 0.5), Vec3(0.0, 1.0, 0.0)));
+}
+
+TEST(SurfaceTests, AxisAlignedRectDetection){
+    EXPECT_TRUE(AxisAlignedRect::IsAxisAlignedRect({Vec3(1.0, 0.0, 0.0),
+            Vec3(1.0, 0.0, 1.0), Vec3(1.0, 1.0, 1.0), Vec3(1.0, 1.0, 0.0)}));
+    //tilted rectangle and triangle are left for the general kernel
+    EXPECT_FALSE(AxisAlignedRect::IsAxisAlignedRect({Vec3(0.0, 0.0, 0.0),
+            Vec3(1.0, 1.0, 0.0), Vec3(1.0, 1.0, 1.0), Vec3(0.0, 0.0, 1.0)}));
+    EXPECT_FALSE(AxisAlignedRect::IsAxisAlignedRect({Vec3(0.0, 0.0, 0.0),
+            Vec3(0.0, 1.0, 0.0), Vec3(0.0, 1.0, 1.0)}));
+}
+
+TEST(SurfaceTests, AxisAlignedRectMatchesPolygon){
+    std::vector<Vec3> contour {Vec3(1.0, 0.0, 0.0),
+                               Vec3(1.0, 0.0, 1.0),
+                               Vec3(1.0, 1.0, 1.0),
+                               Vec3(1.0, 1.0, 0.0)};
+    std::vector<Vec3> rect_contour = contour;
+    AxisAlignedRect rect(std::move(rect_contour),
+                         std::make_unique<MirrorReflector>(0.0), nullptr);
+    PolygonSurface poly(std::move(contour), std::make_unique<MirrorReflector>(0.0),
+                        std::ofstream());
+    EXPECT_EQ(rect.GetRectData().axis_, 0);
+    EXPECT_EQ(rect.GetRectData().normal_sign_, -1.0);
+    std::mt19937 rng(3u);
+    std::uniform_real_distribution<double> rnd(-0.5, 1.5);
+    for(size_t i=0; i<10000; i++){
+        Vec3 start(0.5, 0.5, 0.5);
+        Vec3 dir = Vec3(rnd(rng), rnd(rng), rnd(rng)).Norm();
+        auto res_rect = rect.GetCrossPoint(start, dir);
+        auto res_poly = poly.GetCrossPoint(start, dir);
+        ASSERT_EQ(res_rect.has_value(), res_poly.has_value());
+        if(res_rect){
+            EXPECT_EQ(res_rect->GetX(), 1.0);
+            EXPECT_NEAR(res_rect->GetY(), res_poly->GetY(), 1e-14);
+            EXPECT_NEAR(res_rect->GetZ(), res_poly->GetZ(), 1e-14);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include "sweep.hpp"
+#include "particle.hpp"
+#include "surface.hpp"
+#include "geometry.hpp"
+#include "box.hpp"
+
+namespace {
+
+//unit cube of polygon walls with the given reflection coefficients
+std::vector<std::unique_ptr<Surface>> MakeCube(const std::vector<double>& R){
+    return MakeBoxWalls(Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0),
+                        [&R](size_t wall, std::vector<Vec3>&& contour){
+                            return std::make_unique<PolygonSurface>(std::move(contour),
+                                std::make_unique<LambertianReflector>(R[wall]),
+                                std::ofstream());
+                        });
+}
+
+}
+
+TEST(SweepTests, WeightUpdateTest){
+    Background gas = {2e-16, 300.0, 0.0};
+    std::vector<SweepPoint> points {{"same", 0.0, {0.5, 0.5}},
+                                    {"other", 0.0, {0.8, 0.5}}};
+    SweepTally tally(gas, {0.5, 0.5}, points);
+    Particle pt;
+    tally.OnFlight(pt, 1.0, false);
+    tally.OnWallHit(pt, 0, true);
+    tally.OnFlight(pt, 1.0, false);
+    tally.OnWallHit(pt, 1, false);
+    EXPECT_EQ(tally.GetHistoryNum(), 1);
+    EXPECT_EQ(tally.GetNominalFraction(1), 1.0);
+    EXPECT_EQ(tally.GetFraction(0, 1), 1.0);
+    EXPECT_NEAR(tally.GetFraction(1, 1), 0.8/0.5, 1e-15);
+    EXPECT_EQ(tally.GetFraction(1, 0), 0.0);
+    //next history starts with unit weights
+    tally.OnWallHit(pt, 0, false);
+    EXPECT_EQ(tally.GetHistoryNum(), 2);
+    EXPECT_NEAR(tally.GetFraction(1, 0), 0.2/0.5/2, 1e-15);
+}
+
+TEST(SweepTests, PressureWeightTest){
+    Background gas = {2e-16, 300.0, 5.0};
+    std::vector<SweepPoint> points {{"double_p", 10.0, {0.5}}};
+    SweepTally tally(gas, {0.5}, points);
+    Particle pt;
+    double distance = 0.3;
+    tally.OnFlight(pt, distance, true);
+    tally.OnWallHit(pt, 0, false);
+    double inv_mfp = 1.0/gas.GetMeanFreePath();
+    EXPECT_NEAR(tally.GetFraction(0, 0), 2.0*exp(-inv_mfp*distance), 1e-12);
+}
+
+TEST(SweepTests, ReweightingMatchesDirectRun){
+    Background gas = {2e-16, 300.0, 0.0};
+    std::vector<double> nominal_R(6, 0.5);
+    std::vector<double> swept_R = nominal_R;
+    swept_R[0] = 0.6;
+    Geometry geo(MakeCube(nominal_R));
+    SweepTally tally(gas, nominal_R, {{"swept", 0.0, swept_R}});
+    std::mt19937 rnd_gen(42);
+    Vec3 start(0.5, 0.5, 0.5);
+    Vec3 dir(1.0, 0.0, 0.0);
+    size_t pt_num = 20000;
+    for(size_t i=0; i<pt_num; i++){
+        Particle(start, dir, rnd_gen).Trace(geo, gas, rnd_gen, &tally);
+    }
+    Geometry direct_geo(MakeCube(swept_R));
+    SweepTally direct(gas, swept_R, {});
+    for(size_t i=0; i<pt_num; i++){
+        Particle(start, dir, rnd_gen).Trace(direct_geo, gas, rnd_gen, &direct);
+    }
+    for(size_t j=0; j<geo.GetSurfaceNum(); j++){
+        double direct_frac = direct.GetNominalFraction(j);
+        double direct_err = sqrt(direct_frac*(1-direct_frac)/
+                                 static_cast<double>(direct.GetHistoryNum()));
+        double err = std::hypot(tally.GetFractionError(0, j), direct_err);
+        EXPECT_NEAR(tally.GetFraction(0, j), direct_frac, 4*err);
+        EXPECT_LT(tally.GetDiffError(0, j), tally.GetFractionError(0, j));
+    }
+}
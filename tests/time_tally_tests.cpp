@@ -0,0 +1,63 @@
+﻿#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include "time_tally.hpp"
+#include "geometry.hpp"
+#include "particle.hpp"
+#include "box.hpp"
+
+TEST(TimeTallyTests, StraightFlightTime){
+    Geometry geo = MakeBox(0.0, Vec3(1.0, 1.0, 1.0));
+    Background vacuum = {2e-16, 300.0, 0.0};
+    std::mt19937 rng(1u);
+    TimeTally tally({1e-5, 10}, geo.GetSurfaceNum());
+    Particle pt(Vec3(0.25, 0.5, 0.5), Vec3(1.0, 0.0, 0.0));
+    pt.SetSpeed(1e5);
+    EXPECT_EQ(pt.Trace(geo, vacuum, rng, &tally), 1);
+    //0.75 cm at 1e5 cm/s
+    EXPECT_NEAR(pt.GetTime(), 7.5e-6, 1e-18);
+    EXPECT_EQ(tally.GetCount(3, 7), 1.0);
+    EXPECT_EQ(tally.GetHistoryNum(), 1);
+
+    Particle late(Vec3(0.25, 0.5, 0.5), Vec3(-1.0, 0.0, 0.0));
+    late.SetSpeed(1e4);
+    late.Trace(geo, vacuum, rng, &tally);
+    EXPECT_EQ(tally.GetOverflow(0), 1.0);
+
+    //without speed time is not tracked
+    Particle untimed(Vec3(0.25, 0.5, 0.5), Vec3(1.0, 0.0, 0.0));
+    untimed.Trace(geo, vacuum, rng);
+    EXPECT_EQ(untimed.GetTime(), 0.0);
+}
+
+TEST(TimeTallyTests, HistogramSumsToAbsorbed){
+    Geometry geo = MakeBox(0.7, Vec3(1.0, 1.0, 1.0));
+    Background gas = {2e-16, 300.0, 100.0};
+    TimeTally first({2e-4, 20}, geo.GetSurfaceNum());
+    TimeTally second({2e-4, 20}, geo.GetSurfaceNum());
+    std::mt19937 rng(5u);
+    double min_time = 1.0;
+    for(size_t i=0; i<2000; i++){
+        Particle pt(Vec3(0.5, 0.5, 0.5), Vec3(0.0, 0.0, 1.0), rng);
+        pt.SetSpeed(1e4);
+        pt.Trace(geo, gas, rng, i%2 == 0 ? &first : &second);
+        min_time = std::min(min_time, pt.GetTime());
+    }
+    //nothing arrives before the nearest wall
+    EXPECT_GE(min_time, 0.5e-4 - 1e-12);
+    first.Merge(second);
+    EXPECT_EQ(first.GetHistoryNum(), 2000);
+    double sum = 0.0;
+    for(size_t wall=0; wall<geo.GetSurfaceNum(); wall++){
+        for(size_t bin=0; bin<20; bin++){
+            sum += first.GetCount(wall, bin);
+        }
+        sum += first.GetOverflow(wall);
+    }
+    EXPECT_EQ(sum, 2000.0);
+    std::stringstream out;
+    first.WriteResults(out, {"x0", "y0", "z0", "x1", "y1", "z1"});
+    std::string header;
+    std::getline(out, header);
+    EXPECT_EQ(header, "#Histories: 2000");
+}
@@ -80,3 +80,37 @@ TEST(Vec3Tests, Arithmetic){
     EXPECT_TRUE(rhs-lhs == Vec3(24.0, 15.0, 7.0));
     EXPECT_TRUE(lhs-rhs == (rhs-lhs).Times(-1));
 }
+
+TEST(Vec3Tests, FusedOperations){
+    //value types are usable in constant expressions
+    constexpr Vec3 normal(0.0, 0.0, 2.0);
+    constexpr Vec3 point(1.0, 2.0, 3.0);
+    static_assert(normal.EvalPlane(point, -4.0) == 2.0);
+    static_assert(normal.DotDiff(Vec3(5.0, 5.0, 1.0), point) == 4.0);
+    static_assert(point.AddScaled(normal, 0.5) == Vec3(1.0, 2.0, 4.0));
+    static_assert(ONBasis_3x3().FromOriginalCoorsToThis(point) == point);
+    //same rounding as the unfused expressions
+    Vec3 dir(0.1, 0.7, -0.3);
+    double t = 1.0/3.0;
+    EXPECT_EQ(point.AddScaled(dir, t), point + dir.Times(t));
+    EXPECT_EQ(dir.DotDiff(point, normal), Vec3(point, normal).Dot(dir));
+    ONBasis_3x3 basis(dir);
+    Vec3 local = basis.FromOriginalCoorsToThis(point);
+    EXPECT_EQ(basis.FromThisCoorsToOriginal(local),
+              basis.GetXVec().Times(local.GetX()) + basis.GetYVec().Times(local.GetY()) +
+              basis.GetZVec().Times(local.GetZ()));
+}
+
+TEST(Vec3Tests, OffsetAlongNormalTest){
+    Vec3 normal(-1.0, 0.0, 0.0);
+    Vec3 point(1.0, 0.5, 0.01);
+    Vec3 res = OffsetPointAlongNormal(point, normal);
+    EXPECT_LT(res.GetX(), 1.0);
+    EXPECT_NEAR(res.GetX(), 1.0, 1e-12);
+    EXPECT_EQ(res.GetY(), point.GetY());
+    EXPECT_EQ(res.GetZ(), point.GetZ());
+    Vec3 res2 = OffsetPointAlongNormal(Vec3(-3.0, 0.0, 0.0), Vec3(1.0, 0.0, 0.0));
+    EXPECT_GT(res2.GetX(), -3.0);
+    Vec3 res3 = OffsetPointAlongNormal(Vec3(0.0, 0.0, 0.0), Vec3(0.0, 0.0, -1.0));
+    EXPECT_LT(res3.GetZ(), 0.0);
+}
@@ -0,0 +1,97 @@
+﻿#include <gtest/gtest.h>
+#include <cmath>
+#include <numeric>
+#include "view_factor.hpp"
+#include "reflector.hpp"
+#include "quadric.hpp"
+#include "box.hpp"
+
+namespace {
+
+//Unit cube: x=0, y=0, z=0, x=1, y=1, z=1, every face is split into
+//tiles x tiles patches; face of the wall is wall/(tiles*tiles)
+Geometry MakeCube(const std::vector<double>& reflection, const size_t tiles = 1){
+    std::vector<std::unique_ptr<Surface>> walls;
+    std::vector<std::vector<Vec3>> contours = MakeTiledBoxContours(tiles);
+    for(size_t i=0; i<contours.size(); i++){
+        walls.push_back(std::make_unique<AxisAlignedRect>(std::move(contours[i]),
+                std::make_unique<LambertianReflector>(reflection[i/(tiles*tiles)]), nullptr));
+    }
+    return Geometry(std::move(walls));
+}
+
+}
+
+TEST(ViewFactorTests, ConcentricSpheres){
+    //reflected directions have uniform cos(theta) around the normal, so
+    //the inner ball of radius r is seen from the outer sphere R with the
+    //probability 1 - cos(alpha), sin(alpha) = r/R
+    std::vector<std::unique_ptr<Surface>> walls;
+    walls.push_back(std::make_unique<SphereSurface>(Vec3(0.0, 0.0, 0.0), 1.0,
+                    QuadricSide::INSIDE, std::make_unique<LambertianReflector>(0.5), nullptr));
+    walls.push_back(std::make_unique<SphereSurface>(Vec3(0.0, 0.0, 0.0), 0.5,
+                    QuadricSide::OUTSIDE, std::make_unique<LambertianReflector>(0.5), nullptr));
+    Geometry geo(std::move(walls));
+    ViewFactorMatrix matrix = EstimateViewFactors(geo, 200000, 5u);
+    EXPECT_EQ(matrix.Get(1, 1), 0.0);
+    EXPECT_NEAR(matrix.Get(1, 0), 1.0, 1e-12);
+    EXPECT_NEAR(matrix.Get(0, 1), 1.0 - std::sqrt(0.75), 3e-3);
+    EXPECT_NEAR(matrix.GetEscape(0), 0.0, 1e-12);
+    //same seed, same matrix
+    ViewFactorMatrix again = EstimateViewFactors(geo, 200000, 5u);
+    EXPECT_EQ(matrix.Get(0, 1), again.Get(0, 1));
+}
+
+TEST(ViewFactorTests, CubeSymmetry){
+    Geometry geo = MakeCube(std::vector<double>(6, 0.0));
+    ViewFactorMatrix matrix = EstimateViewFactors(geo, 200000, 5u);
+    for(size_t i=0; i<6; i++){
+        EXPECT_EQ(matrix.Get(i, i), 0.0);
+        EXPECT_NEAR(matrix.Get(i, (i + 3)%6), matrix.Get(0, 3), 4e-3);
+        EXPECT_NEAR(matrix.Get(i, (i + 1)%6), matrix.Get(0, 1), 4e-3);
+        EXPECT_NEAR(matrix.GetEscape(i), 0.0, 1e-12);
+    }
+}
+
+TEST(ViewFactorTests, ParallelPlates){
+    //infinite plates: everything from one goes to the other
+    ViewFactorMatrix matrix(2);
+    matrix.Set(0, 1, 1.0);
+    matrix.Set(1, 0, 1.0);
+    double r1 = 0.3;
+    double r2 = 0.8;
+    auto absorbed = matrix.SolveAbsorption({r1, r2}, {1.0, 0.0});
+    EXPECT_NEAR(absorbed[0], (1 - r1)/(1 - r1*r2), 1e-14);
+    EXPECT_NEAR(absorbed[1], r1*(1 - r2)/(1 - r1*r2), 1e-14);
+    EXPECT_NEAR(absorbed[0] + absorbed[1], 1.0, 1e-14);
+}
+
+TEST(ViewFactorTests, MatchesTracing){
+    std::vector<double> reflection {0.5, 0.7, 0.5, 0.2, 0.9, 0.5};
+    std::vector<ParticleSource> sources {{Vec3(0.5, 0.5, 0.5), Vec3(1.0, 0.0, 0.0),
+                                          true, 0.0}};
+    Simulation sim(MakeCube(reflection), {2e-16, 300.0, 0.0}, 1, 3u);
+    size_t n = 200000;
+    RunResult traced = sim.Run(sources, n);
+    //source flux is peaked at the center of x=1 face, whole faces are
+    //uniform patches only roughly; 4x4 patches follow the tracing closely
+    for(size_t tiles : {size_t{1}, size_t{4}}){
+        Geometry geo = MakeCube(reflection, tiles);
+        size_t patch_num = tiles*tiles;
+        ViewFactorMatrix matrix = EstimateViewFactors(geo, 400000/patch_num, 1u);
+        auto first_hits = EstimateFirstHits(geo, sources, 200000, 2u);
+        EXPECT_NEAR(std::accumulate(first_hits.begin(), first_hits.end(), 0.0), 1.0, 1e-12);
+        auto absorbed = matrix.SolveAbsorption(GetLambertianCoefficients(geo), first_hits);
+        EXPECT_NEAR(std::accumulate(absorbed.begin(), absorbed.end(), 0.0), 1.0, 1e-9);
+        double tolerance = tiles == 1 ? 0.04 : 0.006;
+        for(size_t face=0; face<6; face++){
+            double face_absorbed = 0.0;
+            for(size_t patch=0; patch<patch_num; patch++){
+                face_absorbed += absorbed[face*patch_num + patch];
+            }
+            double fraction = static_cast<double>(traced.absorbed_.GetCount(face))/
+                              static_cast<double>(n);
+            EXPECT_NEAR(face_absorbed, fraction, tolerance) << "face " << face;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+﻿#include <gtest/gtest.h>
+#include <random>
+#include "voxel.hpp"
+#include "geometry.hpp"
+#include "particle.hpp"
+#include "box.hpp"
+
+namespace {
+
+class FlightCounter : public TraceObserver{
+public:
+    double total_ = 0.0;
+    void OnFlight([[maybe_unused]] const Particle& pt, const double distance,
+                  [[maybe_unused]] const bool is_gas_collision) override {
+        total_ += distance;
+    }
+};
+
+}
+
+TEST(VoxelTests, StraightTrack){
+    VoxelTally tally({Vec3(0.0, 0.0, 0.0), Vec3(2.0, 2.0, 2.0), {2, 2, 2}});
+    tally.AddTrack(Vec3(-1.0, 0.5, 1.5), Vec3(1.0, 0.0, 0.0), 3.0);
+    EXPECT_NEAR(tally.GetTrackLength(0, 0, 1), 1.0, 1e-15);
+    EXPECT_NEAR(tally.GetTrackLength(1, 0, 1), 1.0, 1e-15);
+    EXPECT_EQ(tally.GetTrackLength(0, 0, 0), 0.0);
+    //stops inside the grid
+    tally.AddTrack(Vec3(0.5, 1.5, 0.5), Vec3(0.0, -1.0, 0.0), 0.75);
+    EXPECT_NEAR(tally.GetTrackLength(0, 1, 0), 0.5, 1e-15);
+    EXPECT_NEAR(tally.GetTrackLength(0, 0, 0), 0.25, 1e-15);
+    //misses the grid
+    tally.AddTrack(Vec3(3.0, 0.5, 0.5), Vec3(0.0, 1.0, 0.0), 10.0);
+    double sum = 0.0;
+    for(size_t i=0; i<8; i++){
+        sum += tally.GetTrackLength(i/4, (i/2)%2, i%2);
+    }
+    EXPECT_NEAR(sum, 2.75, 1e-15);
+}
+
+TEST(VoxelTests, TrackLengthIsConserved){
+    VoxelTally tally({Vec3(0.0, 0.0, 0.0), Vec3(1.0, 2.0, 3.0), {7, 5, 11}});
+    std::mt19937 rng(9u);
+    std::uniform_real_distribution<double> rnd(0.0, 1.0);
+    double total = 0.0;
+    for(size_t i=0; i<1000; i++){
+        Vec3 start(rnd(rng), 2.0*rnd(rng), 3.0*rnd(rng));
+        Vec3 dir = Vec3(rnd(rng)-0.5, rnd(rng)-0.5, rnd(rng)-0.5).Norm();
+        double length = 0.2*rnd(rng);
+        Vec3 end = start + dir.Times(length);
+        if(end.GetX() < 0 || end.GetX() > 1 || end.GetY() < 0 || end.GetY() > 2 ||
+                end.GetZ() < 0 || end.GetZ() > 3){
+            continue;
+        }
+        tally.AddTrack(start, dir, length);
+        total += length;
+    }
+    double sum = 0.0;
+    for(size_t ix=0; ix<7; ix++){
+        for(size_t iy=0; iy<5; iy++){
+            for(size_t iz=0; iz<11; iz++){
+                sum += tally.GetTrackLength(ix, iy, iz);
+            }
+        }
+    }
+    EXPECT_NEAR(sum, total, 1e-10);
+}
+
+TEST(VoxelTests, CollisionsAndMerge){
+    VoxelGrid grid{Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0), {2, 1, 1}};
+    VoxelTally first(grid);
+    VoxelTally second(grid);
+    first.AddCollision(Vec3(0.25, 0.5, 0.5));
+    second.AddCollision(Vec3(0.75, 0.5, 0.5));
+    second.AddCollision(Vec3(0.75, 1.5, 0.5));
+    second.OnHistoryEnd();
+    first.Merge(second);
+    EXPECT_EQ(first.GetCollisions(0, 0, 0), 1.0);
+    EXPECT_EQ(first.GetCollisions(1, 0, 0), 1.0);
+    EXPECT_EQ(first.GetHistoryNum(), 1);
+    EXPECT_NEAR(first.GetVoxelVolume(), 0.5, 1e-15);
+}
+
+TEST(VoxelTests, TraceScoresAllFlights){
+    Geometry geo = MakeBox(0.5, Vec3(1.0, 1.0, 1.0));
+    Background gas = {2e-16, 300.0, 100.0};
+    VoxelTally tally({Vec3(0.0, 0.0, 0.0), Vec3(1.0, 1.0, 1.0), {4, 4, 4}});
+    FlightCounter counter;
+    ObserverGroup observers;
+    observers.Add(&tally);
+    observers.Add(&counter);
+    std::mt19937 rng(3u);
+    for(size_t i=0; i<1000; i++){
+        Particle(Vec3(0.1, 0.5, 0.5), Vec3(1.0, 0.0, 0.0), rng).Trace(geo, gas, rng,
+                                                                     &observers);
+    }
+    EXPECT_EQ(tally.GetHistoryNum(), 1000);
+    double sum = 0.0;
+    for(size_t i=0; i<64; i++){
+        sum += tally.GetTrackLength(i/16, (i/4)%4, i%4);
+    }
+    EXPECT_NEAR(sum, counter.total_, 1e-9*counter.total_);
+}